@@ -1,12 +1,23 @@
 #version 450 core
 
-in vec4 coords;
+layout(location = 0) in vec4 coords;
+layout(location = 1) in uint attributes;
 layout(rgba16_snorm, binding = 0) uniform image3D image;
 uniform vec3 minBounds;
 
+// positions may be quantized relative to the bounds of their timestep, which is the identity for float positions
+uniform vec3 positionOrigin;
+uniform vec3 positionExtent;
+
+// whether the attributes are read from a separate buffer instead of the w component of coords
+uniform bool staticAttributes;
+
 out vec4 vCoords;
 
 void main()
 {
-    vCoords = coords + vec4(imageLoad(image, ivec3(coords.xyz - minBounds)).xyz, 0);
-}
\ No newline at end of file
+    vec3 position = positionOrigin + positionExtent * coords.xyz;
+    float packedAttributes = staticAttributes ? uintBitsToFloat(attributes) : coords.w;
+
+    vCoords = vec4(position, packedAttributes) + vec4(imageLoad(image, ivec3(position - minBounds)).xyz, 0);
+}
@@ -0,0 +1,24 @@
+#version 450
+
+// Adds the scanned sums of the preceding blocks to the values of each block of 1024
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 1) buffer valueBuffer
+{
+	uint values[];
+};
+
+layout(std430, binding = 3) readonly buffer blockBuffer
+{
+	uint blockOffsets[];
+};
+
+uniform uint valueCount;
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+
+	if (i < valueCount)
+		values[i] += blockOffsets[i / 1024];
+}
@@ -0,0 +1,15 @@
+// Cell lookup shared by the passes building the cell list and the shaders querying it.
+// The atoms of cell i are sortedAtoms[cellStarts[i]] to sortedAtoms[cellStarts[i + 1] - 1].
+uniform vec3 cellListMinimum;
+uniform float cellListCellSize;
+uniform ivec3 cellListCellCounts;
+
+ivec3 cellListCell(vec3 position)
+{
+	return clamp(ivec3(floor((position - cellListMinimum) / cellListCellSize)), ivec3(0), cellListCellCounts - 1);
+}
+
+uint cellListIndex(ivec3 cell)
+{
+	return (uint(cell.z) * uint(cellListCellCounts.y) + uint(cell.y)) * uint(cellListCellCounts.x) + uint(cell.x);
+}
@@ -0,0 +1,33 @@
+#version 450
+#extension GL_ARB_shading_language_include : require
+#include "/celllist.glsl"
+
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer atomBuffer
+{
+	vec4 atoms[];
+};
+
+layout(std430, binding = 1) buffer cellBuffer
+{
+	uint cellSizes[];
+};
+
+layout(std430, binding = 2) writeonly buffer rankBuffer
+{
+	uint ranks[];
+};
+
+uniform uint atomCount;
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+
+	if (i >= atomCount)
+		return;
+
+	// the rank among the atoms of the same cell determines the place of the atom after sorting
+	ranks[i] = atomicAdd(cellSizes[cellListIndex(cellListCell(atoms[i].xyz))], 1);
+}
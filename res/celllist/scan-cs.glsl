@@ -0,0 +1,68 @@
+#version 450
+
+// Exclusive prefix sum over blocks of 1024 values in shared memory, the sum of each block is written for the next level
+layout(local_size_x = 512) in;
+
+layout(std430, binding = 1) buffer valueBuffer
+{
+	uint values[];
+};
+
+layout(std430, binding = 3) writeonly buffer blockBuffer
+{
+	uint blockSums[];
+};
+
+uniform uint valueCount;
+
+shared uint sums[1024];
+
+void main()
+{
+	uint t = gl_LocalInvocationID.x;
+	uint base = gl_WorkGroupID.x * 1024;
+
+	sums[2 * t] = (base + 2 * t < valueCount) ? values[base + 2 * t] : 0;
+	sums[2 * t + 1] = (base + 2 * t + 1 < valueCount) ? values[base + 2 * t + 1] : 0;
+
+	uint offset = 1;
+
+	for (uint d = 512; d > 0; d >>= 1)
+	{
+		barrier();
+
+		if (t < d)
+			sums[offset * (2 * t + 2) - 1] += sums[offset * (2 * t + 1) - 1];
+
+		offset *= 2;
+	}
+
+	if (t == 0)
+	{
+		blockSums[gl_WorkGroupID.x] = sums[1023];
+		sums[1023] = 0;
+	}
+
+	for (uint d = 1; d < 1024; d *= 2)
+	{
+		offset >>= 1;
+		barrier();
+
+		if (t < d)
+		{
+			uint a = offset * (2 * t + 1) - 1;
+			uint b = offset * (2 * t + 2) - 1;
+			uint sum = sums[a];
+			sums[a] = sums[b];
+			sums[b] += sum;
+		}
+	}
+
+	barrier();
+
+	if (base + 2 * t < valueCount)
+		values[base + 2 * t] = sums[2 * t];
+
+	if (base + 2 * t + 1 < valueCount)
+		values[base + 2 * t + 1] = sums[2 * t + 1];
+}
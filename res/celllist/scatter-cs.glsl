@@ -0,0 +1,46 @@
+#version 450
+#extension GL_ARB_shading_language_include : require
+#include "/celllist.glsl"
+
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer atomBuffer
+{
+	vec4 atoms[];
+};
+
+layout(std430, binding = 1) readonly buffer cellBuffer
+{
+	uint cellStarts[];
+};
+
+layout(std430, binding = 2) readonly buffer rankBuffer
+{
+	uint ranks[];
+};
+
+layout(std430, binding = 4) writeonly buffer indexBuffer
+{
+	uint sortedIndices[];
+};
+
+layout(std430, binding = 5) writeonly buffer sortedAtomBuffer
+{
+	vec4 sortedAtoms[];
+};
+
+uniform uint atomCount;
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+
+	if (i >= atomCount)
+		return;
+
+	vec4 atom = atoms[i];
+	uint j = cellStarts[cellListIndex(cellListCell(atom.xyz))] + ranks[i];
+
+	sortedIndices[j] = i;
+	sortedAtoms[j] = atom;
+}
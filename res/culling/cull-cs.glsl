@@ -0,0 +1,214 @@
+#version 450
+
+// one work group per cluster, the local size has to match ClusterCuller::clusterSize
+layout(local_size_x = 256) in;
+
+struct Element
+{
+	vec3 color;
+	float radius;
+};
+
+struct DrawArraysIndirectCommand
+{
+	uint count;
+	uint instanceCount;
+	uint first;
+	uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer atomBuffer
+{
+	vec4 atoms[];
+};
+
+layout(std430, binding = 1) readonly buffer indexBuffer
+{
+	uint indices[];
+};
+
+// lower and upper corner of every cluster, w of the lower corner is 1 if the cluster was visible in the previous frame
+layout(std430, binding = 2) buffer clusterBuffer
+{
+	vec4 clusters[];
+};
+
+layout(std430, binding = 3) readonly buffer elementBuffer
+{
+	Element elements[];
+};
+
+layout(std430, binding = 4) buffer commandBuffer
+{
+	DrawArraysIndirectCommand commands[2];
+	uint clusterCounts[2];
+};
+
+layout(std430, binding = 5) writeonly buffer visibleAtomBuffer
+{
+	vec4 visibleAtoms[];
+};
+
+layout(binding = 0) uniform sampler2D depthPyramid;
+
+uniform uint atomCount;
+uniform bool indexed;
+uniform uint phase;
+uniform bool occlusion;
+uniform float radiusScale;
+uniform float margin;
+uniform mat4 modelViewProjectionMatrix;
+uniform int depthPyramidLevels;
+
+shared vec3 lowerBounds[gl_WorkGroupSize.x];
+shared vec3 upperBounds[gl_WorkGroupSize.x];
+shared bool visible;
+shared uint offset;
+
+bool insideFrustum(vec3 lower, vec3 upper)
+{
+	// the planes are the sums and differences of the last row of the matrix with the others
+	mat4 rows = transpose(modelViewProjectionMatrix);
+
+	for (int i = 0; i < 6; i++)
+	{
+		vec4 plane = rows[3] + ((i & 1) == 0 ? 1.0 : -1.0) * rows[i / 2];
+
+		// the corner furthest along the normal of the plane decides whether the box is completely outside
+		vec3 corner = mix(lower, upper, greaterThanEqual(plane.xyz, vec3(0.0)));
+
+		if (dot(plane.xyz, corner) + plane.w < 0.0)
+			return false;
+	}
+
+	return true;
+}
+
+bool occluded(vec3 lower, vec3 upper)
+{
+	vec3 ndcLower = vec3(1.0);
+	vec3 ndcUpper = vec3(-1.0);
+
+	for (int i = 0; i < 8; i++)
+	{
+		vec4 corner = modelViewProjectionMatrix * vec4(mix(lower, upper, bvec3((i & 1) != 0, (i & 2) != 0, (i & 4) != 0)), 1.0);
+
+		// a box reaching behind the camera cannot be bounded on the screen
+		if (corner.w <= 0.0)
+			return false;
+
+		ndcLower = min(ndcLower, corner.xyz / corner.w);
+		ndcUpper = max(ndcUpper, corner.xyz / corner.w);
+	}
+
+	if (ndcLower.z < -1.0)
+		return false;
+
+	// The level is chosen so that the screen rectangle of the box covers at most two by two of its pixels
+	vec2 size = vec2(textureSize(depthPyramid, 0));
+	vec2 pixelLower = clamp(ndcLower.xy * 0.5 + 0.5, 0.0, 1.0) * size;
+	vec2 pixelUpper = clamp(ndcUpper.xy * 0.5 + 0.5, 0.0, 1.0) * size;
+	vec2 extent = pixelUpper - pixelLower;
+
+	int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, depthPyramidLevels - 1);
+	ivec2 levelSize = textureSize(depthPyramid, level);
+	ivec2 texelLower = clamp(ivec2(pixelLower) >> level, ivec2(0), levelSize - 1);
+	ivec2 texelUpper = clamp(ivec2(pixelUpper) >> level, ivec2(0), levelSize - 1);
+
+	float farthestDepth = 0.0;
+
+	for (int y = texelLower.y; y <= texelUpper.y; y++)
+	{
+		for (int x = texelLower.x; x <= texelUpper.x; x++)
+			farthestDepth = max(farthestDepth, texelFetch(depthPyramid, ivec2(x, y), level).r);
+	}
+
+	return ndcLower.z * 0.5 + 0.5 > farthestDepth;
+}
+
+void main()
+{
+	uint cluster = gl_WorkGroupID.x;
+	uint local = gl_LocalInvocationID.x;
+	uint i = cluster * gl_WorkGroupSize.x + local;
+	bool valid = i < atomCount;
+
+	vec4 atom = vec4(0.0);
+
+	if (valid)
+		atom = atoms[indexed ? indices[i] : i];
+
+	// The first phase computes the bounds of the spheres of the cluster, the second one reuses them
+	if (phase == 0)
+	{
+		if (valid)
+		{
+			uint elementId = bitfieldExtract(floatBitsToUint(atom.w), 0, 8);
+			float radius = elements[elementId].radius * radiusScale + margin;
+			lowerBounds[local] = atom.xyz - radius;
+			upperBounds[local] = atom.xyz + radius;
+		}
+		else
+		{
+			lowerBounds[local] = vec3(uintBitsToFloat(0x7f800000));
+			upperBounds[local] = vec3(-uintBitsToFloat(0x7f800000));
+		}
+
+		barrier();
+
+		for (uint stride = gl_WorkGroupSize.x / 2; stride > 0; stride /= 2)
+		{
+			if (local < stride)
+			{
+				lowerBounds[local] = min(lowerBounds[local], lowerBounds[local + stride]);
+				upperBounds[local] = max(upperBounds[local], upperBounds[local + stride]);
+			}
+
+			barrier();
+		}
+	}
+	else if (local == 0)
+	{
+		lowerBounds[0] = clusters[2 * cluster].xyz;
+		upperBounds[0] = clusters[2 * cluster + 1].xyz;
+	}
+
+	if (local == 0)
+	{
+		bool wasVisible = clusters[2 * cluster].w != 0.0;
+		bool inside = insideFrustum(lowerBounds[0], upperBounds[0]);
+
+		if (phase == 0)
+		{
+			visible = inside && (wasVisible || !occlusion);
+			clusters[2 * cluster] = vec4(lowerBounds[0], wasVisible ? 1.0 : 0.0);
+			clusters[2 * cluster + 1] = vec4(upperBounds[0], 0.0);
+		}
+		else
+		{
+			// clusters drawn in the first phase are only tested to decide whether to draw them first in the next frame
+			bool isVisible = inside && !occluded(lowerBounds[0], upperBounds[0]);
+			visible = isVisible && !wasVisible;
+			clusters[2 * cluster].w = isVisible ? 1.0 : 0.0;
+		}
+
+		if (visible)
+		{
+			uint count = min(gl_WorkGroupSize.x, atomCount - cluster * gl_WorkGroupSize.x);
+			offset = atomicAdd(commands[phase].count, count);
+			atomicAdd(clusterCounts[phase], 1);
+
+			// the atoms of the second phase follow those of the first one
+			if (phase == 1)
+			{
+				offset += commands[0].count;
+				commands[1].first = commands[0].count;
+			}
+		}
+	}
+
+	barrier();
+
+	if (visible && valid)
+		visibleAtoms[offset + local] = atom;
+}
@@ -0,0 +1,40 @@
+#version 450
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(binding = 0) uniform sampler2D depthTexture;
+layout(r32f, binding = 0) uniform readonly image2D sourceImage;
+layout(r32f, binding = 1) uniform writeonly image2D destinationImage;
+
+uniform int level;
+uniform ivec2 sourceSize;
+uniform ivec2 destinationSize;
+
+void main()
+{
+	ivec2 position = ivec2(gl_GlobalInvocationID.xy);
+
+	if (any(greaterThanEqual(position, destinationSize)))
+		return;
+
+	float depth = 0.0;
+
+	if (level == 0)
+	{
+		depth = texelFetch(depthTexture, position, 0).r;
+	}
+	else
+	{
+		// the last row and column of an odd sized level are added to the pixels before them, so no depth is lost
+		ivec2 lower = 2 * position;
+		ivec2 upper = min(lower + 1 + ivec2(equal(position, destinationSize - 1)) * (sourceSize & 1), sourceSize - 1);
+
+		for (int y = lower.y; y <= upper.y; y++)
+		{
+			for (int x = lower.x; x <= upper.x; x++)
+				depth = max(depth, imageLoad(sourceImage, ivec2(x, y)).r);
+		}
+	}
+
+	imageStore(destinationImage, position, vec4(depth));
+}
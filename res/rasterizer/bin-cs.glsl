@@ -0,0 +1,126 @@
+#version 450
+
+// Assigns every sphere to the screen tiles covered by its bounds, the local size has to match SphereRasterizer::workGroupSize
+layout(local_size_x = 256) in;
+
+struct Element
+{
+	vec3 color;
+	float radius;
+};
+
+struct DrawArraysIndirectCommand
+{
+	uint count;
+	uint instanceCount;
+	uint first;
+	uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer atomBuffer
+{
+	vec4 atoms[];
+};
+
+layout(std430, binding = 1) readonly buffer indexBuffer
+{
+	uint indices[];
+};
+
+// the number of spheres of every tile in the first phase, the next free entry of every tile in the second one
+layout(std430, binding = 2) buffer tileBuffer
+{
+	uint tiles[];
+};
+
+layout(std430, binding = 3) readonly buffer elementBuffer
+{
+	Element elements[];
+};
+
+// the commands of the cluster culler, whose first one counts the visible atoms
+layout(std430, binding = 4) readonly buffer commandBuffer
+{
+	DrawArraysIndirectCommand commands[];
+};
+
+layout(std430, binding = 5) writeonly buffer entryBuffer
+{
+	uint entries[];
+};
+
+uniform uint atomCount;
+uniform bool indexed;
+uniform bool culled;
+uniform uint phase;
+uniform float radiusScale;
+uniform float clipRadiusScale;
+uniform float nearPlaneZ;
+uniform mat4 modelViewMatrix;
+uniform mat4 projectionMatrix;
+uniform ivec2 viewportSize;
+uniform ivec2 tileCounts;
+uniform int tileSize;
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	uint count = culled ? commands[0].count : atomCount;
+
+	if (i >= count)
+		return;
+
+	uint atomIndex = indexed ? indices[i] : i;
+	vec4 atom = atoms[atomIndex];
+	uint elementId = bitfieldExtract(floatBitsToUint(atom.w), 0, 8);
+
+	// the same spheres are skipped as by the geometry shader, whose clip radius covers those of all passes
+	vec4 c = modelViewMatrix * vec4(atom.xyz, 1.0);
+	float radius = length(modelViewMatrix * vec4(elements[elementId].radius * radiusScale, 0.0, 0.0, 0.0));
+	float clipRadius = length(modelViewMatrix * vec4(elements[elementId].radius * clipRadiusScale, 0.0, 0.0, 0.0));
+
+	if (c.z + clipRadius >= nearPlaneZ)
+		return;
+
+	// the screen rectangle of the box around the sphere in view space bounds it, a box reaching behind the camera covers the screen
+	vec2 ndcLower = vec2(1.0);
+	vec2 ndcUpper = vec2(-1.0);
+
+	for (int j = 0; j < 8; j++)
+	{
+		vec4 corner = projectionMatrix * vec4(c.xyz + radius * mix(vec3(-1.0), vec3(1.0), bvec3((j & 1) != 0, (j & 2) != 0, (j & 4) != 0)), 1.0);
+
+		if (corner.w <= 0.0)
+		{
+			ndcLower = vec2(-1.0);
+			ndcUpper = vec2(1.0);
+			break;
+		}
+
+		ndcLower = min(ndcLower, corner.xy / corner.w);
+		ndcUpper = max(ndcUpper, corner.xy / corner.w);
+	}
+
+	vec2 pixelLower = (ndcLower * 0.5 + 0.5) * vec2(viewportSize);
+	vec2 pixelUpper = (ndcUpper * 0.5 + 0.5) * vec2(viewportSize);
+
+	if (any(lessThan(pixelUpper, vec2(0.0))) || any(greaterThanEqual(pixelLower, vec2(viewportSize))))
+		return;
+
+	ivec2 tileLower = clamp(ivec2(floor(pixelLower)) / tileSize, ivec2(0), tileCounts - 1);
+	ivec2 tileUpper = clamp(ivec2(floor(pixelUpper)) / tileSize, ivec2(0), tileCounts - 1);
+
+	// The first phase counts the spheres of each tile, the second one writes them to a copy of the starts left by the prefix sum
+	for (int y = tileLower.y; y <= tileUpper.y; y++)
+	{
+		for (int x = tileLower.x; x <= tileUpper.x; x++)
+		{
+			uint tile = uint(y * tileCounts.x + x);
+
+			if (phase == 0)
+				atomicAdd(tiles[tile], 1);
+			else
+				entries[atomicAdd(tiles[tile], 1)] = atomIndex;
+		}
+	}
+}
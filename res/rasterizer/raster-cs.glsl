@@ -0,0 +1,220 @@
+#version 450
+#extension GL_ARB_shading_language_include : require
+#include "/defines.glsl"
+
+// One work group per screen tile and one invocation per pixel, the local size has to match SphereRasterizer::tileSize.
+// The spheres of a tile are loaded into shared memory in batches and intersected with the view rays of all its pixels.
+layout(local_size_x = 16, local_size_y = 16) in;
+
+struct Element
+{
+	vec3 color;
+	float radius;
+};
+
+struct BufferEntry
+{
+	float near;
+	float far;
+	vec3 center;
+	uint id;
+	uint previous;
+};
+
+layout(std430, binding = 0) readonly buffer atomBuffer
+{
+	vec4 atoms[];
+};
+
+layout(std430, binding = 1) buffer intersectionBuffer
+{
+	uint count;
+	BufferEntry intersections[];
+};
+
+// start of the entries of every tile, followed by the total number of entries
+layout(std430, binding = 2) readonly buffer tileBuffer
+{
+	uint tileStarts[];
+};
+
+layout(std430, binding = 3) readonly buffer elementBuffer
+{
+	Element elements[];
+};
+
+layout(std430, binding = 5) readonly buffer entryBuffer
+{
+	uint entries[];
+};
+
+layout(r32ui, binding = 0) uniform writeonly uimage2D offsetImage;
+layout(rgba32f, binding = 1) uniform writeonly image2D positionImage;
+layout(rgba32f, binding = 2) uniform writeonly image2D normalImage;
+
+uniform mat4 inverseModelViewProjectionMatrix;
+uniform float radiusScale;
+uniform uint intersectionCapacity;
+uniform ivec2 viewportSize;
+uniform ivec2 tileCounts;
+
+const uint batchSize = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+
+shared vec4 batchSpheres[batchSize];
+shared uint batchIds[batchSize];
+
+struct Sphere
+{
+	bool hit;
+	vec3 near;
+	vec3 far;
+};
+
+Sphere calcSphereIntersection(float r, vec3 origin, vec3 center, vec3 line)
+{
+	vec3 oc = origin - center;
+	vec3 l = normalize(line);
+	float loc = dot(l, oc);
+	float under_square_root = loc * loc - dot(oc, oc) + r*r;
+	if (under_square_root > 0)
+	{
+		float da = -loc + sqrt(under_square_root);
+		float ds = -loc - sqrt(under_square_root);
+		vec3 near = origin+min(da, ds) * l;
+		vec3 far = origin+max(da, ds) * l;
+
+		return Sphere(true, near, far);
+	}
+	else
+	{
+		return Sphere(false, vec3(0), vec3(0));
+	}
+}
+
+// every invocation loads one sphere of the batch starting at the given entry
+void loadBatch(uint first, uint last)
+{
+	uint local = gl_LocalInvocationIndex;
+
+	barrier();
+
+	if (first + local < last)
+	{
+		vec4 atom = atoms[entries[first + local]];
+		uint id = floatBitsToUint(atom.w);
+		batchSpheres[local] = vec4(atom.xyz, elements[bitfieldExtract(id, 0, 8)].radius);
+		batchIds[local] = id;
+	}
+
+	barrier();
+}
+
+void main()
+{
+	uint tile = gl_WorkGroupID.y * uint(tileCounts.x) + gl_WorkGroupID.x;
+	uint first = tileStarts[tile];
+	uint last = tileStarts[tile + 1];
+
+	// invocations outside of the viewport still load their share of every batch
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	bool inside = all(lessThan(pixel, viewportSize));
+
+	vec2 fragCoord = (vec2(pixel) + 0.5) / vec2(viewportSize) * 2.0 - 1.0;
+
+	vec4 near = inverseModelViewProjectionMatrix*vec4(fragCoord.xy,-1.0,1.0);
+	near /= near.w;
+
+	vec4 far = inverseModelViewProjectionMatrix*vec4(fragCoord.xy,1.0,1.0);
+	far /= far.w;
+
+	vec3 V = normalize(far.xyz-near.xyz);
+
+	// The first sweep finds the closest sphere like the depth test of the sphere pass
+	vec4 position = vec4(0.0, 0.0, 0.0, 65535.0);
+	vec4 normal = vec4(0.0);
+
+	for (uint batch = first; batch < last; batch += batchSize)
+	{
+		loadBatch(batch, last);
+
+		uint batchCount = min(batchSize, last - batch);
+
+		for (uint i = 0; i < batchCount; i++)
+		{
+			Sphere sphere = calcSphereIntersection(batchSpheres[i].w, near.xyz, batchSpheres[i].xyz, V);
+			float sphereDistance = length(sphere.near-near.xyz);
+
+			if (sphere.hit && sphereDistance < position.w)
+			{
+				position = vec4(sphere.near, sphereDistance);
+				normal = vec4(sphere.near - batchSpheres[i].xyz, uintBitsToFloat(batchIds[i]));
+			}
+		}
+	}
+
+	// The second sweep appends the enlarged spheres in front of the closest one to the list of the pixel like the list
+	// generation pass. As each list belongs to a single invocation, it is built without atomic operations on the image.
+	uint offset = 0;
+
+	for (uint batch = first; batch < last; batch += batchSize)
+	{
+		loadBatch(batch, last);
+
+		uint batchCount = min(batchSize, last - batch);
+
+		for (uint i = 0; i < batchCount && inside; i++)
+		{
+			Sphere sphere = calcSphereIntersection(batchSpheres[i].w * radiusScale, near.xyz, batchSpheres[i].xyz, V);
+
+			if (!sphere.hit)
+				continue;
+
+			BufferEntry entry;
+			entry.near = length(sphere.near-near.xyz);
+
+			if (entry.near > position.w)
+				continue;
+
+			uint index = atomicAdd(count,1);
+
+			// entries beyond the end of the buffer are dropped, the final count tells the renderer how large it has to be
+			if (index >= intersectionCapacity)
+				continue;
+
+			entry.far = length(sphere.far-near.xyz);
+			entry.center = batchSpheres[i].xyz;
+			entry.id = batchIds[i];
+
+#ifdef SORTEDLISTS
+			// the entry is inserted in front of the first farther one, so the lists are sorted from near to far
+			uint previous = 0;
+			uint current = offset;
+
+			while (current > 0 && intersections[current].near < entry.near)
+			{
+				previous = current;
+				current = intersections[current].previous;
+			}
+
+			entry.previous = current;
+			intersections[index] = entry;
+
+			if (previous == 0)
+				offset = index;
+			else
+				intersections[previous].previous = index;
+#else
+			entry.previous = offset;
+			intersections[index] = entry;
+			offset = index;
+#endif
+		}
+	}
+
+	if (inside)
+	{
+		imageStore(offsetImage, pixel, uvec4(offset));
+		imageStore(positionImage, pixel, position);
+		imageStore(normalImage, pixel, normal);
+	}
+}
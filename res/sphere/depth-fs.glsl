@@ -0,0 +1,26 @@
+#version 450
+
+uniform mat4 modelViewProjectionMatrix;
+
+layout(binding = 0) uniform sampler2D positionTexture;
+
+// Writes the depth of the closest spheres found by the compute rasterizer, which the later passes read like that of the sphere pass
+float calcDepth(vec3 pos)
+{
+	float far = gl_DepthRange.far; 
+	float near = gl_DepthRange.near;
+	vec4 clip_space_pos = modelViewProjectionMatrix * vec4(pos, 1.0);
+	float ndc_depth = clip_space_pos.z / clip_space_pos.w;
+	return (((far - near) * ndc_depth) + near + far) / 2.0;
+}
+
+void main()
+{
+	vec4 position = texelFetch(positionTexture,ivec2(gl_FragCoord.xy),0);
+
+	// pixels without a sphere keep the value the depth buffer is cleared to
+	if (position.w >= 65535.0)
+		gl_FragDepth = 1.0;
+	else
+		gl_FragDepth = calcDepth(position.xyz);
+}
@@ -0,0 +1,79 @@
+// Sorting of the intersection entries of a pixel by their distance along the view ray. The distances are copied into a local
+// array together with the entry indices while the list is gathered, so that sorting does not read the intersection buffer.
+// Arrays of 128 entries exceed the registers of an invocation and are indexed dynamically, so drivers place them in local
+// memory, which is private to the invocation and cached, but slower than registers. Lists of up to insertionSortLength entries
+// are sorted by insertion, longer ones by a bitonic network over the next power of two. The default switch-over point is not
+// tuned for a particular GPU, the sort benchmark times the combined sort for several of them.
+
+const uint maximumEntries = 128;
+uniform uint insertionSortLength = 16u;
+
+float entryDistances[maximumEntries];
+uint entryIndices[maximumEntries];
+
+void insertionSortEntries(uint entryCount)
+{
+	for (uint i = 1; i < entryCount; i++)
+	{
+		float distance = entryDistances[i];
+		uint index = entryIndices[i];
+		uint j = i;
+
+		while (j > 0 && entryDistances[j-1] > distance)
+		{
+			entryDistances[j] = entryDistances[j-1];
+			entryIndices[j] = entryIndices[j-1];
+			j--;
+		}
+
+		entryDistances[j] = distance;
+		entryIndices[j] = index;
+	}
+}
+
+void bitonicSortEntries(uint entryCount)
+{
+	uint sortCount = 1u << findMSB(max(entryCount,1u)*2u-1u);
+
+	// padding entries are placed behind all others
+	for (uint i = entryCount; i < sortCount; i++)
+	{
+		entryDistances[i] = uintBitsToFloat(0x7f800000);
+		entryIndices[i] = 0;
+	}
+
+	for (uint k = 2; k <= sortCount; k *= 2)
+	{
+		for (uint j = k/2; j > 0; j /= 2)
+		{
+			for (uint i = 0; i < sortCount; i++)
+			{
+				uint l = i ^ j;
+
+				if (l > i)
+				{
+					bool ascending = (i & k) == 0;
+
+					if ((entryDistances[i] > entryDistances[l]) == ascending)
+					{
+						float distance = entryDistances[i];
+						entryDistances[i] = entryDistances[l];
+						entryDistances[l] = distance;
+
+						uint index = entryIndices[i];
+						entryIndices[i] = entryIndices[l];
+						entryIndices[l] = index;
+					}
+				}
+			}
+		}
+	}
+}
+
+void sortEntries(uint entryCount)
+{
+	if (entryCount <= insertionSortLength)
+		insertionSortEntries(entryCount);
+	else
+		bitonicSortEntries(entryCount);
+}
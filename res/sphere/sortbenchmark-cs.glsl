@@ -0,0 +1,101 @@
+#version 450
+#extension GL_ARB_shading_language_include : require
+#include "/sort.glsl"
+
+// one invocation per list, like one fragment per pixel of the surface pass
+layout(local_size_x = 64) in;
+
+layout(std430, binding = 0) readonly buffer lengthBuffer
+{
+	uint lengths[];
+};
+
+// the distances of list i start at i*maximumEntries
+layout(std430, binding = 1) readonly buffer distanceBuffer
+{
+	float distances[];
+};
+
+layout(std430, binding = 2) buffer resultBuffer
+{
+	uint errorCount;
+	float checksum;
+};
+
+uniform uint listCount;
+
+// 0: selection sort reading the buffer, 1: insertion sort, 2: bitonic sort, 3: insertion sort up to insertionSortLength entries, bitonic sort otherwise
+uniform uint method;
+uniform bool verify;
+
+void main()
+{
+	uint list = gl_GlobalInvocationID.x;
+
+	if (list >= listCount)
+		return;
+
+	uint entryCount = min(lengths[list], maximumEntries);
+	uint first = list * maximumEntries;
+
+	if (method == 0)
+	{
+		// the previous sort of the surface pass, which compares entries through their indices into the buffer
+		for (uint i = 0; i < entryCount; i++)
+			entryIndices[i] = first + i;
+
+		for (uint currentIndex = 0; currentIndex < entryCount; currentIndex++)
+		{
+			uint minimumIndex = currentIndex;
+
+			for (uint i = currentIndex+1; i < entryCount; i++)
+			{
+				if (distances[entryIndices[i]] < distances[entryIndices[minimumIndex]])
+					minimumIndex = i;
+			}
+
+			uint index = entryIndices[minimumIndex];
+			entryIndices[minimumIndex] = entryIndices[currentIndex];
+			entryIndices[currentIndex] = index;
+		}
+
+		for (uint i = 0; i < entryCount; i++)
+			entryDistances[i] = distances[entryIndices[i]];
+	}
+	else
+	{
+		for (uint i = 0; i < entryCount; i++)
+		{
+			entryDistances[i] = distances[first + i];
+			entryIndices[i] = first + i;
+		}
+
+		if (method == 1)
+			insertionSortEntries(entryCount);
+		else if (method == 2)
+			bitonicSortEntries(entryCount);
+		else
+			sortEntries(entryCount);
+	}
+
+	// the distances have to be ascending and still belong to their indices
+	if (verify)
+	{
+		bool sorted = true;
+
+		for (uint i = 0; i < entryCount; i++)
+			sorted = sorted && (i == 0 || entryDistances[i-1] <= entryDistances[i]) && distances[entryIndices[i]] == entryDistances[i];
+
+		if (!sorted)
+			atomicAdd(errorCount, 1);
+	}
+
+	// weighting by position keeps the sort from being optimized away while timing
+	float sum = 0.0;
+
+	for (uint i = 0; i < entryCount; i++)
+		sum += float(i) * entryDistances[i];
+
+	if (sum < 0.0)
+		checksum = sum;
+}
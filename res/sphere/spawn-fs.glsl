@@ -1,7 +1,18 @@
 #version 450
+#extension GL_ARB_shading_language_include : require
+#include "/defines.glsl"
+
+#ifdef SORTEDLISTS
+#extension GL_ARB_fragment_shader_interlock : require
+layout(pixel_interlock_unordered) in;
+#define INTERSECTIONBUFFER coherent buffer
+#else
+#define INTERSECTIONBUFFER buffer
+#endif
 
 uniform mat4 modelViewProjectionMatrix;
 uniform mat4 inverseModelViewProjectionMatrix;
+uniform uint intersectionCapacity;
 
 in vec4 gFragmentPosition;
 flat in vec4 gSpherePosition;
@@ -9,7 +20,11 @@ flat in float gSphereRadius;
 flat in uint gSphereId;
 
 layout(binding = 0) uniform sampler2D positionTexture;
+#ifdef SORTEDLISTS
+layout(r32ui, binding = 0) coherent uniform uimage2D offsetImage;
+#else
 layout(r32ui, binding = 0) uniform uimage2D offsetImage;
+#endif
 
 struct BufferEntry
 {
@@ -20,7 +35,7 @@ struct BufferEntry
 	uint previous;
 };
 
-layout(std430, binding = 1) buffer intersectionBuffer
+layout(std430, binding = 1) INTERSECTIONBUFFER intersectionBuffer
 {
 	uint count;
 	BufferEntry intersections[];
@@ -89,15 +104,46 @@ void main()
 		discard;	
 
 	uint index = atomicAdd(count,1);
-	uint prev = imageAtomicExchange(offsetImage,ivec2(gl_FragCoord.xy),index);
+
+	// entries beyond the end of the buffer are dropped, the final count tells the renderer how large it has to be
+	if (index >= intersectionCapacity)
+		discard;
 
 	entry.far = length(sphere.far.xyz-near.xyz);
 
 	entry.center = gSpherePosition.xyz;
 	entry.id = gSphereId;
+
+#ifdef SORTEDLISTS
+	// The entry is inserted in front of the first farther one, so the lists are sorted from near to far. Fragments of the same
+	// pixel are serialized by the interlock, which is why the list can be modified without atomic operations.
+	beginInvocationInterlockARB();
+
+	uint previous = 0;
+	uint current = imageLoad(offsetImage,ivec2(gl_FragCoord.xy)).r;
+
+	while (current > 0 && intersections[current].near < entry.near)
+	{
+		previous = current;
+		current = intersections[current].previous;
+	}
+
+	entry.previous = current;
+	intersections[index] = entry;
+
+	if (previous == 0)
+		imageStore(offsetImage,ivec2(gl_FragCoord.xy),uvec4(index));
+	else
+		intersections[previous].previous = index;
+
+	endInvocationInterlockARB();
+#else
+	uint prev = imageAtomicExchange(offsetImage,ivec2(gl_FragCoord.xy),index);
+
 	entry.previous = prev;
 
 	intersections[index] = entry;
+#endif
 
 	discard;
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 // https://research.nvidia.com/publication/2d-polyhedral-bounds-clipped-perspective-projected-3d-sphere
 
 #version 450
+#extension GL_ARB_shading_language_include : require
+#include "/defines.glsl"
 
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
@@ -211,10 +213,18 @@ struct Element
 	float radius;
 };
 
+#ifdef UNIFORMTABLES
+// original indexing through a uniform block, only used by the table indexing benchmark
 layout(std140, binding = 0) uniform elementBlock
 {
 	Element elements[32];
 };
+#else
+layout(std430, binding = 3) readonly buffer elementBuffer
+{
+	Element elements[];
+};
+#endif
 
 void main()
 {
@@ -2,6 +2,7 @@
 #extension GL_ARB_shading_language_include : require
 #include "/defines.glsl"
 #include "/globals.glsl"
+#include "/sort.glsl"
 
 layout(pixel_center_integer) in vec4 gl_FragCoord;
 
@@ -21,6 +22,7 @@ uniform vec3 ambientMaterial;
 uniform vec3 specularMaterial;
 uniform float shininess;
 uniform vec2 focusPosition;
+uniform vec4 tileTransform = vec4(1.0, 1.0, 0.0, 0.0);
 
 uniform sampler2D positionTexture;
 uniform sampler2D normalTexture;
@@ -51,6 +53,8 @@ struct Chain
 	vec4 color;
 };
 
+#ifdef UNIFORMTABLES
+// original indexing through uniform blocks with 8-bit residue and chain indices, only used by the table indexing benchmark
 layout(std140, binding = 0) uniform elementBlock
 {
 	Element elements[32];
@@ -65,6 +69,33 @@ layout(std140, binding = 2) uniform chainBlock
 {
 	Chain chains[64];
 };
+#else
+layout(std430, binding = 3) readonly buffer elementBuffer
+{
+	Element elements[];
+};
+
+layout(std430, binding = 4) readonly buffer residueBuffer
+{
+	Residue residues[];
+};
+
+layout(std430, binding = 5) readonly buffer chainBuffer
+{
+	Chain chains[];
+};
+
+// residue and chain index of each distinct combination referenced by the atom attributes
+layout(std430, binding = 6) readonly buffer groupBuffer
+{
+	uvec2 groups[];
+};
+
+uvec2 group(uint id)
+{
+	return groups[id];
+}
+#endif
 
 struct BufferEntry
 {
@@ -81,12 +112,11 @@ layout(std430, binding = 1) buffer intersectionBuffer
 	BufferEntry intersections[];
 };
 
+// number of pixels with more entries than are considered, and the longest of their lists
 layout(std430, binding = 2) buffer statisticsBuffer
 {
-	uint intersectionCount;
-	uint totalPixelCount;
-	uint totalEntryCount;
-	uint maximumEntryCount;
+	uint truncatedPixelCount;
+	uint maximumListLength;
 };
 
 struct Sphere
@@ -127,16 +157,29 @@ void main()
 
 	vec3 V = normalize(far.xyz-near.xyz);
 
-	const uint maxEntries = 128;
-	uint entryCount = 0;
-	uint indices[maxEntries];
+	uint listLength = 0;
 
+	// with pre-sorted lists, the entries beyond the maximum are the farthest ones
 	while (offset > 0)
 	{
-		indices[entryCount++] = offset;
+		if (listLength < maximumEntries)
+		{
+			entryDistances[listLength] = intersections[offset].near;
+			entryIndices[listLength] = offset;
+		}
+
+		listLength++;
 		offset = intersections[offset].previous;
 	}
 
+	uint entryCount = min(listLength, maximumEntries);
+
+	if (listLength > maximumEntries)
+	{
+		atomicAdd(truncatedPixelCount, 1);
+		atomicMax(maximumListLength, listLength);
+	}
+
 	if (entryCount == 0)
 		discard;
 
@@ -154,6 +197,7 @@ void main()
 	{
 		uint id = floatBitsToUint(normal.w);
 		uint elementId = bitfieldExtract(id,0,8);
+#ifdef UNIFORMTABLES
 		uint residueId = bitfieldExtract(id,8,8);
 		uint chainId = bitfieldExtract(id,16,8);
 
@@ -163,6 +207,16 @@ void main()
 			diffuseColor = residues[residueId].color.rgb;
 		else if (coloring == 3)
 			diffuseColor = chains[chainId].color.rgb;
+#else
+		uint groupId = bitfieldExtract(id,8,24);
+
+		if (coloring == 1)
+			diffuseColor = elements[elementId].color.rgb;
+		else if (coloring == 2)
+			diffuseColor = residues[group(groupId).x].color.rgb;
+		else if (coloring == 3)
+			diffuseColor = chains[group(groupId).y].color.rgb;
+#endif
 
 		diffuseSphereColor = diffuseColor;
 	}
@@ -173,40 +227,26 @@ void main()
 	float focusFactor = 0.0;
 	if (lens)
 	{
-		focusFactor = min(16.0,1.0/(16.0*pow(length((fragCoord.xy-focusPosition)/vec2(0.5625,1.0)),2.0)));
+		focusFactor = min(16.0,1.0/(16.0*pow(length((fragCoord.xy*tileTransform.xy+tileTransform.zw-focusPosition)/vec2(0.5625,1.0)),2.0)));
 		sharpnessFactor += focusFactor;
 		focusFactor = min(1.0,focusFactor);
 	}
 #endif
 
+#ifndef SORTEDLISTS
+	sortEntries(entryCount);
+#endif
+
 	uint startIndex = 0;
 
-	// selection sort
 	for(uint currentIndex = 0; currentIndex < entryCount; currentIndex++)
 	{
-		uint minimumIndex = currentIndex;
-
-		for(uint i = currentIndex+1; i < entryCount; i++)
-		{
-			if(intersections[indices[i]].near < intersections[indices[minimumIndex]].near)
-			{
-				minimumIndex = i;					
-			}
-		}
-
-		if (minimumIndex != currentIndex)
-		{
-			uint temp = indices[minimumIndex];
-			indices[minimumIndex] = indices[currentIndex];
-			indices[currentIndex] = temp;
-		}
-
 		if (startIndex < currentIndex)
 		{
 			uint endIndex = currentIndex;
 
 			// if span of overlapping spheres of influence has ended, proceed with intersection testing
-			if (currentIndex >= entryCount-1 || intersections[indices[startIndex]].far < intersections[indices[currentIndex]].near)
+			if (currentIndex >= entryCount-1 || intersections[entryIndices[startIndex]].far < entryDistances[currentIndex])
 			{
 				// sphere tracing parameters
 				const uint maximumSteps = 32; // maximum number of steps
@@ -215,9 +255,8 @@ void main()
 
 				const float s = sharpness*sharpnessFactor;
 
-				uint ii = indices[startIndex+1];
-				float nearDistance = intersections[ii].near;
-				float farDistance = intersections[indices[endIndex-1]].far;
+				float nearDistance = entryDistances[startIndex+1];
+				float farDistance = intersections[entryIndices[endIndex-1]].far;
 
 				float maximumDistance = (farDistance-nearDistance)+1.0;
 				float surfaceDistance = 1.0;
@@ -250,7 +289,7 @@ void main()
 					// sum contributions of atoms in the neighborhood
 					for (uint j = startIndex; j <= endIndex; j++)
 					{
-						uint ij = indices[j];
+						uint ij = entryIndices[j];
 						uint id = intersections[ij].id;
 						uint elementId = bitfieldExtract(id,0,8);
 
@@ -275,13 +314,23 @@ void main()
 						}
 						else if (coloring == 2)
 						{
+#ifdef UNIFORMTABLES
 							uint residueId = bitfieldExtract(id,8,8);
 							cj = residues[residueId].color.rgb;
+#else
+							uint groupId = bitfieldExtract(id,8,24);
+							cj = residues[group(groupId).x].color.rgb;
+#endif
 						}
 						else if (coloring == 3)
 						{
+#ifdef UNIFORMTABLES
 							uint chainId = bitfieldExtract(id,16,8);
 							cj = chains[chainId].color.rgb;
+#else
+							uint groupId = bitfieldExtract(id,8,24);
+							cj = chains[group(groupId).y].color.rgb;
+#endif
 						}
 #ifdef LENSING
 						cj = mix(vec3(diffuseMaterial),cj,focusFactor);
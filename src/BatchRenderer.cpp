@@ -0,0 +1,261 @@
+#include "BatchRenderer.h"
+#include "SphereRenderer.h"
+#include "ShaderCache.h"
+#include "Viewer.h"
+#include "Scene.h"
+#include "Protein.h"
+
+#include <glbinding/gl/gl.h>
+#include <globjects/Framebuffer.h>
+#include <globjects/Texture.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <algorithm>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+using namespace globjects;
+
+namespace
+{
+	struct CameraPreset
+	{
+		const char* name;
+		vec3 direction;
+		vec3 up;
+	};
+
+	// the front view is the initial view of the camera interactor, the other views look at the model from its other sides
+	const CameraPreset cameraPresets[] = {
+		{ "front", vec3(0.0f, 0.0f, -1.0f), vec3(0.0f, 1.0f, 0.0f) },
+		{ "back", vec3(0.0f, 0.0f, 1.0f), vec3(0.0f, 1.0f, 0.0f) },
+		{ "left", vec3(-1.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f) },
+		{ "right", vec3(1.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f) },
+		{ "top", vec3(0.0f, 1.0f, 0.0f), vec3(0.0f, 0.0f, 1.0f) },
+		{ "bottom", vec3(0.0f, -1.0f, 0.0f), vec3(0.0f, 0.0f, -1.0f) },
+		{ "diagonal", normalize(vec3(1.0f, 1.0f, -1.0f)), vec3(0.0f, 1.0f, 0.0f) }
+	};
+
+	// the distance of the initial view of the camera interactor, at which the scaled model fills the view
+	const float cameraDistance = 3.0f * sqrt(3.0f);
+
+	const CameraPreset* findCameraPreset(const std::string& name)
+	{
+		for (const auto& p : cameraPresets)
+		{
+			if (name == p.name)
+				return &p;
+		}
+
+		return nullptr;
+	}
+
+	void printUsage()
+	{
+		std::cout << "Usage: dynamol --batch [--headless] [--size <width>x<height>] [--camera <preset>[,<preset>...]] [--set <option>=<value>]... [--output <directory>] <file>..." << std::endl;
+		std::cout << "  Camera presets: front, back, left, right, top, bottom, diagonal" << std::endl;
+		std::cout << "  Options: ambient-occlusion, environment-mapping, environment-lighting, normal-mapping, material-mapping, depth-of-field," << std::endl;
+		std::cout << "           cluster-culling, occlusion-culling, sorted-lists, tiled-rendering, compute-rasterization (on or off), coloring (0 to 3)," << std::endl;
+		std::cout << "           resolution-scale (0.25 to 8)" << std::endl;
+	}
+}
+
+bool BatchRenderer::run(GLFWwindow* window, const std::vector<std::string>& arguments)
+{
+	ivec2 size(1280, 720);
+	std::vector<const CameraPreset*> cameras;
+	std::filesystem::path outputDirectory = ".";
+	std::vector<std::string> filenames;
+	std::vector<std::pair<std::string, std::string>> options;
+
+	for (std::size_t i = 0; i < arguments.size(); i++)
+	{
+		const std::string& argument = arguments[i];
+		const bool hasValue = i + 1 < arguments.size();
+
+		if (argument == "--headless")
+		{
+			// the context has already been created without a display
+		}
+		else if (argument == "--size" && hasValue)
+		{
+			std::istringstream stream(arguments[++i]);
+			char separator = 0;
+
+			if (!(stream >> size.x >> separator >> size.y) || separator != 'x' || size.x <= 0 || size.y <= 0)
+			{
+				std::cout << "Invalid size " << arguments[i] << "." << std::endl;
+				return false;
+			}
+		}
+		else if (argument == "--camera" && hasValue)
+		{
+			std::istringstream stream(arguments[++i]);
+			std::string name;
+
+			while (std::getline(stream, name, ','))
+			{
+				const CameraPreset* preset = findCameraPreset(name);
+
+				if (!preset)
+				{
+					std::cout << "Unknown camera preset " << name << "." << std::endl;
+					printUsage();
+					return false;
+				}
+
+				cameras.push_back(preset);
+			}
+		}
+		else if (argument == "--set" && hasValue)
+		{
+			const std::string& option = arguments[++i];
+			const std::size_t separator = option.find('=');
+
+			if (separator == std::string::npos)
+			{
+				std::cout << "Invalid option " << option << "." << std::endl;
+				printUsage();
+				return false;
+			}
+
+			options.emplace_back(option.substr(0, separator), option.substr(separator + 1));
+		}
+		else if (argument == "--output" && hasValue)
+		{
+			outputDirectory = arguments[++i];
+		}
+		else if (argument.compare(0, 2, "--") == 0)
+		{
+			std::cout << "Unknown or incomplete argument " << argument << "." << std::endl;
+			printUsage();
+			return false;
+		}
+		else
+		{
+			filenames.push_back(argument);
+		}
+	}
+
+	if (filenames.empty())
+	{
+		printUsage();
+		return false;
+	}
+
+	if (cameras.empty())
+		cameras.push_back(&cameraPresets[0]);
+
+	std::error_code error;
+	std::filesystem::create_directories(outputDirectory, error);
+
+	// All images are rendered into the same framebuffer, with a depth buffer like that of the sphere renderer, so that its depth
+	// can be copied along with the color
+	auto colorTexture = Texture::create(GL_TEXTURE_2D);
+	colorTexture->image2D(0, GL_RGBA8, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	auto depthTexture = Texture::create(GL_TEXTURE_2D);
+	depthTexture->image2D(0, GL_DEPTH_COMPONENT, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, nullptr);
+
+	auto framebuffer = Framebuffer::create();
+	framebuffer->attachTexture(GL_COLOR_ATTACHMENT0, colorTexture.get());
+	framebuffer->attachTexture(GL_DEPTH_ATTACHMENT, depthTexture.get());
+	framebuffer->setDrawBuffers({ GL_COLOR_ATTACHMENT0 });
+
+	if (framebuffer->checkStatus() != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Could not create a framebuffer of " << size.x << " x " << size.y << " pixels." << std::endl;
+		return false;
+	}
+
+	auto shaderCache = std::make_shared<ShaderCache>(window, "./cache/shaders");
+
+	bool success = true;
+	std::size_t imageCount = 0;
+	std::chrono::duration<double> renderingTime(0.0);
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
+	// One viewer renders all files, only the protein and the buffers derived from it are replaced for each of them
+	Scene scene;
+	std::unique_ptr<Viewer> viewer;
+
+	for (const auto& filename : filenames)
+	{
+		auto protein = std::make_unique<Protein>();
+		protein->load(filename);
+
+		if (protein->timestepCount() == 0 || protein->atomCount(0) == 0)
+		{
+			std::cout << "Skipping " << filename << ", which contains no atoms." << std::endl;
+			success = false;
+			continue;
+		}
+
+		const auto fileStartTime = std::chrono::high_resolution_clock::now();
+
+		if (viewer)
+		{
+			viewer->setProtein(std::move(protein));
+		}
+		else
+		{
+			scene.setProtein(std::move(protein));
+			viewer = std::make_unique<Viewer>(window, &scene, shaderCache);
+			viewer->setFramebuffer(framebuffer.get(), size);
+			viewer->setUiVisible(false);
+
+			// the options belong to the sphere renderer of the viewer, which keeps them for all files
+			for (const auto& o : options)
+			{
+				if (!viewer->sphereRenderer()->setOption(o.first, o.second))
+				{
+					std::cout << "Invalid option " << o.first << "=" << o.second << "." << std::endl;
+					printUsage();
+					return false;
+				}
+			}
+		}
+
+		const Protein* sceneProtein = scene.protein();
+		const vec3 boundingBoxSize = sceneProtein->maximumBounds() - sceneProtein->minimumBounds();
+		const float maximumSize = std::max(boundingBoxSize.x, std::max(boundingBoxSize.y, boundingBoxSize.z));
+		mat4 modelTransform = scale(vec3(2.0f) / vec3(maximumSize));
+		modelTransform = modelTransform * translate(-0.5f * (sceneProtein->minimumBounds() + sceneProtein->maximumBounds()));
+		viewer->setModelTransform(modelTransform);
+
+		const std::string basename = std::filesystem::path(filename).stem().string();
+
+		for (const CameraPreset* camera : cameras)
+		{
+			viewer->setViewTransform(lookAt(camera->direction * cameraDistance, vec3(0.0f), camera->up));
+			viewer->display();
+
+			const std::string imageFilename = (outputDirectory / (basename + "-" + camera->name + ".png")).string();
+			// the image is encoded while the next one is rendered, a full ring of readback buffers is waited for
+			viewer->saveImage(imageFilename, true);
+			imageCount++;
+
+			std::cout << "Saving " << imageFilename << std::endl;
+		}
+
+		renderingTime += std::chrono::high_resolution_clock::now() - fileStartTime;
+	}
+
+	// waits for the remaining images to be written
+	const auto finishStartTime = std::chrono::high_resolution_clock::now();
+	viewer.reset();
+	renderingTime += std::chrono::high_resolution_clock::now() - finishStartTime;
+
+	const std::chrono::duration<double> totalTime = std::chrono::high_resolution_clock::now() - startTime;
+
+	std::cout << imageCount << " images rendered in " << totalTime.count() << " seconds" << std::endl;
+	std::cout << "  " << double(imageCount) / std::max(totalTime.count(), 1e-9) << " images/s including loading" << std::endl;
+	std::cout << "  " << double(imageCount) / std::max(renderingTime.count(), 1e-9) << " images/s rendering only" << std::endl;
+
+	return success;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct GLFWwindow;
+
+namespace dynamol
+{
+	// Renders a list of files from a list of camera presets into PNG images without showing a window, e.g. on a compute node
+	// with a surfaceless EGL or OSMesa context. All images are rendered into one offscreen framebuffer by one viewer, whose
+	// renderers keep their programs and textures for all files, only the protein and the buffers derived from it are replaced.
+	// Reports the number of images rendered per second.
+	//
+	// The arguments are the files and the options --size <width>x<height>, --camera <preset>[,<preset>...] with the presets
+	// front, back, left, right, top, bottom and diagonal, --set <option>=<value> as accepted by SphereRenderer::setOption, and
+	// --output <directory>. Requires a current OpenGL context.
+	class BatchRenderer
+	{
+	public:
+		static bool run(GLFWwindow* window, const std::vector<std::string>& arguments);
+	};
+}
@@ -0,0 +1,65 @@
+#include "Benchmark.h"
+#include "Protein.h"
+
+#include <iostream>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+using namespace dynamol;
+using namespace glm;
+
+bool Benchmark::replicate(const std::string& filename, std::size_t atomCount, float gap, Protein& protein, Replica& replica)
+{
+	protein.load(filename);
+
+	if (protein.timestepCount() == 0 || protein.atomCount(0) == 0)
+	{
+		std::cout << "Could not load any atoms from " << filename << "!" << std::endl;
+		return false;
+	}
+
+	std::vector<vec4> atoms;
+	protein.loadTimestep(0, atoms);
+
+	const std::size_t copies = std::max<std::size_t>(1, (atomCount + atoms.size() - 1) / atoms.size());
+	const std::size_t side = std::size_t(std::ceil(std::cbrt(double(copies))));
+	const vec3 spacing = protein.maximumBounds() - protein.minimumBounds() + vec3(gap);
+
+	replica.atoms.resize(copies * atoms.size());
+	replica.atomsPerCopy = atoms.size();
+	replica.copies = copies;
+	replica.minimumBounds = protein.minimumBounds();
+	replica.maximumBounds = protein.minimumBounds() + spacing * vec3(float(side)) - vec3(gap);
+
+	for (std::size_t c = 0; c < copies; c++)
+	{
+		const vec3 offset = spacing * vec3(float(c % side), float((c / side) % side), float(c / (side * side)));
+
+		// the attribute bits are copied rather than added to, which could change them if they form a NaN
+		for (std::size_t i = 0; i < atoms.size(); i++)
+			replica.atoms[c * atoms.size() + i] = vec4(vec3(atoms[i]) + offset, atoms[i].w);
+	}
+
+	return true;
+}
+
+double Benchmark::minimumTime(unsigned int iterations, const std::function<void()>& function)
+{
+	double minimum = std::numeric_limits<double>::max();
+
+	for (unsigned int i = 0; i < std::max(iterations, 1u); i++)
+		minimum = std::min(minimum, time(function));
+
+	return minimum;
+}
+
+double Benchmark::time(const std::function<void()>& function)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	function();
+	const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - startTime;
+
+	return duration.count();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+namespace dynamol
+{
+	class Protein;
+
+	// Input generation and timing shared by the benchmarks that run without an OpenGL context
+	class Benchmark
+	{
+	public:
+		// Translated copies of the first timestep of a file, placed on a grid of side x side x side copies
+		struct Replica
+		{
+			std::vector<glm::vec4> atoms;
+			std::size_t atomsPerCopy = 0;
+			std::size_t copies = 0;
+			glm::vec3 minimumBounds = glm::vec3(0.0f);
+			glm::vec3 maximumBounds = glm::vec3(0.0f);
+		};
+
+		// Loads the file without the trajectory cache and replicates its first timestep until there are at least the given number
+		// of atoms, with the given gap between the bounds of neighboring copies. The attributes in w refer to the tables of the
+		// protein. Returns false if the file has no atoms.
+		static bool replicate(const std::string& filename, std::size_t atomCount, float gap, Protein& protein, Replica& replica);
+
+		// Returns the shortest time of the given number of calls in seconds, at least one call is made
+		static double minimumTime(unsigned int iterations, const std::function<void()>& function);
+
+		// Returns the time of a single call in seconds
+		static double time(const std::function<void()>& function);
+	};
+}
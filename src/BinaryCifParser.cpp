@@ -0,0 +1,594 @@
+#include "BinaryCifParser.h"
+#include "MessagePack.h"
+#include "PdbParser.h"
+#include "ThreadPool.h"
+
+#include <array>
+#include <string_view>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	using Value = MessagePack::Value;
+
+	enum Column
+	{
+		X,
+		Y,
+		Z,
+		TypeSymbol,
+		LabelCompId,
+		AuthCompId,
+		AuthAsymId,
+		LabelAsymId,
+		AuthSeqId,
+		LabelSeqId,
+		ModelNumber,
+		ColumnCount
+	};
+
+	const std::array<std::string_view, ColumnCount> columnNames = {
+		"cartn_x",
+		"cartn_y",
+		"cartn_z",
+		"type_symbol",
+		"label_comp_id",
+		"auth_comp_id",
+		"auth_asym_id",
+		"label_asym_id",
+		"auth_seq_id",
+		"label_seq_id",
+		"pdbx_pdb_model_num"
+	};
+
+	// decoded arrays are never larger than this, which rejects corrupt sizes before allocating
+	const std::size_t maximumArraySize = std::size_t(1) << 31;
+
+	inline bool equalsIgnoreCase(std::string_view string, std::string_view lowerCase)
+	{
+		if (string.size() != lowerCase.size())
+			return false;
+
+		for (std::size_t i = 0; i < string.size(); i++)
+		{
+			const char c = (string[i] >= 'A' && string[i] <= 'Z') ? char(string[i] - 'A' + 'a') : string[i];
+
+			if (c != lowerCase[i])
+				return false;
+		}
+
+		return true;
+	}
+
+	template <typename T>
+	inline T littleEndian(const char* data)
+	{
+		std::uint64_t bits = 0;
+
+		for (std::size_t i = 0; i < sizeof(T); i++)
+			bits |= std::uint64_t(static_cast<unsigned char>(data[i])) << (8 * i);
+
+		T result;
+
+		if constexpr (sizeof(T) == 1)
+		{
+			const std::uint8_t b = std::uint8_t(bits);
+			std::memcpy(&result, &b, 1);
+		}
+		else if constexpr (sizeof(T) == 2)
+		{
+			const std::uint16_t b = std::uint16_t(bits);
+			std::memcpy(&result, &b, 2);
+		}
+		else if constexpr (sizeof(T) == 4)
+		{
+			const std::uint32_t b = std::uint32_t(bits);
+			std::memcpy(&result, &b, 4);
+		}
+		else
+		{
+			std::memcpy(&result, &bits, 8);
+		}
+
+		return result;
+	}
+
+	inline double number(const Value& encoding, std::string_view key, double defaultValue = 0.0)
+	{
+		const Value* value = encoding.find(key);
+		return value ? value->toNumber() : defaultValue;
+	}
+
+	// intermediate and final state of a column while its encodings are undone
+	struct Array
+	{
+		enum class Type
+		{
+			Bytes,
+			Integer,
+			Float,
+			String
+		};
+
+		Type type = Type::Bytes;
+		const char* bytes = nullptr;
+		std::size_t byteCount = 0;
+
+		// string columns hold an index into the strings for each row, or -1 for missing values
+		std::vector<std::int32_t> integers;
+		std::vector<double> floats;
+		std::vector<std::string_view> strings;
+
+		std::size_t size() const
+		{
+			return (type == Type::Float) ? floats.size() : integers.size();
+		}
+	};
+
+	template <typename T, typename Result>
+	void convert(const Array& array, std::vector<Result>& result)
+	{
+		const std::size_t count = array.byteCount / sizeof(T);
+		result.resize(count);
+
+		for (std::size_t i = 0; i < count; i++)
+			result[i] = Result(littleEndian<T>(array.bytes + i * sizeof(T)));
+	}
+
+	bool byteArray(const Value& encoding, Array& array)
+	{
+		if (array.type != Array::Type::Bytes)
+			return false;
+
+		switch (int(number(encoding, "type")))
+		{
+		case 1: convert<std::int8_t>(array, array.integers); break;
+		case 2: convert<std::int16_t>(array, array.integers); break;
+		case 3: convert<std::int32_t>(array, array.integers); break;
+		case 4: convert<std::uint8_t>(array, array.integers); break;
+		case 5: convert<std::uint16_t>(array, array.integers); break;
+		case 6: convert<std::uint32_t>(array, array.integers); break;
+		case 32: convert<float>(array, array.floats); array.type = Array::Type::Float; return true;
+		case 33: convert<double>(array, array.floats); array.type = Array::Type::Float; return true;
+		default: return false;
+		}
+
+		array.type = Array::Type::Integer;
+		return true;
+	}
+
+	bool fixedPoint(const Value& encoding, Array& array)
+	{
+		const double factor = number(encoding, "factor", 1.0);
+
+		if (array.type != Array::Type::Integer || factor == 0.0)
+			return false;
+
+		array.floats.resize(array.integers.size());
+
+		for (std::size_t i = 0; i < array.integers.size(); i++)
+			array.floats[i] = double(array.integers[i]) / factor;
+
+		array.integers = std::vector<std::int32_t>();
+		array.type = Array::Type::Float;
+		return true;
+	}
+
+	bool intervalQuantization(const Value& encoding, Array& array)
+	{
+		const double minimum = number(encoding, "min");
+		const double maximum = number(encoding, "max");
+		const double stepCount = number(encoding, "numSteps");
+
+		if (array.type != Array::Type::Integer || stepCount < 2.0)
+			return false;
+
+		const double delta = (maximum - minimum) / (stepCount - 1.0);
+		array.floats.resize(array.integers.size());
+
+		for (std::size_t i = 0; i < array.integers.size(); i++)
+			array.floats[i] = minimum + delta * double(array.integers[i]);
+
+		array.integers = std::vector<std::int32_t>();
+		array.type = Array::Type::Float;
+		return true;
+	}
+
+	bool runLength(const Value& encoding, Array& array)
+	{
+		const double size = number(encoding, "srcSize");
+
+		if (array.type != Array::Type::Integer || array.integers.size() % 2 != 0 || size < 0.0 || size > double(maximumArraySize))
+			return false;
+
+		std::vector<std::int32_t> result(std::size_t(size), 0);
+		std::size_t position = 0;
+
+		for (std::size_t i = 0; i < array.integers.size(); i += 2)
+		{
+			const std::int32_t value = array.integers[i];
+			const std::int32_t count = array.integers[i + 1];
+
+			if (count < 0 || std::size_t(count) > result.size() - position)
+				return false;
+
+			std::fill_n(result.begin() + position, count, value);
+			position += std::size_t(count);
+		}
+
+		if (position != result.size())
+			return false;
+
+		array.integers = std::move(result);
+		return true;
+	}
+
+	bool delta(const Value& encoding, Array& array)
+	{
+		if (array.type != Array::Type::Integer)
+			return false;
+
+		std::uint32_t value = std::uint32_t(std::int64_t(number(encoding, "origin")));
+
+		// wrapping arithmetic on unsigned integers avoids undefined behavior for corrupt input
+		for (auto& i : array.integers)
+		{
+			value += std::uint32_t(i);
+			i = std::int32_t(value);
+		}
+
+		return true;
+	}
+
+	bool integerPacking(const Value& encoding, Array& array)
+	{
+		const int byteCount = int(number(encoding, "byteCount"));
+		const Value* isUnsigned = encoding.find("isUnsigned");
+		const double size = number(encoding, "srcSize");
+
+		if (array.type != Array::Type::Integer || (byteCount != 1 && byteCount != 2) || size < 0.0 || size > double(maximumArraySize))
+			return false;
+
+		// values outside of the packed range are split into a sequence of limit values followed by the remainder
+		const bool unsignedValues = isUnsigned && isUnsigned->integer != 0;
+		const std::int32_t upperLimit = unsignedValues ? (byteCount == 1 ? 0xFF : 0xFFFF) : (byteCount == 1 ? 0x7F : 0x7FFF);
+		const std::int32_t lowerLimit = unsignedValues ? std::numeric_limits<std::int32_t>::min() : (byteCount == 1 ? -0x80 : -0x8000);
+
+		std::vector<std::int32_t> result;
+		result.reserve(std::size_t(size));
+
+		const auto& packed = array.integers;
+
+		for (std::size_t i = 0; i < packed.size(); i++)
+		{
+			std::uint32_t value = 0;
+
+			while (i + 1 < packed.size() && (packed[i] == upperLimit || packed[i] == lowerLimit))
+				value += std::uint32_t(packed[i++]);
+
+			result.push_back(std::int32_t(value + std::uint32_t(packed[i])));
+		}
+
+		if (result.size() != std::size_t(size))
+			return false;
+
+		array.integers = std::move(result);
+		return true;
+	}
+
+	bool decode(const Value& data, const Value& encodings, Array& array);
+
+	bool stringArray(const Value& encoding, Array& array)
+	{
+		const Value* stringData = encoding.find("stringData");
+		const Value* offsets = encoding.find("offsets");
+		const Value* offsetEncoding = encoding.find("offsetEncoding");
+		const Value* dataEncoding = encoding.find("dataEncoding");
+
+		if (array.type != Array::Type::Bytes || !stringData || !offsets || !offsetEncoding || !dataEncoding)
+			return false;
+
+		Value indices;
+		indices.type = Value::Type::Binary;
+		indices.data = array.bytes;
+		indices.size = array.byteCount;
+
+		Array offsetArray;
+
+		if (!decode(indices, *dataEncoding, array) || !decode(*offsets, *offsetEncoding, offsetArray))
+			return false;
+
+		if (array.type != Array::Type::Integer || offsetArray.type != Array::Type::Integer || offsetArray.integers.empty())
+			return false;
+
+		const std::string_view text = stringData->string();
+		array.strings.resize(offsetArray.integers.size() - 1);
+
+		for (std::size_t i = 0; i < array.strings.size(); i++)
+		{
+			const std::int32_t begin = offsetArray.integers[i];
+			const std::int32_t end = offsetArray.integers[i + 1];
+
+			if (begin < 0 || end < begin || std::size_t(end) > text.size())
+				return false;
+
+			array.strings[i] = text.substr(std::size_t(begin), std::size_t(end - begin));
+		}
+
+		for (auto& i : array.integers)
+		{
+			if (i < 0 || std::size_t(i) >= array.strings.size())
+				i = -1;
+		}
+
+		array.type = Array::Type::String;
+		return true;
+	}
+
+	// undoes the encodings in reverse order of their application
+	bool decode(const Value& data, const Value& encodings, Array& array)
+	{
+		if (data.type != Value::Type::Binary || encodings.type != Value::Type::Array)
+			return false;
+
+		array.type = Array::Type::Bytes;
+		array.bytes = data.data;
+		array.byteCount = data.size;
+
+		for (std::size_t i = encodings.elements.size(); i-- > 0;)
+		{
+			const Value& encoding = encodings.elements[i];
+			const Value* kindValue = encoding.find("kind");
+			const std::string_view kind = kindValue ? kindValue->string() : std::string_view();
+
+			bool decoded = false;
+
+			if (kind == "ByteArray")
+				decoded = byteArray(encoding, array);
+			else if (kind == "FixedPoint")
+				decoded = fixedPoint(encoding, array);
+			else if (kind == "IntervalQuantization")
+				decoded = intervalQuantization(encoding, array);
+			else if (kind == "RunLength")
+				decoded = runLength(encoding, array);
+			else if (kind == "Delta")
+				decoded = delta(encoding, array);
+			else if (kind == "IntegerPacking")
+				decoded = integerPacking(encoding, array);
+			else if (kind == "StringArray")
+				decoded = stringArray(encoding, array);
+
+			if (!decoded)
+				return false;
+		}
+
+		return array.type != Array::Type::Bytes;
+	}
+
+	// encoded column with its optional mask, which marks unknown and inapplicable values with non-zero entries
+	struct EncodedColumn
+	{
+		const Value* data = nullptr;
+		const Value* mask = nullptr;
+	};
+
+	struct DecodedColumn
+	{
+		Array values;
+		Array mask;
+		bool present = false;
+
+		// id or packed name of each distinct string, which is computed only once per string
+		std::vector<std::uint64_t> stringIds;
+
+		bool decode(const EncodedColumn& column, std::size_t rowCount)
+		{
+			if (!column.data)
+				return true;
+
+			const Value* data = column.data->find("data");
+			const Value* encoding = column.data->find("encoding");
+
+			if (!data || !encoding || !::decode(*data, *encoding, values) || values.size() != rowCount)
+				return false;
+
+			if (column.mask && column.mask->type == Value::Type::Map)
+			{
+				data = column.mask->find("data");
+				encoding = column.mask->find("encoding");
+
+				if (!data || !encoding || !::decode(*data, *encoding, mask) || mask.type != Array::Type::Integer || mask.size() != rowCount)
+					return false;
+			}
+
+			present = true;
+			return true;
+		}
+
+		template <typename Id>
+		void mapStrings(Id (*id)(const char*, const char*))
+		{
+			stringIds.resize(values.strings.size());
+
+			for (std::size_t i = 0; i < stringIds.size(); i++)
+			{
+				const std::string_view s = values.strings[i];
+				stringIds[i] = std::uint64_t(id(s.data(), s.data() + s.size()));
+			}
+		}
+
+		bool missing(std::size_t row) const
+		{
+			return !present || (!mask.integers.empty() && mask.integers[row] != 0);
+		}
+
+		// id of the string in the given row, returns false if there is none or it is empty
+		bool id(std::size_t row, std::uint64_t& result) const
+		{
+			if (missing(row) || values.type != Array::Type::String || values.integers[row] < 0 || values.strings[std::size_t(values.integers[row])].empty())
+				return false;
+
+			result = stringIds[std::size_t(values.integers[row])];
+			return true;
+		}
+
+		double number(std::size_t row) const
+		{
+			if (values.type == Array::Type::Float)
+				return values.floats[row];
+
+			if (values.type == Array::Type::Integer)
+				return double(values.integers[row]);
+
+			if (values.type == Array::Type::String && values.integers[row] >= 0)
+			{
+				const std::string_view s = values.strings[std::size_t(values.integers[row])];
+				return double(PdbParser::parseFloat(s.data(), s.data() + s.size()));
+			}
+
+			return 0.0;
+		}
+	};
+
+	const Value* findAtomSites(const Value& file)
+	{
+		const Value* dataBlocks = file.find("dataBlocks");
+
+		if (!dataBlocks || dataBlocks->type != Value::Type::Array)
+			return nullptr;
+
+		for (const auto& block : dataBlocks->elements)
+		{
+			const Value* categories = block.find("categories");
+
+			if (!categories || categories->type != Value::Type::Array)
+				continue;
+
+			for (const auto& category : categories->elements)
+			{
+				const Value* name = category.find("name");
+
+				if (name && (equalsIgnoreCase(name->string(), "_atom_site") || equalsIgnoreCase(name->string(), "atom_site")))
+					return &category;
+			}
+		}
+
+		return nullptr;
+	}
+}
+
+bool BinaryCifParser::parse(const char* begin, const char* end, CifParser::AtomSites& atomSites)
+{
+	atomSites.resize(0);
+
+	Value file;
+
+	if (!MessagePack::parse(begin, end, file))
+		return false;
+
+	const Value* category = findAtomSites(file);
+
+	if (!category)
+		return false;
+
+	const Value* rowCountValue = category->find("rowCount");
+	const Value* columns = category->find("columns");
+
+	if (!rowCountValue || !columns || columns->type != Value::Type::Array || rowCountValue->toNumber() < 0.0 || rowCountValue->toNumber() > double(maximumArraySize))
+		return false;
+
+	const std::size_t rowCount = std::size_t(rowCountValue->toNumber());
+
+	std::array<EncodedColumn, ColumnCount> encodedColumns;
+
+	for (const auto& c : columns->elements)
+	{
+		const Value* name = c.find("name");
+
+		if (!name)
+			continue;
+
+		for (std::size_t i = 0; i < ColumnCount; i++)
+		{
+			if (equalsIgnoreCase(name->string(), columnNames[i]))
+			{
+				encodedColumns[i].data = c.find("data");
+				encodedColumns[i].mask = c.find("mask");
+			}
+		}
+	}
+
+	if (!encodedColumns[X].data || !encodedColumns[Y].data || !encodedColumns[Z].data)
+		return false;
+
+	// columns are decoded independently, then the distinct strings of each column are mapped to ids once
+	ThreadPool& threadPool = ThreadPool::instance();
+
+	std::array<DecodedColumn, ColumnCount> decodedColumns;
+	std::array<bool, ColumnCount> decoded;
+
+	threadPool.parallelFor(ColumnCount, [&](std::size_t i)
+	{
+		decoded[i] = decodedColumns[i].decode(encodedColumns[i], rowCount);
+	});
+
+	for (std::size_t i = 0; i < ColumnCount; i++)
+	{
+		if (!decoded[i])
+			return false;
+	}
+
+	decodedColumns[TypeSymbol].mapStrings(&PdbParser::elementId);
+	decodedColumns[LabelCompId].mapStrings<std::uint64_t>(&PdbParser::name);
+	decodedColumns[AuthCompId].mapStrings<std::uint64_t>(&PdbParser::name);
+	decodedColumns[AuthAsymId].mapStrings<std::uint64_t>(&PdbParser::name);
+	decodedColumns[LabelAsymId].mapStrings<std::uint64_t>(&PdbParser::name);
+
+	atomSites.resize(rowCount);
+
+	const std::size_t chunkSize = 65536;
+	const std::size_t chunkCount = (rowCount + chunkSize - 1) / chunkSize;
+
+	threadPool.parallelFor(chunkCount, [&](std::size_t chunk)
+	{
+		const std::size_t chunkEnd = std::min(rowCount, (chunk + 1) * chunkSize);
+
+		for (std::size_t i = chunk * chunkSize; i < chunkEnd; i++)
+		{
+			atomSites.positions[i] = vec3(decodedColumns[X].number(i), decodedColumns[Y].number(i), decodedColumns[Z].number(i));
+
+			std::uint64_t elementId = 0;
+			std::uint64_t residueName = 0;
+			std::uint64_t chainName = 0;
+			std::int32_t residueNumber = 0;
+
+			decodedColumns[TypeSymbol].id(i, elementId);
+
+			if (!decodedColumns[LabelCompId].id(i, residueName))
+				decodedColumns[AuthCompId].id(i, residueName);
+
+			// the author chain names correspond to the chain identifiers of PDB files
+			if (!decodedColumns[AuthAsymId].id(i, chainName))
+				decodedColumns[LabelAsymId].id(i, chainName);
+
+			// the author residue numbers correspond to those of PDB files, the others are missing for non-polymers
+			if (!decodedColumns[AuthSeqId].missing(i))
+				residueNumber = std::int32_t(decodedColumns[AuthSeqId].number(i));
+			else if (!decodedColumns[LabelSeqId].missing(i))
+				residueNumber = std::int32_t(decodedColumns[LabelSeqId].number(i));
+
+			atomSites.elementIds[i] = std::uint8_t(elementId);
+			atomSites.residueNames[i] = residueName;
+			atomSites.chainNames[i] = chainName;
+			atomSites.residueNumbers[i] = residueNumber;
+			atomSites.models[i] = decodedColumns[ModelNumber].missing(i) ? 1 : std::int32_t(decodedColumns[ModelNumber].number(i));
+		}
+	});
+
+	return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "CifParser.h"
+
+namespace dynamol
+{
+	// Decodes the atom_site category of BinaryCIF files, whose columns are MessagePack-encoded byte arrays
+	// compressed with a chain of integer, delta, run-length and string encodings
+	class BinaryCifParser
+	{
+	public:
+		static bool parse(const char* begin, const char* end, CifParser::AtomSites& atomSites);
+	};
+}
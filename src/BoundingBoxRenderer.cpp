@@ -75,6 +75,7 @@ BoundingBoxRenderer::BoundingBoxRenderer(Viewer* viewer) : Renderer(viewer)
 
 void BoundingBoxRenderer::display()
 {
+	const Profiler::Scope scope(viewer()->profiler(), "bounding box");
 	auto currentState = State::currentState();
 
 	glEnable(GL_DEPTH_TEST);
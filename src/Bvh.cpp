@@ -0,0 +1,897 @@
+#include "Bvh.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DYNAMOL_BVH_SSE
+#endif
+
+using namespace dynamol;
+using namespace glm;
+
+// node of the binary hierarchy, which is collapsed into the wide nodes used for traversal
+struct Bvh::BuildNode
+{
+	vec3 lower;
+	vec3 upper;
+	uint first = 0;
+	uint count = 0;
+
+	// index of the left child, which is followed by the right one, or zero for a leaf
+	uint left = 0;
+};
+
+namespace
+{
+	// spheres or nodes processed by a single invocation of the parallel loops
+	const std::size_t chunkSize = 64 * 1024;
+	const std::size_t nodeChunkSize = 1024;
+	const std::size_t taskChunkSize = 256;
+	const std::size_t packetChunkSize = 64;
+
+	// tasks of up to smallLeafSize spheres always become leaves, those of up to maximumLeafSize if splitting them does not pay off
+	const int binCount = 16;
+	const uint smallLeafSize = 4;
+	const uint maximumLeafSize = 8;
+
+	std::size_t chunkCount(std::size_t count, std::size_t size = chunkSize)
+	{
+		return (count + size - 1) / size;
+	}
+
+	struct Bounds
+	{
+		vec3 lower = vec3(std::numeric_limits<float>::max());
+		vec3 upper = vec3(-std::numeric_limits<float>::max());
+
+		void extend(const vec3& l, const vec3& u)
+		{
+			lower = min(lower, l);
+			upper = max(upper, u);
+		}
+
+		void extend(const Bounds& b)
+		{
+			extend(b.lower, b.upper);
+		}
+
+		// half of the surface area, zero if empty
+		float area() const
+		{
+			const vec3 e = max(upper - lower, vec3(0.0f));
+			return e.x * e.y + e.y * e.z + e.z * e.x;
+		}
+	};
+
+	struct Bin
+	{
+		Bounds bounds;
+		uint count = 0;
+	};
+
+	// range of spheres that still has to be split, with the bounds of the spheres and of their centers
+	struct BuildTask
+	{
+		Bounds bounds;
+		Bounds centers;
+		uint first = 0;
+		uint count = 0;
+		uint node = 0;
+	};
+
+	void extendTask(BuildTask& task, const vec4* begin, const vec4* end)
+	{
+		for (const vec4* s = begin; s < end; s++)
+		{
+			task.bounds.extend(vec3(*s) - s->w, vec3(*s) + s->w);
+			task.centers.extend(vec3(*s), vec3(*s));
+		}
+	}
+
+	// Splits the spheres of a task into two children by binning their centers along the axis of largest extent and choosing the
+	// split between bins with the lowest surface area heuristic. Returns false if the task should become a leaf instead.
+	// The spheres are moved together with their indices, so that every level of the build reads them sequentially.
+	bool splitTask(vec4* spheres, uint* indices, const BuildTask& task, bool parallel, BuildTask& left, BuildTask& right)
+	{
+		if (task.count <= smallLeafSize)
+			return false;
+
+		vec4* begin = spheres + task.first;
+		vec4* end = begin + task.count;
+
+		const vec3 extent = task.centers.upper - task.centers.lower;
+		const int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+		if (extent[axis] > 0.0f)
+		{
+			const float offset = task.centers.lower[axis];
+			const float scale = float(binCount) * 0.9999f / extent[axis];
+
+			auto binIndex = [&](const vec4& s)
+			{
+				return std::min(binCount - 1, int((s[axis] - offset) * scale));
+			};
+
+			auto fill = [&](const vec4* b, const vec4* e, std::array<Bin, binCount>& bins)
+			{
+				for (const vec4* s = b; s < e; s++)
+				{
+					Bin& bin = bins[binIndex(*s)];
+					bin.bounds.extend(vec3(*s) - s->w, vec3(*s) + s->w);
+					bin.count++;
+				}
+			};
+
+			std::array<Bin, binCount> bins;
+
+			if (parallel)
+			{
+				std::vector< std::array<Bin, binCount> > chunkBins(chunkCount(task.count));
+
+				ThreadPool::instance().parallelFor(chunkBins.size(), [&](std::size_t chunk)
+				{
+					fill(begin + chunk * chunkSize, begin + std::min<std::size_t>(task.count, (chunk + 1) * chunkSize), chunkBins[chunk]);
+				});
+
+				for (const auto& c : chunkBins)
+				{
+					for (int i = 0; i < binCount; i++)
+					{
+						bins[i].bounds.extend(c[i].bounds);
+						bins[i].count += c[i].count;
+					}
+				}
+			}
+			else
+			{
+				fill(begin, end, bins);
+			}
+
+			// cost of the spheres left of every split, which is then combined with the cost of those right of it
+			std::array<float, binCount> leftCosts;
+			Bounds sweepBounds;
+			uint sweepCount = 0;
+
+			for (int i = 0; i < binCount - 1; i++)
+			{
+				sweepBounds.extend(bins[i].bounds);
+				sweepCount += bins[i].count;
+				leftCosts[i] = sweepBounds.area() * float(sweepCount);
+			}
+
+			sweepBounds = Bounds();
+			sweepCount = 0;
+
+			int split = 0;
+			float splitCost = std::numeric_limits<float>::max();
+
+			for (int i = binCount - 1; i > 0; i--)
+			{
+				sweepBounds.extend(bins[i].bounds);
+				sweepCount += bins[i].count;
+
+				if (sweepCount > 0 && sweepCount < task.count)
+				{
+					const float cost = leftCosts[i - 1] + sweepBounds.area() * float(sweepCount);
+
+					if (cost < splitCost)
+					{
+						split = i;
+						splitCost = cost;
+					}
+				}
+			}
+
+			if (split > 0)
+			{
+				// assuming that visiting a node costs as much as testing a sphere, small leaves are kept unless the split saves tests
+				if (task.count <= maximumLeafSize && 1.0f + splitCost / task.bounds.area() >= float(task.count))
+					return false;
+
+				left = BuildTask();
+				right = BuildTask();
+
+				for (int i = 0; i < binCount; i++)
+				{
+					BuildTask& child = (i < split) ? left : right;
+					child.bounds.extend(bins[i].bounds);
+					child.count += bins[i].count;
+				}
+
+				// the bounds of the centers of the children are gathered while partitioning, which visits every sphere once
+				std::size_t i = 0;
+				std::size_t j = task.count;
+
+				while (true)
+				{
+					for (; i < j && binIndex(begin[i]) < split; i++)
+						left.centers.extend(vec3(begin[i]), vec3(begin[i]));
+
+					for (; i < j && binIndex(begin[j - 1]) >= split; j--)
+						right.centers.extend(vec3(begin[j - 1]), vec3(begin[j - 1]));
+
+					if (i >= j)
+						break;
+
+					std::swap(begin[i], begin[j - 1]);
+					std::swap(indices[task.first + i], indices[task.first + j - 1]);
+				}
+
+				left.first = task.first;
+				right.first = task.first + left.count;
+				return true;
+			}
+		}
+
+		if (task.count <= maximumLeafSize)
+			return false;
+
+		// spheres whose centers cannot be told apart by binning are split in half
+		left = BuildTask();
+		right = BuildTask();
+		left.first = task.first;
+		left.count = task.count / 2;
+		right.first = task.first + left.count;
+		right.count = task.count - left.count;
+
+		extendTask(left, spheres + left.first, spheres + right.first);
+		extendTask(right, spheres + right.first, end);
+		return true;
+	}
+
+#if defined(__AVX__)
+	using Lanes = __m256;
+	inline Lanes load(const float* p) { return _mm256_load_ps(p); }
+	inline void store(float* p, Lanes a) { _mm256_store_ps(p, a); }
+	inline Lanes broadcast(float v) { return _mm256_set1_ps(v); }
+	inline Lanes minimum(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+	inline Lanes maximum(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+	inline Lanes multiply(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+	inline Lanes multiplySubtract(Lanes a, Lanes b, Lanes c) { return _mm256_sub_ps(_mm256_mul_ps(a, b), c); }
+	inline uint lessEqual(Lanes a, Lanes b) { return uint(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ))); }
+#elif defined(DYNAMOL_BVH_SSE)
+	using Lanes = __m128;
+	inline Lanes load(const float* p) { return _mm_load_ps(p); }
+	inline void store(float* p, Lanes a) { _mm_store_ps(p, a); }
+	inline Lanes broadcast(float v) { return _mm_set1_ps(v); }
+	inline Lanes minimum(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+	inline Lanes maximum(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+	inline Lanes multiply(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	inline Lanes multiplySubtract(Lanes a, Lanes b, Lanes c) { return _mm_sub_ps(_mm_mul_ps(a, b), c); }
+	inline uint lessEqual(Lanes a, Lanes b) { return uint(_mm_movemask_ps(_mm_cmple_ps(a, b))); }
+#else
+	// without vector instructions the lanes are processed by loops, which the compiler may still vectorize
+	struct Lanes
+	{
+		float v[Bvh::width];
+	};
+
+	template <typename Function>
+	inline Lanes apply(Function function)
+	{
+		Lanes result;
+
+		for (std::size_t i = 0; i < Bvh::width; i++)
+			result.v[i] = function(i);
+
+		return result;
+	}
+
+	inline Lanes load(const float* p) { return apply([&](std::size_t i) { return p[i]; }); }
+	inline void store(float* p, Lanes a) { std::copy(a.v, a.v + Bvh::width, p); }
+	inline Lanes broadcast(float v) { return apply([&](std::size_t) { return v; }); }
+	inline Lanes minimum(Lanes a, Lanes b) { return apply([&](std::size_t i) { return std::min(a.v[i], b.v[i]); }); }
+	inline Lanes maximum(Lanes a, Lanes b) { return apply([&](std::size_t i) { return std::max(a.v[i], b.v[i]); }); }
+	inline Lanes multiply(Lanes a, Lanes b) { return apply([&](std::size_t i) { return a.v[i] * b.v[i]; }); }
+	inline Lanes multiplySubtract(Lanes a, Lanes b, Lanes c) { return apply([&](std::size_t i) { return a.v[i] * b.v[i] - c.v[i]; }); }
+
+	inline uint lessEqual(Lanes a, Lanes b)
+	{
+		uint mask = 0;
+
+		for (std::size_t i = 0; i < Bvh::width; i++)
+			mask |= (a.v[i] <= b.v[i] ? 1u : 0u) << i;
+
+		return mask;
+	}
+#endif
+
+	// ray with the values used by every slab and sphere test precomputed
+	struct TraversalRay
+	{
+		TraversalRay() = default;
+
+		TraversalRay(const Bvh::Ray& ray) : origin(ray.origin), direction(ray.direction), squaredLength(dot(ray.direction, ray.direction))
+		{
+			// zero components are replaced by tiny ones of the same sign, so that no slab test computes zero times infinity
+			for (int i = 0; i < 3; i++)
+			{
+				const float d = std::abs(direction[i]) > 1e-20f ? direction[i] : std::copysign(1e-20f, direction[i]);
+				inverseDirection[i] = 1.0f / d;
+				scaledOrigin[i] = origin[i] * inverseDirection[i];
+			}
+		}
+
+		vec3 origin = vec3(0.0f);
+		vec3 direction = vec3(0.0f);
+		vec3 inverseDirection = vec3(0.0f);
+		vec3 scaledOrigin = vec3(0.0f);
+		float squaredLength = 0.0f;
+	};
+
+	// Intersects the ray with the bounds of all slots at once, writing the distances at which the ray enters them.
+	// Returns a mask of the slots that the ray enters before the maximum distance.
+	inline uint intersectSlots(const float* lower, const float* upper, const TraversalRay& ray, float maximumDistance, float* entries)
+	{
+		Lanes entry = broadcast(0.0f);
+		Lanes exit = broadcast(maximumDistance);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const Lanes inverseDirection = broadcast(ray.inverseDirection[axis]);
+			const Lanes scaledOrigin = broadcast(ray.scaledOrigin[axis]);
+			const Lanes t0 = multiplySubtract(load(lower + axis * Bvh::width), inverseDirection, scaledOrigin);
+			const Lanes t1 = multiplySubtract(load(upper + axis * Bvh::width), inverseDirection, scaledOrigin);
+			entry = maximum(entry, minimum(t0, t1));
+			exit = minimum(exit, maximum(t0, t1));
+		}
+
+		// the exit is extended by a few units of rounding error, so that spheres touching the bounds are not missed
+		store(entries, entry);
+		return lessEqual(entry, multiply(exit, broadcast(1.0f + 4.0f * std::numeric_limits<float>::epsilon())));
+	}
+
+	// distance at which the ray enters the sphere, or leaves it if it starts inside
+	inline bool intersectSphere(const vec4& sphere, const TraversalRay& ray, float& distance)
+	{
+		const vec3 offset = ray.origin - vec3(sphere);
+		const float b = dot(offset, ray.direction);
+		const float c = dot(offset, offset) - sphere.w * sphere.w;
+		const float discriminant = b * b - ray.squaredLength * c;
+
+		if (discriminant < 0.0f)
+			return false;
+
+		const float root = std::sqrt(discriminant);
+		distance = (-b - root) / ray.squaredLength;
+
+		if (distance < 0.0f)
+			distance = (-b + root) / ray.squaredLength;
+
+		return distance >= 0.0f;
+	}
+
+	inline void intersectLeaf(const vec4* spheres, const uint* indices, uint first, uint count, const TraversalRay& ray, float& closest, Bvh::Hit& hit)
+	{
+		for (uint i = first; i < first + count; i++)
+		{
+			float distance;
+
+			if (intersectSphere(spheres[i], ray, distance) && (distance < closest || (distance == closest && indices[i] < hit.index)))
+			{
+				closest = distance;
+				hit.index = indices[i];
+				hit.distance = distance;
+			}
+		}
+	}
+
+	struct StackEntry
+	{
+		uint node;
+		uint rays;
+		float distance;
+	};
+
+	// Pushes the inner slots in the mask so that the closest one is visited next
+	inline void pushSlots(std::vector<StackEntry>& stack, uint mask, const uint* nodes, const uint* rays, const float* distances)
+	{
+		std::array<StackEntry, Bvh::width> entries;
+		std::size_t entryCount = 0;
+
+		for (std::size_t s = 0; s < Bvh::width; s++)
+		{
+			if (mask & (1u << s))
+			{
+				std::size_t j = entryCount++;
+
+				for (; j > 0 && entries[j - 1].distance < distances[s]; j--)
+					entries[j] = entries[j - 1];
+
+				entries[j] = { nodes[s], rays[s], distances[s] };
+			}
+		}
+
+		stack.insert(stack.end(), entries.begin(), entries.begin() + entryCount);
+	}
+}
+
+void Bvh::build(const vec3* positions, const float* radii, std::size_t count)
+{
+	ThreadPool& threadPool = ThreadPool::instance();
+
+	m_nodes.clear();
+	m_spheres.resize(count);
+	m_indices.resize(count);
+
+	std::vector<BuildTask> chunkTasks(chunkCount(count));
+
+	threadPool.parallelFor(chunkTasks.size(), [&](std::size_t chunk)
+	{
+		const std::size_t first = chunk * chunkSize;
+		const std::size_t last = std::min(count, (chunk + 1) * chunkSize);
+
+		for (std::size_t i = first; i < last; i++)
+		{
+			m_spheres[i] = vec4(positions[i], radii[i]);
+			m_indices[i] = uint(i);
+		}
+
+		extendTask(chunkTasks[chunk], m_spheres.data() + first, m_spheres.data() + last);
+	});
+
+	BuildTask root;
+	root.count = uint(count);
+
+	for (const auto& t : chunkTasks)
+	{
+		root.bounds.extend(t.bounds);
+		root.centers.extend(t.centers);
+	}
+
+	if (count == 0)
+	{
+		m_minimumBounds = vec3(0.0f);
+		m_maximumBounds = vec3(0.0f);
+		return;
+	}
+
+	m_minimumBounds = root.bounds.lower;
+	m_maximumBounds = root.bounds.upper;
+
+	// The hierarchy is built one level at a time. Large tasks bin their spheres in parallel, all others are split in parallel to each other.
+	std::vector<BuildNode> buildNodes(1);
+	buildNodes.reserve(count);
+	buildNodes[0] = { root.bounds.lower, root.bounds.upper, 0, root.count, 0 };
+
+	std::vector<BuildTask> tasks = { root };
+	std::vector<BuildTask> children;
+	std::vector<BuildTask> nextTasks;
+	std::vector<unsigned char> splits;
+
+	while (!tasks.empty())
+	{
+		children.resize(2 * tasks.size());
+		splits.assign(tasks.size(), 0);
+
+		for (std::size_t i = 0; i < tasks.size(); i++)
+		{
+			if (tasks[i].count >= chunkSize)
+				splits[i] = splitTask(m_spheres.data(), m_indices.data(), tasks[i], true, children[2 * i], children[2 * i + 1]);
+		}
+
+		threadPool.parallelFor(chunkCount(tasks.size(), taskChunkSize), [&](std::size_t chunk)
+		{
+			const std::size_t last = std::min(tasks.size(), (chunk + 1) * taskChunkSize);
+
+			for (std::size_t i = chunk * taskChunkSize; i < last; i++)
+			{
+				if (tasks[i].count < chunkSize)
+					splits[i] = splitTask(m_spheres.data(), m_indices.data(), tasks[i], false, children[2 * i], children[2 * i + 1]);
+			}
+		});
+
+		nextTasks.clear();
+
+		for (std::size_t i = 0; i < tasks.size(); i++)
+		{
+			if (!splits[i])
+				continue;
+
+			const uint left = uint(buildNodes.size());
+			buildNodes[tasks[i].node].left = left;
+
+			for (uint c = 0; c < 2; c++)
+			{
+				BuildTask& child = children[2 * i + c];
+				child.node = left + c;
+				buildNodes.push_back({ child.bounds.lower, child.bounds.upper, child.first, child.count, 0 });
+				nextTasks.push_back(child);
+			}
+		}
+
+		tasks.swap(nextTasks);
+	}
+
+	collapse(buildNodes);
+}
+
+void Bvh::collapse(const std::vector<BuildNode>& buildNodes)
+{
+	m_nodes.clear();
+	m_nodes.reserve(buildNodes.size() / (width - 1) + 1);
+
+	// Every wide node starts with the two children of a binary node and repeatedly replaces the inner child with the largest
+	// surface by its children until all slots are used. Nodes are stored before their children, which refit relies on.
+	struct Entry
+	{
+		uint buildNode;
+		uint parent;
+		uint slot;
+	};
+
+	std::vector<Entry> stack = { { 0, 0, 0 } };
+
+	while (!stack.empty())
+	{
+		const Entry entry = stack.back();
+		stack.pop_back();
+
+		const uint node = uint(m_nodes.size());
+		m_nodes.emplace_back();
+
+		if (node > 0)
+			m_nodes[entry.parent].first[entry.slot] = node;
+
+		std::array<uint, width> slots;
+		std::size_t slotCount = 0;
+		const BuildNode& b = buildNodes[entry.buildNode];
+
+		if (b.left == 0)
+		{
+			slots[slotCount++] = entry.buildNode;
+		}
+		else
+		{
+			slots[slotCount++] = b.left;
+			slots[slotCount++] = b.left + 1;
+		}
+
+		while (slotCount < width)
+		{
+			std::size_t largest = width;
+			float largestArea = -1.0f;
+
+			for (std::size_t s = 0; s < slotCount; s++)
+			{
+				const BuildNode& c = buildNodes[slots[s]];
+				const vec3 e = c.upper - c.lower;
+				const float area = e.x * e.y + e.y * e.z + e.z * e.x;
+
+				if (c.left != 0 && area > largestArea)
+				{
+					largest = s;
+					largestArea = area;
+				}
+			}
+
+			if (largest == width)
+				break;
+
+			const uint left = buildNodes[slots[largest]].left;
+			slots[largest] = left;
+			slots[slotCount++] = left + 1;
+		}
+
+		Node& n = m_nodes[node];
+		n.slotCount = uint(slotCount);
+
+		for (std::size_t s = 0; s < width; s++)
+		{
+			const BuildNode& c = buildNodes[slots[std::min(s, slotCount - 1)]];
+			const bool used = s < slotCount;
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				n.lower[axis][s] = used ? c.lower[axis] : 0.0f;
+				n.upper[axis][s] = used ? c.upper[axis] : 0.0f;
+			}
+
+			n.first[s] = (used && c.left == 0) ? c.first : 0;
+			n.count[s] = (used && c.left == 0) ? c.count : 0;
+
+			if (used && c.left != 0)
+				stack.push_back({ slots[s], node, uint(s) });
+		}
+	}
+}
+
+void Bvh::refit(const vec3* positions)
+{
+	ThreadPool& threadPool = ThreadPool::instance();
+	const std::size_t count = m_spheres.size();
+
+	if (m_nodes.empty())
+		return;
+
+	threadPool.parallelFor(chunkCount(count), [&](std::size_t chunk)
+	{
+		const std::size_t last = std::min(count, (chunk + 1) * chunkSize);
+
+		for (std::size_t i = chunk * chunkSize; i < last; i++)
+			m_spheres[i] = vec4(positions[m_indices[i]], m_spheres[i].w);
+	});
+
+	// The bounds of leaves only depend on their spheres and are updated in parallel. Since every node is stored before its children,
+	// the bounds of inner children are then gathered from the back.
+	threadPool.parallelFor(chunkCount(m_nodes.size(), nodeChunkSize), [&](std::size_t chunk)
+	{
+		const std::size_t last = std::min(m_nodes.size(), (chunk + 1) * nodeChunkSize);
+
+		for (std::size_t i = chunk * nodeChunkSize; i < last; i++)
+		{
+			Node& n = m_nodes[i];
+
+			for (uint s = 0; s < n.slotCount; s++)
+			{
+				if (n.count[s] == 0)
+					continue;
+
+				Bounds b;
+
+				for (uint j = n.first[s]; j < n.first[s] + n.count[s]; j++)
+					b.extend(vec3(m_spheres[j]) - m_spheres[j].w, vec3(m_spheres[j]) + m_spheres[j].w);
+
+				for (int axis = 0; axis < 3; axis++)
+				{
+					n.lower[axis][s] = b.lower[axis];
+					n.upper[axis][s] = b.upper[axis];
+				}
+			}
+		}
+	});
+
+	auto nodeBounds = [](const Node& n)
+	{
+		Bounds b;
+
+		for (uint s = 0; s < n.slotCount; s++)
+			b.extend(vec3(n.lower[0][s], n.lower[1][s], n.lower[2][s]), vec3(n.upper[0][s], n.upper[1][s], n.upper[2][s]));
+
+		return b;
+	};
+
+	for (std::size_t i = m_nodes.size(); i-- > 0;)
+	{
+		Node& n = m_nodes[i];
+
+		for (uint s = 0; s < n.slotCount; s++)
+		{
+			if (n.count[s] != 0)
+				continue;
+
+			const Bounds b = nodeBounds(m_nodes[n.first[s]]);
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				n.lower[axis][s] = b.lower[axis];
+				n.upper[axis][s] = b.upper[axis];
+			}
+		}
+	}
+
+	const Bounds b = nodeBounds(m_nodes.front());
+	m_minimumBounds = b.lower;
+	m_maximumBounds = b.upper;
+}
+
+std::size_t Bvh::size() const
+{
+	return m_spheres.size();
+}
+
+std::size_t Bvh::nodeCount() const
+{
+	return m_nodes.size();
+}
+
+vec3 Bvh::minimumBounds() const
+{
+	return m_minimumBounds;
+}
+
+vec3 Bvh::maximumBounds() const
+{
+	return m_maximumBounds;
+}
+
+Bvh::Hit Bvh::intersect(const Ray& ray) const
+{
+	Hit hit;
+
+	if (m_nodes.empty() || dot(ray.direction, ray.direction) <= 0.0f)
+		return hit;
+
+	const TraversalRay traversalRay(ray);
+	float closest = ray.maximumDistance;
+
+	thread_local std::vector<StackEntry> stack;
+	stack.clear();
+	stack.push_back({ 0, 1, 0.0f });
+
+	alignas(32) float entries[width];
+	std::array<uint, width> rays;
+	rays.fill(1);
+
+	while (!stack.empty())
+	{
+		const StackEntry entry = stack.back();
+		stack.pop_back();
+
+		// nodes are entered no earlier than their bounds, so those behind the closest hit are skipped
+		if (entry.distance > closest)
+			continue;
+
+		const Node& n = m_nodes[entry.node];
+		const uint mask = intersectSlots(&n.lower[0][0], &n.upper[0][0], traversalRay, closest, entries) & ((1u << n.slotCount) - 1);
+		uint innerMask = 0;
+
+		for (uint s = 0; s < n.slotCount; s++)
+		{
+			if (!(mask & (1u << s)))
+				continue;
+
+			if (n.count[s] > 0)
+				intersectLeaf(m_spheres.data(), m_indices.data(), n.first[s], n.count[s], traversalRay, closest, hit);
+			else
+				innerMask |= 1u << s;
+		}
+
+		pushSlots(stack, innerMask, n.first, rays.data(), entries);
+	}
+
+	return hit;
+}
+
+void Bvh::intersectAll(const Ray& ray, std::vector<Hit>& hits) const
+{
+	hits.clear();
+
+	if (m_nodes.empty() || dot(ray.direction, ray.direction) <= 0.0f)
+		return;
+
+	const TraversalRay traversalRay(ray);
+
+	thread_local std::vector<uint> stack;
+	stack.clear();
+	stack.push_back(0);
+
+	alignas(32) float entries[width];
+
+	while (!stack.empty())
+	{
+		const Node& n = m_nodes[stack.back()];
+		stack.pop_back();
+
+		const uint mask = intersectSlots(&n.lower[0][0], &n.upper[0][0], traversalRay, ray.maximumDistance, entries);
+
+		for (uint s = 0; s < n.slotCount; s++)
+		{
+			if (!(mask & (1u << s)))
+				continue;
+
+			if (n.count[s] == 0)
+			{
+				stack.push_back(n.first[s]);
+				continue;
+			}
+
+			for (uint i = n.first[s]; i < n.first[s] + n.count[s]; i++)
+			{
+				float distance;
+
+				if (intersectSphere(m_spheres[i], traversalRay, distance) && distance <= ray.maximumDistance)
+					hits.push_back({ m_indices[i], distance });
+			}
+		}
+	}
+
+	std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b)
+	{
+		return a.distance < b.distance || (a.distance == b.distance && a.index < b.index);
+	});
+}
+
+void Bvh::intersect(const Ray* rays, std::size_t count, Hit* hits) const
+{
+	const std::size_t packetCount = chunkCount(count, packetSize);
+
+	ThreadPool::instance().parallelFor(chunkCount(packetCount, packetChunkSize), [&](std::size_t chunk)
+	{
+		const std::size_t last = std::min(packetCount, (chunk + 1) * packetChunkSize);
+
+		for (std::size_t p = chunk * packetChunkSize; p < last; p++)
+		{
+			const std::size_t first = p * packetSize;
+			intersectPacket(rays + first, std::min(packetSize, count - first), hits + first);
+		}
+	});
+}
+
+void Bvh::intersectPacket(const Ray* rays, std::size_t count, Hit* hits) const
+{
+	std::array<TraversalRay, packetSize> traversalRays;
+	std::array<float, packetSize> closest;
+	uint activeRays = 0;
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		hits[i] = Hit();
+
+		if (dot(rays[i].direction, rays[i].direction) > 0.0f)
+		{
+			traversalRays[i] = TraversalRay(rays[i]);
+			closest[i] = rays[i].maximumDistance;
+			activeRays |= 1u << i;
+		}
+	}
+
+	if (m_nodes.empty() || activeRays == 0)
+		return;
+
+	// Every node is tested against all rays of the packet that reached its parent, and children are visited by the rays
+	// that enter them, ordered by the closest entry of any of these rays
+	thread_local std::vector<StackEntry> stack;
+	stack.clear();
+	stack.push_back({ 0, activeRays, 0.0f });
+
+	alignas(32) float entries[width];
+
+	while (!stack.empty())
+	{
+		const StackEntry entry = stack.back();
+		stack.pop_back();
+
+		const Node& n = m_nodes[entry.node];
+		std::array<uint, width> slotRays;
+		std::array<float, width> slotDistances;
+		slotRays.fill(0);
+		slotDistances.fill(std::numeric_limits<float>::max());
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			if (!(entry.rays & (1u << i)))
+				continue;
+
+			const uint mask = intersectSlots(&n.lower[0][0], &n.upper[0][0], traversalRays[i], closest[i], entries);
+
+			for (uint s = 0; s < n.slotCount; s++)
+			{
+				if (mask & (1u << s))
+				{
+					slotRays[s] |= 1u << i;
+					slotDistances[s] = std::min(slotDistances[s], entries[s]);
+				}
+			}
+		}
+
+		uint innerMask = 0;
+
+		for (uint s = 0; s < n.slotCount; s++)
+		{
+			if (slotRays[s] == 0)
+				continue;
+
+			if (n.count[s] == 0)
+			{
+				innerMask |= 1u << s;
+				continue;
+			}
+
+			for (std::size_t i = 0; i < count; i++)
+			{
+				if (slotRays[s] & (1u << i))
+					intersectLeaf(m_spheres.data(), m_indices.data(), n.first[s], n.count[s], traversalRays[i], closest[i], hits[i]);
+			}
+		}
+
+		pushSlots(stack, innerMask, n.first, slotRays.data(), slotDistances.data());
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+// Number of children of a node, whose bounds are tested against a ray with a single vector instruction each
+#if defined(__AVX__)
+#define DYNAMOL_BVH_WIDTH 8
+#else
+#define DYNAMOL_BVH_WIDTH 4
+#endif
+
+namespace dynamol
+{
+	// Bounding volume hierarchy over atom spheres for ray queries such as picking. It is built top-down by binning the sphere
+	// centers along their widest axis and splitting where the surface area heuristic is lowest, one level of all nodes at a time.
+	// The binary hierarchy is then collapsed into nodes with DYNAMOL_BVH_WIDTH children, which are tested against a ray at once.
+	// If only the positions of the atoms change, as between the timesteps of a trajectory, refit updates the bounds in place.
+	class Bvh
+	{
+	public:
+		static const std::size_t width = DYNAMOL_BVH_WIDTH;
+		static const glm::uint noHit = std::numeric_limits<glm::uint>::max();
+
+		struct Ray
+		{
+			glm::vec3 origin = glm::vec3(0.0f);
+			glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+			float maximumDistance = std::numeric_limits<float>::max();
+		};
+
+		// Distances along a ray are given in multiples of the length of its direction
+		struct Hit
+		{
+			glm::uint index = noHit;
+			float distance = std::numeric_limits<float>::max();
+		};
+
+		// Builds the hierarchy over spheres with the given centers and radii
+		void build(const glm::vec3* positions, const float* radii, std::size_t count);
+
+		// Moves the spheres to new positions while keeping their radii and the structure of the hierarchy, which stays
+		// correct but becomes less efficient the further the atoms move relative to each other
+		void refit(const glm::vec3* positions);
+
+		std::size_t size() const;
+		std::size_t nodeCount() const;
+		glm::vec3 minimumBounds() const;
+		glm::vec3 maximumBounds() const;
+
+		// Returns the sphere first hit by the ray within its maximum distance, ties are resolved by the lower index.
+		// A ray starting inside of a sphere hits it where it leaves the sphere.
+		Hit intersect(const Ray& ray) const;
+
+		// Writes all spheres hit by the ray within its maximum distance by increasing distance
+		void intersectAll(const Ray& ray, std::vector<Hit>& hits) const;
+
+		// Finds the first hit of every ray, traversing the hierarchy with packets of neighboring rays that share node visits,
+		// which pays off for coherent rays such as those through adjacent pixels. Packets are processed in parallel.
+		void intersect(const Ray* rays, std::size_t count, Hit* hits) const;
+
+	private:
+		static const std::size_t packetSize = 8;
+
+		// Bounds of the children as one array per axis, so that each can be loaded into a vector register. The children are
+		// stored in the first slotCount slots. A leaf child refers to the spheres first to first + count - 1, an inner child
+		// has a count of zero and refers to a node.
+		struct alignas(32) Node
+		{
+			float lower[3][width];
+			float upper[3][width];
+			glm::uint first[width];
+			glm::uint count[width];
+			glm::uint slotCount = 0;
+		};
+
+		struct BuildNode;
+
+		void collapse(const std::vector<BuildNode>& buildNodes);
+		void intersectPacket(const Ray* rays, std::size_t count, Hit* hits) const;
+
+		std::vector<Node> m_nodes;
+
+		// center and radius of every sphere in the order of the leaves, and its index in the input
+		std::vector<glm::vec4> m_spheres;
+		std::vector<glm::uint> m_indices;
+
+		glm::vec3 m_minimumBounds = glm::vec3(0.0f);
+		glm::vec3 m_maximumBounds = glm::vec3(0.0f);
+	};
+}
@@ -0,0 +1,118 @@
+#include "BvhBenchmark.h"
+#include "Bvh.h"
+#include "Protein.h"
+#include "Benchmark.h"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace dynamol;
+using namespace glm;
+
+bool BvhBenchmark::run(const std::string& filename, std::size_t atomCount, unsigned int iterations)
+{
+	Protein protein;
+	Benchmark::Replica replica;
+
+	if (!Benchmark::replicate(filename, atomCount, 0.0f, protein, replica))
+		return false;
+
+	std::vector<vec3> positions(replica.atoms.size());
+	std::vector<float> radii(replica.atoms.size());
+
+	for (std::size_t i = 0; i < replica.atoms.size(); i++)
+	{
+		positions[i] = vec3(replica.atoms[i]);
+		radii[i] = protein.activeElementRadii()[Protein::elementIndex(floatBitsToUint(replica.atoms[i].w))];
+	}
+
+	// the next timestep moves every atom by up to half an Angstrom along each axis
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> motionDistribution(-0.5f, 0.5f);
+	std::vector<vec3> movedPositions(positions.size());
+
+	for (std::size_t i = 0; i < positions.size(); i++)
+		movedPositions[i] = positions[i] + vec3(motionDistribution(random), motionDistribution(random), motionDistribution(random));
+
+	iterations = std::max(iterations, 1u);
+
+	std::cout << "Benchmarking bounding volume hierarchy on " << positions.size() << " atoms (" << replica.copies << " copies of the first timestep of " << filename << ", "
+		<< iterations << " iterations, " << Bvh::width << " children per node)" << std::endl;
+
+	Bvh bvh;
+	const double buildTime = Benchmark::minimumTime(iterations, [&]() { bvh.build(positions.data(), radii.data(), positions.size()); });
+	const double refitTime = Benchmark::minimumTime(iterations, [&]() { bvh.refit(movedPositions.data()); });
+
+	std::cout << "  Build: " << buildTime * 1000.0 << " ms (" << double(positions.size()) / buildTime / 1e6 << " M atoms/s), " << bvh.nodeCount() << " nodes" << std::endl;
+	std::cout << "  Refit: " << refitTime * 1000.0 << " ms (" << double(positions.size()) / refitTime / 1e6 << " M atoms/s)" << std::endl;
+
+	// Picking rays start outside of the bounds and aim at random atoms of the refitted hierarchy
+	const vec3 minimum = bvh.minimumBounds();
+	const vec3 maximum = bvh.maximumBounds();
+	const vec3 center = 0.5f * (minimum + maximum);
+	const float radius = 0.5f * length(maximum - minimum);
+
+	std::uniform_int_distribution<std::size_t> atomDistribution(0, positions.size() - 1);
+	std::normal_distribution<float> directionDistribution;
+
+	const std::size_t pickCount = 1000;
+	std::vector<Bvh::Ray> pickRays(pickCount);
+
+	for (auto& ray : pickRays)
+	{
+		const vec3 direction = normalize(vec3(directionDistribution(random), directionDistribution(random), directionDistribution(random)));
+		ray.origin = center + 1.5f * radius * direction;
+		ray.direction = movedPositions[atomDistribution(random)] - ray.origin;
+	}
+
+	std::vector<Bvh::Hit> hits;
+	double pickTime = 0.0;
+	double allTime = 0.0;
+	std::size_t allHits = 0;
+
+	for (const auto& ray : pickRays)
+	{
+		pickTime += Benchmark::time([&]() { bvh.intersect(ray); });
+		allTime += Benchmark::time([&]() { bvh.intersectAll(ray, hits); });
+		allHits += hits.size();
+	}
+
+	std::cout << "  Picking: " << pickTime / double(pickCount) * 1e6 << " us per ray" << std::endl;
+	std::cout << "  All hits: " << allTime / double(pickCount) * 1e6 << " us per ray, " << double(allHits) / double(pickCount) << " atoms on average" << std::endl;
+
+	// Rays through the pixels of a view of the whole system, as traced for an image
+	const int resolution = 512;
+	std::vector<Bvh::Ray> viewRays(std::size_t(resolution) * std::size_t(resolution));
+	const vec3 eye = center + vec3(0.0f, 0.0f, 2.0f * radius);
+
+	for (int y = 0; y < resolution; y++)
+	{
+		for (int x = 0; x < resolution; x++)
+		{
+			// rays of a packet cover a block of 4 x 2 pixels
+			const std::size_t block = std::size_t(y / 2) * std::size_t(resolution / 4) + std::size_t(x / 4);
+			Bvh::Ray& ray = viewRays[block * 8 + std::size_t(y % 2) * 4 + std::size_t(x % 4)];
+			const vec2 p = (vec2(float(x), float(y)) + 0.5f) / float(resolution) * 2.0f - 1.0f;
+			ray.origin = eye;
+			ray.direction = vec3(0.6f * p.x, 0.6f * p.y, -1.0f);
+		}
+	}
+
+	std::vector<Bvh::Hit> viewHits(viewRays.size());
+
+	const double packetTime = Benchmark::minimumTime(iterations, [&]() { bvh.intersect(viewRays.data(), viewRays.size(), viewHits.data()); });
+	const std::size_t hitCount = std::count_if(viewHits.begin(), viewHits.end(), [](const Bvh::Hit& h) { return h.index != Bvh::noHit; });
+
+	const double singleTime = Benchmark::minimumTime(iterations, [&]()
+	{
+		for (std::size_t j = 0; j < viewRays.size(); j++)
+			viewHits[j] = bvh.intersect(viewRays[j]);
+	});
+
+	std::cout << "  View rays (" << resolution << " x " << resolution << ", " << hitCount << " hits): " << double(viewRays.size()) / packetTime / 1e6 << " M rays/s in packets, "
+		<< double(viewRays.size()) / singleTime / 1e6 << " M rays/s one at a time" << std::endl;
+
+	return true;
+}
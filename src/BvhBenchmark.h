@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace dynamol
+{
+	// Measures build and refit times of the bounding volume hierarchy on the first timestep of a file, replicated to the given
+	// number of atoms, as well as picking and ray packet queries. The queries are verified by the hierarchy tests on synthetic inputs.
+	class BvhBenchmark
+	{
+	public:
+		static bool run(const std::string& filename, std::size_t atomCount = 1000000, unsigned int iterations = 10);
+	};
+}
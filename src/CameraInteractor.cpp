@@ -1,6 +1,7 @@
 #include "CameraInteractor.h"
 
 #include <iostream>
+#include <sstream>
 #include <algorithm>
 
 #define GLFW_INCLUDE_NONE
@@ -38,6 +39,7 @@ CameraInteractor::CameraInteractor(Viewer * viewer) : Interactor(viewer)
 	globjects::debug() << "  Drag middle mouse - pan";
 	globjects::debug() << "  Drag right mouse - zoom";
 	globjects::debug() << "  Shift + Left mouse - light position";
+	globjects::debug() << "  Ctrl + Left mouse - pick atom";
 	globjects::debug() << "  H - toggle headlight";
 	globjects::debug() << "  B - benchmark";
 	globjects::debug() << "  Home - reset view";
@@ -294,6 +296,21 @@ void CameraInteractor::display()
 		}
 
 		ImGui::Checkbox("Headlight", &m_headlight);
+
+		// the current view as a keyframe of a benchmark camera path, the center is placed at the distance of the origin
+		if (ImGui::MenuItem("Copy Keyframe"))
+		{
+			mat4 inverseViewTransform = inverse(viewer()->viewTransform());
+			vec3 eye = vec3(inverseViewTransform * vec4(0.0f, 0.0f, 0.0f, 1.0f));
+			vec3 forward = normalize(vec3(inverseViewTransform * vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+			vec3 up = normalize(vec3(inverseViewTransform * vec4(0.0f, 1.0f, 0.0f, 0.0f)));
+			vec3 center = eye + forward * length(eye);
+
+			std::ostringstream keyframe;
+			keyframe << "{ \"frame\": 0, \"eye\": [" << eye.x << ", " << eye.y << ", " << eye.z << "], \"center\": [" << center.x << ", " << center.y << ", " << center.z << "], \"up\": [" << up.x << ", " << up.y << ", " << up.z << "] }";
+			ImGui::SetClipboardText(keyframe.str().c_str());
+		}
+
 		ImGui::EndMenu();
 	}
 	
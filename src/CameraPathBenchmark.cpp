@@ -0,0 +1,593 @@
+#include "CameraPathBenchmark.h"
+#include "SphereRenderer.h"
+#include "Viewer.h"
+#include "Scene.h"
+#include "Protein.h"
+
+#include <glbinding/gl/gl.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+
+namespace
+{
+	// A JSON value, which is enough for scenario files
+	struct JsonValue
+	{
+		enum class Type { Null, Boolean, Number, String, Array, Object };
+
+		Type type = Type::Null;
+		bool boolean = false;
+		double number = 0.0;
+		std::string string;
+		std::vector<JsonValue> array;
+		std::vector< std::pair<std::string, JsonValue> > object;
+
+		const JsonValue* find(const std::string& key) const
+		{
+			for (const auto& o : object)
+			{
+				if (o.first == key)
+					return &o.second;
+			}
+
+			return nullptr;
+		}
+	};
+
+	class JsonParser
+	{
+	public:
+		JsonParser(const std::string& text) : m_text(text)
+		{
+		}
+
+		bool parse(JsonValue& value)
+		{
+			if (!parseValue(value))
+				return false;
+
+			skipWhitespace();
+			return m_position == m_text.size();
+		}
+
+		std::size_t position() const
+		{
+			return m_position;
+		}
+
+	private:
+		void skipWhitespace()
+		{
+			while (m_position < m_text.size() && std::isspace((unsigned char)m_text[m_position]))
+				m_position++;
+		}
+
+		bool consume(char c)
+		{
+			skipWhitespace();
+
+			if (m_position < m_text.size() && m_text[m_position] == c)
+			{
+				m_position++;
+				return true;
+			}
+
+			return false;
+		}
+
+		bool consumeWord(const char* word)
+		{
+			const std::size_t length = std::char_traits<char>::length(word);
+
+			if (m_text.compare(m_position, length, word) != 0)
+				return false;
+
+			m_position += length;
+			return true;
+		}
+
+		bool parseString(std::string& string)
+		{
+			if (!consume('"'))
+				return false;
+
+			while (m_position < m_text.size())
+			{
+				const char c = m_text[m_position++];
+
+				if (c == '"')
+					return true;
+
+				if (c != '\\')
+				{
+					string += c;
+					continue;
+				}
+
+				if (m_position >= m_text.size())
+					return false;
+
+				// unicode escapes are not needed for names and paths and are kept as they are
+				const char e = m_text[m_position++];
+
+				switch (e)
+				{
+				case 'n': string += '\n'; break;
+				case 't': string += '\t'; break;
+				case 'r': string += '\r'; break;
+				case 'b': string += '\b'; break;
+				case 'f': string += '\f'; break;
+				case 'u': string += "\\u"; break;
+				default: string += e; break;
+				}
+			}
+
+			return false;
+		}
+
+		bool parseValue(JsonValue& value)
+		{
+			skipWhitespace();
+
+			if (m_position >= m_text.size())
+				return false;
+
+			const char c = m_text[m_position];
+
+			if (c == '{')
+			{
+				m_position++;
+				value.type = JsonValue::Type::Object;
+
+				if (consume('}'))
+					return true;
+
+				do
+				{
+					std::pair<std::string, JsonValue> member;
+
+					if (!parseString(member.first) || !consume(':') || !parseValue(member.second))
+						return false;
+
+					value.object.push_back(std::move(member));
+				} while (consume(','));
+
+				return consume('}');
+			}
+
+			if (c == '[')
+			{
+				m_position++;
+				value.type = JsonValue::Type::Array;
+
+				if (consume(']'))
+					return true;
+
+				do
+				{
+					value.array.emplace_back();
+
+					if (!parseValue(value.array.back()))
+						return false;
+				} while (consume(','));
+
+				return consume(']');
+			}
+
+			if (c == '"')
+			{
+				value.type = JsonValue::Type::String;
+				return parseString(value.string);
+			}
+
+			if (consumeWord("true") || consumeWord("false"))
+			{
+				value.type = JsonValue::Type::Boolean;
+				value.boolean = (c == 't');
+				return true;
+			}
+
+			if (consumeWord("null"))
+				return true;
+
+			const char* begin = m_text.c_str() + m_position;
+			char* end = nullptr;
+			value.type = JsonValue::Type::Number;
+			value.number = std::strtod(begin, &end);
+
+			if (end == begin)
+				return false;
+
+			m_position += std::size_t(end - begin);
+			return true;
+		}
+
+		const std::string& m_text;
+		std::size_t m_position = 0;
+	};
+
+	struct Keyframe
+	{
+		double frame;
+		vec3 eye;
+		vec3 center;
+		vec3 up;
+	};
+
+	bool readVector(const JsonValue* value, vec3& vector)
+	{
+		if (!value || value->type != JsonValue::Type::Array || value->array.size() != 3)
+			return false;
+
+		for (int i = 0; i < 3; i++)
+		{
+			if (value->array[i].type != JsonValue::Type::Number)
+				return false;
+
+			vector[i] = float(value->array[i].number);
+		}
+
+		return true;
+	}
+
+	// Interpolates between unit vectors along the great circle through them, so that keyframes around the center orbit it
+	vec3 slerp(const vec3& a, const vec3& b, float t)
+	{
+		const float angle = std::acos(clamp(dot(a, b), -1.0f, 1.0f));
+
+		if (angle < 1e-4f || angle > pi<float>() - 1e-3f)
+			return normalize(mix(a, b, t) + vec3(1e-6f));
+
+		return (std::sin((1.0f - t) * angle) * a + std::sin(t * angle) * b) / std::sin(angle);
+	}
+
+	mat4 cameraAt(const std::vector<Keyframe>& keyframes, double frame)
+	{
+		std::size_t next = 0;
+
+		while (next < keyframes.size() && keyframes[next].frame <= frame)
+			next++;
+
+		const Keyframe& a = keyframes[next > 0 ? next - 1 : 0];
+		const Keyframe& b = keyframes[std::min(next, keyframes.size() - 1)];
+		const float t = (b.frame > a.frame) ? float((frame - a.frame) / (b.frame - a.frame)) : 0.0f;
+
+		// the direction from the center is interpolated separately from the distance
+		const vec3 center = mix(a.center, b.center, t);
+		const float distanceA = length(a.eye - a.center);
+		const float distanceB = length(b.eye - b.center);
+		const vec3 direction = slerp((a.eye - a.center) / std::max(distanceA, 1e-6f), (b.eye - b.center) / std::max(distanceB, 1e-6f), t);
+		const vec3 eye = center + direction * mix(distanceA, distanceB, t);
+		const vec3 up = normalize(mix(a.up, b.up, t));
+
+		return lookAt(eye, center, up);
+	}
+
+	struct Statistics
+	{
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+	};
+
+	// percentiles by the nearest rank
+	Statistics statistics(std::vector<double> values)
+	{
+		Statistics s;
+
+		if (values.empty())
+			return s;
+
+		std::sort(values.begin(), values.end());
+
+		for (double v : values)
+			s.mean += v;
+
+		s.mean /= double(values.size());
+
+		const auto percentile = [&values](double p)
+		{
+			const std::size_t rank = std::size_t(std::ceil(p / 100.0 * double(values.size())));
+			return values[std::min(std::max(rank, std::size_t(1)), values.size()) - 1];
+		};
+
+		s.p50 = percentile(50.0);
+		s.p95 = percentile(95.0);
+		s.p99 = percentile(99.0);
+
+		return s;
+	}
+
+	std::string escape(const std::string& text)
+	{
+		std::string result;
+
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				result += '\\';
+
+			result += c;
+		}
+
+		return result;
+	}
+
+	void writeStatistics(std::ostream& stream, const Statistics& s)
+	{
+		stream << "{\"mean\":" << s.mean << ",\"p50\":" << s.p50 << ",\"p95\":" << s.p95 << ",\"p99\":" << s.p99 << "}";
+	}
+
+	void printStatistics(const std::string& name, const Statistics& s)
+	{
+		std::cout << "  " << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3);
+		std::cout << " mean " << std::setw(8) << s.mean << "  p50 " << std::setw(8) << s.p50 << "  p95 " << std::setw(8) << s.p95 << "  p99 " << std::setw(8) << s.p99 << " ms" << std::endl;
+	}
+}
+
+bool CameraPathBenchmark::run(GLFWwindow* window, const std::string& scenarioFilename, const std::string& outputFilename)
+{
+	std::ifstream scenarioFile(scenarioFilename);
+
+	if (!scenarioFile)
+	{
+		std::cout << "Could not open scenario " << scenarioFilename << "." << std::endl;
+		return false;
+	}
+
+	std::stringstream buffer;
+	buffer << scenarioFile.rdbuf();
+	const std::string text = buffer.str();
+
+	JsonValue scenario;
+	JsonParser parser(text);
+
+	if (!parser.parse(scenario) || scenario.type != JsonValue::Type::Object)
+	{
+		std::cout << "Could not parse scenario " << scenarioFilename << " at character " << parser.position() << "." << std::endl;
+		return false;
+	}
+
+	std::string name = std::filesystem::path(scenarioFilename).stem().string();
+	std::string molecule = "./dat/6b0x.pdb";
+	std::string trajectory;
+	ivec2 size(1280, 720);
+	unsigned int warmupFrames = 60;
+	unsigned int frameCount = 360;
+	double timestep = 1.0 / 60.0;
+	std::vector<Keyframe> keyframes;
+
+	if (const JsonValue* v = scenario.find("name"); v && v->type == JsonValue::Type::String)
+		name = v->string;
+
+	if (const JsonValue* v = scenario.find("molecule"); v && v->type == JsonValue::Type::String)
+		molecule = v->string;
+
+	if (const JsonValue* v = scenario.find("trajectory"); v && v->type == JsonValue::Type::String)
+		trajectory = v->string;
+
+	if (const JsonValue* v = scenario.find("size"); v && v->type == JsonValue::Type::Array && v->array.size() == 2)
+		size = ivec2(int(v->array[0].number), int(v->array[1].number));
+
+	if (const JsonValue* v = scenario.find("warmupFrames"); v && v->type == JsonValue::Type::Number)
+		warmupFrames = unsigned(std::max(v->number, 0.0));
+
+	if (const JsonValue* v = scenario.find("frames"); v && v->type == JsonValue::Type::Number)
+		frameCount = unsigned(std::max(v->number, 1.0));
+
+	if (const JsonValue* v = scenario.find("timestep"); v && v->type == JsonValue::Type::Number)
+		timestep = std::max(v->number, 0.0);
+
+	// Options are passed on as they would be given on the command line of the batch renderer, once the viewer exists
+	std::vector<std::pair<std::string, std::string>> options;
+
+	if (const JsonValue* settings = scenario.find("settings"); settings && settings->type == JsonValue::Type::Object)
+	{
+		for (const auto& s : settings->object)
+		{
+			std::string value = s.second.string;
+
+			if (s.second.type == JsonValue::Type::Boolean)
+			{
+				value = s.second.boolean ? "on" : "off";
+			}
+			else if (s.second.type == JsonValue::Type::Number)
+			{
+				std::ostringstream stream;
+				stream << s.second.number;
+				value = stream.str();
+			}
+
+			options.emplace_back(s.first, value);
+		}
+	}
+
+	if (const JsonValue* camera = scenario.find("camera"); camera && camera->type == JsonValue::Type::Array)
+	{
+		for (const auto& k : camera->array)
+		{
+			Keyframe keyframe = { 0.0, vec3(0.0f, 0.0f, -3.0f * sqrt(3.0f)), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f) };
+
+			if (const JsonValue* frame = k.find("frame"); frame && frame->type == JsonValue::Type::Number)
+				keyframe.frame = frame->number;
+
+			readVector(k.find("eye"), keyframe.eye);
+			readVector(k.find("center"), keyframe.center);
+			readVector(k.find("up"), keyframe.up);
+			keyframes.push_back(keyframe);
+		}
+	}
+
+	// without a camera path, the model is seen from the initial view of the camera interactor
+	if (keyframes.empty())
+		keyframes.push_back({ 0.0, vec3(0.0f, 0.0f, -3.0f * sqrt(3.0f)), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f) });
+
+	std::stable_sort(keyframes.begin(), keyframes.end(), [](const Keyframe& a, const Keyframe& b) { return a.frame < b.frame; });
+
+	if (size.x <= 0 || size.y <= 0)
+	{
+		std::cout << "Invalid size in scenario " << scenarioFilename << "." << std::endl;
+		return false;
+	}
+
+	Scene scene;
+	Protein* protein = scene.protein();
+	protein->load(molecule);
+
+	if (!trajectory.empty())
+		protein->loadTrajectory(trajectory);
+
+	if (protein->timestepCount() == 0 || protein->atomCount(0) == 0)
+	{
+		std::cout << "The molecule " << molecule << " contains no atoms." << std::endl;
+		return false;
+	}
+
+	// the window is resized before the viewer sets up its projection
+	glfwSetWindowSize(window, size.x, size.y);
+	glfwPollEvents();
+
+	auto viewer = std::make_unique<Viewer>(window, &scene);
+	viewer->setUiVisible(false);
+	viewer->setTimestep(timestep);
+
+	for (const auto& o : options)
+	{
+		if (!viewer->sphereRenderer()->setOption(o.first, o.second))
+		{
+			std::cout << "Invalid option " << o.first << "=" << o.second << " in scenario " << scenarioFilename << "." << std::endl;
+			return false;
+		}
+	}
+
+	const vec3 boundingBoxSize = protein->maximumBounds() - protein->minimumBounds();
+	const float maximumSize = std::max(boundingBoxSize.x, std::max(boundingBoxSize.y, boundingBoxSize.z));
+	mat4 modelTransform = scale(vec3(2.0f) / vec3(maximumSize));
+	modelTransform = modelTransform * translate(-0.5f * (protein->minimumBounds() + protein->maximumBounds()));
+	viewer->setModelTransform(modelTransform);
+
+	const ivec2 viewportSize = viewer->viewportSize();
+	std::cout << "Running scenario " << name << " on " << molecule << " at " << viewportSize.x << " x " << viewportSize.y << " (" << warmupFrames << " warmup frames, " << frameCount << " frames)" << std::endl;
+
+	// The warmup frames compile shaders, upload the timesteps and size the buffers from the first view of the path
+	for (unsigned int i = 0; i < warmupFrames; i++)
+	{
+		viewer->setViewTransform(cameraAt(keyframes, 0.0));
+		glfwPollEvents();
+		viewer->display();
+		glfwSwapBuffers(window);
+	}
+
+	glFinish();
+
+	Profiler* profiler = viewer->profiler();
+	profiler->startRecording();
+
+	std::vector<double> frameTimes;
+	frameTimes.reserve(frameCount);
+	auto frameStart = std::chrono::high_resolution_clock::now();
+
+	for (unsigned int i = 0; i < frameCount; i++)
+	{
+		viewer->setViewTransform(cameraAt(keyframes, double(i)));
+		glfwPollEvents();
+		viewer->display();
+		glfwSwapBuffers(window);
+
+		const auto frameEnd = std::chrono::high_resolution_clock::now();
+		frameTimes.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+		frameStart = frameEnd;
+	}
+
+	const std::vector<Profiler::FrameTimes> passTimes = profiler->stopRecording();
+	const std::size_t passCount = profiler->passCount();
+	const std::size_t recordedCount = std::min(passTimes.size(), frameTimes.size());
+
+	std::vector< std::vector<double> > cpuTimes(passCount);
+	std::vector< std::vector<double> > gpuTimes(passCount);
+
+	// passes that first appeared in a later frame did not run in the earlier ones
+	for (std::size_t f = 0; f < recordedCount; f++)
+	{
+		for (std::size_t p = 0; p < passCount; p++)
+		{
+			cpuTimes[p].push_back(p < passTimes[f].cpuTimes.size() ? passTimes[f].cpuTimes[p] : 0.0);
+			gpuTimes[p].push_back(p < passTimes[f].gpuTimes.size() ? passTimes[f].gpuTimes[p] : 0.0);
+		}
+	}
+
+	const std::string output = outputFilename.empty() ? name + "-results" : outputFilename;
+	bool success = true;
+
+	std::ofstream csv(output + ".csv");
+	csv << std::fixed << std::setprecision(4) << "frame,frame time";
+
+	for (std::size_t p = 0; p < passCount; p++)
+		csv << ",\"" << profiler->passName(p) << " gpu\",\"" << profiler->passName(p) << " cpu\"";
+
+	csv << "\n";
+
+	for (std::size_t f = 0; f < recordedCount; f++)
+	{
+		csv << f << "," << frameTimes[f];
+
+		for (std::size_t p = 0; p < passCount; p++)
+			csv << "," << gpuTimes[p][f] << "," << cpuTimes[p][f];
+
+		csv << "\n";
+	}
+
+	success = success && bool(csv);
+
+	const Statistics frameStatistics = statistics(frameTimes);
+
+	std::ofstream json(output + ".json");
+	json << std::fixed << std::setprecision(4);
+	json << "{\"scenario\":\"" << escape(name) << "\",\"molecule\":\"" << escape(molecule) << "\",\"size\":[" << viewportSize.x << "," << viewportSize.y << "],";
+	json << "\"frames\":" << recordedCount << ",\"frameTime\":";
+	writeStatistics(json, frameStatistics);
+	json << ",\"passes\":[";
+
+	std::cout << "Times in milliseconds over " << recordedCount << " frames:" << std::endl;
+	printStatistics("frame", frameStatistics);
+
+	for (std::size_t p = 0; p < passCount; p++)
+	{
+		const Statistics gpu = statistics(gpuTimes[p]);
+		const Statistics cpu = statistics(cpuTimes[p]);
+
+		json << (p > 0 ? "," : "") << "\n{\"name\":\"" << escape(profiler->passName(p)) << "\",\"gpu\":";
+		writeStatistics(json, gpu);
+		json << ",\"cpu\":";
+		writeStatistics(json, cpu);
+		json << "}";
+
+		printStatistics(profiler->passName(p) + " (GPU)", gpu);
+	}
+
+	json << "\n]}\n";
+	success = success && bool(json);
+
+	if (success)
+		std::cout << "Results written to " << output << ".csv and " << output << ".json" << std::endl;
+	else
+		std::cout << "Could not write results to " << output << ".csv and " << output << ".json" << std::endl;
+
+	return success;
+}
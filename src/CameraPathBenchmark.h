@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+struct GLFWwindow;
+
+namespace dynamol
+{
+	// Renders a scenario described in a JSON file and reports the frame time and the CPU and GPU time of every pass of the
+	// profiler as mean, median, 95th and 99th percentile. A scenario names the molecule, the options of the renderer as accepted by
+	// SphereRenderer::setOption, the window size, the number of warmup and measured frames, and a camera path of keyframes:
+	//
+	//   {
+	//     "name": "spin", "molecule": "./dat/6b0x.pdb", "size": [1280, 720],
+	//     "settings": { "ambient-occlusion": true, "coloring": 2, "resolution-scale": 1.0 },
+	//     "warmupFrames": 60, "frames": 360, "timestep": 0.016667,
+	//     "camera": [ { "frame": 0, "eye": [0, 0, -5.196], "center": [0, 0, 0], "up": [0, 1, 0] }, ... ]
+	//   }
+	//
+	// Positions are given in the space of the model scaled to the canonical view volume, like the initial view of the camera
+	// interactor. The times of every frame are written to <output>.csv and the statistics to <output>.json. Requires a window
+	// with a current OpenGL context.
+	class CameraPathBenchmark
+	{
+	public:
+		static bool run(GLFWwindow* window, const std::string& scenarioFilename, const std::string& outputFilename = "");
+	};
+}
@@ -0,0 +1,376 @@
+#include "CellList.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <utility>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// atoms or cells processed by a single invocation of the parallel loops
+	const std::size_t chunkSize = 64 * 1024;
+
+	std::size_t chunkCount(std::size_t count)
+	{
+		return (count + chunkSize - 1) / chunkSize;
+	}
+
+	inline vec3 position(const vec3& p)
+	{
+		return p;
+	}
+
+	inline vec3 position(const vec4& p)
+	{
+		return vec3(p);
+	}
+
+	// squared distance of a point to a box, zero inside of it
+	inline float squaredDistance(const vec3& p, const vec3& lower, const vec3& upper)
+	{
+		const vec3 d = max(max(lower - p, p - upper), vec3(0.0f));
+		return dot(d, d);
+	}
+}
+
+void CellList::build(const vec3* positions, std::size_t count, const vec3& minimum, const vec3& maximum, float cellSize)
+{
+	buildCells(positions, count, minimum, maximum, cellSize);
+}
+
+void CellList::build(const vec4* atoms, std::size_t count, const vec3& minimum, const vec3& maximum, float cellSize)
+{
+	buildCells(atoms, count, minimum, maximum, cellSize);
+}
+
+template <typename Position>
+void CellList::buildCells(const Position* positions, std::size_t count, const vec3& minimum, const vec3& maximum, float cellSize)
+{
+	ThreadPool& threadPool = ThreadPool::instance();
+
+	m_minimum = minimum;
+	m_cellSize = cellSize;
+	m_cellCounts = gridSize(maximum - minimum, count, m_cellSize);
+	m_inverseCellSize = 1.0f / m_cellSize;
+
+	const std::size_t cellCount = std::size_t(m_cellCounts.x) * std::size_t(m_cellCounts.y) * std::size_t(m_cellCounts.z);
+
+	if (m_cellSizesCapacity < cellCount)
+	{
+		m_cellSizes = std::make_unique<std::atomic<uint>[]>(cellCount);
+		m_cellSizesCapacity = cellCount;
+	}
+
+	m_cells.resize(count);
+	m_ranks.resize(count);
+	m_cellStarts.resize(cellCount + 1);
+	m_sortedIndices.resize(count);
+	m_sortedPositions.resize(count);
+
+	threadPool.parallelFor(chunkCount(cellCount), [&](std::size_t chunk)
+	{
+		const std::size_t last = std::min(cellCount, (chunk + 1) * chunkSize);
+
+		for (std::size_t i = chunk * chunkSize; i < last; i++)
+			m_cellSizes[i].store(0, std::memory_order_relaxed);
+	});
+
+	// Every atom is counted in its cell and remembers its rank among the atoms of the cell, which determines its place after sorting
+	const std::size_t atomChunkCount = chunkCount(count);
+	std::vector< std::pair<vec3, vec3> > chunkBounds(atomChunkCount, { vec3(std::numeric_limits<float>::max()), vec3(-std::numeric_limits<float>::max()) });
+
+	threadPool.parallelFor(atomChunkCount, [&](std::size_t chunk)
+	{
+		const std::size_t last = std::min(count, (chunk + 1) * chunkSize);
+		vec3 lower = chunkBounds[chunk].first;
+		vec3 upper = chunkBounds[chunk].second;
+
+		for (std::size_t i = chunk * chunkSize; i < last; i++)
+		{
+			const vec3 p = position(positions[i]);
+			const uint c = uint(cellIndex(cell(p)));
+
+			m_cells[i] = c;
+			m_ranks[i] = m_cellSizes[c].fetch_add(1, std::memory_order_relaxed);
+			lower = min(lower, p);
+			upper = max(upper, p);
+		}
+
+		chunkBounds[chunk] = { lower, upper };
+	});
+
+	m_lowerBounds = vec3(std::numeric_limits<float>::max());
+	m_upperBounds = vec3(-std::numeric_limits<float>::max());
+
+	for (const auto& b : chunkBounds)
+	{
+		m_lowerBounds = min(m_lowerBounds, b.first);
+		m_upperBounds = max(m_upperBounds, b.second);
+	}
+
+	// Exclusive prefix sum over the cell sizes, first within chunks of cells and then across them
+	const std::size_t cellChunkCount = chunkCount(cellCount);
+	std::vector<uint> chunkOffsets(cellChunkCount + 1, 0);
+
+	threadPool.parallelFor(cellChunkCount, [&](std::size_t chunk)
+	{
+		const std::size_t last = std::min(cellCount, (chunk + 1) * chunkSize);
+		uint sum = 0;
+
+		for (std::size_t i = chunk * chunkSize; i < last; i++)
+		{
+			m_cellStarts[i] = sum;
+			sum += m_cellSizes[i].load(std::memory_order_relaxed);
+		}
+
+		chunkOffsets[chunk + 1] = sum;
+	});
+
+	for (std::size_t i = 0; i < cellChunkCount; i++)
+		chunkOffsets[i + 1] += chunkOffsets[i];
+
+	threadPool.parallelFor(cellChunkCount, [&](std::size_t chunk)
+	{
+		const std::size_t last = std::min(cellCount, (chunk + 1) * chunkSize);
+
+		for (std::size_t i = chunk * chunkSize; i < last; i++)
+			m_cellStarts[i] += chunkOffsets[chunk];
+	});
+
+	m_cellStarts[cellCount] = uint(count);
+
+	threadPool.parallelFor(atomChunkCount, [&](std::size_t chunk)
+	{
+		const std::size_t last = std::min(count, (chunk + 1) * chunkSize);
+
+		for (std::size_t i = chunk * chunkSize; i < last; i++)
+		{
+			const uint j = m_cellStarts[m_cells[i]] + m_ranks[i];
+			m_sortedIndices[j] = uint(i);
+			m_sortedPositions[j] = position(positions[i]);
+		}
+	});
+}
+
+ivec3 CellList::gridSize(const vec3& extent, std::size_t count, float& cellSize)
+{
+	cellSize = std::max(cellSize, 1.0f / 1024.0f);
+
+	while (true)
+	{
+		const ivec3 cellCounts = ivec3(max(extent, vec3(0.0f)) / cellSize) + 1;
+
+		if (double(cellCounts.x) * double(cellCounts.y) * double(cellCounts.z) <= 4.0 * double(count) + 64.0)
+			return cellCounts;
+
+		cellSize *= 2.0f;
+	}
+}
+
+std::size_t CellList::size() const
+{
+	return m_sortedIndices.size();
+}
+
+float CellList::cellSize() const
+{
+	return m_cellSize;
+}
+
+ivec3 CellList::cellCounts() const
+{
+	return m_cellCounts;
+}
+
+vec3 CellList::minimum() const
+{
+	return m_minimum;
+}
+
+ivec3 CellList::cell(const vec3& position) const
+{
+	// the comparison also moves NaN coordinates into the first cell
+	const vec3 c = (position - m_minimum) * m_inverseCellSize;
+	ivec3 result;
+
+	for (int i = 0; i < 3; i++)
+		result[i] = c[i] >= 0.0f ? int(std::min(c[i], float(m_cellCounts[i] - 1))) : 0;
+
+	return result;
+}
+
+std::size_t CellList::cellIndex(const ivec3& cell) const
+{
+	return (std::size_t(cell.z) * std::size_t(m_cellCounts.y) + std::size_t(cell.y)) * std::size_t(m_cellCounts.x) + std::size_t(cell.x);
+}
+
+const std::vector<uint>& CellList::cellStarts() const
+{
+	return m_cellStarts;
+}
+
+const std::vector<uint>& CellList::sortedIndices() const
+{
+	return m_sortedIndices;
+}
+
+const std::vector<vec3>& CellList::sortedPositions() const
+{
+	return m_sortedPositions;
+}
+
+void CellList::range(const vec3& position, float radius, std::vector<uint>& indices) const
+{
+	indices.clear();
+
+	const float squaredRadius = radius * radius;
+
+	if (m_sortedIndices.empty() || squaredDistance(position, m_lowerBounds, m_upperBounds) > squaredRadius)
+		return;
+
+	const ivec3 c0 = cell(position - vec3(radius));
+	const ivec3 c1 = cell(position + vec3(radius));
+
+	for (int z = c0.z; z <= c1.z; z++)
+	{
+		for (int y = c0.y; y <= c1.y; y++)
+		{
+			// cells of a row are consecutive, so their atoms are as well
+			const std::size_t row = cellIndex(ivec3(0, y, z));
+
+			for (uint k = m_cellStarts[row + c0.x]; k < m_cellStarts[row + c1.x + 1]; k++)
+			{
+				const vec3 d = m_sortedPositions[k] - position;
+
+				if (dot(d, d) <= squaredRadius)
+					indices.push_back(m_sortedIndices[k]);
+			}
+		}
+	}
+}
+
+bool CellList::contains(const vec3& position, float radius) const
+{
+	const float squaredRadius = radius * radius;
+
+	if (m_sortedIndices.empty() || squaredDistance(position, m_lowerBounds, m_upperBounds) > squaredRadius)
+		return false;
+
+	const ivec3 c0 = cell(position - vec3(radius));
+	const ivec3 c1 = cell(position + vec3(radius));
+
+	for (int z = c0.z; z <= c1.z; z++)
+	{
+		for (int y = c0.y; y <= c1.y; y++)
+		{
+			const std::size_t row = cellIndex(ivec3(0, y, z));
+
+			for (uint k = m_cellStarts[row + c0.x]; k < m_cellStarts[row + c1.x + 1]; k++)
+			{
+				const vec3 d = m_sortedPositions[k] - position;
+
+				if (dot(d, d) <= squaredRadius)
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void CellList::nearest(const vec3& position, std::size_t k, std::vector<uint>& indices) const
+{
+	indices.clear();
+	k = std::min(k, m_sortedIndices.size());
+
+	if (k == 0)
+		return;
+
+	// The cells are visited in shells of growing distance around the cell of the position. Atoms in unvisited cells lie beyond
+	// a face of the visited block, so the search ends once the k closest candidates are closer than all faces that have cells beyond them.
+	using Candidate = std::pair<float, uint>;
+	std::priority_queue<Candidate> candidates;
+
+	const ivec3 center = cell(position);
+	const ivec3 shells = max(center, m_cellCounts - 1 - center);
+	const int maximumShell = std::max(shells.x, std::max(shells.y, shells.z));
+
+	auto visit = [&](std::size_t cell)
+	{
+		for (uint i = m_cellStarts[cell]; i < m_cellStarts[cell + 1]; i++)
+		{
+			const vec3 d = m_sortedPositions[i] - position;
+			const Candidate candidate(dot(d, d), m_sortedIndices[i]);
+
+			if (candidates.size() < k)
+			{
+				candidates.push(candidate);
+			}
+			else if (candidate < candidates.top())
+			{
+				candidates.pop();
+				candidates.push(candidate);
+			}
+		}
+	};
+
+	for (int shell = 0; shell <= maximumShell; shell++)
+	{
+		const ivec3 c0 = max(center - shell, ivec3(0));
+		const ivec3 c1 = min(center + shell, m_cellCounts - 1);
+
+		for (int z = c0.z; z <= c1.z; z++)
+		{
+			for (int y = c0.y; y <= c1.y; y++)
+			{
+				const std::size_t row = cellIndex(ivec3(0, y, z));
+
+				// only the cells on the surface of the shell have not been visited before
+				if (std::abs(z - center.z) == shell || std::abs(y - center.y) == shell)
+				{
+					for (int x = c0.x; x <= c1.x; x++)
+						visit(row + x);
+				}
+				else
+				{
+					if (center.x - shell >= 0)
+						visit(row + center.x - shell);
+
+					if (center.x + shell < m_cellCounts.x)
+						visit(row + center.x + shell);
+				}
+			}
+		}
+
+		if (candidates.size() == k)
+		{
+			const vec3 lower = m_minimum + vec3(c0) * m_cellSize;
+			const vec3 upper = m_minimum + vec3(c1 + 1) * m_cellSize;
+			float bound = std::numeric_limits<float>::max();
+
+			for (int i = 0; i < 3; i++)
+			{
+				if (c0[i] > 0)
+					bound = std::min(bound, std::max(position[i] - lower[i], 0.0f));
+
+				if (c1[i] < m_cellCounts[i] - 1)
+					bound = std::min(bound, std::max(upper[i] - position[i], 0.0f));
+			}
+
+			if (candidates.top().first <= bound * bound)
+				break;
+		}
+	}
+
+	indices.resize(candidates.size());
+
+	for (std::size_t i = candidates.size(); i > 0; i--)
+	{
+		indices[i - 1] = candidates.top().second;
+		candidates.pop();
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+namespace dynamol
+{
+	// Spatial index that sorts atoms into a uniform grid of cubic cells, so that all atoms within a distance of a point are found
+	// in the cells overlapping a sphere around it. The atoms are bucketed by a parallel counting sort, which makes rebuilding
+	// the index for every timestep cheap. Positions outside of the bounds given to build are stored in the nearest border cell.
+	class CellList
+	{
+	public:
+		// Builds the index over the given bounds, usually those of Protein. Cells are no smaller than cellSize, but are enlarged
+		// until there are at most four per atom, so sparse or tiny inputs do not allocate huge grids.
+		void build(const glm::vec3* positions, std::size_t count, const glm::vec3& minimum, const glm::vec3& maximum, float cellSize);
+
+		// Builds the index for atoms as returned by Protein::loadTimestep, the attributes in w are ignored
+		void build(const glm::vec4* atoms, std::size_t count, const glm::vec3& minimum, const glm::vec3& maximum, float cellSize);
+
+		// Number of cells along each axis for the extent of the bounds, enlarging cellSize as described for build
+		static glm::ivec3 gridSize(const glm::vec3& extent, std::size_t count, float& cellSize);
+
+		std::size_t size() const;
+		float cellSize() const;
+		glm::ivec3 cellCounts() const;
+		glm::vec3 minimum() const;
+
+		// Cell of a position, clamped to the grid
+		glm::ivec3 cell(const glm::vec3& position) const;
+		std::size_t cellIndex(const glm::ivec3& cell) const;
+
+		// The atoms of cell i are sortedIndices()[cellStarts()[i]] to sortedIndices()[cellStarts()[i + 1] - 1]
+		const std::vector<glm::uint>& cellStarts() const;
+		const std::vector<glm::uint>& sortedIndices() const;
+		const std::vector<glm::vec3>& sortedPositions() const;
+
+		// Writes the indices of all atoms within the radius around the position in no particular order
+		void range(const glm::vec3& position, float radius, std::vector<glm::uint>& indices) const;
+
+		// Returns whether any atom is within the radius around the position, stopping at the first one found
+		bool contains(const glm::vec3& position, float radius) const;
+
+		// Writes the indices of the k atoms closest to the position by increasing distance, ties are ordered by index
+		void nearest(const glm::vec3& position, std::size_t k, std::vector<glm::uint>& indices) const;
+
+	private:
+		template <typename Position>
+		void buildCells(const Position* positions, std::size_t count, const glm::vec3& minimum, const glm::vec3& maximum, float cellSize);
+
+		float m_cellSize = 1.0f;
+		float m_inverseCellSize = 1.0f;
+		glm::ivec3 m_cellCounts = glm::ivec3(1);
+		glm::vec3 m_minimum = glm::vec3(0.0f);
+
+		// bounds of the stored positions, which may exceed the grid
+		glm::vec3 m_lowerBounds = glm::vec3(0.0f);
+		glm::vec3 m_upperBounds = glm::vec3(0.0f);
+
+		std::vector<glm::uint> m_cellStarts;
+		std::vector<glm::uint> m_sortedIndices;
+		std::vector<glm::vec3> m_sortedPositions;
+
+		// cell and rank within the cell of every atom, kept between builds to avoid reallocation
+		std::vector<glm::uint> m_cells;
+		std::vector<glm::uint> m_ranks;
+		std::unique_ptr<std::atomic<glm::uint>[]> m_cellSizes;
+		std::size_t m_cellSizesCapacity = 0;
+	};
+}
@@ -0,0 +1,71 @@
+#include "CellListBenchmark.h"
+#include "CellList.h"
+#include "Protein.h"
+#include "Benchmark.h"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace dynamol;
+using namespace glm;
+
+bool CellListBenchmark::run(const std::string& filename, std::size_t atomCount, unsigned int iterations)
+{
+	Protein protein;
+	Benchmark::Replica replica;
+
+	if (!Benchmark::replicate(filename, atomCount, 0.0f, protein, replica))
+		return false;
+
+	const std::vector<vec4>& frame = replica.atoms;
+	const vec3 minimum = replica.minimumBounds;
+	const vec3 maximum = replica.maximumBounds;
+	const float cellSize = 4.0f;
+
+	iterations = std::max(iterations, 1u);
+
+	std::cout << "Benchmarking cell list on " << frame.size() << " atoms (" << replica.copies << " copies of the first timestep of " << filename << ", " << iterations << " iterations)" << std::endl;
+
+	CellList cellList;
+	const double buildTime = Benchmark::minimumTime(iterations, [&]() { cellList.build(frame.data(), frame.size(), minimum, maximum, cellSize); });
+
+	const ivec3 cellCounts = cellList.cellCounts();
+	std::cout << "  Build: " << buildTime * 1000.0 << " ms (" << double(frame.size()) / buildTime / 1e6 << " M atoms/s), "
+		<< cellCounts.x << " x " << cellCounts.y << " x " << cellCounts.z << " cells of " << cellList.cellSize() << " Angstrom" << std::endl;
+
+	// query points near random atoms, with a few outside of the bounds
+	std::mt19937 random(42);
+	std::uniform_int_distribution<std::size_t> atomDistribution(0, frame.size() - 1);
+	std::uniform_real_distribution<float> offsetDistribution(-8.0f, 8.0f);
+
+	const std::size_t queryCount = 200;
+	std::vector<vec3> queries(queryCount);
+
+	for (std::size_t i = 0; i < queryCount; i++)
+		queries[i] = vec3(frame[atomDistribution(random)]) + vec3(offsetDistribution(random), offsetDistribution(random), offsetDistribution(random));
+
+	queries[0] = minimum - vec3(10.0f);
+	queries[1] = maximum + vec3(3.0f);
+
+	const float radius = 6.0f;
+	const std::size_t k = 16;
+
+	std::vector<uint> indices;
+	double rangeTime = 0.0;
+	double nearestTime = 0.0;
+	std::size_t rangeResults = 0;
+
+	for (const auto& q : queries)
+	{
+		rangeTime += Benchmark::time([&]() { cellList.range(q, radius, indices); });
+		rangeResults += indices.size();
+		nearestTime += Benchmark::time([&]() { cellList.nearest(q, k, indices); });
+	}
+
+	std::cout << "  Range queries (" << radius << " Angstrom): " << rangeTime / double(queryCount) * 1e6 << " us per query, " << double(rangeResults) / double(queryCount) << " atoms on average" << std::endl;
+	std::cout << "  Nearest queries (k = " << k << "): " << nearestTime / double(queryCount) * 1e6 << " us per query" << std::endl;
+
+	return true;
+}
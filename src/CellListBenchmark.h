@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace dynamol
+{
+	// Measures the build time of the cell list and the time of range and nearest neighbor queries on the first timestep of a file,
+	// replicated to the given number of atoms. The queries are verified by the cell list tests on synthetic inputs.
+	class CellListBenchmark
+	{
+	public:
+		static bool run(const std::string& filename, std::size_t atomCount = 1000000, unsigned int iterations = 10);
+	};
+}
@@ -0,0 +1,690 @@
+#include "CifParser.h"
+#include "PdbParser.h"
+#include "ThreadPool.h"
+
+#include <array>
+#include <atomic>
+#include <string_view>
+#include <algorithm>
+#include <functional>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	enum Column
+	{
+		X,
+		Y,
+		Z,
+		TypeSymbol,
+		LabelCompId,
+		AuthCompId,
+		AuthAsymId,
+		LabelAsymId,
+		AuthSeqId,
+		LabelSeqId,
+		ModelNumber,
+		ColumnCount
+	};
+
+	const std::array<std::string_view, ColumnCount> columnNames = {
+		"cartn_x",
+		"cartn_y",
+		"cartn_z",
+		"type_symbol",
+		"label_comp_id",
+		"auth_comp_id",
+		"auth_asym_id",
+		"label_asym_id",
+		"auth_seq_id",
+		"label_seq_id",
+		"pdbx_pdb_model_num"
+	};
+
+	const std::string_view categoryName = "_atom_site.";
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+	}
+
+	inline char lower(char c)
+	{
+		return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+	}
+
+	// case-insensitive comparison of the beginning of [begin, end) with a lower-case prefix
+	inline bool startsWith(const char* begin, const char* end, std::string_view prefix)
+	{
+		if (std::size_t(end - begin) < prefix.size())
+			return false;
+
+		for (std::size_t i = 0; i < prefix.size(); i++)
+		{
+			if (lower(begin[i]) != prefix[i])
+				return false;
+		}
+
+		return true;
+	}
+
+	struct Token
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		bool quoted = false;
+	};
+
+	using Fields = std::array<Token, ColumnCount>;
+
+	// splits CIF text into whitespace-separated values, quoted strings and semicolon-delimited text fields
+	class Tokenizer
+	{
+	public:
+		Tokenizer(const char* begin, const char* end) : m_begin(begin), m_position(begin), m_end(end)
+		{
+		}
+
+		bool next(Token& token)
+		{
+			while (m_position < m_end)
+			{
+				const char c = *m_position;
+
+				if (isSpace(c))
+				{
+					m_position++;
+				}
+				else if (c == '#')
+				{
+					m_position = PdbParser::lineEnd(m_position, m_end);
+				}
+				else if (c == ';' && (m_position == m_begin || *(m_position - 1) == '\n'))
+				{
+					// text fields end with a semicolon at the beginning of a line
+					const char* fieldBegin = m_position + 1;
+					const char* line = fieldBegin;
+
+					while (true)
+					{
+						const char* lineEnd = PdbParser::lineEnd(line, m_end);
+
+						if (lineEnd == m_end || lineEnd + 1 == m_end)
+						{
+							token = { fieldBegin, m_end, true };
+							m_position = m_end;
+							return true;
+						}
+
+						if (*(lineEnd + 1) == ';')
+						{
+							token = { fieldBegin, lineEnd, true };
+							m_position = lineEnd + 2;
+							return true;
+						}
+
+						line = lineEnd + 1;
+					}
+				}
+				else if (c == '\'' || c == '"')
+				{
+					// quotes only close when followed by whitespace and never span lines
+					const char* p = m_position + 1;
+
+					while (p < m_end && *p != '\n' && !(*p == c && (p + 1 == m_end || isSpace(*(p + 1)))))
+						p++;
+
+					token = { m_position + 1, p, true };
+					m_position = std::min(p + 1, m_end);
+					return true;
+				}
+				else
+				{
+					const char* tokenBegin = m_position;
+
+					while (m_position < m_end && !isSpace(*m_position))
+						m_position++;
+
+					token = { tokenBegin, m_position, false };
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		const char* position() const
+		{
+			return m_position;
+		}
+
+	private:
+		const char* m_begin = nullptr;
+		const char* m_position = nullptr;
+		const char* m_end = nullptr;
+	};
+
+	// tags, loops and data blocks end the values of a loop
+	inline bool isReserved(const Token& token)
+	{
+		if (token.quoted)
+			return false;
+
+		return *token.begin == '_' || startsWith(token.begin, token.end, "loop_") || startsWith(token.begin, token.end, "data_") ||
+			startsWith(token.begin, token.end, "save_") || startsWith(token.begin, token.end, "global_") || startsWith(token.begin, token.end, "stop_");
+	}
+
+	// unset fields and the unknown and inapplicable markers all yield empty values
+	inline bool value(const Token& token, const char*& begin, const char*& end)
+	{
+		begin = token.begin;
+		end = token.end;
+
+		if (begin == nullptr || begin == end)
+			return false;
+
+		if (!token.quoted && end - begin == 1 && (*begin == '.' || *begin == '?'))
+			return false;
+
+		return true;
+	}
+
+	void appendRow(const Fields& fields, CifParser::AtomSites& atomSites)
+	{
+		const char* begin;
+		const char* end;
+
+		vec3 position;
+
+		for (int i = 0; i < 3; i++)
+		{
+			value(fields[X + i], begin, end);
+			position[i] = PdbParser::parseFloat(begin, end);
+		}
+
+		uint elementId = 0;
+		std::uint64_t residueName = 0;
+		std::uint64_t chainName = 0;
+		std::int32_t residueNumber = 0;
+		std::int32_t model = 1;
+
+		if (value(fields[TypeSymbol], begin, end))
+			elementId = PdbParser::elementId(begin, end);
+
+		if (value(fields[LabelCompId], begin, end) || value(fields[AuthCompId], begin, end))
+			residueName = PdbParser::name(begin, end);
+
+		// the author chain names correspond to the chain identifiers of PDB files
+		if (value(fields[AuthAsymId], begin, end) || value(fields[LabelAsymId], begin, end))
+			chainName = PdbParser::name(begin, end);
+
+		// the author residue numbers correspond to those of PDB files, the others are missing for non-polymers
+		if (value(fields[AuthSeqId], begin, end) || value(fields[LabelSeqId], begin, end))
+			residueNumber = PdbParser::parseInteger(begin, end);
+
+		if (value(fields[ModelNumber], begin, end))
+			model = PdbParser::parseInteger(begin, end);
+
+		atomSites.positions.push_back(position);
+		atomSites.elementIds.push_back(std::uint8_t(elementId));
+		atomSites.residueNames.push_back(residueName);
+		atomSites.chainNames.push_back(chainName);
+		atomSites.residueNumbers.push_back(residueNumber);
+		atomSites.models.push_back(model);
+	}
+
+	// finds the first tag of the atom_site category at the beginning of a line
+	const char* findCategory(const char* begin, const char* end)
+	{
+		const std::string_view text(begin, std::size_t(end - begin));
+
+		for (std::size_t position = text.find(categoryName); position != std::string_view::npos; position = text.find(categoryName, position + 1))
+		{
+			if (position == 0 || text[position - 1] == '\n' || text[position - 1] == '\r')
+				return begin + position;
+		}
+
+		return nullptr;
+	}
+
+	// checks whether the last line before the given position that is neither empty nor a comment starts a loop
+	bool isLoop(const char* begin, const char* position)
+	{
+		const char* lineEnd = position;
+
+		while (lineEnd > begin)
+		{
+			const char* lineBegin = lineEnd - 1;
+
+			while (lineBegin > begin && *(lineBegin - 1) != '\n')
+				lineBegin--;
+
+			const char* c = lineBegin;
+
+			while (c < lineEnd && isSpace(*c))
+				c++;
+
+			if (c < lineEnd && *c != '#')
+				return startsWith(c, lineEnd, "loop_");
+
+			lineEnd = lineBegin;
+		}
+
+		return false;
+	}
+
+	// maps a tag to the column it provides, or -1 for columns that are not needed
+	int column(const Token& tag)
+	{
+		const char* name = tag.begin + categoryName.size();
+
+		for (int i = 0; i < ColumnCount; i++)
+		{
+			if (std::size_t(tag.end - name) == columnNames[i].size() && startsWith(name, tag.end, columnNames[i]))
+				return i;
+		}
+
+		return -1;
+	}
+
+	// result of decoding the lines starting within one chunk of the loop values
+	struct Chunk
+	{
+		CifParser::AtomSites atomSites;
+		bool terminated = false;
+		bool irregular = false;
+	};
+
+	// Decodes one row per line, which is how the loop is written by all common tools. Lines that contain a different number
+	// of values are flagged as irregular, so that the loop can be decoded again as a stream of tokens.
+	void decodeChunk(const char* begin, const char* end, const char* bufferEnd, const std::vector<int>& tagColumns, Chunk& chunk, const std::atomic<std::size_t>& terminatedChunk, std::size_t chunkIndex)
+	{
+		const char* line = begin;
+		chunk.atomSites.positions.reserve(std::size_t(end - begin) / 80 + 1);
+
+		while (line < end && chunkIndex <= terminatedChunk.load(std::memory_order_relaxed))
+		{
+			const char* lineEnd = PdbParser::lineEnd(line, bufferEnd);
+
+			Tokenizer tokenizer(line, lineEnd);
+			Token token;
+			Fields fields;
+			std::size_t count = 0;
+
+			while (tokenizer.next(token))
+			{
+				if (count == 0 && isReserved(token))
+				{
+					chunk.terminated = true;
+					return;
+				}
+
+				if (count < tagColumns.size() && tagColumns[count] >= 0)
+					fields[std::size_t(tagColumns[count])] = token;
+
+				count++;
+			}
+
+			if (count == tagColumns.size())
+			{
+				appendRow(fields, chunk.atomSites);
+			}
+			else if (count > 0)
+			{
+				chunk.irregular = true;
+				return;
+			}
+
+			line = (lineEnd < bufferEnd) ? lineEnd + 1 : bufferEnd;
+		}
+	}
+
+	// Appends the rows of the loop values in [begin, end) using parallel chunks of lines, chunks following the end of the loop
+	// stop early. Returns false without appending anything if a row does not occupy exactly one line.
+	bool decodeLines(const char* begin, const char* end, const std::vector<int>& tagColumns, CifParser::AtomSites& atomSites, bool& terminated)
+	{
+		ThreadPool& threadPool = ThreadPool::instance();
+
+		const std::size_t size = std::size_t(end - begin);
+		const std::size_t chunkCount = std::max<std::size_t>(1, std::min<std::size_t>(threadPool.threadCount() * 4, size / 65536));
+		const std::size_t chunkSize = size / chunkCount + 1;
+
+		std::vector<Chunk> chunks(chunkCount);
+		std::atomic<std::size_t> terminatedChunk = chunkCount;
+
+		threadPool.parallelFor(chunkCount, [&](std::size_t i)
+		{
+			const char* chunkBegin = begin + std::min(i * chunkSize, size);
+			const char* chunkEnd = begin + std::min((i + 1) * chunkSize, size);
+
+			// each chunk handles the lines starting within it
+			if (chunkBegin > begin && *(chunkBegin - 1) != '\n')
+			{
+				chunkBegin = PdbParser::lineEnd(chunkBegin, end);
+				chunkBegin = (chunkBegin < end) ? chunkBegin + 1 : end;
+			}
+
+			decodeChunk(chunkBegin, chunkEnd, end, tagColumns, chunks[i], terminatedChunk, i);
+
+			if (chunks[i].terminated)
+			{
+				std::size_t terminated = terminatedChunk.load();
+
+				while (i < terminated && !terminatedChunk.compare_exchange_weak(terminated, i))
+					;
+			}
+		});
+
+		const std::size_t lastChunk = std::min(terminatedChunk.load(), chunkCount - 1);
+		std::vector<std::size_t> offsets(lastChunk + 2, atomSites.size());
+
+		for (std::size_t i = 0; i <= lastChunk; i++)
+		{
+			if (chunks[i].irregular)
+				return false;
+
+			offsets[i + 1] = offsets[i] + chunks[i].atomSites.size();
+		}
+
+		atomSites.resize(offsets.back());
+		terminated = terminatedChunk.load() < chunkCount;
+
+		threadPool.parallelFor(lastChunk + 1, [&](std::size_t i)
+		{
+			const CifParser::AtomSites& source = chunks[i].atomSites;
+
+			std::copy(source.positions.begin(), source.positions.end(), atomSites.positions.begin() + offsets[i]);
+			std::copy(source.elementIds.begin(), source.elementIds.end(), atomSites.elementIds.begin() + offsets[i]);
+			std::copy(source.residueNames.begin(), source.residueNames.end(), atomSites.residueNames.begin() + offsets[i]);
+			std::copy(source.chainNames.begin(), source.chainNames.end(), atomSites.chainNames.begin() + offsets[i]);
+			std::copy(source.residueNumbers.begin(), source.residueNumbers.end(), atomSites.residueNumbers.begin() + offsets[i]);
+			std::copy(source.models.begin(), source.models.end(), atomSites.models.begin() + offsets[i]);
+		});
+
+		return true;
+	}
+
+	// Decodes the loop values as a stream of tokens, which also handles rows spanning multiple lines and text fields.
+	// Returns whether the end of the loop was found, rowBegin points to the text of an incomplete last row or to end.
+	bool decodeTokens(const char* begin, const char* end, const std::vector<int>& tagColumns, CifParser::AtomSites& atomSites, const char*& rowBegin)
+	{
+		Tokenizer tokenizer(begin, end);
+		Token token;
+		Fields fields;
+		std::size_t count = 0;
+
+		rowBegin = end;
+
+		while (true)
+		{
+			const char* tokenBegin = tokenizer.position();
+
+			if (!tokenizer.next(token))
+				break;
+
+			if (count == 0)
+			{
+				if (isReserved(token))
+					return true;
+
+				rowBegin = tokenBegin;
+			}
+
+			if (tagColumns[count] >= 0)
+				fields[std::size_t(tagColumns[count])] = token;
+
+			if (++count == tagColumns.size())
+			{
+				appendRow(fields, atomSites);
+				fields = Fields();
+				count = 0;
+				rowBegin = end;
+			}
+		}
+
+		return false;
+	}
+
+	bool hasCoordinates(const std::vector<int>& tagColumns)
+	{
+		for (int c : { X, Y, Z })
+		{
+			if (std::find(tagColumns.begin(), tagColumns.end(), c) == tagColumns.end())
+				return false;
+		}
+
+		return true;
+	}
+}
+
+std::size_t CifParser::AtomSites::size() const
+{
+	return positions.size();
+}
+
+void CifParser::AtomSites::resize(std::size_t size)
+{
+	positions.resize(size);
+	elementIds.resize(size);
+	residueNames.resize(size);
+	chainNames.resize(size);
+	residueNumbers.resize(size);
+	models.resize(size);
+}
+
+bool CifParser::parse(const char* begin, const char* end, AtomSites& atomSites)
+{
+	atomSites.resize(0);
+
+	const char* category = findCategory(begin, end);
+
+	if (!category)
+		return false;
+
+	Tokenizer tokenizer(category, end);
+	Token token;
+
+	// structures with a single atom list the category as tag-value pairs instead of a loop
+	if (!isLoop(begin, category))
+	{
+		Fields fields;
+
+		while (tokenizer.next(token) && startsWith(token.begin, token.end, categoryName))
+		{
+			const int c = column(token);
+
+			if (!tokenizer.next(token))
+				break;
+
+			if (c >= 0)
+				fields[std::size_t(c)] = token;
+		}
+
+		if (!fields[X].begin || !fields[Y].begin || !fields[Z].begin)
+			return false;
+
+		appendRow(fields, atomSites);
+		return true;
+	}
+
+	std::vector<int> tagColumns;
+	const char* dataBegin = end;
+
+	while (tokenizer.next(token))
+	{
+		if (token.quoted || !startsWith(token.begin, token.end, categoryName))
+			break;
+
+		tagColumns.push_back(column(token));
+
+		dataBegin = PdbParser::lineEnd(token.end, end);
+		dataBegin = (dataBegin < end) ? dataBegin + 1 : end;
+	}
+
+	if (!hasCoordinates(tagColumns))
+		return false;
+
+	bool terminated = false;
+
+	if (!decodeLines(dataBegin, end, tagColumns, atomSites, terminated))
+	{
+		const char* rowBegin;
+		decodeTokens(dataBegin, end, tagColumns, atomSites, rowBegin);
+	}
+
+	return true;
+}
+
+bool CifParser::parse(const std::function<bool(std::vector<char>&)>& read, AtomSites& atomSites)
+{
+	atomSites.resize(0);
+
+	enum class State
+	{
+		Searching,
+		Pairs,
+		Tags,
+		Values,
+		Done
+	};
+
+	State state = State::Searching;
+	bool loop = false;
+	bool regular = true;
+	bool last = false;
+
+	std::vector<int> tagColumns;
+	Fields fields;
+
+	std::vector<char> block;
+	std::vector<char> pending;
+
+	while (state != State::Done && !last)
+	{
+		if (!read(block))
+		{
+			block.clear();
+			last = true;
+		}
+
+		// text that was cut off at the end of the previous block is decoded together with the next one
+		if (!pending.empty())
+		{
+			pending.insert(pending.end(), block.begin(), block.end());
+			std::swap(pending, block);
+			pending.clear();
+		}
+
+		const char* begin = block.data();
+		const char* end = begin + block.size();
+		const char* line = begin;
+		const char* pairsBegin = nullptr;
+
+		while (line < end && state != State::Done)
+		{
+			if (state == State::Values)
+			{
+				// blocks end with complete lines, so each one can be decoded in parallel as long as the rows do
+				bool terminated = false;
+
+				if (regular && !decodeLines(line, end, tagColumns, atomSites, terminated))
+					regular = false;
+
+				if (!regular)
+				{
+					const char* rowBegin;
+					terminated = decodeTokens(line, end, tagColumns, atomSites, rowBegin);
+
+					if (!terminated && !last)
+						pending.assign(rowBegin, end);
+				}
+
+				state = terminated ? State::Done : State::Values;
+				break;
+			}
+
+			const char* lineEnd = PdbParser::lineEnd(line, end);
+			const char* nextLine = (lineEnd < end) ? lineEnd + 1 : end;
+
+			Tokenizer tokenizer(line, lineEnd);
+			Token token;
+
+			// empty lines and comments
+			if (!tokenizer.next(token))
+			{
+				line = nextLine;
+				continue;
+			}
+
+			const bool tag = !token.quoted && startsWith(token.begin, token.end, categoryName);
+
+			if (state == State::Searching)
+			{
+				if (!tag)
+				{
+					loop = !token.quoted && token.end - token.begin == 5 && startsWith(token.begin, token.end, "loop_");
+					line = nextLine;
+					continue;
+				}
+
+				state = loop ? State::Tags : State::Pairs;
+				pairsBegin = line;
+				fields = Fields();
+			}
+
+			if (state == State::Tags)
+			{
+				if (!tag)
+				{
+					if (!hasCoordinates(tagColumns))
+						return false;
+
+					// the values start with this line
+					state = State::Values;
+					continue;
+				}
+
+				tagColumns.push_back(column(token));
+			}
+			else if (state == State::Pairs)
+			{
+				// structures with a single atom list the category as tag-value pairs on separate lines
+				if (!tag)
+				{
+					state = State::Done;
+					break;
+				}
+
+				const int c = column(token);
+
+				if (tokenizer.next(token) && c >= 0)
+					fields[std::size_t(c)] = token;
+			}
+
+			line = nextLine;
+		}
+
+		if (state == State::Pairs && !last)
+		{
+			pending.assign(pairsBegin, end);
+			state = State::Searching;
+			loop = false;
+		}
+		else if (state == State::Done && !tagColumns.empty())
+		{
+			break;
+		}
+		else if (state == State::Done || state == State::Pairs)
+		{
+			if (!fields[X].begin || !fields[Y].begin || !fields[Z].begin)
+				return false;
+
+			appendRow(fields, atomSites);
+			return true;
+		}
+	}
+
+	return state == State::Values || state == State::Done;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace dynamol
+{
+	// Columnar decoding of the atom_site category of mmCIF files, only the columns used by Protein are extracted
+	class CifParser
+	{
+	public:
+		// atom sites in file order, the element ids correspond to the table of Protein, names are packed by PdbParser::name
+		struct AtomSites
+		{
+			std::vector<glm::vec3> positions;
+			std::vector<std::uint8_t> elementIds;
+			std::vector<std::uint64_t> residueNames;
+			std::vector<std::uint64_t> chainNames;
+			std::vector<std::int32_t> residueNumbers;
+			std::vector<std::int32_t> models;
+
+			std::size_t size() const;
+			void resize(std::size_t size);
+		};
+
+		static bool parse(const char* begin, const char* end, AtomSites& atomSites);
+
+		// Parses a file that is supplied in blocks ending with complete lines, read returns false after the last block
+		static bool parse(const std::function<bool(std::vector<char>&)>& read, AtomSites& atomSites);
+	};
+}
@@ -0,0 +1,238 @@
+#include "ClusterCuller.h"
+#include "Renderer.h"
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+
+#include <algorithm>
+#include <cstddef>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+using namespace globjects;
+
+ClusterCuller::ClusterCuller(Renderer* renderer) : m_renderer(renderer)
+{
+	m_renderer->createShaderProgram("cullingcull", {
+			{ GL_COMPUTE_SHADER,"./res/culling/cull-cs.glsl" }
+		});
+
+	m_renderer->createShaderProgram("cullingpyramid", {
+			{ GL_COMPUTE_SHADER,"./res/culling/pyramid-cs.glsl" }
+		});
+
+	m_commands->setStorage(sizeof(Commands), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	m_statistics->setStorage(sizeof(Commands), nullptr, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_CLIENT_STORAGE_BIT);
+	m_statisticsData = static_cast<const Commands*>(m_statistics->mapRange(0, sizeof(Commands), GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+}
+
+void ClusterCuller::cullPreviouslyVisible(Buffer* atoms, Buffer* indices, uint count, Buffer* elements, float radiusScale, float margin, const mat4& modelViewProjection, bool occlusion)
+{
+	auto programCull = m_renderer->shaderProgram("cullingcull");
+
+	readStatistics();
+
+	m_atoms = atoms;
+	m_indices = indices;
+	m_atomCount = count;
+
+	const uint clusterCount = (count + clusterSize - 1) / clusterSize;
+
+	reserve(m_visibleAtoms, m_visibleAtomsCapacity, std::max(count, 1u) * sizeof(vec4));
+
+	// Clusters are not meaningful across a change of their number, so all of them are tested in the second phase then.
+	// Otherwise the flags of the previous frame are kept, even if the atoms changed, which at worst draws extra clusters.
+	if (clusterCount != m_clusterCount)
+	{
+		reserve(m_clusters, m_clustersCapacity, std::max(clusterCount, 1u) * 2 * sizeof(vec4));
+
+		const uint zero = 0;
+		m_clusters->clearSubData(GL_R32UI, 0, std::max(clusterCount, 1u) * 2 * sizeof(vec4), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		m_clusterCount = clusterCount;
+	}
+
+	const Commands commands = { { { 0, 1, 0, 0 }, { 0, 1, 0, 0 } }, { 0, 0 } };
+	m_commands->setSubData(0, sizeof(Commands), &commands);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	if (clusterCount > 0)
+	{
+		atoms->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+
+		if (indices)
+			indices->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+
+		m_clusters->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+		elements->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+		m_commands->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+		m_visibleAtoms->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+
+		programCull->setUniform("atomCount", count);
+		programCull->setUniform("indexed", indices != nullptr);
+		programCull->setUniform("phase", 0u);
+		programCull->setUniform("occlusion", occlusion);
+		programCull->setUniform("radiusScale", radiusScale);
+		programCull->setUniform("margin", margin);
+		programCull->setUniform("modelViewProjectionMatrix", modelViewProjection);
+		programCull->dispatchCompute(clusterCount, 1, 1);
+
+		for (uint binding : { 0u, 1u, 2u, 4u, 5u })
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+	}
+
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// without occlusion culling there is no second phase, so the statistics are complete
+	if (!occlusion && !m_statisticsFence)
+	{
+		m_commands->copySubData(m_statistics.get(), 0, 0, sizeof(Commands));
+		m_statisticsFence = Sync::fence(GL_SYNC_GPU_COMMANDS_COMPLETE);
+		m_pendingClusterCount = clusterCount;
+	}
+}
+
+void ClusterCuller::cullNewlyVisible(Texture* depth, const ivec2& size, const mat4& modelViewProjection)
+{
+	auto programCull = m_renderer->shaderProgram("cullingcull");
+	auto programPyramid = m_renderer->shaderProgram("cullingpyramid");
+
+	// The pyramid has immutable storage for all levels down to a single pixel and is recreated if the viewport changes
+	if (!m_depthPyramid || size != m_depthPyramidSize)
+	{
+		m_depthPyramidSize = size;
+		m_depthPyramidLevels = 1;
+
+		while ((std::max(size.x, size.y) >> m_depthPyramidLevels) > 0)
+			m_depthPyramidLevels++;
+
+		m_depthPyramid = Texture::create(GL_TEXTURE_2D);
+		m_depthPyramid->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		m_depthPyramid->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		m_depthPyramid->setParameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		m_depthPyramid->setParameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		m_depthPyramid->storage2D(m_depthPyramidLevels, GL_R32F, m_depthPyramidSize);
+	}
+
+	// The first level copies the depth texture, each further one holds the farthest depth of the pixels it covers
+	depth->bindActive(0);
+
+	for (int level = 0; level < m_depthPyramidLevels; level++)
+	{
+		const ivec2 sourceSize = max(m_depthPyramidSize >> std::max(level - 1, 0), ivec2(1));
+		const ivec2 destinationSize = max(m_depthPyramidSize >> level, ivec2(1));
+
+		m_depthPyramid->bindImageTexture(0, std::max(level - 1, 0), false, 0, GL_READ_ONLY, GL_R32F);
+		m_depthPyramid->bindImageTexture(1, level, false, 0, GL_WRITE_ONLY, GL_R32F);
+
+		programPyramid->setUniform("depthTexture", 0);
+		programPyramid->setUniform("level", level);
+		programPyramid->setUniform("sourceSize", sourceSize);
+		programPyramid->setUniform("destinationSize", destinationSize);
+		programPyramid->dispatchCompute((destinationSize.x + 15) / 16, (destinationSize.y + 15) / 16, 1);
+
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+
+	m_depthPyramid->unbindImageTexture(1);
+	m_depthPyramid->unbindImageTexture(0);
+	depth->unbindActive(0);
+
+	if (m_clusterCount > 0)
+	{
+		m_atoms->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+
+		if (m_indices)
+			m_indices->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+
+		m_clusters->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+		m_commands->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+		m_visibleAtoms->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+		m_depthPyramid->bindActive(0);
+
+		programCull->setUniform("atomCount", m_atomCount);
+		programCull->setUniform("indexed", m_indices != nullptr);
+		programCull->setUniform("phase", 1u);
+		programCull->setUniform("occlusion", true);
+		programCull->setUniform("modelViewProjectionMatrix", modelViewProjection);
+		programCull->setUniform("depthPyramid", 0);
+		programCull->setUniform("depthPyramidLevels", m_depthPyramidLevels);
+		programCull->dispatchCompute(m_clusterCount, 1, 1);
+
+		m_depthPyramid->unbindActive(0);
+
+		for (uint binding : { 0u, 1u, 2u, 4u, 5u })
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+	}
+
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	if (!m_statisticsFence)
+	{
+		m_commands->copySubData(m_statistics.get(), 0, 0, sizeof(Commands));
+		m_statisticsFence = Sync::fence(GL_SYNC_GPU_COMMANDS_COMPLETE);
+		m_pendingClusterCount = m_clusterCount;
+	}
+}
+
+const void* ClusterCuller::previouslyVisibleCommand()
+{
+	return reinterpret_cast<const void*>(offsetof(Commands, commands));
+}
+
+const void* ClusterCuller::newlyVisibleCommand()
+{
+	return reinterpret_cast<const void*>(offsetof(Commands, commands) + sizeof(DrawArraysIndirectCommand));
+}
+
+Buffer* ClusterCuller::visibleAtoms() const
+{
+	return m_visibleAtoms.get();
+}
+
+Buffer* ClusterCuller::commands() const
+{
+	return m_commands.get();
+}
+
+uint ClusterCuller::clusterCount() const
+{
+	return m_statisticsClusterCount;
+}
+
+uint ClusterCuller::visibleClusterCount() const
+{
+	return m_visibleClusterCount;
+}
+
+uint ClusterCuller::visibleAtomCount() const
+{
+	return m_visibleAtomCount;
+}
+
+void ClusterCuller::reserve(std::unique_ptr<Buffer>& buffer, std::size_t& capacity, std::size_t size)
+{
+	// buffers only grow, so playback of timesteps with varying atom counts does not reallocate every frame
+	if (capacity < size)
+	{
+		buffer->setData(size, nullptr, GL_DYNAMIC_COPY);
+		capacity = size;
+	}
+}
+
+void ClusterCuller::readStatistics()
+{
+	if (!m_statisticsFence)
+		return;
+
+	const GLenum result = m_statisticsFence->clientWait(GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+	if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+		return;
+
+	m_statisticsFence.reset();
+	m_statisticsClusterCount = m_pendingClusterCount;
+	m_visibleClusterCount = m_statisticsData->clusterCounts[0] + m_statisticsData->clusterCounts[1];
+	m_visibleAtomCount = m_statisticsData->commands[0].count + m_statisticsData->commands[1].count;
+}
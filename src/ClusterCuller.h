@@ -0,0 +1,102 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <memory>
+
+#include <glbinding/gl/gl.h>
+#include <globjects/Buffer.h>
+#include <globjects/Program.h>
+#include <globjects/Texture.h>
+#include <globjects/Sync.h>
+
+namespace dynamol
+{
+	class Renderer;
+
+	// Skips clusters of consecutive atoms that are outside of the view frustum or hidden behind nearer spheres before they are
+	// splatted. Each cluster is bounded by a box around its spheres, and the atoms of the visible clusters are gathered into a
+	// compact buffer, which is drawn with glDrawArraysIndirect so that the number of atoms never has to be read back.
+	//
+	// Occlusion is tested in two phases. The clusters that were visible in the previous frame are drawn first, then a depth
+	// pyramid holding the farthest depth of every block of pixels is built from the result, and the remaining clusters are
+	// tested against it. Since the first phase only draws spheres that are really there, no cluster is wrongly culled if the
+	// camera or the atoms move, and clusters that become visible are drawn in the same frame.
+	class ClusterCuller
+	{
+	public:
+		static const glm::uint clusterSize = 256;
+
+		// Layout of the commands in the command buffer, as consumed by glDrawArraysIndirect
+		struct DrawArraysIndirectCommand
+		{
+			glm::uint count;
+			glm::uint instanceCount;
+			glm::uint first;
+			glm::uint baseInstance;
+		};
+
+		ClusterCuller(Renderer* renderer);
+
+		// Computes the bounds of the clusters of count atoms, read through the indices if given, and gathers the atoms of the
+		// clusters inside of the view frustum that were visible in the previous frame, or of all of them if occlusion is false.
+		// The radii are taken from the element buffer, which is left bound to shader storage buffer binding 3 like for the
+		// sphere shaders, and enlarged by radiusScale and margin to cover the spheres of all passes.
+		void cullPreviouslyVisible(globjects::Buffer* atoms, globjects::Buffer* indices, glm::uint count, globjects::Buffer* elements, float radiusScale, float margin, const glm::mat4& modelViewProjection, bool occlusion);
+
+		// Builds the depth pyramid from the depth texture holding the spheres drawn for the first command and appends the atoms of
+		// the clusters inside of the view frustum that are not hidden behind it, which the second command then draws
+		void cullNewlyVisible(globjects::Texture* depth, const glm::ivec2& size, const glm::mat4& modelViewProjection);
+
+		// Byte offsets of the commands in the command buffer, the first one draws the previously visible clusters and the second
+		// one the newly visible clusters. Together they cover all atoms in the visible atom buffer.
+		static const void* previouslyVisibleCommand();
+		static const void* newlyVisibleCommand();
+
+		globjects::Buffer* visibleAtoms() const;
+		globjects::Buffer* commands() const;
+
+		// Statistics of the latest frame whose results arrived, they are read without waiting for the GPU
+		glm::uint clusterCount() const;
+		glm::uint visibleClusterCount() const;
+		glm::uint visibleAtomCount() const;
+
+	private:
+		// the visible cluster counts of both phases follow the commands in the command buffer
+		struct Commands
+		{
+			DrawArraysIndirectCommand commands[2];
+			glm::uint clusterCounts[2];
+		};
+
+		void reserve(std::unique_ptr<globjects::Buffer>& buffer, std::size_t& capacity, std::size_t size);
+		void readStatistics();
+
+		Renderer* m_renderer;
+
+		// input of the current frame, which the second phase gathers from again
+		globjects::Buffer* m_atoms = nullptr;
+		globjects::Buffer* m_indices = nullptr;
+		glm::uint m_atomCount = 0;
+		glm::uint m_clusterCount = 0;
+
+		// bounds of every cluster, whose lower corner stores in w whether the cluster was visible in the previous frame
+		std::unique_ptr<globjects::Buffer> m_clusters = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_commands = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_visibleAtoms = std::make_unique<globjects::Buffer>();
+		std::size_t m_clustersCapacity = 0;
+		std::size_t m_visibleAtomsCapacity = 0;
+
+		std::unique_ptr<globjects::Texture> m_depthPyramid;
+		glm::ivec2 m_depthPyramidSize = glm::ivec2(0);
+		int m_depthPyramidLevels = 0;
+
+		// copies of the commands are read once the fence of their frame has been signaled
+		std::unique_ptr<globjects::Buffer> m_statistics = std::make_unique<globjects::Buffer>();
+		const Commands* m_statisticsData = nullptr;
+		std::unique_ptr<globjects::Sync> m_statisticsFence;
+		glm::uint m_pendingClusterCount = 0;
+		glm::uint m_statisticsClusterCount = 0;
+		glm::uint m_visibleClusterCount = 0;
+		glm::uint m_visibleAtomCount = 0;
+	};
+}
@@ -0,0 +1,410 @@
+#include "CpuFluidSolver.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DYNAMOL_FLUID_SSE
+#endif
+
+namespace
+{
+    // Slabs of z per thread, more than one so that threads finishing early pick up the remaining ones
+    constexpr std::size_t SlabsPerThread{4};
+
+    // Magnitude below which advection does not move a quantity, SPEED_THRESHOLD in advection.comp
+    constexpr float SpeedThreshold{0.0001f};
+
+    constexpr std::size_t Channels{dynamol::FluidGrid::Channels};
+
+    // The tails of the impulses far from their center are denormal, which is many times slower to compute with on the CPU and
+    // flushed to zero by GPUs anyway
+    inline float FlushDenormal(const float value)
+    {
+        return std::abs(value) < std::numeric_limits<float>::min() ? 0.0f : value;
+    }
+
+    namespace lanes
+    {
+#if defined(__AVX__)
+        constexpr std::size_t Width{8};
+        using Lanes = __m256;
+        inline Lanes Load(const float *p) { return _mm256_loadu_ps(p); }
+        inline void Store(float *p, Lanes a) { _mm256_storeu_ps(p, a); }
+        inline Lanes Broadcast(float v) { return _mm256_set1_ps(v); }
+        inline Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+        inline Lanes Sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+        inline Lanes Mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+        inline Lanes Div(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+#elif defined(DYNAMOL_FLUID_SSE)
+        constexpr std::size_t Width{4};
+        using Lanes = __m128;
+        inline Lanes Load(const float *p) { return _mm_loadu_ps(p); }
+        inline void Store(float *p, Lanes a) { _mm_storeu_ps(p, a); }
+        inline Lanes Broadcast(float v) { return _mm_set1_ps(v); }
+        inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+        inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+        inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+        inline Lanes Div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+#else
+        // without vector instructions the lanes are processed by loops, which the compiler may still vectorize
+        constexpr std::size_t Width{4};
+
+        struct Lanes
+        {
+            float v[Width];
+        };
+
+        template<typename Function>
+        inline Lanes Apply(Function function)
+        {
+            Lanes result;
+
+            for (std::size_t i{0}; i < Width; ++i)
+                result.v[i] = function(i);
+
+            return result;
+        }
+
+        inline Lanes Load(const float *p) { return Apply([&](std::size_t i) { return p[i]; }); }
+        inline void Store(float *p, Lanes a) { std::copy(a.v, a.v + Width, p); }
+        inline Lanes Broadcast(float v) { return Apply([&](std::size_t) { return v; }); }
+        inline Lanes Add(Lanes a, Lanes b) { return Apply([&](std::size_t i) { return a.v[i] + b.v[i]; }); }
+        inline Lanes Sub(Lanes a, Lanes b) { return Apply([&](std::size_t i) { return a.v[i] - b.v[i]; }); }
+        inline Lanes Mul(Lanes a, Lanes b) { return Apply([&](std::size_t i) { return a.v[i] * b.v[i]; }); }
+        inline Lanes Div(Lanes a, Lanes b) { return Apply([&](std::size_t i) { return a.v[i] / b.v[i]; }); }
+#endif
+    }
+
+    // Calls function(y, z) for every row of the grid, with the slabs of z distributed over the thread pool
+    template<typename Function>
+    void ForEachRow(const std::array<std::int32_t, 3> &size, Function function)
+    {
+        dynamol::ThreadPool &pool{dynamol::ThreadPool::instance()};
+        const std::size_t depth{std::size_t(std::max(size[2], 0))};
+        const std::size_t slabCount{std::min(depth, pool.threadCount() * SlabsPerThread)};
+
+        pool.parallelFor(slabCount, [&](const std::size_t slab)
+        {
+            const auto first = std::int32_t(slab * depth / slabCount);
+            const auto last = std::int32_t((slab + 1) * depth / slabCount);
+
+            for (std::int32_t z{first}; z < last; ++z)
+            {
+                for (std::int32_t y{0}; y < size[1]; ++y)
+                    function(y, z);
+            }
+        });
+    }
+
+    // Calls scalar(i) for the floats of the first and last voxel of a row, whose neighbors in x are clamped, and vector(i)
+    // for as many of the floats in between as fill whole lanes. Without a border, all floats are processed alike.
+    template<typename Scalar, typename Vector>
+    void ForEachFloat(const std::size_t length, const std::size_t border, Scalar scalar, Vector vector)
+    {
+        const std::size_t begin{std::min(border, length)};
+        const std::size_t end{length >= begin + border ? length - border : begin};
+        std::size_t i{0};
+
+        for (; i < begin; ++i)
+            scalar(i);
+
+        for (; i + lanes::Width <= end; i += lanes::Width)
+            vector(i);
+
+        for (; i < length; ++i)
+            scalar(i);
+    }
+
+    // Rows adjacent in y and z, clamped to [0, size] like clamp_coord in the shaders, so past the upper faces they read as zero
+    struct NeighborRows
+    {
+        NeighborRows(const dynamol::FluidGrid &grid, const std::int32_t y, const std::int32_t z, const float *const zeros)
+            : Bottom{grid.GetRow(std::max(y - 1, 0), z)},
+              Top{y + 1 < grid.GetSize()[1] ? grid.GetRow(y + 1, z) : zeros},
+              Front{grid.GetRow(y, std::max(z - 1, 0))},
+              Back{z + 1 < grid.GetSize()[2] ? grid.GetRow(y, z + 1) : zeros}
+        {
+        }
+
+        const float *Bottom;
+        const float *Top;
+        const float *Front;
+        const float *Back;
+    };
+}
+
+namespace dynamol
+{
+
+FluidGrid::FluidGrid(const std::array<std::int32_t, 3> &size)
+    : m_size{size},
+      m_data(std::size_t(std::max(size[0], 0)) * std::size_t(std::max(size[1], 0)) * std::size_t(std::max(size[2], 0)) * Channels, 0.0f)
+{
+}
+
+glm::vec4 FluidGrid::GetVoxel(const glm::ivec3 &coord) const
+{
+    // like imageLoad, voxels outside of the grid are zero
+    if (glm::any(glm::lessThan(coord, glm::ivec3{0})) || coord.x >= m_size[0] || coord.y >= m_size[1] || coord.z >= m_size[2])
+    {
+        return glm::vec4{0.0f};
+    }
+
+    const float *const voxel{GetRow(coord.y, coord.z) + std::size_t(coord.x) * Channels};
+    return {voxel[0], voxel[1], voxel[2], voxel[3]};
+}
+
+void FluidGrid::SetVoxel(const glm::ivec3 &coord, const glm::vec4 &value)
+{
+    float *const voxel{GetRow(coord.y, coord.z) + std::size_t(coord.x) * Channels};
+    std::copy(&value[0], &value[0] + Channels, voxel);
+}
+
+void FluidGrid::Clear()
+{
+    std::fill(m_data.begin(), m_data.end(), 0.0f);
+}
+
+void CpuFluidSolver::Advect(const FluidGrid &velocity, const FluidGrid &quantity, FluidGrid &result, const float dt, const float dissipation, const float gridScale)
+{
+    const std::array<std::int32_t, 3> &size{quantity.GetSize()};
+    const glm::ivec3 upper{size[0], size[1], size[2]};
+    const std::size_t rowLength{quantity.GetRowLength()};
+    const std::size_t sliceLength{rowLength * std::size_t(std::max(size[1], 0))};
+
+    // the source of a voxel depends on its velocity, so these loads are gathered per voxel
+    ForEachRow(size, [&](const std::int32_t y, const std::int32_t z)
+    {
+        const float *const velocityRow{velocity.GetRow(y, z)};
+        float *const out{result.GetRow(y, z)};
+
+        for (std::int32_t x{0}; x < size[0]; ++x)
+        {
+            const float *const u{velocityRow + std::size_t(x) * Channels};
+            const glm::vec3 delta{dt * gridScale * glm::vec3{u[0], u[1], u[2]}};
+            const glm::ivec3 offset{glm::sign(delta) * glm::step(glm::vec3{SpeedThreshold}, glm::abs(delta))};
+            const glm::ivec3 position{glm::clamp(glm::ivec3{x, y, z} - offset, glm::ivec3{0}, upper)};
+            float *const value{out + std::size_t(x) * Channels};
+
+            // all neighbors of sources away from the faces are inside of the grid and read without bounds checks
+            if (glm::all(glm::greaterThan(position, glm::ivec3{0})) && glm::all(glm::lessThan(position + 1, upper)))
+            {
+                const float *const source{quantity.GetRow(position.y, position.z) + std::size_t(position.x) * Channels};
+
+                for (std::size_t c{0}; c < Channels; ++c)
+                {
+                    const float sum{source[c + sliceLength] + source[c - sliceLength] + source[c + rowLength] + source[c - rowLength] + source[c - Channels] + source[c + Channels]};
+                    value[c] = sum / 6.0f * dissipation;
+                }
+            }
+            else
+            {
+                const glm::vec4 inFront{quantity.GetVoxel(position + glm::ivec3{0, 0, 1})};
+                const glm::vec4 behind{quantity.GetVoxel(position + glm::ivec3{0, 0, -1})};
+                const glm::vec4 above{quantity.GetVoxel(position + glm::ivec3{0, 1, 0})};
+                const glm::vec4 under{quantity.GetVoxel(position + glm::ivec3{0, -1, 0})};
+                const glm::vec4 left{quantity.GetVoxel(position + glm::ivec3{-1, 0, 0})};
+                const glm::vec4 right{quantity.GetVoxel(position + glm::ivec3{1, 0, 0})};
+                const glm::vec4 sum{(inFront + behind + above + under + left + right) / 6.0f * dissipation};
+
+                std::copy(&sum[0], &sum[0] + Channels, value);
+            }
+        }
+    });
+}
+
+void CpuFluidSolver::AddImpulse(const FluidGrid &field, FluidGrid &result, const glm::vec3 &position, const float radius, const glm::vec4 &force)
+{
+    const std::array<std::int32_t, 3> &size{field.GetSize()};
+
+    // The Gaussian is separable, so only one exponential per voxel along x is evaluated instead of one per voxel
+    std::vector<float> falloff(std::size_t(std::max(size[0], 0)));
+
+    for (std::int32_t x{0}; x < size[0]; ++x)
+    {
+        const float distance{position.x - float(x)};
+        falloff[x] = FlushDenormal(std::exp(-distance * distance / radius));
+    }
+
+    ForEachRow(size, [&](const std::int32_t y, const std::int32_t z)
+    {
+        const glm::vec2 distance{position.y - float(y), position.z - float(z)};
+        const float rowFalloff{FlushDenormal(std::exp(-glm::dot(distance, distance) / radius))};
+        const float *const in{field.GetRow(y, z)};
+        float *const out{result.GetRow(y, z)};
+
+        for (std::int32_t x{0}; x < size[0]; ++x)
+        {
+            const float weight{FlushDenormal(falloff[x] * rowFalloff)};
+
+            for (std::size_t c{0}; c < Channels; ++c)
+                out[x * Channels + c] = in[x * Channels + c] + force[c] * weight;
+        }
+    });
+}
+
+void CpuFluidSolver::AddImpulseLine(const FluidGrid &field, FluidGrid &result, const glm::vec3 &start, const glm::vec3 &end, const float radius, const float forceMultiplier)
+{
+    const std::array<std::int32_t, 3> &size{field.GetSize()};
+    const glm::vec3 direction{glm::normalize(end - start)};
+
+    ForEachRow(size, [&](const std::int32_t y, const std::int32_t z)
+    {
+        const float *const in{field.GetRow(y, z)};
+        float *const out{result.GetRow(y, z)};
+
+        for (std::int32_t x{0}; x < size[0]; ++x)
+        {
+            // squared distance of the voxel to the line through start and end
+            const glm::vec3 point{float(x), float(y), float(z)};
+            const glm::vec3 projection{start + glm::dot(point - start, direction) * direction - point};
+            const float weight{forceMultiplier * FlushDenormal(std::exp(-glm::dot(projection, projection) / radius))};
+            const glm::vec4 effect{weight, weight, weight, 1.0f};
+
+            for (std::size_t c{0}; c < Channels; ++c)
+                out[x * Channels + c] = in[x * Channels + c] + effect[c];
+        }
+    });
+}
+
+void CpuFluidSolver::Jacobi(const FluidGrid &x, const FluidGrid &b, FluidGrid &result, const float alpha, const float beta)
+{
+    const std::array<std::int32_t, 3> &size{x.GetSize()};
+    const std::size_t length{x.GetRowLength()};
+    const std::vector<float> zeros(length, 0.0f);
+
+    ForEachRow(size, [&](const std::int32_t y, const std::int32_t z)
+    {
+        const float *const center{x.GetRow(y, z)};
+        const NeighborRows rows{x, y, z, zeros.data()};
+        const float *const bRow{b.GetRow(y, z)};
+        float *const out{result.GetRow(y, z)};
+
+        const auto scalar = [&](const std::size_t i)
+        {
+            const std::size_t voxel{i / Channels};
+            const float left{center[voxel > 0 ? i - Channels : i]};
+            const float right{voxel + 1 < std::size_t(size[0]) ? center[i + Channels] : 0.0f};
+            out[i] = (left + right + rows.Top[i] + rows.Bottom[i] + rows.Front[i] + rows.Back[i] + alpha * bRow[i]) / beta;
+        };
+
+        const lanes::Lanes alphaLanes{lanes::Broadcast(alpha)};
+        const lanes::Lanes betaLanes{lanes::Broadcast(beta)};
+
+        const auto vector = [&](const std::size_t i)
+        {
+            lanes::Lanes sum{lanes::Add(lanes::Load(center + i - Channels), lanes::Load(center + i + Channels))};
+            sum = lanes::Add(sum, lanes::Load(rows.Top + i));
+            sum = lanes::Add(sum, lanes::Load(rows.Bottom + i));
+            sum = lanes::Add(sum, lanes::Load(rows.Front + i));
+            sum = lanes::Add(sum, lanes::Load(rows.Back + i));
+            sum = lanes::Add(sum, lanes::Mul(alphaLanes, lanes::Load(bRow + i)));
+            lanes::Store(out + i, lanes::Div(sum, betaLanes));
+        };
+
+        ForEachFloat(length, Channels, scalar, vector);
+    });
+}
+
+void CpuFluidSolver::Divergence(const FluidGrid &field, FluidGrid &result, const float gridScale)
+{
+    const std::array<std::int32_t, 3> &size{field.GetSize()};
+    const std::vector<float> zeros(field.GetRowLength(), 0.0f);
+
+    // each voxel combines a different channel of every neighbor, so this kernel works per voxel
+    ForEachRow(size, [&](const std::int32_t y, const std::int32_t z)
+    {
+        const float *const center{field.GetRow(y, z)};
+        const NeighborRows rows{field, y, z, zeros.data()};
+        float *const out{result.GetRow(y, z)};
+
+        for (std::int32_t x{0}; x < size[0]; ++x)
+        {
+            const std::size_t i{std::size_t(x) * Channels};
+            const float left{center[std::size_t(std::max(x - 1, 0)) * Channels]};
+            const float right{x + 1 < size[0] ? center[i + Channels] : 0.0f};
+            const float divergence{(right - left) / (2 * gridScale) + (rows.Top[i + 1] - rows.Bottom[i + 1]) / (2 * gridScale) + (rows.Back[i + 2] - rows.Front[i + 2]) / (2 * gridScale)};
+
+            out[i] = divergence;
+            out[i + 1] = 0.0f;
+            out[i + 2] = 0.0f;
+            out[i + 3] = 0.0f;
+        }
+    });
+}
+
+void CpuFluidSolver::Gradient(const FluidGrid &field, FluidGrid &result, const float gridScale)
+{
+    const std::array<std::int32_t, 3> &size{field.GetSize()};
+    const std::vector<float> zeros(field.GetRowLength(), 0.0f);
+
+    ForEachRow(size, [&](const std::int32_t y, const std::int32_t z)
+    {
+        const float *const center{field.GetRow(y, z)};
+        const NeighborRows rows{field, y, z, zeros.data()};
+        float *const out{result.GetRow(y, z)};
+
+        for (std::int32_t x{0}; x < size[0]; ++x)
+        {
+            const std::size_t i{std::size_t(x) * Channels};
+            const float left{center[std::size_t(std::max(x - 1, 0)) * Channels]};
+            const float right{x + 1 < size[0] ? center[i + Channels] : 0.0f};
+
+            out[i] = (right - left) / (2 * gridScale);
+            out[i + 1] = (rows.Top[i] - rows.Bottom[i]) / (2 * gridScale);
+            out[i + 2] = (rows.Back[i] - rows.Front[i]) / (2 * gridScale);
+            out[i + 3] = 0.0f;
+        }
+    });
+}
+
+void CpuFluidSolver::Subtract(const FluidGrid &a, const FluidGrid &b, FluidGrid &result)
+{
+    const std::size_t length{a.GetRowLength()};
+
+    ForEachRow(a.GetSize(), [&](const std::int32_t y, const std::int32_t z)
+    {
+        const float *const aRow{a.GetRow(y, z)};
+        const float *const bRow{b.GetRow(y, z)};
+        float *const out{result.GetRow(y, z)};
+
+        ForEachFloat(length, 0,
+            [&](const std::size_t i) { out[i] = aRow[i] - bRow[i]; },
+            [&](const std::size_t i) { lanes::Store(out + i, lanes::Sub(lanes::Load(aRow + i), lanes::Load(bRow + i))); });
+    });
+}
+
+void CpuFluidSolver::Boundary(const FluidGrid &field, FluidGrid &result, const float scale)
+{
+    const std::size_t length{field.GetRowLength()};
+    const lanes::Lanes scaleLanes{lanes::Broadcast(scale)};
+
+    // boundary.comp only recognizes the lower faces, its test for the upper ones compares against the size and never holds
+    ForEachRow(field.GetSize(), [&](const std::int32_t y, const std::int32_t z)
+    {
+        const float *const in{field.GetRow(y, z)};
+        float *const out{result.GetRow(y, z)};
+
+        if (y == 0 || z == 0)
+        {
+            ForEachFloat(length, 0,
+                [&](const std::size_t i) { out[i] = in[i] * scale; },
+                [&](const std::size_t i) { lanes::Store(out + i, lanes::Mul(lanes::Load(in + i), scaleLanes)); });
+        }
+        else
+        {
+            std::copy(in, in + length, out);
+
+            for (std::size_t i{0}; i < std::min(Channels, length); ++i)
+                out[i] = in[i] * scale;
+        }
+    });
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+    // Voxels of a simulation grid with four channels each, laid out like the RGBA textures of FluidSim: x varies fastest, then
+    // y, then z, so a row along x is contiguous and can be up- and downloaded with a single call.
+    class FluidGrid
+    {
+    public:
+        FluidGrid() = default;
+        explicit FluidGrid(const std::array<std::int32_t, 3> &size);
+
+    public:
+        static constexpr std::size_t Channels{4};
+
+        const std::array<std::int32_t, 3> &GetSize() const { return m_size; }
+        std::size_t GetVoxelCount() const { return m_data.size() / Channels; }
+        std::size_t GetRowLength() const { return std::size_t(m_size[0]) * Channels; }
+
+        float *GetData() { return m_data.data(); }
+        const float *GetData() const { return m_data.data(); }
+        float *GetRow(std::int32_t y, std::int32_t z) { return m_data.data() + (std::size_t(z) * m_size[1] + y) * GetRowLength(); }
+        const float *GetRow(std::int32_t y, std::int32_t z) const { return m_data.data() + (std::size_t(z) * m_size[1] + y) * GetRowLength(); }
+
+        glm::vec4 GetVoxel(const glm::ivec3 &coord) const;
+        void SetVoxel(const glm::ivec3 &coord, const glm::vec4 &value);
+        void Clear();
+
+    private:
+        std::array<std::int32_t, 3> m_size{0, 0, 0};
+        std::vector<float> m_data;
+    };
+
+    // Reference implementation of the compute shaders in fluidsim/shader on the CPU. Every kernel reproduces its shader
+    // exactly, including how it treats the border: neighbors are clamped to [0, size], so the lower faces repeat their own
+    // value while the voxel past the upper faces is out of bounds and reads as zero, as imageLoad does. Unlike the dispatch of
+    // FluidSim, which only covers whole work groups, all voxels are processed.
+    //
+    // The rows of a slab of z are distributed over the thread pool. Kernels that combine the same channel of their neighbors
+    // are vectorized across x on the interleaved floats of a row, the others per voxel over its four channels. The result
+    // grid must not be one of the inputs.
+    class CpuFluidSolver
+    {
+    public:
+        static void Advect(const FluidGrid &velocity, const FluidGrid &quantity, FluidGrid &result, float dt, float dissipation, float gridScale);
+        static void AddImpulse(const FluidGrid &field, FluidGrid &result, const glm::vec3 &position, float radius, const glm::vec4 &force);
+        static void AddImpulseLine(const FluidGrid &field, FluidGrid &result, const glm::vec3 &start, const glm::vec3 &end, float radius, float forceMultiplier);
+        static void Jacobi(const FluidGrid &x, const FluidGrid &b, FluidGrid &result, float alpha, float beta);
+        static void Divergence(const FluidGrid &field, FluidGrid &result, float gridScale);
+        static void Gradient(const FluidGrid &field, FluidGrid &result, float gridScale);
+        static void Subtract(const FluidGrid &a, const FluidGrid &b, FluidGrid &result);
+        static void Boundary(const FluidGrid &field, FluidGrid &result, float scale);
+    };
+}
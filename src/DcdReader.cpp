@@ -0,0 +1,219 @@
+#include "DcdReader.h"
+
+#include <cstring>
+#include <globjects/globjects.h>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	inline std::uint32_t swap(std::uint32_t value)
+	{
+		return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+	}
+
+	// size of a Fortran record including its leading and trailing length markers
+	inline std::size_t recordSize(std::size_t length)
+	{
+		return length + 8;
+	}
+}
+
+bool DcdReader::open(const std::string& filename)
+{
+	if (!m_file.open(filename) || m_file.size() < recordSize(84))
+	{
+		globjects::critical() << "Could not open DCD file " << filename << "!";
+		return false;
+	}
+
+	// the first record always has a length of 84 bytes, which also reveals the byte order
+	m_swapBytes = false;
+
+	if (readInt(0) != 84)
+	{
+		m_swapBytes = true;
+
+		if (readInt(0) != 84)
+		{
+			globjects::critical() << filename << " is not a DCD file with 32-bit record markers!";
+			return false;
+		}
+	}
+
+	if (std::memcmp(m_file.data() + 4, "CORD", 4) != 0 || readInt(88) != 84)
+	{
+		globjects::critical() << filename << " is not a DCD coordinate file!";
+		return false;
+	}
+
+	std::int32_t control[20];
+
+	for (std::size_t i = 0; i < 20; i++)
+		control[i] = readInt(8 + i * 4);
+
+	const bool charmm = control[19] != 0;
+	const std::int32_t fixedAtomCount = control[8];
+
+	m_unitCell = charmm && control[10] != 0;
+	m_fourDimensions = charmm && control[11] != 0;
+
+	// title record
+	std::size_t offset = recordSize(84);
+
+	if (offset + 4 > m_file.size())
+		return false;
+
+	const std::int32_t titleLength = readInt(offset);
+
+	if (titleLength < 0 || offset + recordSize(std::size_t(titleLength)) + recordSize(4) > m_file.size())
+		return false;
+
+	offset += recordSize(std::size_t(titleLength));
+
+	// atom count record
+	if (readInt(offset) != 4)
+		return false;
+
+	const std::int32_t atomCount = readInt(offset + 4);
+	offset += recordSize(4);
+
+	if (atomCount <= 0 || fixedAtomCount < 0 || fixedAtomCount > atomCount)
+		return false;
+
+	m_atomCount = std::size_t(atomCount);
+	m_freeAtoms.clear();
+	m_firstFrame.clear();
+
+	if (fixedAtomCount > 0)
+	{
+		const std::size_t freeAtomCount = m_atomCount - std::size_t(fixedAtomCount);
+
+		if (offset + recordSize(freeAtomCount * 4) > m_file.size() || readInt(offset) != std::int32_t(freeAtomCount * 4))
+			return false;
+
+		for (std::size_t i = 0; i < freeAtomCount; i++)
+		{
+			const std::int32_t index = readInt(offset + 4 + i * 4) - 1;
+
+			if (index < 0 || index >= atomCount)
+				return false;
+
+			m_freeAtoms.push_back(std::uint32_t(index));
+		}
+
+		offset += recordSize(freeAtomCount * 4);
+	}
+
+	const auto frameSize = [this](std::size_t count)
+	{
+		return (m_unitCell ? recordSize(48) : 0) + (m_fourDimensions ? 4 : 3) * recordSize(count * 4);
+	};
+
+	m_firstFrameOffset = offset;
+	m_firstFrameSize = frameSize(m_atomCount);
+	m_frameSize = frameSize(m_freeAtoms.empty() ? m_atomCount : m_freeAtoms.size());
+
+	// The frame count in the header is unreliable for files that are still being written or were appended to,
+	// so it is derived from the file size instead
+	m_frameCount = 0;
+
+	if (m_file.size() >= m_firstFrameOffset + m_firstFrameSize)
+		m_frameCount = 1 + (m_file.size() - m_firstFrameOffset - m_firstFrameSize) / m_frameSize;
+
+	if (!m_freeAtoms.empty() && m_frameCount > 0)
+	{
+		std::vector<vec3> firstFrame;
+
+		if (!readFrame(0, firstFrame))
+			return false;
+
+		m_firstFrame = std::move(firstFrame);
+	}
+
+	globjects::debug() << "DCD file " << filename << ": " << uint(m_frameCount) << " frames, " << uint(m_atomCount) << " atoms" << (m_freeAtoms.empty() ? "" : " (with fixed atoms)") << ".";
+
+	return true;
+}
+
+std::size_t DcdReader::frameCount() const
+{
+	return m_frameCount;
+}
+
+std::size_t DcdReader::atomCount() const
+{
+	return m_atomCount;
+}
+
+bool DcdReader::readFrame(std::size_t frame, std::vector<vec3>& positions) const
+{
+	if (frame >= m_frameCount)
+		return false;
+
+	std::size_t offset = m_firstFrameOffset;
+	const std::vector<std::uint32_t>* indices = nullptr;
+	std::size_t count = m_atomCount;
+
+	if (frame > 0)
+	{
+		offset += m_firstFrameSize + (frame - 1) * m_frameSize;
+
+		if (!m_freeAtoms.empty())
+		{
+			indices = &m_freeAtoms;
+			count = m_freeAtoms.size();
+		}
+	}
+
+	if (indices)
+		positions = m_firstFrame;
+	else
+		positions.resize(m_atomCount);
+
+	if (m_unitCell)
+		offset += recordSize(48);
+
+	return readCoordinates(offset, count, positions, indices);
+}
+
+std::int32_t DcdReader::readInt(std::size_t offset) const
+{
+	std::uint32_t value;
+	std::memcpy(&value, m_file.data() + offset, sizeof(value));
+	return std::int32_t(m_swapBytes ? swap(value) : value);
+}
+
+bool DcdReader::readCoordinates(std::size_t offset, std::size_t count, std::vector<vec3>& positions, const std::vector<std::uint32_t>* indices) const
+{
+	const std::size_t length = count * 4;
+
+	// X, Y and Z are stored in separate records
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (readInt(offset) != std::int32_t(length) || readInt(offset + 4 + length) != std::int32_t(length))
+			return false;
+
+		const char* data = m_file.data() + offset + 4;
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			std::uint32_t bits;
+			std::memcpy(&bits, data + i * 4, sizeof(bits));
+
+			if (m_swapBytes)
+				bits = swap(bits);
+
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+
+			positions[indices ? (*indices)[i] : i][axis] = value;
+		}
+
+		offset += recordSize(length);
+	}
+
+	return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "TrajectoryReader.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+
+namespace dynamol
+{
+	// CHARMM/NAMD DCD trajectories of either byte order, frames have a fixed size and are located in constant time
+	class DcdReader : public TrajectoryReader
+	{
+	public:
+		bool open(const std::string& filename) override;
+		std::size_t frameCount() const override;
+		std::size_t atomCount() const override;
+		bool readFrame(std::size_t frame, std::vector<glm::vec3>& positions) const override;
+
+	private:
+		std::int32_t readInt(std::size_t offset) const;
+		bool readCoordinates(std::size_t offset, std::size_t count, std::vector<glm::vec3>& positions, const std::vector<std::uint32_t>* indices) const;
+
+		MappedFile m_file;
+		bool m_swapBytes = false;
+		bool m_unitCell = false;
+		bool m_fourDimensions = false;
+
+		std::size_t m_atomCount = 0;
+		std::size_t m_frameCount = 0;
+		std::size_t m_firstFrameOffset = 0;
+		std::size_t m_firstFrameSize = 0;
+		std::size_t m_frameSize = 0;
+
+		// with fixed atoms, only the first frame is complete and later ones contain the remaining free atoms
+		std::vector<std::uint32_t> m_freeAtoms;
+		std::vector<glm::vec3> m_firstFrame;
+	};
+}
@@ -0,0 +1,272 @@
+#include "FluidBenchmark.h"
+#include "CpuFluidSolver.h"
+#include "FluidSim.h"
+#include "ThreadPool.h"
+#include "Benchmark.h"
+
+#include <glbinding/gl/gl.h>
+#include <globjects/Program.h>
+#include <globjects/Shader.h>
+#include <globjects/Query.h>
+#include <globjects/base/File.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <vector>
+#include <random>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+using namespace globjects;
+
+namespace
+{
+	// has to match the work group size that FluidSim substitutes into the compute shaders
+	const std::int32_t workGroupSize = 8;
+
+	// one unit in the last place of a 16-bit float, relative to values above one and absolute below
+	const float tolerance = 1.0f / 1024.0f;
+
+	struct Kernel
+	{
+		std::string name;
+		std::string shader;
+		std::function<void(FluidGrid&)> cpu;
+		std::function<void(Program*)> gpu;
+
+		// the divergence is written to a texture with a single channel
+		bool scalar = false;
+	};
+
+	// compute shader of fluidsim/shader with the same replacements as in FluidSim
+	struct ComputeProgram
+	{
+		std::unique_ptr<File> file;
+		std::unique_ptr<AbstractStringSource> source;
+		std::unique_ptr<Shader> shader;
+		std::unique_ptr<Program> program;
+	};
+
+	void bindImage(Program* program, const char* name, const CStdTexture3D& texture, GLuint unit, GLenum access)
+	{
+		program->use();
+		program->setUniform(name, int(unit));
+		texture.BindImage(unit, access);
+	}
+
+	// NaN and infinity are reported as an infinite error, which std::max would otherwise drop
+	float error(float value, float reference)
+	{
+		const float e = std::abs(value - reference) / std::max(std::abs(reference), 1.0f);
+		return std::isfinite(e) ? e : std::numeric_limits<float>::infinity();
+	}
+}
+
+bool FluidBenchmark::run(std::int32_t size, bool gpu, unsigned int iterations)
+{
+	size = std::max((size + workGroupSize - 1) / workGroupSize, 1) * workGroupSize;
+	iterations = std::max(iterations, 1u);
+
+	const std::array<std::int32_t, 3> dimensions = { size, size, size };
+	const std::size_t voxelCount = std::size_t(size) * std::size_t(size) * std::size_t(size);
+	const unsigned int threadCount = ThreadPool::instance().threadCount();
+
+	// Inputs are rounded to 16-bit floats, as stored by the textures, so that both implementations start from the same values
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+	FluidGrid a(dimensions);
+	FluidGrid b(dimensions);
+
+	for (FluidGrid* grid : { &a, &b })
+	{
+		for (std::size_t i = 0; i < voxelCount * FluidGrid::Channels; i++)
+			grid->GetData()[i] = unpackHalf1x16(packHalf1x16(distribution(random)));
+	}
+
+	const float dt = 1.0f / 60.0f;
+	const float dissipation = 0.99f;
+	const float gridScale = 1.0f;
+	const float radius = float(size) * 0.37f;
+	const vec3 position = vec3(float(size) * 0.5f, float(size) * 0.25f, float(size) * 0.75f);
+	const vec4 force = vec4(0.5f, -0.25f, 1.0f, 0.0f);
+	const vec3 start = vec3(0.0f, float(size) * 0.5f, 0.0f);
+	const vec3 end = vec3(float(size), float(size) * 0.75f, float(size));
+
+	CStdTexture3D gpuA, gpuB, gpuResult, gpuDivergence;
+
+	// Arguments as used by FluidSim, the Jacobi iteration with those of the pressure solve
+	const std::vector<Kernel> kernels = {
+		{ "Advection", "advection",
+			[&](FluidGrid& result) { CpuFluidSolver::Advect(a, a, result, dt, dissipation, gridScale); },
+			[&](Program* program) {
+				program->setUniform("delta_t", dt);
+				program->setUniform("dissipation", dissipation);
+				program->setUniform("gs", gridScale);
+				bindImage(program, "quantity_r", gpuA, 0, GL_READ_ONLY);
+				bindImage(program, "quantity_w", gpuResult, 1, GL_WRITE_ONLY);
+				bindImage(program, "velocity", gpuA, 2, GL_READ_ONLY);
+			} },
+		{ "Impulse", "add_impulse",
+			[&](FluidGrid& result) { CpuFluidSolver::AddImpulse(a, result, position, radius, force); },
+			[&](Program* program) {
+				program->setUniform("position", position);
+				program->setUniform("radius", radius);
+				program->setUniform("force", force);
+				bindImage(program, "field_r", gpuA, 0, GL_READ_ONLY);
+				bindImage(program, "field_w", gpuResult, 1, GL_WRITE_ONLY);
+			} },
+		{ "Impulse line", "add_impulse_line",
+			[&](FluidGrid& result) { CpuFluidSolver::AddImpulseLine(a, result, start, end, radius, 2.0f); },
+			[&](Program* program) {
+				program->setUniform("radius", radius);
+				program->setUniform("start", start);
+				program->setUniform("end", end);
+				program->setUniform("forceMultiplier", 2.0f);
+				bindImage(program, "field_r", gpuA, 0, GL_READ_ONLY);
+				bindImage(program, "field_w", gpuResult, 1, GL_WRITE_ONLY);
+			} },
+		{ "Jacobi", "jacobi",
+			[&](FluidGrid& result) { CpuFluidSolver::Jacobi(a, b, result, -1.0f, 0.25f); },
+			[&](Program* program) {
+				program->setUniform("alpha", -1.0f);
+				program->setUniform("beta", 0.25f);
+				bindImage(program, "fieldb_r", gpuB, 0, GL_READ_ONLY);
+				bindImage(program, "fieldx_r", gpuA, 1, GL_READ_ONLY);
+				bindImage(program, "field_out", gpuResult, 2, GL_WRITE_ONLY);
+			} },
+		{ "Divergence", "divergence",
+			[&](FluidGrid& result) { CpuFluidSolver::Divergence(a, result, gridScale); },
+			[&](Program* program) {
+				program->setUniform("gs", gridScale);
+				bindImage(program, "field_r", gpuA, 0, GL_READ_ONLY);
+				bindImage(program, "field_w", gpuDivergence, 1, GL_WRITE_ONLY);
+			}, true },
+		{ "Gradient", "gradient",
+			[&](FluidGrid& result) { CpuFluidSolver::Gradient(a, result, gridScale); },
+			[&](Program* program) {
+				program->setUniform("gs", gridScale);
+				bindImage(program, "field_r", gpuA, 0, GL_READ_ONLY);
+				bindImage(program, "field_w", gpuResult, 1, GL_WRITE_ONLY);
+			} },
+		{ "Subtract", "subtract",
+			[&](FluidGrid& result) { CpuFluidSolver::Subtract(a, b, result); },
+			[&](Program* program) {
+				bindImage(program, "a", gpuA, 0, GL_READ_ONLY);
+				bindImage(program, "b", gpuB, 1, GL_READ_ONLY);
+				bindImage(program, "c", gpuResult, 2, GL_WRITE_ONLY);
+			} },
+		{ "Boundary", "boundary",
+			[&](FluidGrid& result) { CpuFluidSolver::Boundary(a, result, -1.0f); },
+			[&](Program* program) {
+				program->setUniform("scale", -1.0f);
+				bindImage(program, "field_r", gpuA, 0, GL_READ_ONLY);
+				bindImage(program, "field_w", gpuResult, 1, GL_WRITE_ONLY);
+			} }
+	};
+
+	std::vector<ComputeProgram> programs(kernels.size());
+	std::unique_ptr<Query> timer;
+
+	if (gpu)
+	{
+		FluidSim::AddShaderReplacements();
+
+		for (std::size_t k = 0; k < kernels.size(); k++)
+		{
+			ComputeProgram& p = programs[k];
+			p.file = Shader::sourceFromFile("./fluidsim/shader/" + kernels[k].shader + ".comp");
+			p.source = Shader::applyGlobalReplacements(p.file.get());
+			p.shader = Shader::create(GL_COMPUTE_SHADER, p.source.get());
+			p.program = std::make_unique<Program>();
+			p.program->attach(p.shader.get());
+			p.program->link();
+
+			if (!p.program->isLinked())
+			{
+				std::cout << "Could not build the " << kernels[k].shader << " shader!" << std::endl;
+				return false;
+			}
+		}
+
+		gpuA = CStdTexture3D(size, size, size, 4, false, false, a.GetData());
+		gpuB = CStdTexture3D(size, size, size, 4, false, false, b.GetData());
+		gpuResult = CStdTexture3D(size, size, size, 4);
+		gpuDivergence = CStdTexture3D(size, size, size, 1);
+		timer = std::make_unique<Query>();
+	}
+
+	std::cout << "Benchmarking fluid kernels on a " << size << " x " << size << " x " << size << " grid (" << iterations << " iterations, " << threadCount << " threads)" << std::endl;
+
+	FluidGrid result(dimensions);
+	std::vector<float> gpuData(voxelCount * FluidGrid::Channels);
+	bool match = true;
+
+	for (std::size_t k = 0; k < kernels.size(); k++)
+	{
+		const Kernel& kernel = kernels[k];
+		const double cpuTime = Benchmark::minimumTime(iterations, [&]() { kernel.cpu(result); });
+
+		// per core is the throughput of all threads of the pool divided by their number
+		const double voxelsPerSecond = double(voxelCount) / cpuTime;
+		std::cout << "  " << kernel.name << ": " << cpuTime * 1000.0 << " ms (" << voxelsPerSecond / 1e6 << " M voxels/s, " << voxelsPerSecond / double(threadCount) / 1e6 << " M voxels/s per core)";
+
+		if (gpu)
+		{
+			Program* program = programs[k].program.get();
+			double gpuTime = std::numeric_limits<double>::max();
+
+			for (unsigned int i = 0; i < iterations; i++)
+			{
+				kernel.gpu(program);
+				glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+				timer->begin(GL_TIME_ELAPSED);
+				program->dispatchCompute(size / workGroupSize, size / workGroupSize, size / workGroupSize);
+				timer->end(GL_TIME_ELAPSED);
+
+				gpuTime = std::min(gpuTime, double(timer->get64(GL_QUERY_RESULT)) / 1e9);
+			}
+
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+			const CStdTexture3D& output = kernel.scalar ? gpuDivergence : gpuResult;
+			output.Bind(0);
+			glGetTexImage(GL_TEXTURE_3D, 0, kernel.scalar ? GL_RED : GL_RGBA, GL_FLOAT, gpuData.data());
+
+			float maximumError = 0.0f;
+
+			for (std::size_t i = 0; i < voxelCount; i++)
+			{
+				if (kernel.scalar)
+				{
+					maximumError = std::max(maximumError, error(gpuData[i], result.GetData()[i * FluidGrid::Channels]));
+				}
+				else
+				{
+					for (std::size_t c = 0; c < FluidGrid::Channels; c++)
+						maximumError = std::max(maximumError, error(gpuData[i * FluidGrid::Channels + c], result.GetData()[i * FluidGrid::Channels + c]));
+				}
+			}
+
+			const bool kernelMatch = maximumError <= tolerance;
+			match = match && kernelMatch;
+
+			std::cout << ", GPU " << gpuTime * 1000.0 << " ms (" << double(voxelCount) / gpuTime / 1e6 << " M voxels/s), maximum error " << maximumError << (kernelMatch ? "" : " DIFFERS");
+		}
+
+		std::cout << std::endl;
+	}
+
+	if (gpu)
+		std::cout << "Kernels " << (match ? "identical" : "DIFFER") << " to the compute shaders within the precision of 16-bit floats." << std::endl;
+
+	return match;
+}
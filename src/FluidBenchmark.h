@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+namespace dynamol
+{
+	// Measures the throughput of every kernel of the CPU fluid solver on a grid of random velocities, in voxels per second and
+	// per core of the thread pool. With a current OpenGL context, the compute shaders of FluidSim run on the same input, are
+	// timed with GPU timer queries and their results are checked against the CPU kernels within the precision of the 16-bit
+	// float textures. The size is rounded up to whole work groups of the shaders.
+	class FluidBenchmark
+	{
+	public:
+		static bool run(std::int32_t size = 128, bool gpu = true, unsigned int iterations = 10);
+	};
+}
@@ -26,7 +26,6 @@ namespace dynamol
 FluidSim::FluidSim(Renderer *const renderer, const std::array<std::int32_t, 2> &windowDimensions, const std::array<std::int32_t, 3> &cubeDimensions)
     : Interactor{renderer->viewer()},
       m_renderer{renderer},
-      m_timerQuery{std::make_unique<globjects::Query>()},
 	  m_windowDimensions{windowDimensions},
 	  m_cubeDimensions{cubeDimensions},
       m_velocityTexture{cubeDimensions[0], cubeDimensions[1], cubeDimensions[2], 4, false},
@@ -37,9 +36,7 @@ FluidSim::FluidSim(Renderer *const renderer, const std::array<std::int32_t, 2> &
       m_gridScale{1.0f},
       m_splatRadius{cubeDimensions[0] * 0.37f},
       m_dt{0},
-      m_lastTime{0},
-      m_frameCounter{0},
-      m_frameTimeSum{0}
+      m_lastTime{0}
 {
     LoadShaders();
     m_debugFramebuffer.Bind();
@@ -53,12 +50,43 @@ FluidSim::~FluidSim()
 
 void FluidSim::Execute()
 {
-    const double now{glfwGetTime()};
+    const double now{m_renderer->viewer()->time()};
     m_dt = m_lastTime == 0 ? 0.016667 : now - m_lastTime;
     m_lastTime = now;
     //DoDroplets();
 
-    m_timerQuery->begin(GL_TIME_ELAPSED);
+    Profiler *const profiler{m_renderer->viewer()->profiler()};
+
+    if (m_backend == Backend::Cpu)
+    {
+        ExecuteCpu();
+    }
+    else
+    {
+        ExecuteGpu();
+    }
+
+    // Transform feedback read
+#pragma region Render
+    profiler->begin("fluid render plane");
+    m_debugFramebuffer.Bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_renderPlaneProgram->use();
+    m_velocityTexture.Bind(0);
+    m_renderPlaneProgram->setUniform("sampler", 0);
+    m_renderPlaneProgram->setUniform("depth", 5.0f);
+    m_quad.Bind();
+
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    m_quad.Draw();
+    m_debugFramebuffer.Unbind();
+    profiler->end();
+#pragma endregion
+}
+
+void FluidSim::ExecuteGpu()
+{
+    Profiler *const profiler{m_renderer->viewer()->profiler()};
 
 /*
 #pragma region Seed
@@ -76,6 +104,7 @@ void FluidSim::Execute()
 
 
 #pragma region Advection
+    profiler->begin("fluid advection");
     m_advectionProgram->setUniform("delta_t", m_dt);
     m_advectionProgram->setUniform("dissipation", m_variables.Dissipation);
     m_advectionProgram->setUniform("gs", m_gridScale);
@@ -85,6 +114,7 @@ void FluidSim::Execute()
     BindImage(m_advectionProgram, "velocity", m_velocityTexture.GetFront(), 2, GL_READ_ONLY);
     Compute(m_advectionProgram);
     m_velocityTexture.SwapBuffers();
+    profiler->end();
 #pragma endregion
 
 /*
@@ -97,8 +127,9 @@ void FluidSim::Execute()
 
 #pragma region Impulse
     std::visit(Visitor{
-        [this](const ImpulseState &impulseState)
+        [this, profiler](const ImpulseState &impulseState)
         {
+            const Profiler::Scope scope{profiler, "fluid impulse"};
             m_addImpulseProgram->setUniform("position", impulseState.CurrentPos);
             m_addImpulseProgram->setUniform("radius", m_splatRadius);
             m_addImpulseProgram->setUniform("force", glm::vec4{ impulseState.Delta, 0 });
@@ -107,16 +138,17 @@ void FluidSim::Execute()
             Compute(m_addImpulseProgram);
             m_velocityTexture.SwapBuffers();
         },
-        [this](const std::pair<glm::vec3, glm::vec3> &impulseLine)
+        [this, profiler](const std::pair<glm::vec3, glm::vec3> &impulseLine)
         {
+            const Profiler::Scope scope{profiler, "fluid impulse"};
             m_addImpulseLineProgram->setUniform("radius", m_splatRadius);
             m_addImpulseLineProgram->setUniform("start", impulseLine.first);
             m_addImpulseLineProgram->setUniform("end", impulseLine.second);
             m_addImpulseLineProgram->setUniform("cameraPosition", m_renderer->viewer()->cameraPosition());
             m_addImpulseLineProgram->setUniform("forceMultiplier", m_variables.ForceMultiplier);
-            BindImage(m_addImpulseProgram, "field_r", m_velocityTexture.GetFront(), 0, GL_READ_ONLY);
-            BindImage(m_addImpulseProgram, "field_w", m_velocityTexture.GetBack(), 1, GL_WRITE_ONLY);
-            Compute(m_addImpulseProgram);
+            BindImage(m_addImpulseLineProgram, "field_r", m_velocityTexture.GetFront(), 0, GL_READ_ONLY);
+            BindImage(m_addImpulseLineProgram, "field_w", m_velocityTexture.GetBack(), 1, GL_WRITE_ONLY);
+            Compute(m_addImpulseLineProgram);
             m_velocityTexture.SwapBuffers();
         },
         [this](std::monostate) {}
@@ -178,35 +210,51 @@ void FluidSim::Execute()
     m_velocityTexture.SwapBuffers();
 #pragma endregion
 */
-    // Transform feedback read
-#pragma region TimeTrack
-    m_timerQuery->end(GL_TIME_ELAPSED);
+}
 
-    const GLuint elapsedTime{m_timerQuery->waitAndGet(GL_QUERY_RESULT)};
+void FluidSim::ExecuteCpu()
+{
+    const Profiler::Scope scope{m_renderer->viewer()->profiler(), "fluid cpu"};
 
-    m_frameTimeSum += elapsedTime / 1000;
+    // The grids continue from the texture, which the GPU backend may have advanced since they were last used
+    if (!m_cpuVelocityValid)
+    {
+        m_cpuVelocity = FluidGrid{m_cubeDimensions};
+        m_cpuTemporary = FluidGrid{m_cubeDimensions};
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        m_velocityTexture.GetFront().Bind(0);
+        glGetTexImage(GL_TEXTURE_3D, 0, GL_RGBA, GL_FLOAT, m_cpuVelocity.GetData());
+        m_cpuVelocityValid = true;
+    }
 
-    if (++m_frameCounter == 100)
+    if (m_variables.Boundaries)
     {
-        globjects::debug() << m_frameTimeSum / static_cast<float>(m_frameCounter) << '\n';
-        m_frameCounter = 0;
-        m_frameTimeSum = 0;
+        CpuFluidSolver::Boundary(m_cpuVelocity, m_cpuTemporary, -1);
+        std::swap(m_cpuVelocity, m_cpuTemporary);
     }
-#pragma endregion
 
-#pragma region Render
-    m_debugFramebuffer.Bind();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    m_renderPlaneProgram->use();
-    m_velocityTexture.Bind(0);
-    m_renderPlaneProgram->setUniform("sampler", 0);
-    m_renderPlaneProgram->setUniform("depth", 5.0f);
-    m_quad.Bind();
+    CpuFluidSolver::Advect(m_cpuVelocity, m_cpuVelocity, m_cpuTemporary, m_dt, m_variables.Dissipation, m_gridScale);
+    std::swap(m_cpuVelocity, m_cpuTemporary);
 
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-    m_quad.Draw();
-    m_debugFramebuffer.Unbind();
-#pragma endregion
+    std::visit(Visitor{
+        [this](const ImpulseState &impulseState)
+        {
+            CpuFluidSolver::AddImpulse(m_cpuVelocity, m_cpuTemporary, impulseState.CurrentPos, m_splatRadius, glm::vec4{ impulseState.Delta, 0 });
+            std::swap(m_cpuVelocity, m_cpuTemporary);
+        },
+        [this](const std::pair<glm::vec3, glm::vec3> &impulseLine)
+        {
+            CpuFluidSolver::AddImpulseLine(m_cpuVelocity, m_cpuTemporary, impulseLine.first, impulseLine.second, m_splatRadius, m_variables.ForceMultiplier);
+            std::swap(m_cpuVelocity, m_cpuTemporary);
+        },
+        [](std::monostate) {}
+    }, m_impulseState);
+
+    m_impulseState.emplace<0>();
+
+    // the front texture is read by the render plane and the sphere renderer
+    m_velocityTexture.GetFront().Bind(0);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, m_cubeDimensions[0], m_cubeDimensions[1], m_cubeDimensions[2], GL_RGBA, GL_FLOAT, m_cpuVelocity.GetData());
 }
 
 GLuint FluidSim::GetDebugFramebufferTexture() const
@@ -219,6 +267,30 @@ const CStdTexture3D &FluidSim::GetVelocityTexture() const
     return m_velocityTexture.GetFront();
 }
 
+FluidSim::Backend FluidSim::GetBackend() const
+{
+    return m_backend;
+}
+
+void FluidSim::SetBackend(const Backend backend)
+{
+    m_backend = backend;
+    m_cpuVelocityValid = false;
+}
+
+void FluidSim::Resize(const std::array<std::int32_t, 3> &cubeDimensions)
+{
+    m_cubeDimensions = cubeDimensions;
+    m_velocityTexture = CStdSwappableTexture3D{cubeDimensions[0], cubeDimensions[1], cubeDimensions[2], 4, false};
+    m_pressureTexture = CStdSwappableTexture3D{cubeDimensions[0], cubeDimensions[1], cubeDimensions[2], 4, false};
+    m_divergenceTexture = CStdTexture3D{cubeDimensions[0], cubeDimensions[1], cubeDimensions[2], 1, false};
+    m_temporaryTexture = CStdTexture3D{cubeDimensions[0], cubeDimensions[1], cubeDimensions[2], 4, false};
+    m_splatRadius = cubeDimensions[0] * 0.37f;
+    m_impulseState.emplace<0>();
+    m_lastTime = 0;
+    m_cpuVelocityValid = false;
+}
+
 void FluidSim::mouseButtonEvent(const int button, const int action, const int mods)
 {
     if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) return;
@@ -265,15 +337,30 @@ void FluidSim::display()
 		ImGui::SliderFloat("ForceMultiplier", &m_variables.ForceMultiplier, 0.1f, 10.0f);
 		ImGui::Checkbox("Boundaries", &m_variables.Boundaries);
 		ImGui::SliderFloat("Global Gravity", &m_variables.GlobalGravity, 0.f, 10.f, "%.3f", ImGuiSliderFlags_AlwaysClamp);
+
+		int backend{static_cast<int>(m_backend)};
+		ImGui::RadioButton("GPU", &backend, static_cast<int>(Backend::Gpu));
+		ImGui::SameLine();
+		ImGui::RadioButton("CPU", &backend, static_cast<int>(Backend::Cpu));
+
+		if (backend != static_cast<int>(m_backend))
+		{
+			SetBackend(static_cast<Backend>(backend));
+		}
 		ImGui::EndMenu();
 	}
 }
 
-void FluidSim::LoadShaders()
+void FluidSim::AddShaderReplacements()
 {
     globjects::Shader::globalReplace("layout(local_size_x=1, local_size_y=1, local_size_z=1)", "layout(local_size_x=8, local_size_y=8, local_size_z=8)");
     globjects::Shader::globalReplace("layout(rgba16_snorm)", "layout(rgba16f)");
     globjects::Shader::globalReplace("layout(r16_snorm)", "layout(r16f)");
+}
+
+void FluidSim::LoadShaders()
+{
+    AddShaderReplacements();
 
     const auto addShaderProgram = [this](globjects::Program *(FluidSim::*program), std::string_view name, std::initializer_list<std::pair<gl::GLenum, std::string>> shaders)
     {
@@ -325,6 +412,8 @@ void FluidSim::Compute(globjects::Program *const program)
 
 void FluidSim::SolvePoissonSystem(CStdSwappableTexture3D& swappableTexture, const CStdTexture3D& initialValue, const float alpha, const float beta, const bool isProject)
 {
+    const Profiler::Scope scope{m_renderer->viewer()->profiler(), "fluid jacobi"};
+
     CopyImage(initialValue, m_temporaryTexture);
     m_jacobiProgram->setUniform("alpha", alpha);
     m_jacobiProgram->setUniform("beta", beta);
@@ -343,6 +432,8 @@ void FluidSim::SolvePoissonSystem(CStdSwappableTexture3D& swappableTexture, cons
 
 void FluidSim::CopyImage(const CStdTexture3D& source, CStdTexture3D& destination)
 {
+    const Profiler::Scope scope{m_renderer->viewer()->profiler(), "fluid copy"};
+
     BindImage(m_copyProgram, "src", source, 0, GL_READ_ONLY);
     BindImage(m_copyProgram, "dest", destination, 1, GL_WRITE_ONLY);
     Compute(m_copyProgram);
@@ -350,6 +441,8 @@ void FluidSim::CopyImage(const CStdTexture3D& source, CStdTexture3D& destination
 
 void FluidSim::SetBounds(CStdSwappableTexture3D& texture, const float scale)
 {
+    const Profiler::Scope scope{m_renderer->viewer()->profiler(), "fluid bounds"};
+
     m_boundaryProgram->setUniform("scale", scale);
     // m_boundaryProgram->setUniform("box_size", glm::vec3{ static_cast<float>(m_cubeDimensions[0]), static_cast<float>(m_cubeDimensions[1]), static_cast<float>(m_cubeDimensions[2]) });
     BindImage(m_boundaryProgram, "field_r", texture.GetFront(), 0, GL_READ_ONLY);
@@ -4,6 +4,7 @@
 #include "ImpulseState.h"
 #include "Interactor.h"
 #include "Shader.h"
+#include "CpuFluidSolver.h"
 
 #include <array>
 #include <memory>
@@ -26,7 +27,6 @@
 #include <globjects/TextureHandle.h>
 #include <globjects/NamedString.h>
 #include <globjects/base/StaticStringSource.h>
-#include <globjects/Query.h>
 #include <globjects/TransformFeedback.h>
 
 namespace dynamol
@@ -48,6 +48,13 @@ namespace dynamol
             static constexpr std::size_t NumJacobiRoundsDiffusion{ 20 };
         };
 
+        // The CPU backend runs the same steps with CpuFluidSolver and uploads the velocity for rendering after every step
+        enum class Backend
+        {
+            Gpu,
+            Cpu
+        };
+
     public:
         FluidSim(Renderer *renderer, const std::array<std::int32_t, 2> &windowDimensions, const std::array<std::int32_t, 3> &cubeDimensions);
         ~FluidSim();
@@ -56,11 +63,21 @@ namespace dynamol
         void Execute();
         GLuint GetDebugFramebufferTexture() const;
         const CStdTexture3D &GetVelocityTexture() const;
+        Backend GetBackend() const;
+        void SetBackend(Backend backend);
+
+        // Starts over with a grid of the given size at rest
+        void Resize(const std::array<std::int32_t, 3> &cubeDimensions);
+
+        // Replacements applied to the compute shaders, which are written for a single invocation per work group and snorm textures
+        static void AddShaderReplacements();
 
 		virtual void mouseButtonEvent(int button, int action, int mods) override;
         virtual void display() override;
 
     private:
+        void ExecuteGpu();
+        void ExecuteCpu();
         void LoadShaders();
         void BindImage(globjects::Program *program, std::string_view name, const CStdTexture3D &texture, int value, GLenum access);
         void Compute(globjects::Program *program);
@@ -76,7 +93,6 @@ namespace dynamol
         Renderer *m_renderer;
         std::array<std::int32_t, 2> m_windowDimensions;
         std::array<std::int32_t, 3> m_cubeDimensions;
-        std::unique_ptr<globjects::Query> m_timerQuery;
 
         globjects::Program *m_borderProgram{nullptr};
         globjects::Program *m_addImpulseProgram{nullptr};
@@ -104,7 +120,10 @@ namespace dynamol
         float m_splatRadius;
         float m_lastTime;
         std::variant<std::monostate, ImpulseState, std::pair<glm::vec3, glm::vec3>> m_impulseState;
-        GLuint m_frameCounter{0};
-        GLuint m_frameTimeSum{0};
+
+        Backend m_backend{Backend::Gpu};
+        FluidGrid m_cpuVelocity;
+        FluidGrid m_cpuTemporary;
+        bool m_cpuVelocityValid{false};
     };
 }
\ No newline at end of file
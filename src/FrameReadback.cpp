@@ -0,0 +1,180 @@
+#include "FrameReadback.h"
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+
+#include <algorithm>
+#include <limits>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+using namespace globjects;
+
+FrameReadback::FrameReadback(std::size_t slotCount)
+{
+	for (std::size_t i = 0; i < std::max(slotCount, std::size_t(1)); i++)
+		m_slots.push_back(std::make_unique<Slot>());
+
+	m_thread = std::thread(&FrameReadback::run, this);
+}
+
+FrameReadback::~FrameReadback()
+{
+	finish();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+
+	m_condition.notify_all();
+	m_thread.join();
+}
+
+bool FrameReadback::read(Framebuffer* framebuffer, GLenum buffer, const ivec2& size, Callback callback, bool wait)
+{
+	if (size.x <= 0 || size.y <= 0)
+		return false;
+
+	Slot* slot = availableSlot();
+
+	while (!slot && wait)
+	{
+		// the oldest readback is waited for, or if all of them are with the worker, the oldest callback
+		if (!m_reading.empty())
+		{
+			m_reading.front()->fence->clientWait(GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+			submit(m_reading.front());
+			m_reading.pop_front();
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_released.wait(lock, [this] { return m_processing < m_slots.size(); });
+		}
+
+		slot = availableSlot();
+	}
+
+	if (!slot)
+		return false;
+
+	// Buffers only grow, persistently mapped storage cannot be resized, so it is created again
+	const std::size_t byteSize = std::size_t(size.x) * std::size_t(size.y) * 4;
+
+	if (slot->capacity < byteSize)
+	{
+		slot->buffer = std::make_unique<Buffer>();
+		slot->buffer->setStorage(byteSize, nullptr, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_CLIENT_STORAGE_BIT);
+		slot->data = static_cast<unsigned char*>(slot->buffer->mapRange(0, byteSize, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+		slot->capacity = byteSize;
+	}
+
+	slot->busy = true;
+	slot->size = size;
+	slot->callback = std::move(callback);
+
+	framebuffer->bind(GL_READ_FRAMEBUFFER);
+	glReadBuffer(buffer);
+
+	// with a pixel pack buffer bound, the copy is only queued and the pointer is an offset into the buffer
+	slot->buffer->bind(GL_PIXEL_PACK_BUFFER);
+	glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	Buffer::unbind(GL_PIXEL_PACK_BUFFER);
+
+	slot->fence = Sync::fence(GL_SYNC_GPU_COMMANDS_COMPLETE);
+	m_reading.push_back(slot);
+
+	return true;
+}
+
+void FrameReadback::update()
+{
+	// Readbacks complete in the order they were issued, so the first one that is still in flight ends the update
+	while (!m_reading.empty())
+	{
+		const GLenum result = m_reading.front()->fence->clientWait(GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			break;
+
+		submit(m_reading.front());
+		m_reading.pop_front();
+	}
+}
+
+void FrameReadback::finish()
+{
+	while (!m_reading.empty())
+	{
+		m_reading.front()->fence->clientWait(GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+		submit(m_reading.front());
+		m_reading.pop_front();
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_released.wait(lock, [this] { return m_processing == 0; });
+}
+
+std::size_t FrameReadback::pendingCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_reading.size() + m_processing;
+}
+
+FrameReadback::Slot* FrameReadback::availableSlot()
+{
+	for (auto& s : m_slots)
+	{
+		if (!s->busy)
+			return s.get();
+	}
+
+	return nullptr;
+}
+
+void FrameReadback::submit(Slot* slot)
+{
+	slot->fence.reset();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(slot);
+		m_processing++;
+	}
+
+	m_condition.notify_one();
+}
+
+void FrameReadback::run()
+{
+	while (true)
+	{
+		Slot* slot = nullptr;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+
+			if (m_queue.empty())
+				break;
+
+			slot = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		// the coherent mapping makes the pixels visible once the fence has signaled, the worker makes no OpenGL calls
+		if (slot->callback)
+			slot->callback({ slot->data, slot->size });
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			slot->callback = nullptr;
+			slot->busy = false;
+			m_processing--;
+		}
+
+		m_released.notify_all();
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <globjects/Buffer.h>
+#include <globjects/Framebuffer.h>
+#include <globjects/Sync.h>
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+	// Reads the pixels of a framebuffer without stalling the render loop. The pixels are copied into one of a ring of persistently
+	// mapped pixel buffer objects, whose fences are polled once per frame. Once a copy is complete, the mapped pixels are handed
+	// to a worker thread, which passes them to the callback of the request, e.g. to encode an image or a frame of a video. The
+	// buffer is reused as soon as the callback returns, so a callback that keeps up with the frame rate allows every frame to be read.
+	class FrameReadback
+	{
+	public:
+		// RGBA pixels with 8 bits per channel, starting with the bottom row as returned by glReadPixels
+		struct Image
+		{
+			const unsigned char* data;
+			glm::ivec2 size;
+		};
+
+		// called on the worker thread, the pixels are only valid until it returns
+		using Callback = std::function<void(const Image&)>;
+
+		FrameReadback(std::size_t slotCount = 3);
+		~FrameReadback();
+
+		// Starts to read the buffer of the framebuffer, returns false if all buffers are still in use, unless it is asked to wait
+		// for one to become available
+		bool read(globjects::Framebuffer* framebuffer, gl::GLenum buffer, const glm::ivec2& size, Callback callback, bool wait = false);
+
+		// Passes the readbacks that are complete to the worker thread, never waits for the GPU
+		void update();
+
+		// Waits until every readback has been passed to its callback
+		void finish();
+
+		// readbacks that were started but have not been passed to their callback yet
+		std::size_t pendingCount() const;
+
+	private:
+		struct Slot
+		{
+			std::unique_ptr<globjects::Buffer> buffer;
+			unsigned char* data = nullptr;
+			std::size_t capacity = 0;
+
+			std::unique_ptr<globjects::Sync> fence;
+			glm::ivec2 size = glm::ivec2(0);
+			Callback callback;
+
+			// set while the slot is read by the GPU or its pixels are used by the callback
+			std::atomic<bool> busy { false };
+		};
+
+		Slot* availableSlot();
+		void submit(Slot* slot);
+		void run();
+
+		std::vector< std::unique_ptr<Slot> > m_slots;
+
+		// slots read by the GPU in the order of their requests, only used on the render thread
+		std::deque<Slot*> m_reading;
+
+		std::thread m_thread;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::condition_variable m_released;
+		std::deque<Slot*> m_queue;
+		std::size_t m_processing = 0;
+		bool m_stopping = false;
+	};
+}
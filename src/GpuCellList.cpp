@@ -0,0 +1,194 @@
+#include "GpuCellList.h"
+#include "CellList.h"
+#include "Renderer.h"
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+
+#include <algorithm>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+using namespace globjects;
+
+GpuCellList::GpuCellList(Renderer* renderer) : m_renderer(renderer)
+{
+	m_renderer->createShaderProgram("celllistcount", {
+			{ GL_COMPUTE_SHADER,"./res/celllist/count-cs.glsl" }
+		},
+		{ "./res/celllist/celllist.glsl" });
+
+	m_renderer->createShaderProgram("celllistscan", {
+			{ GL_COMPUTE_SHADER,"./res/celllist/scan-cs.glsl" }
+		});
+
+	m_renderer->createShaderProgram("celllistadd", {
+			{ GL_COMPUTE_SHADER,"./res/celllist/add-cs.glsl" }
+		});
+
+	m_renderer->createShaderProgram("celllistscatter", {
+			{ GL_COMPUTE_SHADER,"./res/celllist/scatter-cs.glsl" }
+		},
+		{ "./res/celllist/celllist.glsl" });
+}
+
+void GpuCellList::build(Buffer* atoms, uint count, const vec3& minimum, const vec3& maximum, float cellSize)
+{
+	auto programCount = m_renderer->shaderProgram("celllistcount");
+	auto programScan = m_renderer->shaderProgram("celllistscan");
+	auto programAdd = m_renderer->shaderProgram("celllistadd");
+	auto programScatter = m_renderer->shaderProgram("celllistscatter");
+
+	m_size = count;
+	m_minimum = minimum;
+	m_cellSize = cellSize;
+	m_cellCounts = CellList::gridSize(maximum - minimum, count, m_cellSize);
+
+	// one more entry than cells, so the start after the last cell holds the number of atoms
+	const uint valueCount = uint(m_cellCounts.x) * uint(m_cellCounts.y) * uint(m_cellCounts.z) + 1;
+
+	reserve(m_cellStarts, m_cellStartsCapacity, valueCount * sizeof(uint));
+	reserve(m_ranks, m_ranksCapacity, std::max(count, 1u) * sizeof(uint));
+	reserve(m_sortedIndices, m_sortedIndicesCapacity, std::max(count, 1u) * sizeof(uint));
+	reserve(m_sortedAtoms, m_sortedAtomsCapacity, std::max(count, 1u) * sizeof(vec4));
+
+	const uint zero = 0;
+	m_cellStarts->clearSubData(GL_R32UI, 0, valueCount * sizeof(uint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	const uint atomGroups = (count + workGroupSize - 1) / workGroupSize;
+
+	atoms->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+	m_cellStarts->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+	m_ranks->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+
+	if (atomGroups > 0)
+	{
+		setUniforms(programCount);
+		programCount->setUniform("atomCount", count);
+		programCount->dispatchCompute(atomGroups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	// The cell sizes are turned into starts by a prefix sum over blocks, whose sums are scanned in turn until a single block remains
+	std::vector<Buffer*> levels = { m_cellStarts.get() };
+	std::vector<uint> levelSizes = { valueCount };
+
+	while (true)
+	{
+		const std::size_t level = levels.size() - 1;
+		const uint blockCount = (levelSizes.back() + scanBlockSize - 1) / scanBlockSize;
+
+		if (m_blockSums.size() <= level)
+		{
+			m_blockSums.push_back(std::make_unique<Buffer>());
+			m_blockSumsCapacities.push_back(0);
+		}
+
+		reserve(m_blockSums[level], m_blockSumsCapacities[level], blockCount * sizeof(uint));
+
+		levels.back()->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+		m_blockSums[level]->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+		programScan->setUniform("valueCount", levelSizes.back());
+		programScan->dispatchCompute(blockCount, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		if (blockCount == 1)
+			break;
+
+		levels.push_back(m_blockSums[level].get());
+		levelSizes.push_back(blockCount);
+	}
+
+	for (std::size_t level = levels.size() - 1; level > 0; level--)
+	{
+		levels[level - 1]->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+		levels[level]->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+		programAdd->setUniform("valueCount", levelSizes[level - 1]);
+		programAdd->dispatchCompute((levelSizes[level - 1] + workGroupSize - 1) / workGroupSize, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	m_cellStarts->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+	m_sortedIndices->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+	m_sortedAtoms->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+
+	if (atomGroups > 0)
+	{
+		setUniforms(programScatter);
+		programScatter->setUniform("atomCount", count);
+		programScatter->dispatchCompute(atomGroups, 1, 1);
+	}
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	for (uint binding = 0; binding <= 5; binding++)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+}
+
+void GpuCellList::bind(Program* program, uint firstBinding) const
+{
+	m_cellStarts->bindBase(GL_SHADER_STORAGE_BUFFER, firstBinding);
+	m_sortedIndices->bindBase(GL_SHADER_STORAGE_BUFFER, firstBinding + 1);
+	m_sortedAtoms->bindBase(GL_SHADER_STORAGE_BUFFER, firstBinding + 2);
+	setUniforms(program);
+}
+
+void GpuCellList::unbind(uint firstBinding) const
+{
+	for (uint binding = firstBinding; binding < firstBinding + 3; binding++)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+}
+
+uint GpuCellList::size() const
+{
+	return m_size;
+}
+
+float GpuCellList::cellSize() const
+{
+	return m_cellSize;
+}
+
+ivec3 GpuCellList::cellCounts() const
+{
+	return m_cellCounts;
+}
+
+vec3 GpuCellList::minimum() const
+{
+	return m_minimum;
+}
+
+Buffer* GpuCellList::cellStarts() const
+{
+	return m_cellStarts.get();
+}
+
+Buffer* GpuCellList::sortedIndices() const
+{
+	return m_sortedIndices.get();
+}
+
+Buffer* GpuCellList::sortedAtoms() const
+{
+	return m_sortedAtoms.get();
+}
+
+void GpuCellList::reserve(std::unique_ptr<Buffer>& buffer, std::size_t& capacity, std::size_t size)
+{
+	// buffers only grow, so playback of timesteps with varying atom counts does not reallocate every frame
+	if (capacity < size)
+	{
+		buffer->setData(size, nullptr, GL_DYNAMIC_COPY);
+		capacity = size;
+	}
+}
+
+void GpuCellList::setUniforms(Program* program) const
+{
+	program->setUniform("cellListMinimum", m_minimum);
+	program->setUniform("cellListCellSize", m_cellSize);
+	program->setUniform("cellListCellCounts", m_cellCounts);
+}
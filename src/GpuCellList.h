@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <memory>
+
+#include <glbinding/gl/gl.h>
+#include <globjects/Buffer.h>
+#include <globjects/Program.h>
+
+namespace dynamol
+{
+	class Renderer;
+
+	// Builds the same cell list as CellList on the GPU from a buffer of atoms, with the counting sort split into compute passes
+	// for counting, prefix summing and scattering. Shaders querying the list include /celllist.glsl and bind the buffers.
+	class GpuCellList
+	{
+	public:
+		GpuCellList(Renderer* renderer);
+
+		// Sorts count atoms stored as vec4 in the buffer, the cells are chosen as described for CellList::build
+		void build(globjects::Buffer* atoms, glm::uint count, const glm::vec3& minimum, const glm::vec3& maximum, float cellSize);
+
+		// Binds the cell starts, sorted atom indices and sorted atoms to consecutive shader storage buffer bindings
+		// and sets the uniforms of /celllist.glsl for the program
+		void bind(globjects::Program* program, glm::uint firstBinding) const;
+		void unbind(glm::uint firstBinding) const;
+
+		glm::uint size() const;
+		float cellSize() const;
+		glm::ivec3 cellCounts() const;
+		glm::vec3 minimum() const;
+
+		globjects::Buffer* cellStarts() const;
+		globjects::Buffer* sortedIndices() const;
+		globjects::Buffer* sortedAtoms() const;
+
+	private:
+		static const glm::uint scanBlockSize = 1024;
+		static const glm::uint workGroupSize = 256;
+
+		void reserve(std::unique_ptr<globjects::Buffer>& buffer, std::size_t& capacity, std::size_t size);
+		void setUniforms(globjects::Program* program) const;
+
+		Renderer* m_renderer;
+
+		glm::uint m_size = 0;
+		float m_cellSize = 1.0f;
+		glm::ivec3 m_cellCounts = glm::ivec3(1);
+		glm::vec3 m_minimum = glm::vec3(0.0f);
+
+		std::unique_ptr<globjects::Buffer> m_cellStarts = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_ranks = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_sortedIndices = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_sortedAtoms = std::make_unique<globjects::Buffer>();
+		std::size_t m_cellStartsCapacity = 0;
+		std::size_t m_ranksCapacity = 0;
+		std::size_t m_sortedIndicesCapacity = 0;
+		std::size_t m_sortedAtomsCapacity = 0;
+
+		// block sums of every level of the prefix sum, until a single block remains
+		std::vector< std::unique_ptr<globjects::Buffer> > m_blockSums;
+		std::vector<std::size_t> m_blockSumsCapacities;
+	};
+}
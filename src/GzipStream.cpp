@@ -0,0 +1,249 @@
+#include "GzipStream.h"
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <globjects/globjects.h>
+#include <globjects/logging.h>
+
+#ifdef DYNAMOL_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace dynamol;
+
+GzipStream::GzipStream(const std::string& filename, std::size_t blockSize, std::size_t queueLength) : m_blockSize(std::max<std::size_t>(blockSize, 4096)), m_queueLength(std::max<std::size_t>(queueLength, 1))
+{
+#ifdef DYNAMOL_ZLIB
+	if (!m_file.open(filename))
+	{
+		globjects::critical() << "Could not open file " << filename << "!";
+		return;
+	}
+
+	m_thread = std::thread(&GzipStream::inflate, this);
+#else
+	globjects::critical() << "Cannot decompress " << filename << ", dynamol was built without zlib!";
+#endif
+}
+
+GzipStream::~GzipStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_spaceCondition.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+bool GzipStream::isCompressed(const std::string& filename)
+{
+	if (filename.size() < 3)
+		return false;
+
+	const std::string extension = filename.substr(filename.size() - 3);
+	return extension == ".gz" || extension == ".GZ" || extension == ".Gz" || extension == ".gZ";
+}
+
+std::string GzipStream::uncompressedFilename(const std::string& filename)
+{
+	return isCompressed(filename) ? filename.substr(0, filename.size() - 3) : filename;
+}
+
+bool GzipStream::isOpen() const
+{
+	return m_thread.joinable();
+}
+
+bool GzipStream::failed() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_failed || !isOpen();
+}
+
+std::size_t GzipStream::compressedSize() const
+{
+	return m_file.size();
+}
+
+std::size_t GzipStream::decompressedSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_decompressedSize;
+}
+
+bool GzipStream::read(std::vector<char>& block)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (block.capacity() > 0)
+	{
+		block.clear();
+		m_freeBlocks.push_back(std::move(block));
+		block = std::vector<char>();
+	}
+
+	if (!isOpen())
+		return false;
+
+	m_blockCondition.wait(lock, [this]() { return !m_blocks.empty() || m_finished; });
+
+	if (m_blocks.empty())
+		return false;
+
+	block = std::move(m_blocks.front());
+	m_blocks.pop_front();
+
+	lock.unlock();
+	m_spaceCondition.notify_one();
+
+	return true;
+}
+
+bool GzipStream::push(std::vector<char>& block)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_spaceCondition.wait(lock, [this]() { return m_blocks.size() < m_queueLength || m_stop; });
+
+	if (m_stop)
+		return false;
+
+	m_decompressedSize += block.size();
+	m_blocks.push_back(std::move(block));
+
+	// recycled blocks keep their capacity, which avoids reallocations once the queue is full
+	if (!m_freeBlocks.empty())
+	{
+		block = std::move(m_freeBlocks.back());
+		m_freeBlocks.pop_back();
+	}
+	else
+	{
+		block = std::vector<char>();
+	}
+
+	lock.unlock();
+	m_blockCondition.notify_one();
+
+	return true;
+}
+
+void GzipStream::inflate()
+{
+	bool failed = false;
+
+#ifdef DYNAMOL_ZLIB
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+
+	// automatic detection of the gzip or zlib header
+	if (inflateInit2(&stream, 15 + 32) != Z_OK)
+	{
+		failed = true;
+	}
+	else
+	{
+		const unsigned char* input = reinterpret_cast<const unsigned char*>(m_file.data());
+		std::size_t remaining = m_file.size();
+
+		std::vector<char> block;
+		std::vector<char> carry;
+		bool finished = false;
+
+		while (!finished && !failed)
+		{
+			// the incomplete last line of the previous block starts the next one
+			block.assign(carry.begin(), carry.end());
+			carry.clear();
+
+			std::size_t size = block.size();
+			std::size_t searched = size;
+			const char* lineEnd = nullptr;
+
+			while (!finished && !failed)
+			{
+				block.resize(std::max(size + m_blockSize / 2, m_blockSize));
+
+				while (size < block.size())
+				{
+					const uInt inputSize = uInt(std::min<std::size_t>(remaining, std::numeric_limits<uInt>::max()));
+
+					stream.next_in = const_cast<Bytef*>(input);
+					stream.avail_in = inputSize;
+					stream.next_out = reinterpret_cast<Bytef*>(block.data() + size);
+					stream.avail_out = uInt(std::min<std::size_t>(block.size() - size, std::numeric_limits<uInt>::max()));
+
+					const uInt outputSize = stream.avail_out;
+					const int result = ::inflate(&stream, Z_NO_FLUSH);
+
+					input += inputSize - stream.avail_in;
+					remaining -= inputSize - stream.avail_in;
+					size += outputSize - stream.avail_out;
+
+					if (result == Z_STREAM_END)
+					{
+						// concatenated gzip members form a single stream
+						if (remaining > 0 && inflateReset(&stream) == Z_OK)
+							continue;
+
+						finished = true;
+						break;
+					}
+
+					if (result != Z_OK || (remaining == 0 && stream.avail_out > 0))
+					{
+						// corrupt or truncated input
+						failed = true;
+						break;
+					}
+				}
+
+				const void* newline = (size > searched) ? std::memchr(block.data() + searched, '\n', size - searched) : nullptr;
+
+				if (newline)
+				{
+					// the last line break of the block determines where it is split
+					for (const char* c = block.data() + size; c > block.data(); c--)
+					{
+						if (*(c - 1) == '\n')
+						{
+							lineEnd = c;
+							break;
+						}
+					}
+
+					break;
+				}
+
+				// lines longer than a block extend it until their end is found
+				searched = size;
+			}
+
+			if (lineEnd && !finished)
+			{
+				carry.assign(lineEnd, static_cast<const char*>(block.data() + size));
+				size = std::size_t(lineEnd - block.data());
+			}
+
+			block.resize(size);
+
+			if (!block.empty() && !failed && !push(block))
+				break;
+		}
+
+		inflateEnd(&stream);
+	}
+#endif
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_finished = true;
+		m_failed = failed;
+	}
+
+	m_blockCondition.notify_all();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+namespace dynamol
+{
+	// Decompresses a gzip file on a background thread into a bounded queue of blocks, so that parsing
+	// can overlap with decompression without ever holding the whole decompressed file in memory
+	class GzipStream
+	{
+	public:
+		GzipStream(const std::string& filename, std::size_t blockSize = 4 * 1024 * 1024, std::size_t queueLength = 4);
+		~GzipStream();
+
+		GzipStream(const GzipStream&) = delete;
+		GzipStream& operator=(const GzipStream&) = delete;
+
+		// Returns whether the file ends with .gz, which is how compressed inputs are recognized
+		static bool isCompressed(const std::string& filename);
+
+		// Returns the file name without the .gz extension
+		static std::string uncompressedFilename(const std::string& filename);
+
+		bool isOpen() const;
+		bool failed() const;
+
+		std::size_t compressedSize() const;
+		std::size_t decompressedSize() const;
+
+		// Waits for the next block, which ends with a line break unless it is the last one. The previous contents of block
+		// are recycled for later blocks. Returns false at the end of the stream or if decompression failed.
+		bool read(std::vector<char>& block);
+
+	private:
+		void inflate();
+		bool push(std::vector<char>& block);
+
+		MappedFile m_file;
+		std::size_t m_blockSize = 0;
+		std::size_t m_queueLength = 0;
+
+		std::thread m_thread;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_blockCondition;
+		std::condition_variable m_spaceCondition;
+		std::deque< std::vector<char> > m_blocks;
+		std::vector< std::vector<char> > m_freeBlocks;
+		std::size_t m_decompressedSize = 0;
+		bool m_finished = false;
+		bool m_failed = false;
+		bool m_stop = false;
+	};
+}
@@ -0,0 +1,446 @@
+#include "LoadingBenchmark.h"
+#include "Protein.h"
+#include "TrajectoryCache.h"
+#include "TimestepStream.h"
+#include "PdbParser.h"
+#include "ThreadPool.h"
+
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <limits>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <cmath>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// trim from start (in place)
+	static inline void ltrim(std::string &s)
+	{
+		s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](int ch) {
+			return !std::isspace(ch);
+		}));
+	}
+
+	// trim from end (in place)
+	static inline void rtrim(std::string &s)
+	{
+		s.erase(std::find_if(s.rbegin(), s.rend(), [](int ch) {
+			return !std::isspace(ch);
+		}).base(), s.end());
+	}
+
+	// trim from both ends (in place)
+	static inline void trim(std::string &s)
+	{
+		ltrim(s);
+		rtrim(s);
+	}
+
+	// trim from both ends (copying)
+	static inline std::string trim_copy(std::string s)
+	{
+		trim(s);
+		return s;
+	}
+
+	// state of the original Protein class filled by the reference parser
+	struct ReferenceProtein
+	{
+		std::vector< std::vector<vec4> > m_atoms;
+		vec3 m_minimumBounds;
+		vec3 m_maximumBounds;
+
+		std::array<uint, 116> m_elementIdMap;
+		std::array<uint, 24> m_residueIdMap;
+		std::array<uint, 64> m_chainIdMap;
+
+		std::vector<uint> m_activeElementIds;
+		std::vector<uint> m_activeResidueIds;
+		std::vector<uint> m_activeChainIds;
+
+		// The parsing loop of Protein::load before the memory-mapped parser, copied verbatim as a reference for throughput
+		void load(const std::string& filename)
+		{
+			std::ifstream file(filename);
+
+			if (!file.is_open())
+			{
+				globjects::critical() << "Could not open file " << filename << "!";
+			}
+
+			m_atoms.clear();
+			m_minimumBounds = vec3(std::numeric_limits<float>::max());
+			m_maximumBounds = vec3(-std::numeric_limits<float>::max());
+
+			m_elementIdMap.fill(0);
+			m_residueIdMap.fill(0);
+			m_chainIdMap.fill(0);
+
+			m_activeElementIds.clear();
+			m_activeElementIds.push_back(0);
+
+			m_activeResidueIds.clear();
+			m_activeResidueIds.push_back(0);
+
+			m_activeChainIds.clear();
+			m_activeChainIds.push_back(0);
+
+			std::string str;
+			uint elementCount = 1;
+
+			std::vector<vec4> atoms;
+
+			while (std::getline(file, str))
+			{
+				//std::vector<std::string> tokens;
+				//std::istringstream buffer(str);
+				//std::copy(std::istream_iterator<std::string>(buffer), std::istream_iterator<std::string>(), std::back_inserter(tokens));
+
+				std::string recordName = trim_copy(str.substr(0, 6));
+
+				if (recordName == "END")
+				{
+					m_atoms.push_back(atoms);
+					atoms.clear();
+				}
+				else if (recordName == "ATOM" || recordName == "HETATM")
+				{
+					float x = float(std::atof(trim_copy(str.substr(30, 8)).c_str()));
+					float y = float(std::atof(trim_copy(str.substr(38, 8)).c_str()));
+					float z = float(std::atof(trim_copy(str.substr(46, 8)).c_str()));
+
+
+					std::string residueName = trim_copy(str.substr(17, 3));
+					std::string chainName = trim_copy(str.substr(21, 1));
+					std::string elementName = trim_copy(str.substr(76, 2));
+
+					uint elementId = 0;
+					uint elementIndex = 0;
+			
+					auto ei = Protein::elementIds().find(elementName);
+
+					if (ei != Protein::elementIds().end())
+						elementId = ei->second;
+
+					elementIndex = m_elementIdMap[elementId];
+
+					if (elementIndex == 0)
+					{
+						elementIndex = uint(m_activeElementIds.size());
+						m_activeElementIds.push_back(elementId);				
+						m_elementIdMap[elementId] = elementIndex;
+					}
+
+					uint residueId = 0;
+					uint residueIndex = 0;
+
+					auto ri = Protein::residueIds().find(residueName);
+
+					if (ri != Protein::residueIds().end())
+						residueId = ri->second;
+
+					residueIndex = m_residueIdMap[residueId];
+
+					if (residueIndex == 0)
+					{
+						residueIndex = uint(m_activeResidueIds.size());
+						m_activeResidueIds.push_back(residueId);
+						m_residueIdMap[residueId] = residueIndex;
+					}
+
+					uint chainId = 0;
+					uint chainIndex = 0;
+
+					auto ci = Protein::chainIds().find(chainName);
+
+					if (ci != Protein::chainIds().end())
+						chainId = ci->second;
+
+					chainIndex = m_chainIdMap[chainId];
+
+					if (chainIndex == 0)
+					{
+						chainIndex = uint(m_activeChainIds.size());
+						m_activeChainIds.push_back(chainId);
+						m_chainIdMap[chainId] = chainIndex;
+					}
+
+					uint atomAttributes = elementIndex | (residueIndex << 8) | (chainIndex << 16);
+					vec4 atom(x, y, z, uintBitsToFloat(atomAttributes));
+					atoms.push_back(atom);
+
+					m_minimumBounds = min(m_minimumBounds, vec3(atom));
+					m_maximumBounds = max(m_maximumBounds, vec3(atom));
+				}
+			}
+		}
+	};
+
+	// Parser output independent of the packing of the attributes and the order of the id tables: the exact position bits,
+	// the atomic number and the indices of residue and chain name in the fixed tables of Protein (0 for unknown names)
+	struct NormalizedAtom
+	{
+		uvec3 position;
+		uint elementId = 0;
+		uint residueId = 0;
+		uint chainId = 0;
+
+		bool operator==(const NormalizedAtom& other) const
+		{
+			return position == other.position && elementId == other.elementId && residueId == other.residueId && chainId == other.chainId;
+		}
+	};
+
+	using NormalizedOutput = std::vector< std::vector<NormalizedAtom> >;
+
+	uint tableId(const std::unordered_map<std::string, uint>& table, std::uint64_t name)
+	{
+		const auto i = table.find(PdbParser::name(name));
+		return i != table.end() ? i->second : 0;
+	}
+
+	NormalizedOutput normalize(const ReferenceProtein& protein)
+	{
+		NormalizedOutput output(protein.m_atoms.size());
+
+		for (std::size_t i = 0; i < protein.m_atoms.size(); i++)
+		{
+			for (const auto& a : protein.m_atoms[i])
+			{
+				const uint attributes = floatBitsToUint(a.w);
+
+				NormalizedAtom atom;
+				atom.position = floatBitsToUint(vec3(a));
+				atom.elementId = protein.m_activeElementIds[attributes & 0xFF];
+				atom.residueId = protein.m_activeResidueIds[(attributes >> 8) & 0xFF];
+				atom.chainId = protein.m_activeChainIds[(attributes >> 16) & 0xFF];
+				output[i].push_back(atom);
+			}
+		}
+
+		return output;
+	}
+
+	NormalizedOutput normalize(const Protein& protein)
+	{
+		NormalizedOutput output(protein.timestepCount());
+		std::vector<vec4> atoms;
+
+		for (std::size_t i = 0; i < protein.timestepCount(); i++)
+		{
+			protein.loadTimestep(i, atoms);
+
+			for (const auto& a : atoms)
+			{
+				const uint attributes = floatBitsToUint(a.w);
+				const uvec2 group = protein.activeGroups()[Protein::groupIndex(attributes)];
+
+				NormalizedAtom atom;
+				atom.position = floatBitsToUint(vec3(a));
+				atom.elementId = protein.activeElementIds()[Protein::elementIndex(attributes)];
+				atom.residueId = tableId(Protein::residueIds(), protein.activeResidueNames()[group.x]);
+				atom.chainId = tableId(Protein::chainIds(), protein.activeChainNames()[group.y]);
+				output[i].push_back(atom);
+			}
+		}
+
+		return output;
+	}
+
+	// Streams all timesteps as float and as quantized positions and compares them to loadTimestep, the quantization error
+	// may not exceed half a quantization step plus the rounding of the float arithmetic used for decoding
+	bool streamedPositionsMatch(const Protein& protein, float& maximumError, float& maximumErrorBound)
+	{
+		maximumError = 0.0f;
+		maximumErrorBound = 0.0f;
+
+		TimestepStream floatStream(&protein, TimestepStream::Format::Positions);
+		TimestepStream quantizedStream(&protein, TimestepStream::Format::QuantizedPositions);
+
+		std::vector<vec4> atoms;
+		std::vector<vec3> positions;
+		std::vector<u16vec4> quantizedPositions;
+
+		for (std::size_t i = 0; i < protein.timestepCount(); i++)
+		{
+			protein.loadTimestep(i, atoms);
+
+			if (atoms.size() != protein.staticAttributes().size())
+				return false;
+
+			positions.resize(atoms.size());
+			quantizedPositions.resize(atoms.size());
+
+			TimestepStream::Quantization quantization;
+
+			if (!floatStream.read(i, positions.data(), true) || !quantizedStream.read(i, quantizedPositions.data(), true, &quantization))
+				return false;
+
+			const vec3 errorBound = quantization.maximumError() + (abs(quantization.origin) + quantization.extent) * 1e-6f;
+
+			for (std::size_t j = 0; j < atoms.size(); j++)
+			{
+				if (vec3(atoms[j]) != positions[j] || floatBitsToUint(atoms[j].w) != protein.staticAttributes()[j])
+					return false;
+
+				const vec3 error = abs(quantization.decode(quantizedPositions[j]) - positions[j]);
+
+				for (int k = 0; k < 3; k++)
+				{
+					if (!(error[k] <= errorBound[k]))
+						return false;
+
+					maximumError = std::max(maximumError, error[k]);
+					maximumErrorBound = std::max(maximumErrorBound, errorBound[k]);
+				}
+			}
+		}
+
+		return true;
+	}
+}
+
+bool LoadingBenchmark::run(const std::string& filename, unsigned int maximumThreadCount, unsigned int iterations)
+{
+	std::error_code error;
+	const auto fileSize = std::filesystem::file_size(filename, error);
+
+	if (error)
+	{
+		std::cout << "Could not open file " << filename << "!" << std::endl;
+		return false;
+	}
+
+	const double megabytes = double(fileSize) / (1024.0 * 1024.0);
+	iterations = std::max(iterations, 1u);
+	maximumThreadCount = std::max(maximumThreadCount, 1u);
+
+	std::cout << "Benchmarking PDB loading of " << filename << " (" << megabytes << " MB, " << iterations << " iterations)" << std::endl;
+
+	double referenceTime = std::numeric_limits<double>::max();
+	double loaderTime = std::numeric_limits<double>::max();
+
+	ReferenceProtein reference;
+	Protein protein;
+
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		reference.load(filename);
+		std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - startTime;
+		referenceTime = std::min(referenceTime, duration.count());
+
+		startTime = std::chrono::high_resolution_clock::now();
+		protein.load(filename, false);
+		duration = std::chrono::high_resolution_clock::now() - startTime;
+		loaderTime = std::min(loaderTime, duration.count());
+	}
+
+	const NormalizedOutput referenceOutput = normalize(reference);
+	bool match = normalize(protein) == referenceOutput;
+
+	std::cout << "Reference parser: " << referenceTime << " seconds, " << megabytes / referenceTime << " MB/s" << std::endl;
+	std::cout << "Protein::load:    " << loaderTime << " seconds, " << megabytes / loaderTime << " MB/s" << std::endl;
+	std::cout << "Speedup:          " << referenceTime / loaderTime << "x" << std::endl;
+	std::cout << "Output " << (match ? "identical" : "DIFFERS") << " to reference parser." << std::endl;
+
+	// scaling of the parallel loader from one thread up to the given number of threads, doubling in between
+	ThreadPool& threadPool = ThreadPool::instance();
+	const unsigned int poolThreadCount = threadPool.threadCount();
+	double singleThreadTime = 0.0;
+
+	for (unsigned int threadCount = 1; threadCount <= maximumThreadCount; threadCount = (threadCount < maximumThreadCount) ? std::min(threadCount * 2, maximumThreadCount) : threadCount + 1)
+	{
+		threadPool.setThreadCount(threadCount);
+
+		double time = std::numeric_limits<double>::max();
+
+		for (unsigned int i = 0; i < iterations; i++)
+		{
+			const auto startTime = std::chrono::high_resolution_clock::now();
+			Protein().load(filename, false);
+			const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - startTime;
+			time = std::min(time, duration.count());
+		}
+
+		if (threadCount == 1)
+			singleThreadTime = time;
+
+		std::cout << "Protein::load with " << threadCount << " threads: " << time << " seconds, " << megabytes / time << " MB/s, " << singleThreadTime / time << "x" << std::endl;
+	}
+
+	threadPool.setThreadCount(poolThreadCount);
+
+	// the cache is measured on a temporary copy, so that benchmarking leaves an existing cache of the input untouched
+	const std::filesystem::path copy = std::filesystem::temp_directory_path(error) / ("dynamol-loading-benchmark-" + std::filesystem::path(filename).filename().string());
+
+	if (!error && std::filesystem::copy_file(filename, copy, std::filesystem::copy_options::overwrite_existing, error))
+	{
+		// the first cached load parses the file and writes the trajectory cache, all later ones map it
+		Protein().load(copy.string(), true);
+
+		if (TrajectoryCache().open(copy.string()))
+		{
+			double cacheTime = std::numeric_limits<double>::max();
+			bool cacheMatch = true;
+
+			for (unsigned int i = 0; i < iterations; i++)
+			{
+				Protein cachedProtein;
+
+				auto startTime = std::chrono::high_resolution_clock::now();
+				cachedProtein.load(copy.string(), true);
+				std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - startTime;
+				cacheTime = std::min(cacheTime, duration.count());
+
+				cacheMatch = cacheMatch && normalize(cachedProtein) == referenceOutput;
+			}
+
+			std::cout << "Trajectory cache: " << cacheTime << " seconds" << std::endl;
+			std::cout << "Cached output " << (cacheMatch ? "identical" : "DIFFERS") << " to reference parser." << std::endl;
+
+			match = match && cacheMatch;
+		}
+		else
+		{
+			std::cout << "Trajectory cache could not be written." << std::endl;
+		}
+
+		std::filesystem::remove(TrajectoryCache::filename(copy.string()), error);
+		std::filesystem::remove(copy, error);
+	}
+	else
+	{
+		std::cout << "Could not copy " << filename << " to measure the trajectory cache." << std::endl;
+	}
+
+	if (protein.hasStaticAttributes())
+	{
+		float maximumError = 0.0f;
+		float maximumErrorBound = 0.0f;
+		const bool quantizationMatch = streamedPositionsMatch(protein, maximumError, maximumErrorBound);
+
+		std::cout << "Streamed timestep size: " << TimestepStream::elementSize(TimestepStream::Format::QuantizedPositions) << " instead of " << TimestepStream::elementSize(TimestepStream::Format::Atoms) << " bytes per atom" << std::endl;
+		std::cout << "Quantized positions " << (quantizationMatch ? "within" : "EXCEED") << " error bound (maximum error " << maximumError << ", bound " << maximumErrorBound << ")." << std::endl;
+
+		match = match && quantizationMatch;
+	}
+	else
+	{
+		std::cout << "Timesteps have different attributes, positions are streamed with their attributes." << std::endl;
+	}
+
+	return match;
+}
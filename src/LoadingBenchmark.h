@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <thread>
+
+namespace dynamol
+{
+	// Compares the throughput of Protein::load against a verbatim copy of the original getline-based PDB parser and checks
+	// that both produce the same atoms. The trajectory cache is measured on a temporary copy of the input.
+	// Also measures how loading scales from one thread up to the given number of threads.
+	class LoadingBenchmark
+	{
+	public:
+		static bool run(const std::string& filename, unsigned int maximumThreadCount = std::thread::hardware_concurrency(), unsigned int iterations = 3);
+	};
+}
@@ -0,0 +1,161 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace dynamol;
+
+MappedFile::MappedFile()
+{
+
+}
+
+MappedFile::MappedFile(const std::string& filename)
+{
+	open(filename);
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	m_fileHandle = file;
+	m_size = std::size_t(fileSize.QuadPart);
+	m_open = true;
+
+	// empty files cannot be mapped, but are still valid
+	if (m_size == 0)
+		return true;
+
+	m_mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (m_mappingHandle == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	m_data = static_cast<const char*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+	m_fileDescriptor = ::open(filename.c_str(), O_RDONLY);
+
+	if (m_fileDescriptor < 0)
+		return false;
+
+	struct stat fileStatus;
+
+	if (fstat(m_fileDescriptor, &fileStatus) != 0)
+	{
+		::close(m_fileDescriptor);
+		m_fileDescriptor = -1;
+		return false;
+	}
+
+	m_size = std::size_t(fileStatus.st_size);
+	m_open = true;
+
+	// empty files cannot be mapped, but are still valid
+	if (m_size == 0)
+		return true;
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fileDescriptor, 0);
+
+	if (data == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	madvise(data, m_size, MADV_SEQUENTIAL);
+	m_data = static_cast<const char*>(data);
+#endif
+
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (m_data)
+		UnmapViewOfFile(m_data);
+
+	if (m_mappingHandle)
+		CloseHandle(m_mappingHandle);
+
+	if (m_fileHandle)
+		CloseHandle(m_fileHandle);
+
+	m_mappingHandle = nullptr;
+	m_fileHandle = nullptr;
+#else
+	if (m_data)
+		munmap(const_cast<char*>(m_data), m_size);
+
+	if (m_fileDescriptor >= 0)
+		::close(m_fileDescriptor);
+
+	m_fileDescriptor = -1;
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+
+bool MappedFile::isOpen() const
+{
+	return m_open;
+}
+
+const char* MappedFile::data() const
+{
+	return m_data;
+}
+
+std::size_t MappedFile::size() const
+{
+	return m_size;
+}
+
+const char* MappedFile::begin() const
+{
+	return m_data;
+}
+
+const char* MappedFile::end() const
+{
+	return m_data + m_size;
+}
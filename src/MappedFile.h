@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace dynamol
+{
+	// Read-only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		MappedFile(const std::string& filename);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& filename);
+		void close();
+
+		bool isOpen() const;
+		const char* data() const;
+		std::size_t size() const;
+		const char* begin() const;
+		const char* end() const;
+
+	private:
+		const char* m_data = nullptr;
+		std::size_t m_size = 0;
+		bool m_open = false;
+
+#ifdef _WIN32
+		void* m_fileHandle = nullptr;
+		void* m_mappingHandle = nullptr;
+#else
+		int m_fileDescriptor = -1;
+#endif
+	};
+}
@@ -0,0 +1,254 @@
+#include "MessagePack.h"
+
+#include <cstring>
+
+using namespace dynamol;
+
+namespace
+{
+	const int maximumDepth = 64;
+
+	class Reader
+	{
+	public:
+		Reader(const char* begin, const char* end) : m_position(begin), m_end(end)
+		{
+		}
+
+		bool value(MessagePack::Value& value, int depth = 0)
+		{
+			using Type = MessagePack::Value::Type;
+
+			std::uint8_t type;
+
+			if (depth > maximumDepth || !read(type))
+				return false;
+
+			value = MessagePack::Value();
+
+			if (type <= 0x7F)
+				return integer(value, type);
+
+			if (type >= 0xE0)
+				return integer(value, std::int8_t(type));
+
+			if ((type & 0xF0) == 0x80)
+				return map(value, type & 0x0F, depth);
+
+			if ((type & 0xF0) == 0x90)
+				return array(value, type & 0x0F, depth);
+
+			if ((type & 0xE0) == 0xA0)
+				return bytes(value, Type::String, type & 0x1F);
+
+			switch (type)
+			{
+			case 0xC0:
+				value.type = Type::Nil;
+				return true;
+			case 0xC2:
+			case 0xC3:
+				value.type = Type::Boolean;
+				value.integer = type - 0xC2;
+				return true;
+			case 0xC4: return sized<std::uint8_t>(value, Type::Binary);
+			case 0xC5: return sized<std::uint16_t>(value, Type::Binary);
+			case 0xC6: return sized<std::uint32_t>(value, Type::Binary);
+			case 0xCA: return floating<float>(value);
+			case 0xCB: return floating<double>(value);
+			case 0xCC: return fixed<std::uint8_t>(value);
+			case 0xCD: return fixed<std::uint16_t>(value);
+			case 0xCE: return fixed<std::uint32_t>(value);
+			case 0xCF: return fixed<std::uint64_t>(value);
+			case 0xD0: return fixed<std::int8_t>(value);
+			case 0xD1: return fixed<std::int16_t>(value);
+			case 0xD2: return fixed<std::int32_t>(value);
+			case 0xD3: return fixed<std::int64_t>(value);
+			case 0xD9: return sized<std::uint8_t>(value, Type::String);
+			case 0xDA: return sized<std::uint16_t>(value, Type::String);
+			case 0xDB: return sized<std::uint32_t>(value, Type::String);
+			case 0xDC: return container<std::uint16_t>(value, Type::Array, depth);
+			case 0xDD: return container<std::uint32_t>(value, Type::Array, depth);
+			case 0xDE: return container<std::uint16_t>(value, Type::Map, depth);
+			case 0xDF: return container<std::uint32_t>(value, Type::Map, depth);
+			default:
+				// extension types are not used by BinaryCIF
+				return false;
+			}
+		}
+
+	private:
+		template <typename T>
+		bool read(T& result)
+		{
+			if (std::size_t(m_end - m_position) < sizeof(T))
+				return false;
+
+			// all numbers are stored in big-endian byte order
+			std::uint64_t bits = 0;
+
+			for (std::size_t i = 0; i < sizeof(T); i++)
+				bits = (bits << 8) | std::uint64_t(static_cast<unsigned char>(m_position[i]));
+
+			m_position += sizeof(T);
+
+			if constexpr (sizeof(T) == 1)
+			{
+				std::uint8_t b = std::uint8_t(bits);
+				std::memcpy(&result, &b, 1);
+			}
+			else if constexpr (sizeof(T) == 2)
+			{
+				std::uint16_t b = std::uint16_t(bits);
+				std::memcpy(&result, &b, 2);
+			}
+			else if constexpr (sizeof(T) == 4)
+			{
+				std::uint32_t b = std::uint32_t(bits);
+				std::memcpy(&result, &b, 4);
+			}
+			else
+			{
+				std::memcpy(&result, &bits, 8);
+			}
+
+			return true;
+		}
+
+		bool integer(MessagePack::Value& value, std::int64_t number)
+		{
+			value.type = MessagePack::Value::Type::Integer;
+			value.integer = number;
+			value.number = double(number);
+			return true;
+		}
+
+		template <typename T>
+		bool fixed(MessagePack::Value& value)
+		{
+			T number;
+			return read(number) && integer(value, std::int64_t(number));
+		}
+
+		template <typename T>
+		bool floating(MessagePack::Value& value)
+		{
+			T number;
+
+			if (!read(number))
+				return false;
+
+			value.type = MessagePack::Value::Type::Float;
+			value.number = double(number);
+			value.integer = std::int64_t(number);
+			return true;
+		}
+
+		bool bytes(MessagePack::Value& value, MessagePack::Value::Type type, std::size_t size)
+		{
+			if (std::size_t(m_end - m_position) < size)
+				return false;
+
+			value.type = type;
+			value.data = m_position;
+			value.size = size;
+			m_position += size;
+			return true;
+		}
+
+		template <typename T>
+		bool sized(MessagePack::Value& value, MessagePack::Value::Type type)
+		{
+			T size;
+			return read(size) && bytes(value, type, std::size_t(size));
+		}
+
+		bool array(MessagePack::Value& value, std::size_t count, int depth)
+		{
+			// every element takes at least one byte, which bounds the allocation for corrupt sizes
+			if (count > std::size_t(m_end - m_position))
+				return false;
+
+			value.type = MessagePack::Value::Type::Array;
+			value.elements.resize(count);
+
+			for (auto& e : value.elements)
+			{
+				if (!this->value(e, depth + 1))
+					return false;
+			}
+
+			return true;
+		}
+
+		bool map(MessagePack::Value& value, std::size_t count, int depth)
+		{
+			if (count > std::size_t(m_end - m_position))
+				return false;
+
+			value.type = MessagePack::Value::Type::Map;
+			value.elements.resize(count);
+			value.keys.resize(count);
+
+			for (std::size_t i = 0; i < count; i++)
+			{
+				MessagePack::Value key;
+
+				if (!this->value(key, depth + 1) || !this->value(value.elements[i], depth + 1))
+					return false;
+
+				// non-string keys are kept as empty strings
+				value.keys[i] = key.string();
+			}
+
+			return true;
+		}
+
+		template <typename T>
+		bool container(MessagePack::Value& value, MessagePack::Value::Type type, int depth)
+		{
+			T count;
+
+			if (!read(count))
+				return false;
+
+			if (type == MessagePack::Value::Type::Array)
+				return array(value, std::size_t(count), depth);
+
+			return map(value, std::size_t(count), depth);
+		}
+
+		const char* m_position = nullptr;
+		const char* m_end = nullptr;
+	};
+}
+
+const MessagePack::Value* MessagePack::Value::find(std::string_view key) const
+{
+	for (std::size_t i = 0; i < keys.size(); i++)
+	{
+		if (keys[i] == key)
+			return &elements[i];
+	}
+
+	return nullptr;
+}
+
+std::string_view MessagePack::Value::string() const
+{
+	if (type != Type::String && type != Type::Binary)
+		return std::string_view();
+
+	return std::string_view(data, size);
+}
+
+double MessagePack::Value::toNumber() const
+{
+	return (type == Type::Integer || type == Type::Boolean) ? double(integer) : number;
+}
+
+bool MessagePack::parse(const char* begin, const char* end, Value& value)
+{
+	Reader reader(begin, end);
+	return reader.value(value);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+namespace dynamol
+{
+	// Minimal MessagePack reader, strings and binary data reference the parsed buffer without copies
+	class MessagePack
+	{
+	public:
+		struct Value
+		{
+			enum class Type
+			{
+				Nil,
+				Boolean,
+				Integer,
+				Float,
+				String,
+				Binary,
+				Array,
+				Map
+			};
+
+			Type type = Type::Nil;
+			std::int64_t integer = 0;
+			double number = 0.0;
+			const char* data = nullptr;
+			std::size_t size = 0;
+
+			// elements of arrays and values of maps, keys of maps
+			std::vector<Value> elements;
+			std::vector<std::string_view> keys;
+
+			// Returns the value of a map entry with the given string key, nullptr if there is none
+			const Value* find(std::string_view key) const;
+
+			std::string_view string() const;
+			double toNumber() const;
+		};
+
+		static bool parse(const char* begin, const char* end, Value& value);
+	};
+}
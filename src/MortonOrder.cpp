@@ -0,0 +1,127 @@
+#include "MortonOrder.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// elements processed by a single invocation of the parallel loops
+	const std::size_t chunkSize = 64 * 1024;
+
+	// 30-bit codes are sorted in three passes of ten bits each
+	const uint digitBits = 10;
+	const uint digitCount = 1u << digitBits;
+	const uint passCount = 3;
+
+	// spreads the lower 10 bits so that two zero bits follow each of them
+	inline std::uint32_t spreadBits(std::uint32_t v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+}
+
+std::uint32_t MortonOrder::code(const vec3& position, const vec3& minimum, const vec3& maximum)
+{
+	const vec3 extent = max(maximum - minimum, vec3(std::numeric_limits<float>::min()));
+	const vec3 normalized = (position - minimum) / extent;
+	std::uint32_t c[3];
+
+	// the comparison also maps NaN coordinates to zero
+	for (int i = 0; i < 3; i++)
+		c[i] = normalized[i] > 0.0f ? std::uint32_t(std::min(normalized[i] * 1024.0f, 1023.0f)) : 0;
+
+	return (spreadBits(c[0]) << 2) | (spreadBits(c[1]) << 1) | spreadBits(c[2]);
+}
+
+void MortonOrder::codes(const vec3* positions, std::size_t count, const vec3& minimum, const vec3& maximum, std::vector<std::uint32_t>& codes)
+{
+	codes.resize(count);
+
+	ThreadPool::instance().parallelFor((count + chunkSize - 1) / chunkSize, [&](std::size_t chunk)
+	{
+		const std::size_t last = std::min(count, (chunk + 1) * chunkSize);
+
+		for (std::size_t i = chunk * chunkSize; i < last; i++)
+			codes[i] = code(positions[i], minimum, maximum);
+	});
+}
+
+void MortonOrder::sort(const vec3* positions, std::size_t count, const vec3& minimum, const vec3& maximum, std::vector<uint>& order)
+{
+	std::vector<std::uint32_t> c;
+	codes(positions, count, minimum, maximum, c);
+	sort(c, order);
+}
+
+void MortonOrder::sort(const std::vector<std::uint32_t>& codes, std::vector<uint>& order)
+{
+	ThreadPool& threadPool = ThreadPool::instance();
+
+	const std::size_t count = codes.size();
+	const std::size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+	std::vector<std::uint32_t> keys = codes;
+	std::vector<std::uint32_t> sortedKeys(count);
+	std::vector<uint> sortedOrder(count);
+
+	order.resize(count);
+
+	for (std::size_t i = 0; i < count; i++)
+		order[i] = uint(i);
+
+	// Least significant digit first, every chunk counts its digits, and the offsets of a digit in a chunk follow those of the
+	// same digit in all preceding chunks, which keeps each pass stable
+	std::vector< std::array<uint, digitCount> > offsets(chunkCount);
+
+	for (uint pass = 0; pass < passCount; pass++)
+	{
+		const uint shift = pass * digitBits;
+
+		threadPool.parallelFor(chunkCount, [&](std::size_t chunk)
+		{
+			const std::size_t last = std::min(count, (chunk + 1) * chunkSize);
+			auto& histogram = offsets[chunk];
+			histogram.fill(0);
+
+			for (std::size_t i = chunk * chunkSize; i < last; i++)
+				histogram[(keys[i] >> shift) & (digitCount - 1)]++;
+		});
+
+		uint sum = 0;
+
+		for (uint digit = 0; digit < digitCount; digit++)
+		{
+			for (std::size_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				const uint size = offsets[chunk][digit];
+				offsets[chunk][digit] = sum;
+				sum += size;
+			}
+		}
+
+		threadPool.parallelFor(chunkCount, [&](std::size_t chunk)
+		{
+			const std::size_t last = std::min(count, (chunk + 1) * chunkSize);
+			auto& offset = offsets[chunk];
+
+			for (std::size_t i = chunk * chunkSize; i < last; i++)
+			{
+				const uint j = offset[(keys[i] >> shift) & (digitCount - 1)]++;
+				sortedKeys[j] = keys[i];
+				sortedOrder[j] = order[i];
+			}
+		});
+
+		keys.swap(sortedKeys);
+		order.swap(sortedOrder);
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace dynamol
+{
+	// Orders positions along a Morton curve, which interleaves the bits of their quantized coordinates,
+	// so that atoms close to each other in space are mostly close to each other in the resulting order
+	class MortonOrder
+	{
+	public:
+		// 30-bit code of a position quantized to 1024 steps per axis within the bounds, positions outside are clamped
+		static std::uint32_t code(const glm::vec3& position, const glm::vec3& minimum, const glm::vec3& maximum);
+
+		// Writes the codes of all positions
+		static void codes(const glm::vec3* positions, std::size_t count, const glm::vec3& minimum, const glm::vec3& maximum, std::vector<std::uint32_t>& codes);
+
+		// Writes the indices of the positions sorted by their codes, positions with equal codes keep their relative order.
+		// Uses a parallel radix sort over the codes.
+		static void sort(const glm::vec3* positions, std::size_t count, const glm::vec3& minimum, const glm::vec3& maximum, std::vector<glm::uint>& order);
+
+		// Sorts the indices by the given codes in the same way
+		static void sort(const std::vector<std::uint32_t>& codes, std::vector<glm::uint>& order);
+	};
+}
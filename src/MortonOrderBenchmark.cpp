@@ -0,0 +1,157 @@
+#include "MortonOrderBenchmark.h"
+#include "Viewer.h"
+#include "Scene.h"
+#include "Protein.h"
+#include "PdbParser.h"
+#include "Benchmark.h"
+
+#include <glbinding/gl/gl.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+
+namespace
+{
+	// Renders the file in the given order and returns the average frame time in milliseconds
+	double measureFrameTime(GLFWwindow* window, const std::string& filename, bool sorted, unsigned int frameCount)
+	{
+		Scene scene;
+		Protein* protein = scene.protein();
+		protein->load(filename, false);
+
+		if (sorted && !protein->sortAtomsSpatially())
+			return -1.0;
+
+		// average distance between atoms that follow each other in memory
+		std::vector<vec3> positions;
+		protein->loadPositions(0, positions);
+		double distance = 0.0;
+
+		for (std::size_t i = 1; i < positions.size(); i++)
+			distance += double(length(positions[i] - positions[i - 1]));
+
+		auto viewer = std::make_unique<Viewer>(window, &scene);
+
+		const vec3 boundingBoxSize = protein->maximumBounds() - protein->minimumBounds();
+		const float maximumSize = std::max(boundingBoxSize.x, std::max(boundingBoxSize.y, boundingBoxSize.z));
+		mat4 modelTransform = scale(vec3(2.0f) / vec3(maximumSize));
+		modelTransform = modelTransform * translate(-0.5f * (protein->minimumBounds() + protein->maximumBounds()));
+		viewer->setModelTransform(modelTransform);
+
+		// the first frames compile shaders and upload the timestep
+		for (unsigned int i = 0; i < 20; i++)
+		{
+			glfwPollEvents();
+			viewer->display();
+			glfwSwapBuffers(window);
+		}
+
+		glFinish();
+
+		const double duration = Benchmark::time([&]()
+		{
+			for (unsigned int i = 0; i < frameCount; i++)
+			{
+				glfwPollEvents();
+				viewer->display();
+				glfwSwapBuffers(window);
+			}
+
+			glFinish();
+		});
+
+		const double frameTime = duration * 1000.0 / double(std::max(frameCount, 1u));
+
+		std::cout << "  " << (sorted ? "Morton order: " : "File order:   ") << frameTime << " ms per frame, "
+			<< distance / double(std::max<std::size_t>(positions.size(), 2) - 1) << " Angstrom between consecutive atoms" << std::endl;
+
+		return frameTime;
+	}
+}
+
+bool MortonOrderBenchmark::run(GLFWwindow* window, const std::string& filename, std::size_t atomCount, unsigned int frameCount)
+{
+	const std::string syntheticFilename = (std::filesystem::temp_directory_path() / "dynamol-morton-benchmark.pdb").string();
+
+	if (!writeSyntheticSystem(filename, syntheticFilename, atomCount))
+		return false;
+
+	bool success = true;
+
+	for (const auto& f : { filename, syntheticFilename })
+	{
+		std::cout << "Benchmarking atom order on " << f << " (" << frameCount << " frames)" << std::endl;
+
+		const double fileOrderTime = measureFrameTime(window, f, false, frameCount);
+		const double mortonOrderTime = measureFrameTime(window, f, true, frameCount);
+
+		if (fileOrderTime < 0.0 || mortonOrderTime < 0.0)
+		{
+			success = false;
+			continue;
+		}
+
+		std::cout << "  Speedup: " << fileOrderTime / mortonOrderTime << "x" << std::endl;
+	}
+
+	std::filesystem::remove(syntheticFilename);
+
+	return success;
+}
+
+bool MortonOrderBenchmark::writeSyntheticSystem(const std::string& filename, const std::string& syntheticFilename, std::size_t atomCount)
+{
+	Protein protein;
+	Benchmark::Replica replica;
+
+	if (!Benchmark::replicate(filename, atomCount, 0.0f, protein, replica))
+		return false;
+
+	std::vector<std::string> elementSymbols(Protein::elementRadii().size());
+
+	for (const auto& e : Protein::elementIds())
+	{
+		std::string symbol = e.first;
+		std::transform(symbol.begin(), symbol.end(), symbol.begin(), [](unsigned char c) { return char(std::toupper(c)); });
+		elementSymbols[e.second] = symbol;
+	}
+
+	std::ofstream file(syntheticFilename, std::ios::binary);
+
+	if (!file)
+	{
+		std::cout << "Could not write " << syntheticFilename << "!" << std::endl;
+		return false;
+	}
+
+	char line[128];
+
+	for (const auto& a : replica.atoms)
+	{
+		const uint attributes = floatBitsToUint(a.w);
+		const uint groupIndex = Protein::groupIndex(attributes);
+		const uvec2 group = protein.activeGroups()[groupIndex];
+		const std::string residueName = PdbParser::name(protein.activeResidueNames()[group.x]);
+		const std::string chainName = PdbParser::name(protein.activeChainNames()[group.y]);
+		const std::string& element = elementSymbols[protein.activeElementIds()[Protein::elementIndex(attributes)]];
+
+		std::snprintf(line, sizeof(line), "ATOM      1  X   %-3.3s %c%4d    %8.3f%8.3f%8.3f  1.00  0.00          %2.2s\n",
+			residueName.c_str(), chainName.empty() ? ' ' : chainName[0], int(protein.activeResidueNumbers()[groupIndex] % 10000), a.x, a.y, a.z, element.c_str());
+
+		file << line;
+	}
+
+	file << "END\n";
+
+	return bool(file);
+}
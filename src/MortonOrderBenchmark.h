@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+struct GLFWwindow;
+
+namespace dynamol
+{
+	// Compares the frame time of rendering atoms in file order and in Morton order, for a file and for a synthetic system
+	// made of copies of its first timestep with the given number of atoms. Requires a window with a current OpenGL context.
+	class MortonOrderBenchmark
+	{
+	public:
+		static bool run(GLFWwindow* window, const std::string& filename, std::size_t atomCount = 2000000, unsigned int frameCount = 200);
+
+		// Writes translated copies of the first timestep of a file as a PDB file with at least the given number of atoms
+		static bool writeSyntheticSystem(const std::string& filename, const std::string& syntheticFilename, std::size_t atomCount);
+	};
+}
@@ -0,0 +1,309 @@
+#include "PdbParser.h"
+#include "Protein.h"
+
+#include <array>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+	}
+
+	inline bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	// equivalent of trim_copy(str.substr(position, count)) without creating any strings
+	inline void field(const char* line, const char* lineEnd, std::size_t position, std::size_t count, const char*& begin, const char*& end)
+	{
+		const std::size_t length = std::size_t(lineEnd - line);
+
+		begin = line + std::min(position, length);
+		end = line + std::min(position + count, length);
+
+		while (begin < end && isSpace(*begin))
+			begin++;
+
+		while (end > begin && isSpace(*(end - 1)))
+			end--;
+	}
+
+	inline bool equals(const char* begin, const char* end, const char* string)
+	{
+		const std::size_t length = std::strlen(string);
+		return std::size_t(end - begin) == length && std::memcmp(begin, string, length) == 0;
+	}
+
+	// packs up to four characters into an integer key, returns false for longer names
+	inline bool key(const char* begin, const char* end, uint& result)
+	{
+		if (end - begin > 4)
+			return false;
+
+		result = 0;
+
+		for (uint i = 0; begin + i < end; i++)
+			result |= uint(static_cast<unsigned char>(begin[i])) << (8 * i);
+
+		return true;
+	}
+
+	// lookup table derived once from the string-keyed element map in Protein
+	struct LookupTables
+	{
+		LookupTables()
+		{
+			elements.fill(0);
+
+			for (auto& e : Protein::elementIds())
+			{
+				uint k;
+
+				if (e.first.size() <= 2 && key(e.first.data(), e.first.data() + e.first.size(), k))
+					elements[k] = std::uint8_t(e.second);
+			}
+		}
+
+		std::array<std::uint8_t, 65536> elements;
+	};
+
+	const std::uint64_t hashedName = std::uint64_t(1) << 63;
+
+	const LookupTables& lookupTables()
+	{
+		static const LookupTables tables;
+		return tables;
+	}
+
+	const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+}
+
+const char* PdbParser::lineEnd(const char* begin, const char* end)
+{
+	const void* newline = std::memchr(begin, '\n', std::size_t(end - begin));
+	return newline ? static_cast<const char*>(newline) : end;
+}
+
+PdbParser::Record PdbParser::record(const char* begin, const char* end)
+{
+	const char* fieldBegin;
+	const char* fieldEnd;
+
+	field(begin, end, 0, 6, fieldBegin, fieldEnd);
+
+	if (equals(fieldBegin, fieldEnd, "END"))
+		return Record::End;
+
+	if (equals(fieldBegin, fieldEnd, "ENDMDL"))
+		return Record::ModelEnd;
+
+	if (equals(fieldBegin, fieldEnd, "ATOM") || equals(fieldBegin, fieldEnd, "HETATM"))
+		return Record::Atom;
+
+	return Record::Other;
+}
+
+PdbParser::Record PdbParser::parse(const char* begin, const char* end, Atom& atom)
+{
+	const Record type = record(begin, end);
+
+	if (type != Record::Atom)
+		return type;
+
+	const char* fieldBegin;
+	const char* fieldEnd;
+
+	field(begin, end, 30, 8, fieldBegin, fieldEnd);
+	atom.position.x = parseFloat(fieldBegin, fieldEnd);
+
+	field(begin, end, 38, 8, fieldBegin, fieldEnd);
+	atom.position.y = parseFloat(fieldBegin, fieldEnd);
+
+	field(begin, end, 46, 8, fieldBegin, fieldEnd);
+	atom.position.z = parseFloat(fieldBegin, fieldEnd);
+
+	field(begin, end, 17, 3, fieldBegin, fieldEnd);
+	atom.residueName = name(fieldBegin, fieldEnd);
+
+	field(begin, end, 21, 1, fieldBegin, fieldEnd);
+	atom.chainName = name(fieldBegin, fieldEnd);
+
+	field(begin, end, 22, 4, fieldBegin, fieldEnd);
+	atom.residueNumber = parseInteger(fieldBegin, fieldEnd);
+
+	field(begin, end, 76, 2, fieldBegin, fieldEnd);
+	atom.elementId = elementId(fieldBegin, fieldEnd);
+
+	return Record::Atom;
+}
+
+float PdbParser::parseFloat(const char* begin, const char* end)
+{
+	const char* c = begin;
+
+	while (c < end && isSpace(*c))
+		c++;
+
+	bool negative = false;
+
+	if (c < end && (*c == '-' || *c == '+'))
+	{
+		negative = (*c == '-');
+		c++;
+	}
+
+	std::uint64_t mantissa = 0;
+	uint digitCount = 0;
+	uint fractionCount = 0;
+
+	while (c < end && isDigit(*c))
+	{
+		mantissa = mantissa * 10 + std::uint64_t(*c - '0');
+		digitCount++;
+		c++;
+	}
+
+	if (c < end && *c == '.')
+	{
+		c++;
+
+		while (c < end && isDigit(*c))
+		{
+			mantissa = mantissa * 10 + std::uint64_t(*c - '0');
+			digitCount++;
+			fractionCount++;
+			c++;
+		}
+	}
+
+	// Exponents, special values, excess precision or malformed input are rare in PDB files,
+	// so we simply defer to the C library for these to retain the exact semantics of atof
+	if (digitCount == 0 || digitCount > 15 || (c < end && !isSpace(*c)))
+	{
+		char buffer[64];
+		const std::size_t length = std::min(std::size_t(end - begin), sizeof(buffer) - 1);
+		std::memcpy(buffer, begin, length);
+		buffer[length] = '\0';
+
+		return float(std::strtod(buffer, nullptr));
+	}
+
+	// both operands are exactly representable, so the division is correctly rounded just like atof
+	double value = double(mantissa) / powersOfTen[fractionCount];
+	return float(negative ? -value : value);
+}
+
+std::int32_t PdbParser::parseInteger(const char* begin, const char* end)
+{
+	while (begin < end && isSpace(*begin))
+		begin++;
+
+	bool negative = false;
+
+	if (begin < end && (*begin == '-' || *begin == '+'))
+	{
+		negative = (*begin == '-');
+		begin++;
+	}
+
+	if (begin < end && !isDigit(*begin) && !negative && end - begin <= 8)
+	{
+		// Hybrid-36 continues after the largest decimal number of a field with upper-case and then lower-case
+		// base-36 digits, e.g. A000 follows 9999 in the four columns of residue numbers
+		const bool upper = *begin >= 'A' && *begin <= 'Z';
+		std::int64_t result = 0;
+		std::int64_t decimalRange = 1;
+		std::int64_t digitRange = 1;
+
+		for (const char* c = begin; c < end; c++)
+		{
+			int digit;
+
+			if (isDigit(*c))
+				digit = *c - '0';
+			else if (upper && *c >= 'A' && *c <= 'Z')
+				digit = *c - 'A' + 10;
+			else if (!upper && *c >= 'a' && *c <= 'z')
+				digit = *c - 'a' + 10;
+			else
+				return 0;
+
+			result = result * 36 + digit;
+			decimalRange *= 10;
+			digitRange *= 36;
+		}
+
+		// the first code, A followed by zeros, has the value 10 * 36^(n-1) and represents 10^n
+		result += decimalRange - 10 * (digitRange / 36);
+
+		if (!upper)
+			result += 26 * (digitRange / 36);
+
+		return std::int32_t(result);
+	}
+
+	std::int32_t result = 0;
+
+	for (; begin < end && isDigit(*begin); begin++)
+		result = result * 10 + (*begin - '0');
+
+	return negative ? -result : result;
+}
+
+uint PdbParser::elementId(const char* begin, const char* end)
+{
+	uint k;
+
+	if (end - begin > 2 || !key(begin, end, k))
+		return 0;
+
+	return lookupTables().elements[k];
+}
+
+std::uint64_t PdbParser::name(const char* begin, const char* end)
+{
+	const std::size_t length = std::size_t(end - begin);
+
+	if (length <= 8)
+	{
+		std::uint64_t result = 0;
+
+		for (std::size_t i = 0; i < length; i++)
+			result |= std::uint64_t(static_cast<unsigned char>(begin[i])) << (8 * i);
+
+		return result;
+	}
+
+	// 64-bit FNV-1a, names are ASCII, so the highest bit of packed names is never set
+	std::uint64_t hash = 14695981039346656037ull;
+
+	for (const char* c = begin; c < end; c++)
+	{
+		hash ^= std::uint64_t(static_cast<unsigned char>(*c));
+		hash *= 1099511628211ull;
+	}
+
+	return hash | hashedName;
+}
+
+std::string PdbParser::name(std::uint64_t name)
+{
+	std::string result;
+
+	if (name & hashedName)
+		return result;
+
+	for (; name != 0; name >>= 8)
+		result.push_back(char(name & 0xFF));
+
+	return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+
+namespace dynamol
+{
+	// Allocation-free decoding of fixed-column PDB records directly from a character buffer
+	class PdbParser
+	{
+	public:
+		enum class Record
+		{
+			Other,
+			Atom,
+			End,
+			ModelEnd
+		};
+
+		struct Atom
+		{
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::uint elementId = 0;
+			std::uint64_t residueName = 0;
+			std::uint64_t chainName = 0;
+			std::int32_t residueNumber = 0;
+		};
+
+		// Returns the end of the line starting at begin (pointing to the newline character or to end)
+		static const char* lineEnd(const char* begin, const char* end);
+
+		// Determines the record type of a single line without decoding any of its fields
+		static Record record(const char* begin, const char* end);
+
+		// Parses a single line (excluding the newline character), atom is only written for ATOM/HETATM records
+		static Record parse(const char* begin, const char* end, Atom& atom);
+
+		// Equivalent to float(std::atof(...)) on the given character range
+		static float parseFloat(const char* begin, const char* end);
+
+		// Decodes decimal residue sequence numbers as well as the hybrid-36 numbers written for more than 9999 residues
+		static std::int32_t parseInteger(const char* begin, const char* end);
+
+		static glm::uint elementId(const char* begin, const char* end);
+
+		// Packs residue and chain names of up to eight characters into an integer, longer names are hashed with the highest bit set
+		static std::uint64_t name(const char* begin, const char* end);
+
+		// Unpacks a name, hashed names cannot be recovered and result in an empty string
+		static std::string name(std::uint64_t name);
+	};
+}
@@ -0,0 +1,277 @@
+#include "Profiler.h"
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <imgui.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+using namespace dynamol;
+using namespace gl;
+using namespace globjects;
+
+namespace
+{
+	std::string escape(const std::string& text)
+	{
+		std::string result;
+
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				result += '\\';
+
+			result += c;
+		}
+
+		return result;
+	}
+}
+
+Profiler::Scope::Scope(Profiler* profiler, const std::string& name) : m_profiler(profiler)
+{
+	m_profiler->begin(name);
+}
+
+Profiler::Scope::~Scope()
+{
+	m_profiler->end();
+}
+
+Profiler::Profiler()
+{
+}
+
+void Profiler::beginFrame()
+{
+	m_frameIndex++;
+	m_openSections.clear();
+
+	Frame& frame = m_frames[m_frameIndex % frameCount];
+
+	if (frame.pending)
+		resolve(frame, frame.recorded);
+
+	frame.sections.clear();
+	frame.traced = m_tracing;
+	frame.recorded = m_recording;
+	frame.pending = true;
+
+	// the current GPU time is returned without waiting for the commands issued so far
+	GLint64 timestamp = 0;
+	glGetInteger64v(GL_TIMESTAMP, &timestamp);
+	frame.gpuOffset = now() - double(timestamp) / 1000000.0;
+}
+
+void Profiler::begin(const std::string& name)
+{
+	auto i = m_passIndices.find(name);
+
+	if (i == m_passIndices.end())
+	{
+		i = m_passIndices.emplace(name, m_passes.size()).first;
+		m_passes.emplace_back();
+		m_passes.back().name = name;
+	}
+
+	Frame& frame = m_frames[m_frameIndex % frameCount];
+	const std::size_t section = frame.sections.size();
+
+	while (frame.queries.size() < 2 * (section + 1))
+		frame.queries.push_back(std::make_unique<Query>());
+
+	frame.queries[2 * section]->counter(GL_TIMESTAMP);
+	frame.sections.push_back({ i->second, m_openSections.size(), now(), -1.0 });
+
+	m_passes[i->second].depth = m_openSections.size();
+	m_openSections.push_back(section);
+}
+
+void Profiler::end()
+{
+	if (m_openSections.empty())
+		return;
+
+	Frame& frame = m_frames[m_frameIndex % frameCount];
+	const std::size_t section = m_openSections.back();
+	m_openSections.pop_back();
+
+	frame.queries[2 * section + 1]->counter(GL_TIMESTAMP);
+	frame.sections[section].cpuEnd = now();
+}
+
+void Profiler::displayOverlay()
+{
+	ImGui::Text("Average over %zu frames, %zu frames without GPU times", historySize, m_droppedFrames);
+
+	if (m_tracing)
+		ImGui::Text("Recording trace (%zu events)", m_traceEvents.size());
+
+	// the histograms start with the oldest frame
+	const int offset = int((m_historyIndex + 1) % historySize);
+
+	for (const Pass& p : m_passes)
+	{
+		float cpuTime = 0.0f;
+		float gpuTime = 0.0f;
+		float gpuMaximum = 0.0f;
+
+		for (std::size_t i = 0; i < historySize; i++)
+		{
+			cpuTime += p.cpuTimes[i];
+			gpuTime += p.gpuTimes[i];
+			gpuMaximum = std::max(gpuMaximum, p.gpuTimes[i]);
+		}
+
+		const float indent = 16.0f * float(p.depth) + 1.0f;
+		ImGui::Indent(indent);
+		ImGui::Text("%s: GPU %.3f ms, CPU %.3f ms", p.name.c_str(), gpuTime / float(historySize), cpuTime / float(historySize));
+		ImGui::PlotHistogram(("##" + p.name).c_str(), p.gpuTimes.data(), int(historySize), offset, nullptr, 0.0f, std::max(gpuMaximum, 0.001f), ImVec2(256.0f, 32.0f));
+		ImGui::Unindent(indent);
+	}
+}
+
+bool Profiler::isTracing() const
+{
+	return m_tracing;
+}
+
+void Profiler::startTrace()
+{
+	m_traceEvents.clear();
+	m_tracing = true;
+}
+
+bool Profiler::stopTrace(const std::string& filename)
+{
+	// the current frame is not complete yet and no longer recorded
+	resolvePreviousFrames();
+
+	m_frames[m_frameIndex % frameCount].traced = false;
+	m_tracing = false;
+
+	std::ofstream file(filename);
+
+	if (!file)
+		return false;
+
+	// times are given in microseconds, the sections of the CPU and the GPU are shown as two threads
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+
+	for (const TraceEvent& e : m_traceEvents)
+	{
+		file << ",\n{\"name\":\"" << escape(m_passes[e.pass].name) << "\",\"cat\":\"" << (e.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << (e.gpu ? 1 : 0);
+		file << ",\"ts\":" << e.begin * 1000.0 << ",\"dur\":" << e.duration * 1000.0 << "}";
+	}
+
+	file << "\n]}\n";
+	m_traceEvents.clear();
+
+	return bool(file);
+}
+
+std::size_t Profiler::passCount() const
+{
+	return m_passes.size();
+}
+
+const std::string& Profiler::passName(std::size_t pass) const
+{
+	return m_passes[pass].name;
+}
+
+void Profiler::startRecording()
+{
+	m_recordedFrames.clear();
+	m_recording = true;
+}
+
+std::vector<Profiler::FrameTimes> Profiler::stopRecording()
+{
+	resolvePreviousFrames();
+
+	Frame& frame = m_frames[m_frameIndex % frameCount];
+
+	if (frame.pending)
+		resolve(frame, true);
+
+	m_recording = false;
+
+	return std::move(m_recordedFrames);
+}
+
+double Profiler::now() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+void Profiler::resolve(Frame& frame, bool wait)
+{
+	frame.pending = false;
+
+	// Sections still open at the end of the frame are skipped
+	bool available = true;
+
+	for (std::size_t i = 0; i < frame.sections.size() && available && !wait; i++)
+	{
+		if (frame.sections[i].cpuEnd >= 0.0)
+			available = frame.queries[2 * i + 1]->resultAvailable();
+	}
+
+	if (!available)
+		m_droppedFrames++;
+
+	std::vector<float> cpuTimes(m_passes.size(), 0.0f);
+	std::vector<float> gpuTimes(m_passes.size(), 0.0f);
+
+	for (std::size_t i = 0; i < frame.sections.size(); i++)
+	{
+		const Section& s = frame.sections[i];
+
+		if (s.cpuEnd < 0.0)
+			continue;
+
+		cpuTimes[s.pass] += float(s.cpuEnd - s.cpuBegin);
+
+		if (frame.traced && m_traceEvents.size() < maximumTraceEvents)
+			m_traceEvents.push_back({ s.pass, false, s.cpuBegin, s.cpuEnd - s.cpuBegin });
+
+		if (!available)
+			continue;
+
+		const double gpuBegin = double(frame.queries[2 * i]->get64(GL_QUERY_RESULT)) / 1000000.0;
+		const double gpuEnd = double(frame.queries[2 * i + 1]->get64(GL_QUERY_RESULT)) / 1000000.0;
+		gpuTimes[s.pass] += float(gpuEnd - gpuBegin);
+
+		if (frame.traced && m_traceEvents.size() < maximumTraceEvents)
+			m_traceEvents.push_back({ s.pass, true, gpuBegin + frame.gpuOffset, gpuEnd - gpuBegin });
+	}
+
+	if (frame.recorded)
+		m_recordedFrames.push_back({ cpuTimes, gpuTimes });
+
+	m_historyIndex = (m_historyIndex + 1) % historySize;
+
+	for (std::size_t p = 0; p < m_passes.size(); p++)
+	{
+		m_passes[p].cpuTimes[m_historyIndex] = cpuTimes[p];
+		m_passes[p].gpuTimes[m_historyIndex] = gpuTimes[p];
+	}
+}
+
+void Profiler::resolvePreviousFrames()
+{
+	// the earlier frames are resolved from the oldest one
+	for (std::size_t i = 1; i < frameCount; i++)
+	{
+		Frame& frame = m_frames[(m_frameIndex + i) % frameCount];
+
+		if (frame.pending)
+			resolve(frame, true);
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <globjects/Query.h>
+
+namespace dynamol
+{
+	// Measures the CPU and GPU time of the sections of a frame, such as the passes of the renderers and the kernels of the fluid
+	// simulation. Every section is bracketed by two GPU timestamp queries, which are read a few frames later once they are
+	// available, so the pipeline is never stalled. If they are still not available by then, the GPU times of that frame are
+	// dropped. Sections may be nested, and sections of the same name within a frame, e.g. of several tiles, are added up.
+	//
+	// The times of the latest frames are shown as histograms, and the sections of a range of frames can be recorded and written
+	// as a trace in the JSON format of the Chrome trace viewer (chrome://tracing or https://ui.perfetto.dev).
+	class Profiler
+	{
+	public:
+		// Measures the section from its construction to the end of the enclosing block
+		class Scope
+		{
+		public:
+			Scope(Profiler* profiler, const std::string& name);
+			~Scope();
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+		private:
+			Profiler* m_profiler;
+		};
+
+		// the times of every pass in one frame in milliseconds, indexed like the names of the passes
+		struct FrameTimes
+		{
+			std::vector<float> cpuTimes;
+			std::vector<float> gpuTimes;
+		};
+
+		static const std::size_t historySize = 128;
+
+		Profiler();
+
+		// Starts a frame and reads the results of the frame that used the same queries before
+		void beginFrame();
+
+		// Starts a section, which ends with the next call to end that is not matched by another begin
+		void begin(const std::string& name);
+		void end();
+
+		// Shows the times of every section in the current ImGui window
+		void displayOverlay();
+
+		bool isTracing() const;
+		void startTrace();
+
+		// Waits for the frames still in flight and writes the sections recorded since the start of the trace
+		bool stopTrace(const std::string& filename);
+
+		std::size_t passCount() const;
+		const std::string& passName(std::size_t pass) const;
+
+		// Records the times of every frame from the next one on. The queries of recorded frames are waited for instead of dropped.
+		void startRecording();
+
+		// Waits for all frames still in flight, including the current one, and returns the recorded times. Has to be called between
+		// frames, after all sections have ended.
+		std::vector<FrameTimes> stopRecording();
+
+	private:
+		// frames whose queries are in flight at the same time
+		static const std::size_t frameCount = 3;
+
+		// bounds the memory of a trace, later sections are not recorded
+		static const std::size_t maximumTraceEvents = 1 << 22;
+
+		struct Section
+		{
+			std::size_t pass;
+			std::size_t depth;
+			double cpuBegin;
+			double cpuEnd;
+		};
+
+		struct Frame
+		{
+			std::vector<Section> sections;
+
+			// two timestamp queries per section, which are kept for later frames
+			std::vector< std::unique_ptr<globjects::Query> > queries;
+
+			// maps GPU timestamps to the CPU clock of the profiler in milliseconds
+			double gpuOffset = 0.0;
+			bool pending = false;
+			bool traced = false;
+			bool recorded = false;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			std::size_t depth = 0;
+			std::array<float, historySize> cpuTimes = {};
+			std::array<float, historySize> gpuTimes = {};
+		};
+
+		struct TraceEvent
+		{
+			std::size_t pass;
+			bool gpu;
+			double begin;
+			double duration;
+		};
+
+		double now() const;
+		void resolve(Frame& frame, bool wait);
+		void resolvePreviousFrames();
+
+		std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+
+		std::array<Frame, frameCount> m_frames;
+		std::size_t m_frameIndex = 0;
+		std::vector<std::size_t> m_openSections;
+
+		std::vector<Pass> m_passes;
+		std::unordered_map<std::string, std::size_t> m_passIndices;
+		std::size_t m_historyIndex = 0;
+		std::size_t m_droppedFrames = 0;
+
+		bool m_tracing = false;
+		std::vector<TraceEvent> m_traceEvents;
+
+		bool m_recording = false;
+		std::vector<FrameTimes> m_recordedFrames;
+	};
+}
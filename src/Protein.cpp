@@ -1,17 +1,23 @@
 #include "Protein.h"
+#include "PdbParser.h"
+#include "CifParser.h"
+#include "BinaryCifParser.h"
+#include "MappedFile.h"
+#include "GzipStream.h"
+#include "ThreadPool.h"
+#include "TrajectoryCache.h"
+#include "TrajectoryReader.h"
+#include "MortonOrder.h"
 
-#include <fstream>
 #include <string>
-#include <sstream>
-#include <cstdlib>
-#include <iterator>
 #include <iostream>
 #include <limits>
 #include <unordered_map>
 #include <array>
 #include <algorithm> 
+#include <chrono>
 #include <cctype>
-#include <locale>
+#include <utility>
 #include <globjects/globjects.h>
 #include <globjects/logging.h>
 
@@ -21,178 +27,820 @@
 using namespace dynamol;
 using namespace glm;
 
-// trim from start (in place)
-static inline void ltrim(std::string &s)
+Protein::Protein()
 {
-	s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](int ch) {
-		return !std::isspace(ch);
-	}));
-}
 
-// trim from end (in place)
-static inline void rtrim(std::string &s)
-{
-	s.erase(std::find_if(s.rbegin(), s.rend(), [](int ch) {
-		return !std::isspace(ch);
-	}).base(), s.end());
 }
 
-// trim from both ends (in place)
-static inline void trim(std::string &s)
+Protein::Protein(const std::string& filename)
 {
-	ltrim(s);
-	rtrim(s);
+	load(filename);
 }
 
-// trim from start (copying)
-static inline std::string ltrim_copy(std::string s)
+Protein::~Protein()
 {
-	ltrim(s);
-	return s;
-}
 
-// trim from end (copying)
-static inline std::string rtrim_copy(std::string s)
-{
-	rtrim(s);
-	return s;
 }
 
-// trim from both ends (copying)
-static inline std::string trim_copy(std::string s)
+namespace
 {
-	trim(s);
-	return s;
-}
+	// assigns consecutive indices to ids in order of their first occurrence, index 0 marks unassigned ids
+	inline uint index(uint id, uint* indices, std::vector<uint>& ids)
+	{
+		if (indices[id] == 0)
+		{
+			indices[id] = uint(ids.size());
+			ids.push_back(id);
+		}
 
-Protein::Protein()
-{
+		return indices[id];
+	}
 
-}
+	// assigns consecutive indices to packed names or residue keys in order of their first occurrence
+	template <typename Key, typename Map>
+	inline uint index(const Key& key, Map& indices, std::vector<Key>& keys)
+	{
+		const auto result = indices.try_emplace(key, uint(keys.size()));
 
-Protein::Protein(const std::string& filename)
-{
-	load(filename);
+		if (result.second)
+			keys.push_back(key);
+
+		return result.first->second;
+	}
+
+	using GroupKey = std::pair<std::uint64_t, std::int32_t>;
+
+	inline GroupKey groupKey(uint residueIndex, uint chainIndex, std::int32_t residueNumber)
+	{
+		return GroupKey((std::uint64_t(residueIndex) << 32) | chainIndex, residueNumber);
+	}
+
+	inline std::size_t groupHash(const GroupKey& key)
+	{
+		return std::hash<std::uint64_t>()(key.first * 0x9E3779B97F4A7C15ull ^ std::uint64_t(std::uint32_t(key.second)));
+	}
+
+	struct GroupHash
+	{
+		std::size_t operator()(const GroupKey& key) const
+		{
+			return groupHash(key);
+		}
+	};
+
+	// segment decoded independently with its own id tables
+	struct Segment
+	{
+		std::vector<vec4> atoms;
+
+		std::array<uint, 116> elementIndices = {};
+		std::vector<uint> elementIds = { 0 };
+
+		std::unordered_map<std::uint64_t, uint> residueIndices;
+		std::unordered_map<std::uint64_t, uint> chainIndices;
+		std::unordered_map<GroupKey, uint, GroupHash> groupIndices;
+
+		std::vector<std::uint64_t> residueNames = { 0 };
+		std::vector<std::uint64_t> chainNames = { 0 };
+		std::vector<GroupKey> groups = { GroupKey(0, 0) };
+
+		std::array<uint, 256> elementRemap = {};
+		std::vector<uint> groupRemap;
+
+		vec3 minimumBounds = vec3(std::numeric_limits<float>::max());
+		vec3 maximumBounds = vec3(-std::numeric_limits<float>::max());
+
+		void decode(const char* begin, const char* end)
+		{
+			PdbParser::Atom atom;
+			const char* line = begin;
+
+			// consecutive atoms mostly belong to the same residue, so the name lookups can be skipped for them
+			std::uint64_t residueName = 0;
+			std::uint64_t chainName = 0;
+			std::int32_t residueNumber = 0;
+			uint groupIndex = 0;
+
+			atoms.reserve(std::size_t(end - begin) / 81 + 1);
+
+			while (line < end)
+			{
+				const char* lineEnd = PdbParser::lineEnd(line, end);
+
+				if (PdbParser::parse(line, lineEnd, atom) == PdbParser::Record::Atom)
+				{
+					uint elementIndex = index(atom.elementId, elementIndices.data(), elementIds);
+
+					if (groupIndex == 0 || atom.residueName != residueName || atom.chainName != chainName || atom.residueNumber != residueNumber)
+					{
+						residueName = atom.residueName;
+						chainName = atom.chainName;
+						residueNumber = atom.residueNumber;
+
+						const uint residueIndex = index(residueName, residueIndices, residueNames);
+						const uint chainIndex = index(chainName, chainIndices, chainNames);
+						groupIndex = index(groupKey(residueIndex, chainIndex, residueNumber), groupIndices, groups);
+					}
+
+					atoms.emplace_back(atom.position, uintBitsToFloat(Protein::packAttributes(elementIndex, groupIndex)));
+
+					minimumBounds = min(minimumBounds, atom.position);
+					maximumBounds = max(maximumBounds, atom.position);
+				}
+
+				line = (lineEnd < end) ? lineEnd + 1 : end;
+			}
+		}
+
+		// translates the segment-local indices into the global ones computed during merging
+		void remap()
+		{
+			for (auto& a : atoms)
+			{
+				const uint atomAttributes = floatBitsToUint(a.w);
+				a.w = uintBitsToFloat(Protein::packAttributes(elementRemap[Protein::elementIndex(atomAttributes)], groupRemap[Protein::groupIndex(atomAttributes)]));
+			}
+		}
+	};
+
+	// line of an END or ENDMDL record
+	struct EndRecord
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		PdbParser::Record type = PdbParser::Record::End;
+	};
+
+	// returns whether an ATOM or HETATM record starts within [begin, end)
+	bool containsAtoms(const char* begin, const char* end)
+	{
+		const char* line = begin;
+
+		while (line < end)
+		{
+			const char* lineEnd = PdbParser::lineEnd(line, end);
+
+			if (PdbParser::record(line, lineEnd) == PdbParser::Record::Atom)
+				return true;
+
+			line = (lineEnd < end) ? lineEnd + 1 : end;
+		}
+
+		return false;
+	}
+
+	// Finds the start and end of all lines terminating a timestep, scanning the file in parallel chunks. END and ENDMDL records
+	// both terminate timesteps, so that every model of an ensemble becomes a timestep, except for the END record closing such a
+	// file after its last ENDMDL record. modelEnded tells whether the data before begin ended with an ENDMDL record and no atoms.
+	std::vector< std::pair<const char*, const char*> > findEndRecords(const char* begin, const char* end, bool& modelEnded)
+	{
+		const std::size_t size = std::size_t(end - begin);
+		const std::size_t chunkCount = std::max<std::size_t>(1, std::min<std::size_t>(ThreadPool::instance().threadCount() * 4, size / 65536));
+		const std::size_t chunkSize = size / chunkCount + 1;
+
+		std::vector< std::vector<EndRecord> > chunkRecords(chunkCount);
+
+		ThreadPool::instance().parallelFor(chunkCount, [&](std::size_t i)
+		{
+			const char* chunkBegin = begin + std::min(i * chunkSize, size);
+			const char* chunkEnd = begin + std::min((i + 1) * chunkSize, size);
+
+			// each chunk handles the lines starting within it
+			const char* line = chunkBegin;
+
+			if (line > begin && *(line - 1) != '\n')
+			{
+				line = PdbParser::lineEnd(line, end);
+				line = (line < end) ? line + 1 : end;
+			}
+
+			while (line < chunkEnd)
+			{
+				const char* lineEnd = PdbParser::lineEnd(line, end);
+				const PdbParser::Record record = PdbParser::record(line, lineEnd);
+
+				if (record == PdbParser::Record::End || record == PdbParser::Record::ModelEnd)
+					chunkRecords[i].push_back({ line, lineEnd, record });
+
+				line = (lineEnd < end) ? lineEnd + 1 : end;
+			}
+		});
+
+		std::vector< std::pair<const char*, const char*> > records;
+		const char* previousEnd = begin;
+
+		for (auto& c : chunkRecords)
+		{
+			for (auto& r : c)
+			{
+				// an END record without atoms since the last ENDMDL record does not add an empty timestep
+				if (r.type == PdbParser::Record::End && modelEnded && !containsAtoms(previousEnd, r.begin))
+				{
+					modelEnded = false;
+					continue;
+				}
+
+				modelEnded = r.type == PdbParser::Record::ModelEnd;
+				previousEnd = r.end;
+				records.emplace_back(r.begin, r.end);
+			}
+		}
+
+		if (modelEnded)
+			modelEnded = !containsAtoms(previousEnd, end);
+
+		return records;
+	}
+
+	// Residues missing from the color table are colored like unknown ones
+	vec3 residueColor(std::uint64_t name)
+	{
+		const auto ri = Protein::residueIds().find(PdbParser::name(name));
+		return Protein::residueColors()[ri != Protein::residueIds().end() ? ri->second : 0];
+	}
+
+	// Chains with longer names than in PDB files, as used by large assemblies, are distributed over the chain colors
+	vec3 chainColor(std::uint64_t name)
+	{
+		const std::string string = PdbParser::name(name);
+		const auto ci = Protein::chainIds().find(string);
+
+		if (ci != Protein::chainIds().end())
+			return Protein::chainColors()[ci->second];
+
+		if (name == 0 || string.size() == 1)
+			return Protein::chainColors()[0];
+
+		std::uint64_t hash = 14695981039346656037ull;
+
+		for (int i = 0; i < 8; i++)
+			hash = (hash ^ ((name >> (8 * i)) & 0xFF)) * 1099511628211ull;
+
+		return Protein::chainColors()[1 + hash % (Protein::chainColors().size() - 1)];
+	}
+
+	// lower-case extension of a file name including the dot, or an empty string
+	std::string fileExtension(const std::string& filename)
+	{
+		const std::size_t dot = filename.find_last_of('.');
+
+		if (dot == std::string::npos || filename.find_first_of("/\\", dot) != std::string::npos)
+			return std::string();
+
+		std::string extension = filename.substr(dot);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+
+		return extension;
+	}
 }
 
-void Protein::load(const std::string& filename)
+void Protein::load(const std::string& filename, bool useCache)
 {
 	globjects::debug() << "Loading file " << filename << " ...";
-	std::ifstream file(filename);
 
-	if (!file.is_open())
+	m_filename = filename;
+	m_cache.reset();
+	m_source.reset();
+	m_sourceTimesteps.clear();
+	m_trajectory.reset();
+	m_topology.clear();
+	m_positions.clear();
+	m_staticAttributes.clear();
+	m_atomOrder.clear();
+	m_orderedStaticAttributes.clear();
+	m_sourceAttributesDiffer = false;
+
+	if (useCache && loadCache(filename))
+		return;
+
+	// compressed files are decompressed on a background thread while they are parsed
+	std::unique_ptr<MappedFile> file;
+	std::unique_ptr<GzipStream> stream;
+
+	if (GzipStream::isCompressed(filename))
 	{
-		globjects::critical() << "Could not open file " << filename << "!";
+		stream = std::make_unique<GzipStream>(filename);
 	}
+	else
+	{
+		file = std::make_unique<MappedFile>(filename);
 
-	m_filename = filename;
+		if (!file->isOpen())
+		{
+			globjects::critical() << "Could not open file " << filename << "!";
+		}
+	}
 
 	m_atoms.clear();
 	m_minimumBounds = vec3(std::numeric_limits<float>::max());
 	m_maximumBounds = vec3(-std::numeric_limits<float>::max());
 
-	m_elementIdMap.fill(0);
-	m_residueIdMap.fill(0);
-	m_chainIdMap.fill(0);
+	clearActiveTables();
 
-	m_activeElementIds.clear();
-	m_activeElementIds.push_back(0);
+	const auto startTime = std::chrono::high_resolution_clock::now();
 
-	m_activeResidueIds.clear();
-	m_activeResidueIds.push_back(0);
+	const std::string extension = fileExtension(GzipStream::uncompressedFilename(filename));
+	const bool binary = extension == ".bcif";
 
-	m_activeChainIds.clear();
-	m_activeChainIds.push_back(0);
+	if (binary || extension == ".cif" || extension == ".mmcif")
+	{
+		if (stream)
+			parseCif(*stream, binary);
+		else
+			parseCif(file->begin(), file->end(), binary);
+	}
+	else
+	{
+		if (stream)
+			parsePdb(*stream);
+		else
+			parsePdb(file);
+	}
+
+	if (stream && stream->failed())
+	{
+		globjects::critical() << "Could not decompress " << filename << ", it is corrupt or truncated!";
+	}
 
-	std::string str;
-	uint elementCount = 1;
+	if (m_activeGroups.size() >= maximumGroupCount)
+	{
+		globjects::critical() << filename << " has more than " << maximumGroupCount << " residues, the remaining ones are colored as unknown!";
+	}
 
-	std::vector<vec4> atoms;
+	updateActiveTables();
+	updateStaticAttributes();
 
-	while (std::getline(file, str))
+	for (std::size_t i = 0; i < timestepCount(); i++)
 	{
-		//std::vector<std::string> tokens;
-		//std::istringstream buffer(str);
-		//std::copy(std::istream_iterator<std::string>(buffer), std::istream_iterator<std::string>(), std::back_inserter(tokens));
+		globjects::debug() << "  Timestep " << uint(i) << ": " << uint(atomCount(i)) << " atoms";
+	}
+
+	const std::chrono::duration<double> loadingTime = std::chrono::high_resolution_clock::now() - startTime;
+	const std::size_t size = m_source ? m_source->size() : (file ? file->size() : stream->decompressedSize());
+	const double megabytes = double(size) / (1024.0 * 1024.0);
+
+	globjects::debug() << uint(timestepCount()) << " timesteps loaded in " << loadingTime.count() << " seconds (" << megabytes / std::max(loadingTime.count(), 1e-9) << " MB/s, " << ThreadPool::instance().threadCount() << " threads)." << std::endl;
+
+	// the cache is only mapped by the next load, this one keeps using the parsed timesteps
+	const bool complete = m_source || (file && file->isOpen()) || (stream && !stream->failed());
+
+	if (useCache && complete)
+		TrajectoryCache::write(filename, *this);
+}
+
+void Protein::parsePdb(std::unique_ptr<MappedFile>& file)
+{
+	ThreadPool& threadPool = ThreadPool::instance();
+
+	const char* begin = file->begin();
+	const char* end = file->end();
+
+	// Timesteps are delimited by END and ENDMDL records, which are located first so that timesteps can be decoded independently.
+	// Large timesteps are further split into segments so that single-frame files also benefit from multiple threads.
+	bool modelEnded = false;
+	const auto endRecords = findEndRecords(begin, end, modelEnded);
+	const std::size_t segmentSize = std::clamp<std::size_t>(file->size() / (std::size_t(threadPool.threadCount()) * 8 + 1), 256 * 1024, 16 * 1024 * 1024);
+
+	std::vector<SegmentRange> segmentRanges;
+	const char* timestepBegin = begin;
+
+	for (std::size_t i = 0; i < endRecords.size(); i++)
+	{
+		appendSegments(timestepBegin, endRecords[i].first, i, segmentSize, segmentRanges);
+		timestepBegin = (endRecords[i].second < end) ? endRecords[i].second + 1 : end;
+	}
+
+	// atoms after the last terminating record do not form a timestep, but still contribute to the id tables and bounds
+	if (timestepBegin < end)
+		appendSegments(timestepBegin, end, endRecords.size(), segmentSize, segmentRanges);
+
+	// Trajectories are only scanned for their id tables, bounds and atom counts here, and their timesteps are decoded
+	// from the mapped file when requested, so that memory usage does not grow with their length. Only the atoms of
+	// single structures are kept in memory.
+	const bool resident = endRecords.size() <= 1;
+
+	if (resident)
+	{
+		m_atoms.resize(endRecords.size());
+	}
+	else
+	{
+		m_sourceTimesteps.resize(endRecords.size());
+
+		for (auto& r : segmentRanges)
+		{
+			if (r.timestep < m_sourceTimesteps.size())
+			{
+				if (m_sourceTimesteps[r.timestep].end == 0)
+					m_sourceTimesteps[r.timestep].begin = std::size_t(r.begin - begin);
+
+				m_sourceTimesteps[r.timestep].end = std::size_t(r.end - begin);
+			}
+		}
+	}
+
+	decodeSegments(segmentRanges, resident);
+
+	if (!resident)
+		m_source = std::move(file);
+}
+
+void Protein::parsePdb(GzipStream& stream)
+{
+	// Each block is decoded while the following ones are decompressed, timesteps can continue across blocks
+	const std::size_t threadCount = ThreadPool::instance().threadCount();
+
+	std::vector<char> block;
+	std::size_t timestep = 0;
+	bool modelEnded = false;
+
+	while (stream.read(block))
+	{
+		const char* begin = block.data();
+		const char* end = begin + block.size();
+
+		const auto endRecords = findEndRecords(begin, end, modelEnded);
+		const std::size_t segmentSize = std::clamp<std::size_t>(block.size() / (threadCount * 8 + 1), 256 * 1024, 16 * 1024 * 1024);
+
+		std::vector<SegmentRange> segmentRanges;
+		const char* timestepBegin = begin;
+
+		for (auto& r : endRecords)
+		{
+			appendSegments(timestepBegin, r.first, timestep++, segmentSize, segmentRanges);
+			timestepBegin = (r.second < end) ? r.second + 1 : end;
+		}
+
+		if (timestepBegin < end)
+			appendSegments(timestepBegin, end, timestep, segmentSize, segmentRanges);
+
+		// the last timestep is kept until it is known whether an END or ENDMDL record terminates it
+		m_atoms.resize(timestep + 1);
+		decodeSegments(segmentRanges, true);
+	}
+
+	// atoms after the last terminating record do not form a timestep, but still contribute to the id tables and bounds
+	m_atoms.resize(timestep);
+}
 
-		std::string recordName = trim_copy(str.substr(0, 6));
+// splits the lines in [begin, end) into segments of roughly the given size
+void Protein::appendSegments(const char* begin, const char* end, std::size_t timestep, std::size_t segmentSize, std::vector<SegmentRange>& segments)
+{
+	do
+	{
+		const char* segmentEnd = end;
 
-		if (recordName == "END")
+		if (std::size_t(end - begin) > segmentSize)
 		{
-			m_atoms.push_back(atoms);
-			atoms.clear();
+			segmentEnd = PdbParser::lineEnd(begin + segmentSize, end);
+			segmentEnd = (segmentEnd < end) ? segmentEnd + 1 : end;
 		}
-		else if (recordName == "ATOM" || recordName == "HETATM")
+
+		segments.push_back({ begin, segmentEnd, timestep });
+
+		begin = segmentEnd;
+	}
+	while (begin < end);
+}
+
+void Protein::decodeSegments(const std::vector<SegmentRange>& segmentRanges, bool resident)
+{
+	ThreadPool& threadPool = ThreadPool::instance();
+
+	// Segments are processed in batches to bound the memory of the intermediate tables
+	const std::size_t batchSize = std::size_t(threadPool.threadCount()) * 4;
+
+	for (std::size_t first = 0; first < segmentRanges.size(); first += batchSize)
+	{
+		std::vector<Segment> segments(std::min(batchSize, segmentRanges.size() - first));
+
+		threadPool.parallelFor(segments.size(), [&](std::size_t i)
 		{
-			float x = float(std::atof(trim_copy(str.substr(30, 8)).c_str()));
-			float y = float(std::atof(trim_copy(str.substr(38, 8)).c_str()));
-			float z = float(std::atof(trim_copy(str.substr(46, 8)).c_str()));
+			segments[i].decode(segmentRanges[first + i].begin, segmentRanges[first + i].end);
+		});
 
+		// Merging the segment-local id tables in file order assigns the same indices as a sequential pass over the file
+		for (auto& s : segments)
+		{
+			for (uint i = 1; i < s.elementIds.size(); i++)
+				s.elementRemap[i] = index(s.elementIds[i], m_elementIdMap.data(), m_activeElementIds);
 
-			std::string residueName = trim_copy(str.substr(17, 3));
-			std::string chainName = trim_copy(str.substr(21, 1));
-			std::string elementName = trim_copy(str.substr(76, 2));
+			// segments hold far fewer distinct names than residues, so the names are translated before the residues
+			std::vector<uint> residueRemap(s.residueNames.size());
+			std::vector<uint> chainRemap(s.chainNames.size());
 
-			uint elementId = 0;
-			uint elementIndex = 0;
-			
-			auto ei = elementIds().find(elementName);
+			for (std::size_t i = 1; i < s.residueNames.size(); i++)
+				residueRemap[i] = index(s.residueNames[i], m_residueIndices, m_activeResidueNames);
 
-			if (ei != elementIds().end())
-				elementId = ei->second;
+			for (std::size_t i = 1; i < s.chainNames.size(); i++)
+				chainRemap[i] = index(s.chainNames[i], m_chainIndices, m_activeChainNames);
 
-			elementIndex = m_elementIdMap[elementId];
+			s.groupRemap.resize(s.groups.size());
 
-			if (elementIndex == 0)
-			{
-				elementIndex = uint(m_activeElementIds.size());
-				m_activeElementIds.push_back(elementId);				
-				m_elementIdMap[elementId] = elementIndex;
-			}
+			for (std::size_t i = 1; i < s.groups.size(); i++)
+				s.groupRemap[i] = group(residueRemap[s.groups[i].first >> 32], chainRemap[s.groups[i].first & 0xFFFFFFFF], s.groups[i].second);
 
-			uint residueId = 0;
-			uint residueIndex = 0;
+			m_minimumBounds = min(m_minimumBounds, s.minimumBounds);
+			m_maximumBounds = max(m_maximumBounds, s.maximumBounds);
+		}
 
-			auto ri = residueIds().find(residueName);
+		threadPool.parallelFor(segments.size(), [&](std::size_t i)
+		{
+			segments[i].remap();
+		});
 
-			if (ri != residueIds().end())
-				residueId = ri->second;
+		if (resident)
+		{
+			for (std::size_t i = 0; i < segments.size(); i++)
+			{
+				const std::size_t timestep = segmentRanges[first + i].timestep;
+
+				if (timestep >= m_atoms.size())
+					continue;
 
-			residueIndex = m_residueIdMap[residueId];
+				auto& atoms = m_atoms[timestep];
 
-			if (residueIndex == 0)
+				if (atoms.empty())
+					atoms = std::move(segments[i].atoms);
+				else
+					atoms.insert(atoms.end(), segments[i].atoms.begin(), segments[i].atoms.end());
+			}
+		}
+		else
+		{
+			for (std::size_t i = 0; i < segments.size(); i++)
 			{
-				residueIndex = uint(m_activeResidueIds.size());
-				m_activeResidueIds.push_back(residueId);
-				m_residueIdMap[residueId] = residueIndex;
+				const std::size_t timestep = segmentRanges[first + i].timestep;
+
+				if (timestep >= m_sourceTimesteps.size())
+					continue;
+
+				// Timesteps that are decoded on demand are compared to the attributes of the first one while scanning,
+				// since comparing them afterwards would require decoding the whole file a second time
+				std::size_t& atomCount = m_sourceTimesteps[timestep].atomCount;
+				const auto& atoms = segments[i].atoms;
+
+				if (timestep == 0)
+				{
+					for (const auto& a : atoms)
+						m_staticAttributes.push_back(floatBitsToUint(a.w));
+				}
+				else if (!m_sourceAttributesDiffer)
+				{
+					m_sourceAttributesDiffer = atomCount + atoms.size() > m_staticAttributes.size();
+
+					for (std::size_t j = 0; j < atoms.size() && !m_sourceAttributesDiffer; j++)
+						m_sourceAttributesDiffer = floatBitsToUint(atoms[j].w) != m_staticAttributes[atomCount + j];
+				}
+
+				atomCount += atoms.size();
 			}
+		}
+	}
+}
 
-			uint chainId = 0;
-			uint chainIndex = 0;
+void Protein::parseCif(const char* begin, const char* end, bool binary)
+{
+	CifParser::AtomSites atomSites;
 
-			auto ci = chainIds().find(chainName);
+	if (!(binary ? BinaryCifParser::parse(begin, end, atomSites) : CifParser::parse(begin, end, atomSites)))
+	{
+		globjects::critical() << "Could not find the atom sites in " << m_filename << "!";
+		return;
+	}
 
-			if (ci != chainIds().end())
-				chainId = ci->second;
+	addAtomSites(atomSites);
+}
 
-			chainIndex = m_chainIdMap[chainId];
+void Protein::parseCif(GzipStream& stream, bool binary)
+{
+	if (binary)
+	{
+		// BinaryCIF needs random access to its MessagePack container, but it is a fraction of the size of the text formats
+		std::vector<char> data;
+		std::vector<char> block;
 
-			if (chainIndex == 0)
-			{
-				chainIndex = uint(m_activeChainIds.size());
-				m_activeChainIds.push_back(chainId);
-				m_chainIdMap[chainId] = chainIndex;
-			}
+		while (stream.read(block))
+			data.insert(data.end(), block.begin(), block.end());
 
-			uint atomAttributes = elementIndex | (residueIndex << 8) | (chainIndex << 16);
-			vec4 atom(x, y, z, uintBitsToFloat(atomAttributes));
-			atoms.push_back(atom);
+		parseCif(data.data(), data.data() + data.size(), true);
+		return;
+	}
 
-			m_minimumBounds = min(m_minimumBounds, vec3(atom));
-			m_maximumBounds = max(m_maximumBounds, vec3(atom));
+	CifParser::AtomSites atomSites;
+
+	if (!CifParser::parse([&stream](std::vector<char>& block) { return stream.read(block); }, atomSites))
+	{
+		globjects::critical() << "Could not find the atom sites in " << m_filename << "!";
+		return;
+	}
+
+	addAtomSites(atomSites);
+}
+
+void Protein::addAtomSites(const CifParser::AtomSites& atomSites)
+{
+	// every model forms a timestep, the ids are indexed in the order of their first occurrence just like for PDB files
+	uint groupIndex = 0;
+
+	for (std::size_t i = 0; i < atomSites.size(); i++)
+	{
+		if (i == 0 || atomSites.models[i] != atomSites.models[i - 1])
+		{
+			std::size_t modelEnd = i + 1;
+
+			while (modelEnd < atomSites.size() && atomSites.models[modelEnd] == atomSites.models[i])
+				modelEnd++;
+
+			m_atoms.emplace_back();
+			m_atoms.back().reserve(modelEnd - i);
 		}
+
+		uint elementIndex = index(atomSites.elementIds[i], m_elementIdMap.data(), m_activeElementIds);
+
+		if (i == 0 || atomSites.residueNames[i] != atomSites.residueNames[i - 1] || atomSites.chainNames[i] != atomSites.chainNames[i - 1] || atomSites.residueNumbers[i] != atomSites.residueNumbers[i - 1])
+			groupIndex = group(index(atomSites.residueNames[i], m_residueIndices, m_activeResidueNames), index(atomSites.chainNames[i], m_chainIndices, m_activeChainNames), atomSites.residueNumbers[i]);
+
+		m_atoms.back().emplace_back(atomSites.positions[i], uintBitsToFloat(packAttributes(elementIndex, groupIndex)));
+
+		m_minimumBounds = min(m_minimumBounds, atomSites.positions[i]);
+		m_maximumBounds = max(m_maximumBounds, atomSites.positions[i]);
+	}
+}
+
+bool Protein::loadTrajectory(const std::string& filename)
+{
+	globjects::debug() << "Loading trajectory " << filename << " ...";
+
+	auto trajectory = TrajectoryReader::create(filename);
+
+	if (!trajectory)
+	{
+		globjects::critical() << "Unknown trajectory format of " << filename << "!";
+		return false;
+	}
+
+	if (!trajectory->open(filename) || trajectory->frameCount() == 0)
+		return false;
+
+	// the element, residue and chain attributes of the first timestep serve as topology for all frames
+	std::vector<vec4> topology;
+
+	if (m_trajectory)
+		topology = m_topology;
+	else if (timestepCount() > 0)
+		loadFileTimestep(0, topology);
+
+	if (topology.size() != trajectory->atomCount())
+	{
+		globjects::critical() << "Trajectory " << filename << " has " << uint(trajectory->atomCount()) << " atoms, but the topology has " << uint(topology.size()) << "!";
+		return false;
+	}
+
+	std::vector<vec3> positions;
+
+	if (!trajectory->readFrame(0, positions))
+	{
+		globjects::critical() << "Could not read the first frame of trajectory " << filename << "!";
+		return false;
+	}
+
+	// Scanning all frames for the bounds would defeat random access, so the topology's bounds are only extended by the first frame
+	for (const auto& p : positions)
+	{
+		m_minimumBounds = min(m_minimumBounds, p);
+		m_maximumBounds = max(m_maximumBounds, p);
 	}
 
+	m_topology = std::move(topology);
+	m_trajectory = std::move(trajectory);
+	updateStaticAttributes();
+	applyAtomOrder();
+
+	globjects::debug() << uint(m_trajectory->frameCount()) << " trajectory frames with " << uint(m_trajectory->atomCount()) << " atoms loaded." << std::endl;
+
+	return true;
+}
+
+bool Protein::loadCache(const std::string& filename)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
+	auto cache = std::make_unique<TrajectoryCache>();
+
+	if (!cache->open(filename))
+		return false;
+
+	m_atoms.clear();
+	m_positions.clear();
+	m_source.reset();
+	m_sourceTimesteps.clear();
+	m_minimumBounds = cache->minimumBounds();
+	m_maximumBounds = cache->maximumBounds();
+
+	clearActiveTables();
+
+	m_activeElementIds = cache->elementIds();
+	m_activeResidueNames = cache->residueNames();
+	m_activeChainNames = cache->chainNames();
+	m_activeGroups = cache->groups();
+	m_activeResidueNumbers = cache->residueNumbers();
+
+	for (uint i = 1; i < m_activeElementIds.size(); i++)
+		m_elementIdMap[m_activeElementIds[i]] = i;
+
+	for (uint i = 1; i < m_activeResidueNames.size(); i++)
+		m_residueIndices[m_activeResidueNames[i]] = i;
+
+	for (uint i = 1; i < m_activeChainNames.size(); i++)
+		m_chainIndices[m_activeChainNames[i]] = i;
+
+	for (uint i = 1; i < m_activeGroups.size(); i++)
+		m_groupIndices[groupKey(m_activeGroups[i].x, m_activeGroups[i].y, m_activeResidueNumbers[i])] = i;
+
+	m_cache = std::move(cache);
+	updateActiveTables();
+	updateStaticAttributes();
+
+	const std::chrono::duration<double> loadingTime = std::chrono::high_resolution_clock::now() - startTime;
+	globjects::debug() << uint(m_cache->timestepCount()) << " timesteps loaded from " << TrajectoryCache::filename(filename) << " in " << loadingTime.count() << " seconds." << std::endl;
+
+	return true;
+}
+
+void Protein::clearActiveTables()
+{
+	m_elementIdMap.fill(0);
+	m_residueIndices.clear();
+	m_chainIndices.clear();
+	m_groupIndices.clear();
+
+	m_activeElementIds.assign(1, 0);
+	m_activeResidueNames.assign(1, 0);
+	m_activeChainNames.assign(1, 0);
+	m_activeGroups.assign(1, uvec2(0));
+	m_activeResidueNumbers.assign(1, 0);
+}
+
+std::size_t Protein::GroupKeyHash::operator()(const GroupKey& key) const
+{
+	return groupHash(key);
+}
+
+uint Protein::group(uint residueIndex, uint chainIndex, std::int32_t residueNumber)
+{
+	const GroupKey key = groupKey(residueIndex, chainIndex, residueNumber);
+
+	const auto gi = m_groupIndices.find(key);
+
+	if (gi != m_groupIndices.end())
+		return gi->second;
+
+	// combinations beyond the capacity of the packed attributes fall back to the unused group 0
+	if (m_activeGroups.size() >= maximumGroupCount)
+		return 0;
+
+	const uint groupIndex = uint(m_activeGroups.size());
+	m_groupIndices.emplace(key, groupIndex);
+	m_activeGroups.push_back(uvec2(residueIndex, chainIndex));
+	m_activeResidueNumbers.push_back(residueNumber);
+
+	return groupIndex;
+}
+
+uint Protein::findGroup(std::uint64_t residueName, std::uint64_t chainName, std::int32_t residueNumber) const
+{
+	const auto ri = m_residueIndices.find(residueName);
+	const auto ci = m_chainIndices.find(chainName);
+
+	if (ri == m_residueIndices.end() || ci == m_chainIndices.end())
+		return 0;
+
+	const auto gi = m_groupIndices.find(groupKey(ri->second, ci->second, residueNumber));
+	return gi != m_groupIndices.end() ? gi->second : 0;
+}
+
+uint Protein::packAttributes(uint elementIndex, uint groupIndex)
+{
+	return elementIndex | (groupIndex << 8);
+}
+
+uint Protein::elementIndex(uint attributes)
+{
+	return attributes & 0xFF;
+}
+
+uint Protein::groupIndex(uint attributes)
+{
+	return attributes >> 8;
+}
+
+void Protein::updateActiveTables()
+{
+	m_activeElementColors.clear();
+	m_activeElementRadii.clear();
+	m_activeElementColorsRadiiPacked.clear();
+
 	for (auto id : m_activeElementIds)
 	{
 		m_activeElementColors.push_back(elementColors()[id]);
@@ -200,25 +848,98 @@ void Protein::load(const std::string& filename)
 		m_activeElementColorsRadiiPacked.push_back(vec4(elementColors()[id],elementRadii()[id]));
 	}
 
-	for (auto id : m_activeResidueIds)
+	m_activeResidueColors.clear();
+	m_activeResidueColorsPacked.clear();
+
+	for (auto name : m_activeResidueNames)
 	{
-		m_activeResidueColors.push_back(residueColors()[id]);
-		m_activeResidueColorsPacked.push_back(vec4(residueColors()[id],1.0f));
+		m_activeResidueColors.push_back(residueColor(name));
+		m_activeResidueColorsPacked.push_back(vec4(residueColor(name),1.0f));
 	}
 
-	for (auto id : m_activeChainIds)
+	m_activeChainColors.clear();
+	m_activeChainColorsPacked.clear();
+
+	for (auto name : m_activeChainNames)
 	{
-		m_activeChainColors.push_back(chainColors()[id]);
-		m_activeChainColorsPacked.push_back(vec4(chainColors()[id], 1.0f));
+		m_activeChainColors.push_back(chainColor(name));
+		m_activeChainColorsPacked.push_back(vec4(chainColor(name), 1.0f));
 	}
+}
 
+void Protein::updateStaticAttributes()
+{
+	if (m_trajectory)
+	{
+		// all frames of a trajectory share its topology
+		m_staticAttributes.resize(m_topology.size());
 
-	for (uint i = 0; i < m_atoms.size(); i++)
+		for (std::size_t i = 0; i < m_topology.size(); i++)
+			m_staticAttributes[i] = floatBitsToUint(m_topology[i].w);
+	}
+	else if (m_cache)
 	{
-		globjects::debug() << "  Timestep " << i << ": " << uint(m_atoms[i].size()) << " atoms";
+		m_staticAttributes.clear();
+
+		if (m_cache->hasStaticAttributes() && m_cache->timestepCount() > 0)
+		{
+			const vec4* data = m_cache->atomData(0);
+
+			for (std::size_t i = 0; i < m_cache->atomCount(0); i++)
+				m_staticAttributes.push_back(floatBitsToUint(data[i].w));
+		}
 	}
+	else if (m_source)
+	{
+		// the attributes of the first timestep have been collected and compared while scanning the file
+		bool uniform = !m_sourceAttributesDiffer;
+
+		for (const auto& t : m_sourceTimesteps)
+			uniform = uniform && t.atomCount == m_staticAttributes.size();
+
+		if (!uniform)
+			m_staticAttributes.clear();
+	}
+	else if (!m_atoms.empty() && m_positions.empty())
+	{
+		const std::size_t atomCount = m_atoms.front().size();
+		bool uniform = true;
+
+		for (std::size_t i = 1; i < m_atoms.size() && uniform; i++)
+		{
+			const auto& atoms = m_atoms[i];
+			uniform = atoms.size() == atomCount;
+
+			for (std::size_t j = 0; j < atomCount && uniform; j++)
+				uniform = floatBitsToUint(atoms[j].w) == floatBitsToUint(m_atoms.front()[j].w);
+		}
+
+		m_staticAttributes.clear();
+
+		if (!uniform || atomCount == 0)
+			return;
+
+		for (const auto& a : m_atoms.front())
+			m_staticAttributes.push_back(floatBitsToUint(a.w));
+
+		// resident timesteps only keep their positions, which saves a quarter of their memory
+		m_positions.resize(m_atoms.size());
 
-	globjects::debug() << uint(m_atoms.size()) << " timesteps loaded." << std::endl;
+		ThreadPool::instance().parallelFor(m_atoms.size(), [&](std::size_t i)
+		{
+			m_positions[i].resize(atomCount);
+
+			for (std::size_t j = 0; j < atomCount; j++)
+				m_positions[i][j] = vec3(m_atoms[i][j]);
+
+			std::vector<vec4>().swap(m_atoms[i]);
+		});
+
+		m_atoms.clear();
+	}
+
+	if (hasStaticAttributes())
+		globjects::debug() << "All timesteps share the attributes of their " << uint(m_staticAttributes.size()) << " atoms.";
 }
 
 const std::string & Protein::filename() const
@@ -226,9 +947,257 @@ const std::string & Protein::filename() const
 	return m_filename;
 }
 
-const std::vector< std::vector<glm::vec4> > & Protein::atoms() const
+std::size_t Protein::timestepCount() const
+{
+	if (m_trajectory)
+		return m_trajectory->frameCount();
+
+	if (m_cache)
+		return m_cache->timestepCount();
+
+	if (m_source)
+		return m_sourceTimesteps.size();
+
+	if (!m_positions.empty())
+		return m_positions.size();
+
+	return m_atoms.size();
+}
+
+std::size_t Protein::atomCount(std::size_t timestep) const
 {
-	return m_atoms;
+	if (m_trajectory)
+		return m_topology.size();
+
+	if (m_cache)
+		return m_cache->atomCount(timestep);
+
+	if (m_source)
+		return m_sourceTimesteps[timestep].atomCount;
+
+	if (!m_positions.empty())
+		return m_positions[timestep].size();
+
+	return m_atoms[timestep].size();
+}
+
+std::size_t Protein::maximumAtomCount() const
+{
+	std::size_t count = 0;
+
+	for (std::size_t i = 0; i < timestepCount(); i++)
+		count = std::max(count, atomCount(i));
+
+	return count;
+}
+
+void Protein::loadTimestep(std::size_t timestep, std::vector<vec4>& atoms) const
+{
+	if (m_atomOrder.empty())
+	{
+		loadFileTimestep(timestep, atoms);
+		return;
+	}
+
+	// resident atoms are gathered directly, all others are decoded in file order first
+	thread_local std::vector<vec4> fileAtoms;
+	const vec4* source = nullptr;
+
+	if (m_cache && !m_trajectory)
+	{
+		source = m_cache->atomData(timestep);
+	}
+	else
+	{
+		loadFileTimestep(timestep, fileAtoms);
+		source = fileAtoms.data();
+	}
+
+	atoms.resize(m_atomOrder.size());
+
+	for (std::size_t i = 0; i < atoms.size(); i++)
+		atoms[i] = source[m_atomOrder[i]];
+}
+
+void Protein::loadPositions(std::size_t timestep, std::vector<vec3>& positions) const
+{
+	if (m_atomOrder.empty())
+	{
+		loadFilePositions(timestep, positions);
+		return;
+	}
+
+	thread_local std::vector<vec3> filePositions;
+	const vec3* source = nullptr;
+
+	if (!m_positions.empty() && !m_trajectory)
+	{
+		source = m_positions[timestep].data();
+	}
+	else
+	{
+		loadFilePositions(timestep, filePositions);
+		source = filePositions.data();
+	}
+
+	positions.resize(m_atomOrder.size());
+
+	for (std::size_t i = 0; i < positions.size(); i++)
+		positions[i] = source[m_atomOrder[i]];
+}
+
+bool Protein::sortAtomsSpatially()
+{
+	if (!hasStaticAttributes())
+	{
+		globjects::critical() << "The atoms of " << m_filename << " cannot be sorted, because they differ between timesteps!";
+		return false;
+	}
+
+	const auto startTime = std::chrono::high_resolution_clock::now();
+
+	std::vector<vec3> positions;
+	loadFilePositions(0, positions);
+	MortonOrder::sort(positions.data(), positions.size(), m_minimumBounds, m_maximumBounds, m_atomOrder);
+	applyAtomOrder();
+
+	const std::chrono::duration<double> sortingTime = std::chrono::high_resolution_clock::now() - startTime;
+	globjects::debug() << uint(m_atomOrder.size()) << " atoms sorted along a Morton curve in " << sortingTime.count() << " seconds.";
+
+	return true;
+}
+
+const std::vector<uint>& Protein::atomOrder() const
+{
+	return m_atomOrder;
+}
+
+void Protein::applyAtomOrder()
+{
+	// the static attributes stay in file order for decoding, a copy is kept in the order of the atoms
+	m_orderedStaticAttributes.clear();
+
+	if (m_atomOrder.empty() || m_staticAttributes.size() != m_atomOrder.size())
+	{
+		m_atomOrder.clear();
+		return;
+	}
+
+	m_orderedStaticAttributes.resize(m_atomOrder.size());
+
+	for (std::size_t i = 0; i < m_atomOrder.size(); i++)
+		m_orderedStaticAttributes[i] = m_staticAttributes[m_atomOrder[i]];
+}
+
+void Protein::loadFileTimestep(std::size_t timestep, std::vector<vec4>& atoms) const
+{
+	if (m_trajectory)
+	{
+		thread_local std::vector<vec3> positions;
+
+		// frames that cannot be read are replaced by the topology
+		if (!m_trajectory->readFrame(timestep, positions) || positions.size() != m_topology.size())
+		{
+			atoms = m_topology;
+			return;
+		}
+
+		atoms.resize(m_topology.size());
+
+		for (std::size_t i = 0; i < atoms.size(); i++)
+			atoms[i] = vec4(positions[i], m_topology[i].w);
+	}
+	else if (m_cache)
+	{
+		const vec4* data = m_cache->atomData(timestep);
+		atoms.assign(data, data + m_cache->atomCount(timestep));
+	}
+	else if (m_source)
+	{
+		const SourceTimestep& t = m_sourceTimesteps[timestep];
+		const char* end = m_source->begin() + t.end;
+		const char* line = m_source->begin() + t.begin;
+
+		PdbParser::Atom atom;
+		bool first = true;
+		uint groupIndex = 0;
+
+		atoms.clear();
+		atoms.reserve(t.atomCount);
+
+		// all ids have been indexed during loading, so the global tables can be used directly
+		while (line < end)
+		{
+			const char* lineEnd = PdbParser::lineEnd(line, end);
+			const std::uint64_t residueName = atom.residueName;
+			const std::uint64_t chainName = atom.chainName;
+			const std::int32_t residueNumber = atom.residueNumber;
+
+			if (PdbParser::parse(line, lineEnd, atom) == PdbParser::Record::Atom)
+			{
+				if (first || atom.residueName != residueName || atom.chainName != chainName || atom.residueNumber != residueNumber)
+					groupIndex = findGroup(atom.residueName, atom.chainName, atom.residueNumber);
+
+				first = false;
+				atoms.emplace_back(atom.position, uintBitsToFloat(packAttributes(m_elementIdMap[atom.elementId], groupIndex)));
+			}
+
+			line = (lineEnd < end) ? lineEnd + 1 : end;
+		}
+	}
+	else if (!m_positions.empty())
+	{
+		const auto& positions = m_positions[timestep];
+		atoms.resize(positions.size());
+
+		for (std::size_t i = 0; i < atoms.size(); i++)
+			atoms[i] = vec4(positions[i], uintBitsToFloat(m_staticAttributes[i]));
+	}
+	else
+	{
+		atoms = m_atoms[timestep];
+	}
+}
+
+void Protein::loadFilePositions(std::size_t timestep, std::vector<vec3>& positions) const
+{
+	if (m_trajectory)
+	{
+		if (m_trajectory->readFrame(timestep, positions) && positions.size() == m_topology.size())
+			return;
+
+		positions.resize(m_topology.size());
+
+		for (std::size_t i = 0; i < positions.size(); i++)
+			positions[i] = vec3(m_topology[i]);
+	}
+	else if (!m_positions.empty())
+	{
+		positions = m_positions[timestep];
+	}
+	else
+	{
+		thread_local std::vector<vec4> atoms;
+		loadFileTimestep(timestep, atoms);
+
+		positions.resize(atoms.size());
+
+		for (std::size_t i = 0; i < atoms.size(); i++)
+			positions[i] = vec3(atoms[i]);
+	}
+}
+
+bool Protein::hasStaticAttributes() const
+{
+	return !m_staticAttributes.empty();
+}
+
+const std::vector<uint>& Protein::staticAttributes() const
+{
+	if (!m_atomOrder.empty())
+		return m_orderedStaticAttributes;
+
+	return m_staticAttributes;
 }
 
 vec3 Protein::minimumBounds() const
@@ -261,14 +1230,24 @@ const std::vector<uint>& Protein::activeElementIds() const
 	return m_activeElementIds;
 }
 
-const std::vector<uint>& dynamol::Protein::activeResidueIds() const
+const std::vector<std::uint64_t>& Protein::activeResidueNames() const
+{
+	return m_activeResidueNames;
+}
+
+const std::vector<std::uint64_t>& Protein::activeChainNames() const
+{
+	return m_activeChainNames;
+}
+
+const std::vector<uvec2>& Protein::activeGroups() const
 {
-	return m_activeResidueIds;
+	return m_activeGroups;
 }
 
-const std::vector<uint>& dynamol::Protein::activeChainIds() const
+const std::vector<std::int32_t>& Protein::activeResidueNumbers() const
 {
-	return m_activeChainIds;
+	return m_activeResidueNumbers;
 }
 
 const std::vector<float>& dynamol::Protein::activeElementRadii() const
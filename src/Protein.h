@@ -1,13 +1,23 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include <glm/glm.hpp>
 #include <unordered_map>
 #include <vector>
 #include <array>
+#include <memory>
+#include <cstdint>
+#include <utility>
+#include "CifParser.h"
 
 namespace dynamol
 {
+	class TrajectoryCache;
+	class TrajectoryReader;
+	class MappedFile;
+	class GzipStream;
+
 	class Protein
 	{
 		struct Element
@@ -16,14 +26,60 @@ namespace dynamol
 			float radius = 1.0;
 		};
 
+		// byte range and atom count of a timestep that is decoded on demand
+		struct SourceTimestep
+		{
+			std::size_t begin = 0;
+			std::size_t end = 0;
+			std::size_t atomCount = 0;
+		};
+
+		// contiguous range of lines within a single timestep
+		struct SegmentRange
+		{
+			const char* begin = nullptr;
+			const char* end = nullptr;
+			std::size_t timestep = 0;
+		};
+
 	public:
 
 		Protein();
 		Protein(const std::string& filename);
-		void load(const std::string& filename);
+		~Protein();
+
+		// Parses the given PDB, mmCIF or BinaryCIF file, which may be gzip-compressed. Only if useCache is set, its binary trajectory
+		// cache is mapped instead if it is up to date, or written after parsing for the next load.
+		void load(const std::string& filename, bool useCache = false);
+
+		// Replaces the timesteps by the frames of a DCD or XTC trajectory, using the loaded atoms as topology
+		bool loadTrajectory(const std::string& filename);
 		const std::string & filename() const;
 
-		const std::vector < std::vector<glm::vec4> > & atoms() const;
+		std::size_t timestepCount() const;
+		std::size_t atomCount(std::size_t timestep) const;
+		std::size_t maximumAtomCount() const;
+
+		// Copies or decodes the atoms of a single timestep, safe to call from multiple threads
+		void loadTimestep(std::size_t timestep, std::vector<glm::vec4>& atoms) const;
+
+		// Copies or decodes only the positions of a single timestep, safe to call from multiple threads
+		void loadPositions(std::size_t timestep, std::vector<glm::vec3>& positions) const;
+
+		// Sorts the atoms of all timesteps along a Morton curve through the positions of the first timestep, so that atoms
+		// close in space are close in memory. Only possible if hasStaticAttributes(), loading a file restores the file order.
+		bool sortAtomsSpatially();
+
+		// Index in file order of every atom in the order returned by loadTimestep, empty if the atoms are in file order
+		const std::vector<glm::uint> & atomOrder() const;
+
+		// Returns whether all timesteps share the element, residue and chain attributes of the first one,
+		// so that the attributes can be stored once and only the positions change between timesteps
+		bool hasStaticAttributes() const;
+
+		// Attributes of all atoms in the packing of the w component of loadTimestep, empty unless hasStaticAttributes()
+		const std::vector<glm::uint> & staticAttributes() const;
+
 		const std::vector<Element> & elements() const;
 		glm::vec3 minimumBounds() const;
 		glm::vec3 maximumBounds() const;
@@ -33,8 +89,23 @@ namespace dynamol
 		const std::vector<glm::vec4> & activeChainColorsPacked() const;
 
 		const std::vector<glm::uint> & activeElementIds() const;
-		const std::vector<glm::uint> & activeResidueIds() const;
-		const std::vector<glm::uint> & activeChainIds() const;
+
+		// Residue and chain names packed by PdbParser::name in order of their first occurrence, without any limit on their number
+		const std::vector<std::uint64_t> & activeResidueNames() const;
+		const std::vector<std::uint64_t> & activeChainNames() const;
+
+		// Residue and chain index of every distinct residue, which is identified by its name, chain and residue number
+		const std::vector<glm::uvec2> & activeGroups() const;
+
+		// Residue number of every entry of activeGroups
+		const std::vector<std::int32_t> & activeResidueNumbers() const;
+
+		// The attributes packed into the w component of the atoms consist of the index of their element in activeElementIds
+		// and the index of their residue in activeGroups. Index 0 of all active tables is unused.
+		static const glm::uint maximumGroupCount = 1u << 24;
+		static glm::uint packAttributes(glm::uint elementIndex, glm::uint groupIndex);
+		static glm::uint elementIndex(glm::uint attributes);
+		static glm::uint groupIndex(glm::uint attributes);
 
 		const std::vector<float> & activeElementRadii() const;
 		const std::vector<glm::vec3> & activeElementColors() const;
@@ -53,16 +124,54 @@ namespace dynamol
 
 	private:
 
+		// residue and chain index packed into 64 bits together with the residue number
+		using GroupKey = std::pair<std::uint64_t, std::int32_t>;
+
+		struct GroupKeyHash
+		{
+			std::size_t operator()(const GroupKey& key) const;
+		};
+
+		bool loadCache(const std::string& filename);
+		void parsePdb(std::unique_ptr<MappedFile>& file);
+		void parsePdb(GzipStream& stream);
+		void parseCif(const char* begin, const char* end, bool binary);
+		void parseCif(GzipStream& stream, bool binary);
+		void addAtomSites(const CifParser::AtomSites& atomSites);
+		void decodeSegments(const std::vector<SegmentRange>& segmentRanges, bool resident);
+		static void appendSegments(const char* begin, const char* end, std::size_t timestep, std::size_t segmentSize, std::vector<SegmentRange>& segments);
+		void clearActiveTables();
+		void updateActiveTables();
+		glm::uint group(glm::uint residueIndex, glm::uint chainIndex, std::int32_t residueNumber);
+		glm::uint findGroup(std::uint64_t residueName, std::uint64_t chainName, std::int32_t residueNumber) const;
+		void updateStaticAttributes();
+		void loadFileTimestep(std::size_t timestep, std::vector<glm::vec4>& atoms) const;
+		void loadFilePositions(std::size_t timestep, std::vector<glm::vec3>& positions) const;
+		void applyAtomOrder();
+
 		std::string m_filename;
 		std::vector<std::vector<glm::vec4> > m_atoms;
+		std::vector<std::vector<glm::vec3> > m_positions;
+		std::vector<glm::uint> m_staticAttributes;
+		std::vector<glm::uint> m_atomOrder;
+		std::vector<glm::uint> m_orderedStaticAttributes;
+		bool m_sourceAttributesDiffer = false;
+		std::unique_ptr<TrajectoryCache> m_cache;
+		std::unique_ptr<MappedFile> m_source;
+		std::vector<SourceTimestep> m_sourceTimesteps;
+		std::unique_ptr<TrajectoryReader> m_trajectory;
+		std::vector<glm::vec4> m_topology;
 
 		std::array<glm::uint, 116> m_elementIdMap;
-		std::array<glm::uint, 24> m_residueIdMap;
-		std::array<glm::uint, 64> m_chainIdMap;
+		std::unordered_map<std::uint64_t, glm::uint> m_residueIndices;
+		std::unordered_map<std::uint64_t, glm::uint> m_chainIndices;
+		std::unordered_map<GroupKey, glm::uint, GroupKeyHash> m_groupIndices;
 
 		std::vector<glm::uint> m_activeElementIds;
-		std::vector<glm::uint> m_activeResidueIds;
-		std::vector<glm::uint> m_activeChainIds;
+		std::vector<std::uint64_t> m_activeResidueNames;
+		std::vector<std::uint64_t> m_activeChainNames;
+		std::vector<glm::uvec2> m_activeGroups;
+		std::vector<std::int32_t> m_activeResidueNumbers;
 
 		std::vector<float> m_activeElementRadii;
 		std::vector<glm::vec3> m_activeElementColors;
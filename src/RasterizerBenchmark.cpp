@@ -0,0 +1,97 @@
+#include "RasterizerBenchmark.h"
+#include "MortonOrderBenchmark.h"
+#include "SphereRenderer.h"
+#include "Viewer.h"
+#include "Scene.h"
+#include "Protein.h"
+
+#include <glbinding/gl/gl.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+
+namespace
+{
+	// Renders the file with the given rasterization path and returns the average frame time in milliseconds
+	double measureFrameTime(GLFWwindow* window, const std::string& filename, bool compute, unsigned int frameCount)
+	{
+		Scene scene;
+		Protein* protein = scene.protein();
+		protein->load(filename, false);
+
+		if (protein->timestepCount() == 0 || protein->atomCount(0) == 0)
+			return -1.0;
+
+		auto viewer = std::make_unique<Viewer>(window, &scene);
+		viewer->sphereRenderer()->setComputeRasterization(compute);
+
+		const vec3 boundingBoxSize = protein->maximumBounds() - protein->minimumBounds();
+		const float maximumSize = std::max(boundingBoxSize.x, std::max(boundingBoxSize.y, boundingBoxSize.z));
+		mat4 modelTransform = scale(vec3(2.0f) / vec3(maximumSize));
+		modelTransform = modelTransform * translate(-0.5f * (protein->minimumBounds() + protein->maximumBounds()));
+		viewer->setModelTransform(modelTransform);
+
+		// the first frames compile shaders, upload the timestep and size the buffers
+		for (unsigned int i = 0; i < 20; i++)
+		{
+			glfwPollEvents();
+			viewer->display();
+			glfwSwapBuffers(window);
+		}
+
+		glFinish();
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		for (unsigned int i = 0; i < frameCount; i++)
+		{
+			glfwPollEvents();
+			viewer->display();
+			glfwSwapBuffers(window);
+		}
+
+		glFinish();
+		const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - startTime;
+		const double frameTime = duration.count() * 1000.0 / double(std::max(frameCount, 1u));
+
+		std::cout << "  " << (compute ? "Compute shader:  " : "Geometry shader: ") << frameTime << " ms per frame" << std::endl;
+
+		return frameTime;
+	}
+}
+
+bool RasterizerBenchmark::run(GLFWwindow* window, const std::string& filename, std::size_t atomCount, unsigned int frameCount)
+{
+	const std::string syntheticFilename = (std::filesystem::temp_directory_path() / "dynamol-rasterizer-benchmark.pdb").string();
+
+	if (!MortonOrderBenchmark::writeSyntheticSystem(filename, syntheticFilename, atomCount))
+		return false;
+
+	bool success = true;
+
+	for (const auto& f : { filename, syntheticFilename })
+	{
+		std::cout << "Benchmarking sphere rasterization on " << f << " (" << frameCount << " frames)" << std::endl;
+
+		const double geometryTime = measureFrameTime(window, f, false, frameCount);
+		const double computeTime = measureFrameTime(window, f, true, frameCount);
+
+		if (geometryTime < 0.0 || computeTime < 0.0)
+		{
+			success = false;
+			continue;
+		}
+
+		std::cout << "  Speedup: " << geometryTime / computeTime << "x" << std::endl;
+	}
+
+	std::filesystem::remove(syntheticFilename);
+
+	return success;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+struct GLFWwindow;
+
+namespace dynamol
+{
+	// Compares the frame time of rasterizing the spheres with the geometry shader and with the tile-binned compute shaders, for a
+	// file and for a synthetic system made of copies of its first timestep with the given number of atoms. Requires a window with
+	// a current OpenGL context.
+	class RasterizerBenchmark
+	{
+	public:
+		static bool run(GLFWwindow* window, const std::string& filename, std::size_t atomCount = 2000000, unsigned int frameCount = 200);
+	};
+}
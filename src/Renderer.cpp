@@ -1,7 +1,11 @@
 #include "Renderer.h"
+#include "Viewer.h"
+#include "ShaderCache.h"
 #include <globjects/base/File.h>
 #include <globjects/State.h>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <filesystem>
 
 
@@ -10,6 +14,17 @@ using namespace gl;
 using namespace glm;
 using namespace globjects;
 
+namespace
+{
+	std::string readFile(const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		std::ostringstream stream;
+		stream << file.rdbuf();
+		return stream.str();
+	}
+}
+
 Renderer::Renderer(Viewer* viewer) : m_viewer(viewer)
 {
 	Shader::hintIncludeImplementation(Shader::IncludeImplementation::Fallback);
@@ -30,16 +45,35 @@ bool Renderer::isEnabled() const
 	return m_enabled;
 }
 
+void Renderer::proteinChanged()
+{
+}
+
 void Renderer::reloadShaders()
 {
+	// The programs are kept, as other objects hold on to them, and only their shaders are replaced by the current files
 	for (auto& p : m_shaderPrograms)
 	{
 		globjects::debug() << "Reloading shader program " << p.first << " ...";
 
-		for (auto& f : p.second.m_files)
+		const ShaderProgramDefinition& definition = m_shaderProgramDefinitions[p.first];
+
+		for (auto& permutation : p.second)
 		{
-			globjects::debug() << "Reloading shader file " << f->filePath() << " ...";
-			f->reload();
+			ShaderProgram& program = permutation.second;
+
+			for (auto& shader : program.m_shaders)
+				program.m_program->detach(shader.get());
+
+			program.m_shaders.clear();
+			program.m_sources.clear();
+			program.m_program->setBinary(nullptr);
+			program.m_binary.reset();
+
+			const auto sources = shaderSources(definition, permutation.first);
+			program.m_key = m_viewer->shaderCache()->key(sources);
+			program.m_binaryPending = true;
+			attachShaders(program, sources);
 		}
 	}
 }
@@ -48,42 +82,209 @@ bool Renderer::createShaderProgram(const std::string& name, std::initializer_lis
 {
 	globjects::debug() << "Creating shader program " << name << " ...";
 
-	ShaderProgram program;
+	ShaderProgramDefinition definition;
 
 	for (auto i : shaderIncludes)
 	{
-		globjects::debug() << "Loading include file " << i << " ...";
+		globjects::debug() << "Registering include file " << i << " ...";
 
+		// a missing file does not replace an include of the same name
 		std::filesystem::path path(i);
 
-		auto file = File::create(i);
-		auto string = NamedString::create("/" + path.filename().string(), file.get());
-
-		program.m_files.insert(std::move(file));
-		program.m_strings.insert(std::move(string));
+		if (std::filesystem::exists(path) || m_shaderIncludes.count("/" + path.filename().string()) == 0)
+			m_shaderIncludes["/" + path.filename().string()] = i;
 	}
 
 	for (auto i : shaders)
 	{
-		globjects::debug() << "Loading shader file " << i.second << " ...";
+		globjects::debug() << "Registering shader file " << i.second << " ...";
+		definition.m_shaders.push_back(i);
+	}
 
-		auto file = Shader::sourceFromFile(i.second);
-		auto source = Shader::applyGlobalReplacements(file.get());
-		auto shader = Shader::create(i.first, source.get());
+	// Programs depend on the defines if any of their sources includes them
+	definition.m_permuted = shaderSources(definition, "#define PERMUTATION\n") != shaderSources(definition, "");
+
+	m_shaderProgramDefinitions[name] = definition;
+	m_shaderPrograms.erase(name);
+
+	return false;
+}
+
+globjects::Program* Renderer::shaderProgram(const std::string& name)
+{
+	auto definition = m_shaderProgramDefinitions.find(name);
+
+	if (definition == m_shaderProgramDefinitions.end())
+		return m_shaderPrograms[name][""].m_program.get();
+
+	const std::string defines = definition->second.m_permuted ? m_shaderDefines : std::string();
+	auto& permutations = m_shaderPrograms[name];
+	auto permutation = permutations.find(defines);
+
+	if (permutation == permutations.end())
+	{
+		globjects::debug() << "Creating permutation of shader program " << name << " ...";
+		permutation = permutations.emplace(defines, createShaderPermutation(definition->second, defines)).first;
+	}
+
+	return permutation->second.m_program.get();
+}
+
+void Renderer::setShaderDefines(const std::string& defines, const std::vector<std::string>& alternatives)
+{
+	if (m_shaderDefinesSelected && defines == m_shaderDefines)
+		return;
+
+	m_shaderDefines = defines;
+	m_shaderDefinesSelected = true;
+
+	for (const auto& d : m_shaderProgramDefinitions)
+	{
+		if (!d.second.m_permuted)
+			continue;
+
+		for (const auto& a : alternatives)
+		{
+			if (m_shaderPrograms[d.first].count(a) > 0)
+				continue;
+
+			const auto sources = shaderSources(d.second, a);
+			m_viewer->shaderCache()->prewarm(m_viewer->shaderCache()->key(sources), sources);
+		}
+	}
+}
+
+const std::string& Renderer::shaderDefines() const
+{
+	return m_shaderDefines;
+}
+
+void Renderer::storeShaderBinaries()
+{
+	for (auto& p : m_shaderPrograms)
+	{
+		for (auto& permutation : p.second)
+		{
+			ShaderProgram& program = permutation.second;
+
+			if (!program.m_binaryPending)
+				continue;
+
+			program.m_binaryPending = false;
+
+			// programs that failed to link report their errors and are not stored
+			if (!program.m_program->isLinked())
+				continue;
+
+			ShaderCache::Binary binary;
+			GLint length = 0;
+			glGetProgramiv(program.m_program->id(), GL_PROGRAM_BINARY_LENGTH, &length);
+
+			if (length <= 0)
+				continue;
+
+			binary.data.resize(std::size_t(length));
+			glGetProgramBinary(program.m_program->id(), length, nullptr, &binary.format, binary.data.data());
+			m_viewer->shaderCache()->store(program.m_key, binary);
+		}
+	}
+}
+
+Renderer::ShaderProgram Renderer::createShaderPermutation(const ShaderProgramDefinition& definition, const std::string& defines)
+{
+	ShaderProgram program;
+
+	const auto sources = shaderSources(definition, defines);
+	program.m_key = m_viewer->shaderCache()->key(sources);
+
+	// A binary from an earlier run or from the background thread is used if the driver accepts it
+	ShaderCache::Binary binary;
+
+	if (m_viewer->shaderCache()->load(program.m_key, binary))
+	{
+		program.m_binary = ProgramBinary::create(binary.format, binary.data);
+		program.m_program->setBinary(program.m_binary.get());
+
+		if (program.m_program->isLinked())
+			return program;
+
+		globjects::debug() << "Cached shader program binary was rejected, compiling from source ...";
+		program.m_program->setBinary(nullptr);
+		program.m_binary.reset();
+	}
+
+	program.m_binaryPending = true;
+	attachShaders(program, sources);
+
+	return program;
+}
+
+void Renderer::attachShaders(ShaderProgram& program, const std::vector< std::pair<GLenum, std::string> >& sources)
+{
+	program.m_program->setParameter(GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GLint(GL_TRUE));
+
+	for (const auto& s : sources)
+	{
+		auto source = StaticStringSource::create(s.second);
+		auto shader = Shader::create(s.first, source.get());
 
 		program.m_program->attach(shader.get());
 
-		program.m_files.insert(std::move(file));
 		program.m_sources.insert(std::move(source));
 		program.m_shaders.insert(std::move(shader));
 	}
+}
+
+std::vector< std::pair<GLenum, std::string> > Renderer::shaderSources(const ShaderProgramDefinition& definition, const std::string& defines)
+{
+	std::vector< std::pair<GLenum, std::string> > sources;
 
-	m_shaderPrograms[name] = std::move(program);
+	for (const auto& s : definition.m_shaders)
+	{
+		auto file = StaticStringSource::create(resolveIncludes(readFile(s.second), defines, 0));
+		auto source = Shader::applyGlobalReplacements(file.get());
+		sources.emplace_back(s.first, source->string());
+	}
 
-	return false;
+	return sources;
 }
 
-globjects::Program* Renderer::shaderProgram(const std::string& name)
+std::string Renderer::resolveIncludes(const std::string& source, const std::string& defines, int depth)
 {
-	return m_shaderPrograms[name].m_program.get();
+	// Includes are replaced by the files registered with the programs, so every permutation keeps the defines it was created with
+	std::istringstream stream(source);
+	std::string result;
+	std::string line;
+
+	while (std::getline(stream, line))
+	{
+		const std::size_t begin = line.find_first_not_of(" \t");
+		const std::string directive = (begin == std::string::npos) ? std::string() : line.substr(begin);
+
+		if (directive.compare(0, 10, "#extension") == 0 && directive.find("GL_ARB_shading_language_include") != std::string::npos)
+			continue;
+
+		const std::size_t nameBegin = directive.find('"');
+		const std::size_t nameEnd = directive.find('"', nameBegin + 1);
+
+		if (directive.compare(0, 8, "#include") != 0 || nameBegin == std::string::npos || nameEnd == std::string::npos || depth > 16)
+		{
+			result += line + "\n";
+			continue;
+		}
+
+		const std::string name = directive.substr(nameBegin + 1, nameEnd - nameBegin - 1);
+		auto include = m_shaderIncludes.find(name);
+
+		if (name == "/defines.glsl")
+			result += resolveIncludes(defines, defines, depth + 1);
+		else if (include != m_shaderIncludes.end())
+			result += resolveIncludes(readFile(include->second), defines, depth + 1);
+		else if (NamedString::isNamedString(name))
+			result += resolveIncludes(NamedString::obtain(name)->string(), defines, depth + 1);
+		else
+			globjects::critical() << "Shader include " << name << " not found!";
+	}
+
+	return result;
 }
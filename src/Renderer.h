@@ -5,6 +5,8 @@
 #include <memory>
 #include <unordered_map>
 #include <set>
+#include <vector>
+#include <string>
 
 #include <glm/glm.hpp>
 #include <glbinding/gl/gl.h>
@@ -15,6 +17,7 @@
 #include <globjects/VertexAttributeBinding.h>
 #include <globjects/Buffer.h>
 #include <globjects/Program.h>
+#include <globjects/ProgramBinary.h>
 #include <globjects/Shader.h>
 #include <globjects/Framebuffer.h>
 #include <globjects/Renderbuffer.h>
@@ -32,11 +35,22 @@ namespace dynamol
 	{
 		struct ShaderProgram
 		{
-			std::set< std::unique_ptr< globjects::File> > m_files;
 			std::set< std::unique_ptr< globjects::AbstractStringSource> > m_sources;
-			std::set< std::unique_ptr< globjects::NamedString> > m_strings;
 			std::set< std::unique_ptr< globjects::Shader > > m_shaders;
+			std::unique_ptr< globjects::ProgramBinary > m_binary;
 			std::unique_ptr< globjects::Program > m_program = std::make_unique<globjects::Program>();
+
+			// key of the binary in the shader cache, which is stored once the program has been used
+			std::string m_key;
+			bool m_binaryPending = false;
+		};
+
+		struct ShaderProgramDefinition
+		{
+			std::vector< std::pair<gl::GLenum, std::string> > m_shaders;
+
+			// programs including /defines.glsl are linked once for every set of defines they are used with
+			bool m_permuted = false;
 		};
 
 	public:
@@ -48,14 +62,40 @@ namespace dynamol
 		virtual void reloadShaders();
 		virtual void display() = 0;
 
+		// Called after the protein of the scene has been replaced, to rebuild everything derived from it
+		virtual void proteinChanged();
+
 		bool createShaderProgram(const std::string& name, std::initializer_list< std::pair<gl::GLenum, std::string> > shaders, std::initializer_list < std::string> shaderIncludes = {});
 		globjects::Program* shaderProgram(const std::string& name);
 
+		// Selects the defines of the programs including /defines.glsl, whose permutation for them is linked when it is first used.
+		// If the defines change, the permutations for the alternatives, such as the defines differing in a single option, are
+		// linked in the background, so that switching to them does not stall.
+		void setShaderDefines(const std::string& defines, const std::vector<std::string>& alternatives = {});
+		const std::string& shaderDefines() const;
+
+		// Stores the binaries of the programs linked since the last call in the shader cache of the viewer
+		void storeShaderBinaries();
+
 	private:
+		ShaderProgram createShaderPermutation(const ShaderProgramDefinition& definition, const std::string& defines);
+		void attachShaders(ShaderProgram& program, const std::vector< std::pair<gl::GLenum, std::string> >& sources);
+		std::vector< std::pair<gl::GLenum, std::string> > shaderSources(const ShaderProgramDefinition& definition, const std::string& defines);
+		std::string resolveIncludes(const std::string& source, const std::string& defines, int depth);
+
 		Viewer* m_viewer;
 		bool m_enabled = true;
-		std::unordered_map<std::string, ShaderProgram > m_shaderPrograms;
 
+		std::unordered_map<std::string, ShaderProgramDefinition> m_shaderProgramDefinitions;
+
+		// linked programs by name and defines, for every set of defines seen so far
+		std::unordered_map<std::string, std::unordered_map<std::string, ShaderProgram> > m_shaderPrograms;
+
+		// paths of the include files by the name they are included with
+		std::unordered_map<std::string, std::string> m_shaderIncludes;
+
+		std::string m_shaderDefines;
+		bool m_shaderDefinesSelected = false;
 	};
 
 }
\ No newline at end of file
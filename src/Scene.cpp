@@ -12,4 +12,10 @@ Scene::Scene()
 Protein * Scene::protein()
 {
 	return m_protein.get();
+}
+
+std::unique_ptr<Protein> Scene::setProtein(std::unique_ptr<Protein> protein)
+{
+	std::swap(m_protein, protein);
+	return protein;
 }
\ No newline at end of file
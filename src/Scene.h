@@ -12,6 +12,9 @@ namespace dynamol
 		Scene();
 		Protein* protein();
 
+		// Replaces the protein and returns the previous one
+		std::unique_ptr<Protein> setProtein(std::unique_ptr<Protein> protein);
+
 	private:
 		std::unique_ptr<Protein> m_protein;
 	};
@@ -0,0 +1,824 @@
+#include "Selection.h"
+#include "Protein.h"
+#include "PdbParser.h"
+#include "ThreadPool.h"
+#include "CellList.h"
+
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+#include <map>
+#include <utility>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// words of 64 atoms processed by a single invocation of the parallel loops
+	const std::size_t chunkWords = 1024;
+
+	inline std::size_t wordCount(std::size_t size)
+	{
+		return (size + 63) / 64;
+	}
+
+	inline uint bitCount(std::uint64_t word)
+	{
+		word = word - ((word >> 1) & 0x5555555555555555ull);
+		word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+		word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		return uint((word * 0x0101010101010101ull) >> 56);
+	}
+
+	inline uint trailingZeros(std::uint64_t word)
+	{
+		return bitCount((word & (~word + 1)) - 1);
+	}
+
+	// invokes function(first, last) for consecutive ranges of words in parallel
+	void forEachChunk(std::size_t words, const std::function<void(std::size_t, std::size_t)>& function)
+	{
+		const std::size_t chunkCount = (words + chunkWords - 1) / chunkWords;
+
+		ThreadPool::instance().parallelFor(chunkCount, [&](std::size_t i)
+		{
+			function(i * chunkWords, std::min(words, (i + 1) * chunkWords));
+		});
+	}
+
+	// atoms in either of the two layouts accepted by Selection::evaluate
+	struct Atoms
+	{
+		const vec4* atoms = nullptr;
+		const vec3* positions = nullptr;
+		const uint* attributes = nullptr;
+		std::size_t count = 0;
+
+		vec3 position(std::size_t i) const
+		{
+			return atoms ? vec3(atoms[i]) : positions[i];
+		}
+
+		uint attribute(std::size_t i) const
+		{
+			return atoms ? floatBitsToUint(atoms[i].w) : attributes[i];
+		}
+	};
+
+	using Row = std::shared_ptr<const std::vector<std::uint64_t> >;
+
+	std::string lowerCase(std::string string)
+	{
+		std::transform(string.begin(), string.end(), string.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+		return string;
+	}
+
+	bool isKeyword(const std::string& token)
+	{
+		static const std::unordered_set<std::string> keywords = { "all", "none", "chain", "resname", "resid", "element", "within", "of", "to", "not", "and", "or" };
+		return keywords.count(lowerCase(token)) > 0;
+	}
+
+	// parses a complete decimal integer such as -12
+	bool parseInteger(const std::string& text, std::int32_t& value)
+	{
+		if (text.empty())
+			return false;
+
+		char* end = nullptr;
+		const long result = std::strtol(text.c_str(), &end, 10);
+
+		if (*end != '\0' || result < std::numeric_limits<std::int32_t>::min() || result > std::numeric_limits<std::int32_t>::max())
+			return false;
+
+		value = std::int32_t(result);
+		return true;
+	}
+}
+
+// Terms that only depend on the attributes are represented as one bitset over the groups for every element index,
+// elements with the same bitset share it, so that the tables stay small regardless of the number of groups
+struct Selection::Node
+{
+	enum class Type
+	{
+		Attributes,
+		Within,
+		And,
+		Or,
+		Not
+	};
+
+	Type type = Type::Attributes;
+
+	std::vector<Row> rows;
+	std::size_t groupCount = 0;
+
+	float distance = 0.0f;
+
+	std::unique_ptr<Node> left;
+	std::unique_ptr<Node> right;
+
+	void evaluate(const Atoms& atoms, AtomBitset& result) const
+	{
+		result.resize(atoms.count);
+
+		if (type == Type::Attributes)
+			evaluateAttributes(atoms, result);
+		else if (type == Type::Within)
+			evaluateWithin(atoms, result);
+		else
+			evaluateOperator(atoms, result);
+	}
+
+	void evaluateAttributes(const Atoms& atoms, AtomBitset& result) const
+	{
+		std::vector<const std::uint64_t*> elementRows(rows.size());
+
+		for (std::size_t i = 0; i < rows.size(); i++)
+			elementRows[i] = rows[i]->data();
+
+		std::vector<std::uint64_t>& words = result.words();
+
+		forEachChunk(words.size(), [&](std::size_t first, std::size_t last)
+		{
+			for (std::size_t w = first; w < last; w++)
+			{
+				const std::size_t begin = w * 64;
+				const std::size_t end = std::min(atoms.count, begin + 64);
+				std::uint64_t word = 0;
+
+				for (std::size_t i = begin; i < end; i++)
+				{
+					const uint attributes = atoms.attribute(i);
+					const uint elementIndex = Protein::elementIndex(attributes);
+					const uint groupIndex = Protein::groupIndex(attributes);
+
+					if (elementIndex < elementRows.size() && groupIndex < groupCount)
+						word |= ((elementRows[elementIndex][groupIndex >> 6] >> (groupIndex & 63)) & 1) << (i - begin);
+				}
+
+				words[w] = word;
+			}
+		});
+	}
+
+	void evaluateWithin(const Atoms& atoms, AtomBitset& result) const
+	{
+		AtomBitset targets;
+		left->evaluate(atoms, targets);
+
+		std::vector<uint> indices;
+		targets.indices(indices);
+
+		if (indices.empty())
+			return;
+
+		vec3 minimum = vec3(std::numeric_limits<float>::max());
+		vec3 maximum = vec3(-std::numeric_limits<float>::max());
+
+		std::vector<vec3> positions(indices.size());
+
+		for (std::size_t i = 0; i < indices.size(); i++)
+		{
+			positions[i] = atoms.position(indices[i]);
+			minimum = min(minimum, positions[i]);
+			maximum = max(maximum, positions[i]);
+		}
+
+		// with cells no smaller than the distance, all candidates of an atom are in the neighborhood of its cell
+		CellList cellList;
+		cellList.build(positions.data(), positions.size(), minimum, maximum, distance);
+
+		std::vector<std::uint64_t>& words = result.words();
+
+		forEachChunk(words.size(), [&](std::size_t first, std::size_t last)
+		{
+			for (std::size_t w = first; w < last; w++)
+			{
+				const std::size_t begin = w * 64;
+				const std::size_t end = std::min(atoms.count, begin + 64);
+				std::uint64_t word = 0;
+
+				for (std::size_t i = begin; i < end; i++)
+				{
+					if (cellList.contains(atoms.position(i), distance))
+						word |= std::uint64_t(1) << (i - begin);
+				}
+
+				words[w] = word;
+			}
+		});
+	}
+
+	void evaluateOperator(const Atoms& atoms, AtomBitset& result) const
+	{
+		left->evaluate(atoms, result);
+
+		AtomBitset other;
+
+		if (right)
+			right->evaluate(atoms, other);
+
+		std::vector<std::uint64_t>& words = result.words();
+		const std::vector<std::uint64_t>& otherWords = other.words();
+
+		forEachChunk(words.size(), [&](std::size_t first, std::size_t last)
+		{
+			if (type == Type::And)
+			{
+				for (std::size_t w = first; w < last; w++)
+					words[w] &= otherWords[w];
+			}
+			else if (type == Type::Or)
+			{
+				for (std::size_t w = first; w < last; w++)
+					words[w] |= otherWords[w];
+			}
+			else
+			{
+				for (std::size_t w = first; w < last; w++)
+					words[w] = ~words[w];
+			}
+		});
+
+		// bits beyond the last atom have to remain cleared
+		if (type == Type::Not && atoms.count % 64 != 0)
+			words.back() &= (std::uint64_t(1) << (atoms.count % 64)) - 1;
+	}
+};
+
+// Recursive descent parser that folds all terms depending only on attributes into their tables while parsing
+class Selection::Parser
+{
+public:
+	Parser(const std::string& expression, const Protein& protein) : m_protein(protein)
+	{
+		std::size_t i = 0;
+
+		while (i < expression.size())
+		{
+			const char c = expression[i];
+
+			if (std::isspace(static_cast<unsigned char>(c)))
+			{
+				i++;
+			}
+			else if (c == '(' || c == ')')
+			{
+				m_tokens.push_back({ std::string(1, c), i });
+				i++;
+			}
+			else
+			{
+				const std::size_t begin = i;
+
+				while (i < expression.size() && !std::isspace(static_cast<unsigned char>(expression[i])) && expression[i] != '(' && expression[i] != ')')
+					i++;
+
+				m_tokens.push_back({ expression.substr(begin, i - begin), begin });
+			}
+		}
+	}
+
+	std::unique_ptr<Node> parse(std::string& error)
+	{
+		std::unique_ptr<Node> node;
+
+		if (m_tokens.empty())
+			fail("The selection is empty");
+		else
+			node = parseOr();
+
+		if (node && m_next < m_tokens.size())
+			fail("Unexpected '" + m_tokens[m_next].text + "'");
+
+		if (!m_error.empty())
+		{
+			error = m_error;
+			return nullptr;
+		}
+
+		return node;
+	}
+
+private:
+	struct Token
+	{
+		std::string text;
+		std::size_t position = 0;
+	};
+
+	std::unique_ptr<Node> parseOr()
+	{
+		std::unique_ptr<Node> node = parseAnd();
+
+		while (node && accept("or"))
+			node = combine(Node::Type::Or, std::move(node), parseAnd());
+
+		return node;
+	}
+
+	std::unique_ptr<Node> parseAnd()
+	{
+		std::unique_ptr<Node> node = parseUnary();
+
+		while (node && accept("and"))
+			node = combine(Node::Type::And, std::move(node), parseUnary());
+
+		return node;
+	}
+
+	std::unique_ptr<Node> parseUnary()
+	{
+		if (accept("not"))
+			return combine(Node::Type::Not, parseUnary(), nullptr);
+
+		if (accept("within"))
+		{
+			float distance = 0.0f;
+
+			if (!number(distance))
+				return fail("Expected a distance after 'within'");
+
+			if (!accept("of"))
+				return fail("Expected 'of' after the distance");
+
+			std::unique_ptr<Node> target = parseUnary();
+
+			if (!target)
+				return nullptr;
+
+			auto node = std::make_unique<Node>();
+			node->type = Node::Type::Within;
+			node->distance = distance;
+			node->left = std::move(target);
+
+			return node;
+		}
+
+		return parsePrimary();
+	}
+
+	std::unique_ptr<Node> parsePrimary()
+	{
+		if (m_next >= m_tokens.size())
+			return fail("Unexpected end of the selection");
+
+		if (accept("("))
+		{
+			std::unique_ptr<Node> node = parseOr();
+
+			if (node && !accept(")"))
+				return fail("Expected ')'");
+
+			return node;
+		}
+
+		if (accept("all"))
+			return constant(true);
+
+		if (accept("none"))
+			return constant(false);
+
+		if (accept("chain"))
+		{
+			std::unordered_set<std::uint64_t> names;
+
+			if (!values("chain names", [&](const std::string& v) { names.insert(PdbParser::name(v.data(), v.data() + v.size())); return true; }))
+				return nullptr;
+
+			const auto& chainNames = m_protein.activeChainNames();
+			std::vector<bool> chains(chainNames.size());
+
+			for (std::size_t i = 0; i < chainNames.size(); i++)
+				chains[i] = names.count(chainNames[i]) > 0;
+
+			return groups([&](std::size_t g) { return chains[m_protein.activeGroups()[g].y]; });
+		}
+
+		if (accept("resname"))
+		{
+			std::unordered_set<std::uint64_t> names;
+
+			if (!values("residue names", [&](const std::string& v) { names.insert(PdbParser::name(v.data(), v.data() + v.size())); return true; }))
+				return nullptr;
+
+			const auto& residueNames = m_protein.activeResidueNames();
+			std::vector<bool> residues(residueNames.size());
+
+			for (std::size_t i = 0; i < residueNames.size(); i++)
+				residues[i] = names.count(residueNames[i]) > 0;
+
+			return groups([&](std::size_t g) { return residues[m_protein.activeGroups()[g].x]; });
+		}
+
+		if (accept("resid"))
+		{
+			std::vector< std::pair<std::int32_t, std::int32_t> > ranges;
+
+			if (!residueNumbers(ranges))
+				return nullptr;
+
+			return groups([&](std::size_t g)
+			{
+				const std::int32_t number = m_protein.activeResidueNumbers()[g];
+				return std::any_of(ranges.begin(), ranges.end(), [number](const std::pair<std::int32_t, std::int32_t>& r) { return number >= r.first && number <= r.second; });
+			});
+		}
+
+		if (accept("element"))
+		{
+			std::unordered_set<uint> ids;
+
+			auto symbol = [&](const std::string& v)
+			{
+				// element symbols are matched regardless of their case, e.g. CL or cl for Cl
+				std::string s = lowerCase(v);
+
+				if (!s.empty())
+					s[0] = char(std::toupper(static_cast<unsigned char>(s[0])));
+
+				const auto ei = Protein::elementIds().find(s);
+
+				if (ei == Protein::elementIds().end())
+				{
+					fail("Unknown element '" + v + "'");
+					return false;
+				}
+
+				ids.insert(ei->second);
+				return true;
+			};
+
+			if (!values("element symbols", symbol))
+				return nullptr;
+
+			return elements([&](uint id) { return ids.count(id) > 0; });
+		}
+
+		return fail("Unexpected '" + m_tokens[m_next].text + "'");
+	}
+
+	// consumes the values following a keyword until the next keyword or parenthesis
+	bool values(const std::string& description, const std::function<bool(const std::string&)>& value)
+	{
+		std::size_t count = 0;
+
+		while (m_next < m_tokens.size() && m_tokens[m_next].text != "(" && m_tokens[m_next].text != ")" && !isKeyword(m_tokens[m_next].text))
+		{
+			if (!value(m_tokens[m_next++].text))
+				return false;
+
+			count++;
+		}
+
+		if (count == 0)
+		{
+			fail("Expected " + description);
+			return false;
+		}
+
+		return true;
+	}
+
+	// residue numbers are given as single numbers, as ranges like 10-20 or as 10 to 20
+	bool residueNumbers(std::vector< std::pair<std::int32_t, std::int32_t> >& ranges)
+	{
+		auto value = [&](const std::string& v)
+		{
+			std::int32_t first;
+			std::int32_t last;
+			const std::size_t dash = v.find('-', 1);
+
+			if (parseInteger(v, first))
+			{
+				ranges.emplace_back(first, first);
+			}
+			else if (dash != std::string::npos && parseInteger(v.substr(0, dash), first) && parseInteger(v.substr(dash + 1), last))
+			{
+				ranges.emplace_back(first, last);
+			}
+			else
+			{
+				fail("Invalid residue number '" + v + "'");
+				return false;
+			}
+
+			return true;
+		};
+
+		while (m_next < m_tokens.size() && m_tokens[m_next].text != "(" && m_tokens[m_next].text != ")" && !isKeyword(m_tokens[m_next].text))
+		{
+			if (!value(m_tokens[m_next++].text))
+				return false;
+
+			if (accept("to"))
+			{
+				std::int32_t last;
+
+				if (m_next >= m_tokens.size() || !parseInteger(m_tokens[m_next].text, last))
+				{
+					fail("Expected a residue number after 'to'");
+					return false;
+				}
+
+				ranges.back().second = last;
+				m_next++;
+			}
+		}
+
+		if (ranges.empty())
+		{
+			fail("Expected residue numbers");
+			return false;
+		}
+
+		return true;
+	}
+
+	bool number(float& value)
+	{
+		if (m_next >= m_tokens.size())
+			return false;
+
+		const std::string& text = m_tokens[m_next].text;
+		char* end = nullptr;
+		value = std::strtof(text.c_str(), &end);
+
+		if (text.empty() || *end != '\0' || !std::isfinite(value) || value < 0.0f)
+			return false;
+
+		m_next++;
+		return true;
+	}
+
+	bool accept(const std::string& keyword)
+	{
+		if (m_next < m_tokens.size() && lowerCase(m_tokens[m_next].text) == keyword)
+		{
+			m_next++;
+			return true;
+		}
+
+		return false;
+	}
+
+	std::unique_ptr<Node> fail(const std::string& message)
+	{
+		if (m_error.empty())
+		{
+			const std::size_t position = (m_next < m_tokens.size()) ? m_tokens[m_next].position : (m_tokens.empty() ? 0 : m_tokens.back().position + m_tokens.back().text.size());
+			m_error = message + " at position " + std::to_string(position + 1) + ".";
+		}
+
+		return nullptr;
+	}
+
+	std::unique_ptr<Node> attributes(std::vector<Row> rows)
+	{
+		auto node = std::make_unique<Node>();
+		node->type = Node::Type::Attributes;
+		node->rows = std::move(rows);
+		node->groupCount = m_protein.activeGroups().size();
+
+		return node;
+	}
+
+	Row row(bool value)
+	{
+		return std::make_shared<const std::vector<std::uint64_t> >(wordCount(m_protein.activeGroups().size()), value ? ~std::uint64_t(0) : 0);
+	}
+
+	std::unique_ptr<Node> constant(bool value)
+	{
+		return attributes(std::vector<Row>(m_protein.activeElementIds().size(), row(value)));
+	}
+
+	std::unique_ptr<Node> groups(const std::function<bool(std::size_t)>& predicate)
+	{
+		std::vector<std::uint64_t> words(wordCount(m_protein.activeGroups().size()), 0);
+
+		for (std::size_t g = 1; g < m_protein.activeGroups().size(); g++)
+		{
+			if (predicate(g))
+				words[g >> 6] |= std::uint64_t(1) << (g & 63);
+		}
+
+		const Row shared = std::make_shared<const std::vector<std::uint64_t> >(std::move(words));
+		return attributes(std::vector<Row>(m_protein.activeElementIds().size(), shared));
+	}
+
+	std::unique_ptr<Node> elements(const std::function<bool(uint)>& predicate)
+	{
+		const auto& elementIds = m_protein.activeElementIds();
+		const Row selected = row(true);
+		const Row unselected = row(false);
+
+		std::vector<Row> rows(elementIds.size(), unselected);
+
+		for (std::size_t i = 1; i < elementIds.size(); i++)
+		{
+			if (predicate(elementIds[i]))
+				rows[i] = selected;
+		}
+
+		return attributes(std::move(rows));
+	}
+
+	// Operators on two attribute terms are applied to their tables, every distinct combination of rows is computed only once
+	std::unique_ptr<Node> combine(Node::Type type, std::unique_ptr<Node> left, std::unique_ptr<Node> right)
+	{
+		if (!left || (type != Node::Type::Not && !right))
+			return nullptr;
+
+		const bool foldable = left->type == Node::Type::Attributes && (!right || right->type == Node::Type::Attributes);
+
+		if (!foldable)
+		{
+			auto node = std::make_unique<Node>();
+			node->type = type;
+			node->left = std::move(left);
+			node->right = std::move(right);
+
+			return node;
+		}
+
+		std::map< std::pair<const void*, const void*>, Row> combinedRows;
+		std::vector<Row> rows(left->rows.size());
+
+		for (std::size_t e = 0; e < rows.size(); e++)
+		{
+			const auto& a = *left->rows[e];
+			const auto* b = right ? right->rows[e].get() : nullptr;
+			Row& combined = combinedRows[std::make_pair(static_cast<const void*>(&a), static_cast<const void*>(b))];
+
+			if (!combined)
+			{
+				std::vector<std::uint64_t> words(a.size());
+
+				for (std::size_t w = 0; w < words.size(); w++)
+				{
+					if (type == Node::Type::And)
+						words[w] = a[w] & (*b)[w];
+					else if (type == Node::Type::Or)
+						words[w] = a[w] | (*b)[w];
+					else
+						words[w] = ~a[w];
+				}
+
+				combined = std::make_shared<const std::vector<std::uint64_t> >(std::move(words));
+			}
+
+			rows[e] = combined;
+		}
+
+		return attributes(std::move(rows));
+	}
+
+	const Protein& m_protein;
+	std::vector<Token> m_tokens;
+	std::size_t m_next = 0;
+	std::string m_error;
+};
+
+void AtomBitset::resize(std::size_t size)
+{
+	m_size = size;
+	m_words.assign(wordCount(size), 0);
+}
+
+std::size_t AtomBitset::size() const
+{
+	return m_size;
+}
+
+std::size_t AtomBitset::count() const
+{
+	std::size_t count = 0;
+
+	for (auto w : m_words)
+		count += bitCount(w);
+
+	return count;
+}
+
+bool AtomBitset::test(std::size_t index) const
+{
+	return ((m_words[index >> 6] >> (index & 63)) & 1) != 0;
+}
+
+void AtomBitset::indices(std::vector<uint>& indices) const
+{
+	// the indices of each chunk are written to its offset in the result, which is known after counting in parallel
+	const std::size_t chunkCount = (m_words.size() + chunkWords - 1) / chunkWords;
+	std::vector<std::size_t> offsets(chunkCount + 1, 0);
+
+	ThreadPool::instance().parallelFor(chunkCount, [&](std::size_t i)
+	{
+		std::size_t count = 0;
+
+		for (std::size_t w = i * chunkWords; w < std::min(m_words.size(), (i + 1) * chunkWords); w++)
+			count += bitCount(m_words[w]);
+
+		offsets[i + 1] = count;
+	});
+
+	for (std::size_t i = 0; i < chunkCount; i++)
+		offsets[i + 1] += offsets[i];
+
+	indices.resize(offsets.back());
+
+	ThreadPool::instance().parallelFor(chunkCount, [&](std::size_t i)
+	{
+		uint* output = indices.data() + offsets[i];
+
+		for (std::size_t w = i * chunkWords; w < std::min(m_words.size(), (i + 1) * chunkWords); w++)
+		{
+			for (std::uint64_t word = m_words[w]; word != 0; word &= word - 1)
+				*output++ = uint(w * 64 + trailingZeros(word));
+		}
+	});
+}
+
+std::vector<std::uint64_t>& AtomBitset::words()
+{
+	return m_words;
+}
+
+const std::vector<std::uint64_t>& AtomBitset::words() const
+{
+	return m_words;
+}
+
+Selection::Selection()
+{
+
+}
+
+Selection::~Selection()
+{
+
+}
+
+Selection::Selection(Selection&& other) = default;
+Selection& Selection::operator=(Selection&& other) = default;
+
+bool Selection::compile(const std::string& expression, const Protein& protein)
+{
+	m_expression = expression;
+	m_error.clear();
+	m_root = Parser(expression, protein).parse(m_error);
+
+	return m_root != nullptr;
+}
+
+bool Selection::isValid() const
+{
+	return m_root != nullptr;
+}
+
+const std::string& Selection::expression() const
+{
+	return m_expression;
+}
+
+const std::string& Selection::error() const
+{
+	return m_error;
+}
+
+bool Selection::dependsOnPositions() const
+{
+	return m_root && m_root->type != Node::Type::Attributes;
+}
+
+void Selection::evaluate(const vec4* atoms, std::size_t count, AtomBitset& result) const
+{
+	Atoms a;
+	a.atoms = atoms;
+	a.count = count;
+
+	if (m_root)
+		m_root->evaluate(a, result);
+	else
+		result.resize(count);
+}
+
+void Selection::evaluate(const vec3* positions, const uint* attributes, std::size_t count, AtomBitset& result) const
+{
+	Atoms a;
+	a.positions = positions;
+	a.attributes = attributes;
+	a.count = count;
+
+	if (m_root)
+		m_root->evaluate(a, result);
+	else
+		result.resize(count);
+}
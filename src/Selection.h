@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace dynamol
+{
+	class Protein;
+
+	// One bit per atom of a timestep, stored in 64-bit words so that boolean operations combine 64 atoms at once
+	class AtomBitset
+	{
+	public:
+		// Resizes the set to the given number of atoms, none of which are selected
+		void resize(std::size_t size);
+
+		std::size_t size() const;
+		std::size_t count() const;
+		bool test(std::size_t index) const;
+
+		// Writes the indices of all selected atoms in ascending order
+		void indices(std::vector<glm::uint>& indices) const;
+
+		std::vector<std::uint64_t>& words();
+		const std::vector<std::uint64_t>& words() const;
+
+	private:
+		std::vector<std::uint64_t> m_words;
+		std::size_t m_size = 0;
+	};
+
+	// Compiles atom selections such as "chain A and (resname HEM or within 5 of resid 10-20) and not element H" for a protein.
+	// All terms that only depend on the element, residue and chain attributes are folded into a single table during compilation,
+	// so evaluating them costs one lookup per atom regardless of the complexity of the expression.
+	//
+	//   all, none                 every or no atom
+	//   chain A B ...             chain names
+	//   resname ALA GLY ...       residue names
+	//   resid 10 20-30 40 to 50   residue numbers and inclusive ranges of them
+	//   element C N ...           element symbols
+	//   within 5 of <term>        atoms within the given distance of the atoms selected by a term, use parentheses for longer expressions
+	//   not, and, or, ( )         in order of decreasing precedence
+	class Selection
+	{
+	public:
+		Selection();
+		~Selection();
+
+		Selection(Selection&& other);
+		Selection& operator=(Selection&& other);
+
+		// Returns false and provides an error message if the expression is invalid, the tables of the protein must not change afterwards
+		bool compile(const std::string& expression, const Protein& protein);
+
+		bool isValid() const;
+		const std::string& expression() const;
+		const std::string& error() const;
+
+		// Returns whether the selection has to be reevaluated when the positions change, otherwise only changes of the attributes matter
+		bool dependsOnPositions() const;
+
+		// Evaluates the selection for atoms with their attributes packed into w, as returned by Protein::loadTimestep
+		void evaluate(const glm::vec4* atoms, std::size_t count, AtomBitset& result) const;
+
+		// Evaluates the selection for positions with separate attributes, as provided by Protein::staticAttributes
+		void evaluate(const glm::vec3* positions, const glm::uint* attributes, std::size_t count, AtomBitset& result) const;
+
+	private:
+		struct Node;
+		class Parser;
+
+		std::string m_expression;
+		std::string m_error;
+		std::unique_ptr<Node> m_root;
+	};
+}
@@ -0,0 +1,69 @@
+#include "SelectionBenchmark.h"
+#include "Selection.h"
+#include "Protein.h"
+#include "Benchmark.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+using namespace dynamol;
+using namespace glm;
+
+bool SelectionBenchmark::run(const std::string& filename, std::size_t atomCount, unsigned int iterations)
+{
+	// the copies are separated by gaps larger than any distance used below, so that each selects the same atoms
+	Protein protein;
+	Benchmark::Replica replica;
+
+	if (!Benchmark::replicate(filename, atomCount, 32.0f, protein, replica))
+		return false;
+
+	const std::vector<std::string> expressions = {
+		"all",
+		"chain A",
+		"resname ALA GLY and element C",
+		"resid 10-50 or not element O",
+		"not (chain A or chain b) and resid 100 to 200",
+		"within 5 of (chain A and resid 30)",
+		"element N and within 8 of chain B"
+	};
+
+	std::vector<vec3> positions(replica.atoms.size());
+	std::vector<uint> attributes(replica.atoms.size());
+
+	for (std::size_t i = 0; i < replica.atoms.size(); i++)
+	{
+		positions[i] = vec3(replica.atoms[i]);
+		attributes[i] = floatBitsToUint(replica.atoms[i].w);
+	}
+
+	iterations = std::max(iterations, 1u);
+
+	std::cout << "Benchmarking atom selections on " << positions.size() << " atoms (" << replica.copies << " copies of the first timestep of " << filename << ", " << iterations << " iterations)" << std::endl;
+
+	bool success = true;
+
+	for (const auto& e : expressions)
+	{
+		Selection selection;
+
+		if (!selection.compile(e, protein))
+		{
+			std::cout << "  " << e << ": " << selection.error() << std::endl;
+			success = false;
+			continue;
+		}
+
+		AtomBitset result;
+		std::vector<uint> indices;
+
+		const double evaluationTime = Benchmark::minimumTime(iterations, [&]() { selection.evaluate(positions.data(), attributes.data(), positions.size(), result); });
+		const double indexTime = Benchmark::minimumTime(iterations, [&]() { result.indices(indices); });
+
+		std::cout << "  " << e << ": " << evaluationTime * 1000.0 << " ms (" << double(positions.size()) / evaluationTime / 1e6 << " M atoms/s), "
+			<< indices.size() << " atoms selected, index list " << indexTime * 1000.0 << " ms" << std::endl;
+	}
+
+	return success;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace dynamol
+{
+	// Measures the evaluation time of atom selections on the first timestep of a file, replicated to the given number of atoms.
+	// The results are verified by the selection tests on synthetic inputs.
+	class SelectionBenchmark
+	{
+	public:
+		static bool run(const std::string& filename, std::size_t atomCount = 5000000, unsigned int iterations = 10);
+	};
+}
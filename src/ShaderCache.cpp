@@ -0,0 +1,212 @@
+#include "ShaderCache.h"
+
+#include <glbinding/glbinding.h>
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <globjects/globjects.h>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include <iterator>
+#include <cstdint>
+
+using namespace dynamol;
+using namespace gl;
+
+namespace
+{
+	std::string contextString(GLenum name)
+	{
+		const GLubyte* string = glGetString(name);
+		return string ? std::string(reinterpret_cast<const char*>(string)) : std::string();
+	}
+}
+
+ShaderCache::ShaderCache(GLFWwindow* window, const std::string& directory) : m_directory(directory)
+{
+	// binaries only load on the driver that produced them
+	m_driver = contextString(GL_VENDOR) + "\n" + contextString(GL_RENDERER) + "\n" + contextString(GL_VERSION) + "\n";
+
+	// The hidden window uses the same context hints as the visible one, which are still set
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	m_window = glfwCreateWindow(1, 1, "dynamol shader cache", nullptr, window);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+	if (m_window)
+		m_thread = std::thread(&ShaderCache::run, this);
+	else
+		globjects::debug() << "Could not create a shared context, shader programs are not prepared in the background.";
+}
+
+ShaderCache::~ShaderCache()
+{
+	if (m_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+
+		m_condition.notify_all();
+		m_thread.join();
+	}
+
+	if (m_window)
+		glfwDestroyWindow(m_window);
+}
+
+std::string ShaderCache::key(const Sources& sources) const
+{
+	std::string text = m_driver;
+
+	for (const auto& s : sources)
+		text += std::to_string(static_cast<unsigned int>(s.first)) + "\n" + s.second + "\n";
+
+	std::ostringstream stream;
+	stream << std::hex << std::setw(16) << std::setfill('0') << std::uint64_t(std::hash<std::string>()(text));
+	return stream.str();
+}
+
+bool ShaderCache::load(const std::string& key, Binary& binary)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto i = m_binaries.find(key);
+
+	if (i != m_binaries.end())
+	{
+		binary = i->second;
+		return true;
+	}
+
+	std::ifstream file(path(key), std::ios::binary);
+
+	if (!file)
+		return false;
+
+	std::uint32_t format = 0;
+
+	if (!file.read(reinterpret_cast<char*>(&format), sizeof(format)))
+		return false;
+
+	binary.format = GLenum(format);
+	binary.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+	return !binary.data.empty();
+}
+
+void ShaderCache::store(const std::string& key, const Binary& binary)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// later viewers sharing the cache load the binary from memory
+	m_binaries[key] = binary;
+
+	std::error_code error;
+	std::filesystem::create_directories(m_directory, error);
+
+	// a file that cannot be written only means the program is compiled again in the next run
+	std::ofstream file(path(key), std::ios::binary);
+	const std::uint32_t format = static_cast<std::uint32_t>(binary.format);
+	file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+	file.write(reinterpret_cast<const char*>(binary.data.data()), std::streamsize(binary.data.size()));
+}
+
+void ShaderCache::prewarm(const std::string& key, const Sources& sources)
+{
+	if (!m_window)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_binaries.count(key) > 0 || m_queued.count(key) > 0 || std::filesystem::exists(path(key)))
+			return;
+
+		m_queued.insert(key);
+		m_queue.emplace_back(key, sources);
+	}
+
+	m_condition.notify_one();
+}
+
+void ShaderCache::run()
+{
+	glfwMakeContextCurrent(m_window);
+	glbinding::initialize(glfwGetProcAddress, false);
+
+	while (true)
+	{
+		std::pair<std::string, Sources> request;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+
+			if (m_stopping)
+				break;
+
+			request = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+
+		// programs that fail to link are compiled again when they are used, which reports the errors
+		Binary binary;
+
+		if (link(request.second, binary))
+			store(request.first, binary);
+	}
+
+	glbinding::releaseCurrentContext();
+	glfwMakeContextCurrent(nullptr);
+}
+
+bool ShaderCache::link(const Sources& sources, Binary& binary)
+{
+	const GLuint program = glCreateProgram();
+	std::vector<GLuint> shaders;
+
+	for (const auto& s : sources)
+	{
+		const GLuint shader = glCreateShader(s.first);
+		const char* source = s.second.c_str();
+		glShaderSource(shader, 1, &source, nullptr);
+		glCompileShader(shader);
+		glAttachShader(program, shader);
+		shaders.push_back(shader);
+	}
+
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GLint(GL_TRUE));
+	glLinkProgram(program);
+
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+	if (linked)
+	{
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		binary.data.resize(std::size_t(length));
+		glGetProgramBinary(program, length, nullptr, &binary.format, binary.data.data());
+	}
+
+	for (GLuint shader : shaders)
+	{
+		glDetachShader(program, shader);
+		glDeleteShader(shader);
+	}
+
+	glDeleteProgram(program);
+
+	return linked && !binary.data.empty();
+}
+
+std::filesystem::path ShaderCache::path(const std::string& key) const
+{
+	return m_directory / (key + ".bin");
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <filesystem>
+
+#include <glbinding/gl/gl.h>
+
+struct GLFWwindow;
+
+namespace dynamol
+{
+	// Keeps the binaries of linked shader programs, which are stored on disk and keyed by their sources and the OpenGL driver, so
+	// that later runs do not have to compile them again. Programs can also be linked in advance by a background thread, which uses
+	// a hidden window whose context shares its objects with the window of the viewer.
+	class ShaderCache
+	{
+	public:
+		// format and data as returned by glGetProgramBinary
+		struct Binary
+		{
+			gl::GLenum format = gl::GL_NONE;
+			std::vector<unsigned char> data;
+		};
+
+		// the source of every stage of a program, with includes already resolved
+		using Sources = std::vector< std::pair<gl::GLenum, std::string> >;
+
+		ShaderCache(GLFWwindow* window, const std::string& directory);
+		~ShaderCache();
+
+		std::string key(const Sources& sources) const;
+
+		// Returns the binary stored or linked in the background by this cache, or stored on disk by an earlier run, for the key
+		bool load(const std::string& key, Binary& binary);
+		void store(const std::string& key, const Binary& binary);
+
+		// Queues the sources to be linked in the background, unless a binary for the key exists already
+		void prewarm(const std::string& key, const Sources& sources);
+
+	private:
+		void run();
+		static bool link(const Sources& sources, Binary& binary);
+		std::filesystem::path path(const std::string& key) const;
+
+		std::filesystem::path m_directory;
+		std::string m_driver;
+
+		GLFWwindow* m_window = nullptr;
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque< std::pair<std::string, Sources> > m_queue;
+		std::unordered_set<std::string> m_queued;
+		std::unordered_map<std::string, Binary> m_binaries;
+		bool m_stopping = false;
+	};
+}
@@ -0,0 +1,187 @@
+#include "SortBenchmark.h"
+
+#include <glbinding/gl/gl.h>
+#include <globjects/Buffer.h>
+#include <globjects/Program.h>
+#include <globjects/Shader.h>
+#include <globjects/Query.h>
+#include <globjects/NamedString.h>
+#include <globjects/base/File.h>
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <memory>
+#include <vector>
+#include <random>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+using namespace globjects;
+
+namespace
+{
+	// has to match maximumEntries of sort.glsl
+	const uint maximumEntries = 128;
+
+	struct Result
+	{
+		uint errorCount;
+		float checksum;
+	};
+}
+
+bool SortBenchmark::run(std::size_t listCount, unsigned int iterations)
+{
+	Shader::hintIncludeImplementation(Shader::IncludeImplementation::Fallback);
+
+	auto sortFile = File::create("./res/sphere/sort.glsl");
+	auto sortString = NamedString::create("/sort.glsl", sortFile.get());
+	auto source = Shader::sourceFromFile("./res/sphere/sortbenchmark-cs.glsl");
+	auto shader = Shader::create(GL_COMPUTE_SHADER, source.get());
+	auto program = std::make_unique<Program>();
+	program->attach(shader.get());
+	program->link();
+
+	if (!program->isLinked())
+	{
+		std::cout << "Could not build the sort benchmark shader!" << std::endl;
+		return false;
+	}
+
+	listCount = std::max<std::size_t>(listCount, 1);
+	iterations = std::max(iterations, 1u);
+
+	// lengths as found on sparse and dense parts of a molecule, clamped to the entries the surface pass considers
+	std::mt19937 generator(42);
+	std::uniform_int_distribution<uint> uniformLength(1, maximumEntries);
+	std::exponential_distribution<double> exponentialLength(1.0 / 16.0);
+	std::uniform_real_distribution<double> fraction(0.0, 1.0);
+
+	const std::vector<std::pair<std::string, std::function<uint()>>> distributions = {
+		{ "Short lists (4 entries)", [&]() { return 4u; } },
+		{ "Uniform lengths (1 to 128 entries)", [&]() { return uniformLength(generator); } },
+		{ "Exponential lengths (16 entries on average)", [&]() { return std::min(maximumEntries, 1u + uint(exponentialLength(generator))); } },
+		{ "Bimodal lengths (90% with 8, 10% with 128 entries)", [&]() { return fraction(generator) < 0.9 ? 8u : maximumEntries; } },
+		{ "Long lists (128 entries)", [&]() { return maximumEntries; } }
+	};
+
+	// the combined sort is timed with several lengths up to which it sorts by insertion, the default of sort.glsl is 16
+	struct Method
+	{
+		std::string name;
+		uint method;
+		uint insertionSortLength;
+	};
+
+	std::vector<Method> methods = { { "Selection sort on the buffer", 0, 0 }, { "Insertion sort", 1, 0 }, { "Bitonic sort", 2, 0 } };
+
+	for (uint length : { 4u, 8u, 16u, 32u, 64u })
+		methods.push_back({ "Insertion up to " + std::to_string(length) + ", then bitonic sort", 3, length });
+
+	std::uniform_real_distribution<float> distance(0.0f, 100.0f);
+	std::vector<float> distances(listCount * maximumEntries);
+
+	for (auto& d : distances)
+		d = distance(generator);
+
+	auto lengthBuffer = Buffer::create();
+	auto distanceBuffer = Buffer::create();
+	auto resultBuffer = Buffer::create();
+	distanceBuffer->setData(distances, GL_STATIC_DRAW);
+	resultBuffer->setData(sizeof(Result), nullptr, GL_DYNAMIC_READ);
+
+	auto timer = std::make_unique<Query>();
+	const uint groupCount = uint((listCount + 63) / 64);
+	bool success = true;
+
+	std::cout << "Benchmarking intersection list sorting on " << listCount << " lists (" << iterations << " iterations)" << std::endl;
+
+	for (const auto& distribution : distributions)
+	{
+		std::vector<uint> lengths(listCount);
+		std::size_t entryCount = 0;
+
+		for (auto& l : lengths)
+		{
+			l = distribution.second();
+			entryCount += l;
+		}
+
+		lengthBuffer->setData(lengths, GL_STATIC_DRAW);
+
+		std::cout << distribution.first << ", " << double(entryCount) / double(listCount) << " entries on average" << std::endl;
+
+		double selectionTime = 0.0;
+		double fastestTime = std::numeric_limits<double>::max();
+		uint fastestLength = 0;
+
+		for (const auto& m : methods)
+		{
+			lengthBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+			distanceBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+			resultBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+
+			const Result clearResult = { 0, 0.0f };
+			resultBuffer->setSubData(0, sizeof(Result), &clearResult);
+
+			program->setUniform("listCount", uint(listCount));
+			program->setUniform("method", m.method);
+			program->setUniform("insertionSortLength", m.insertionSortLength);
+
+			// the first dispatch verifies the result, the others are timed
+			program->setUniform("verify", true);
+			program->dispatchCompute(groupCount, 1, 1);
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+			Result result;
+			resultBuffer->getSubData(0, sizeof(Result), &result);
+
+			program->setUniform("verify", false);
+			double time = std::numeric_limits<double>::max();
+
+			for (unsigned int i = 0; i < iterations; i++)
+			{
+				timer->begin(GL_TIME_ELAPSED);
+				program->dispatchCompute(groupCount, 1, 1);
+				timer->end(GL_TIME_ELAPSED);
+
+				time = std::min(time, double(timer->get64(GL_QUERY_RESULT)) / 1000000.0);
+			}
+
+			for (uint binding : { 0u, 1u, 2u })
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+
+			if (m.method == 0)
+				selectionTime = time;
+
+			if (m.method == 3 && time < fastestTime)
+			{
+				fastestTime = time;
+				fastestLength = m.insertionSortLength;
+			}
+
+			std::cout << "  " << m.name << ": " << time << " ms (" << double(entryCount) / time / 1e6 << " G entries/s, " << selectionTime / time << "x)";
+
+			if (result.errorCount > 0)
+			{
+				std::cout << ", " << result.errorCount << " lists NOT SORTED";
+				success = false;
+			}
+
+			std::cout << std::endl;
+		}
+
+		std::cout << "  Fastest switch-over to the bitonic sort: after " << fastestLength << " entries" << std::endl;
+	}
+
+	std::cout << "Lists " << (success ? "sorted correctly" : "NOT SORTED") << " by all methods." << std::endl;
+
+	return success;
+}
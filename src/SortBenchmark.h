@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+namespace dynamol
+{
+	// Measures the GPU time of sorting per-pixel intersection lists as in the surface pass, for the previous selection sort
+	// reading the buffer and for the sorts on local copies of the distances, over several distributions of list lengths.
+	// The combined sort is timed for several lengths up to which it sorts by insertion, to choose where it switches to the
+	// bitonic sort. Requires a current OpenGL context.
+	class SortBenchmark
+	{
+	public:
+		static bool run(std::size_t listCount = 262144, unsigned int iterations = 10);
+	};
+}
@@ -0,0 +1,210 @@
+#include "SphereRasterizer.h"
+#include "Renderer.h"
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+
+#include <algorithm>
+#include <limits>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+using namespace globjects;
+
+SphereRasterizer::SphereRasterizer(Renderer* renderer) : m_renderer(renderer)
+{
+	m_renderer->createShaderProgram("rasterizerbin", {
+			{ GL_COMPUTE_SHADER,"./res/rasterizer/bin-cs.glsl" }
+		});
+
+	m_renderer->createShaderProgram("rasterizerscan", {
+			{ GL_COMPUTE_SHADER,"./res/celllist/scan-cs.glsl" }
+		});
+
+	m_renderer->createShaderProgram("rasterizeradd", {
+			{ GL_COMPUTE_SHADER,"./res/celllist/add-cs.glsl" }
+		});
+
+	m_renderer->createShaderProgram("rasterizerraster", {
+			{ GL_COMPUTE_SHADER,"./res/rasterizer/raster-cs.glsl" }
+		});
+
+	m_entryCountReadback->setStorage(sizeof(uint), nullptr, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_CLIENT_STORAGE_BIT);
+	m_entryCountData = static_cast<const uint*>(m_entryCountReadback->mapRange(0, sizeof(uint), GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+}
+
+void SphereRasterizer::rasterize(Buffer* atoms, Buffer* indices, uint count, Buffer* commands, Buffer* elements,
+	float radiusScale, float nearPlaneZ, const mat4& modelView, const mat4& projection, const ivec2& size,
+	Texture* offsets, Texture* positions, Texture* normals, Buffer* intersections, uint intersectionCapacity)
+{
+	auto programBin = m_renderer->shaderProgram("rasterizerbin");
+	auto programRaster = m_renderer->shaderProgram("rasterizerraster");
+
+	const ivec2 tileCounts = (size + int(tileSize) - 1) / int(tileSize);
+	const uint tileCount = uint(tileCounts.x * tileCounts.y);
+
+	// one more entry than tiles, so the start after the last tile holds the number of entries
+	const uint valueCount = tileCount + 1;
+
+	reserve(m_tileStarts, m_tileStartsCapacity, valueCount * sizeof(uint));
+	reserve(m_tileCursors, m_tileCursorsCapacity, valueCount * sizeof(uint));
+
+	const uint zero = 0;
+	m_tileStarts->clearSubData(GL_R32UI, 0, valueCount * sizeof(uint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// without a count on the CPU, as many groups are dispatched as there could be visible atoms
+	const uint atomGroups = (count + workGroupSize - 1) / workGroupSize;
+
+	atoms->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (indices)
+		indices->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+
+	elements->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+
+	if (commands)
+		commands->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+
+	programBin->setUniform("atomCount", count);
+	programBin->setUniform("indexed", indices != nullptr);
+	programBin->setUniform("culled", commands != nullptr);
+	programBin->setUniform("radiusScale", std::max(radiusScale, 1.0f));
+	programBin->setUniform("clipRadiusScale", radiusScale);
+	programBin->setUniform("nearPlaneZ", nearPlaneZ);
+	programBin->setUniform("modelViewMatrix", modelView);
+	programBin->setUniform("projectionMatrix", projection);
+	programBin->setUniform("viewportSize", size);
+	programBin->setUniform("tileCounts", tileCounts);
+	programBin->setUniform("tileSize", int(tileSize));
+
+	if (atomGroups > 0)
+	{
+		m_tileStarts->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+		programBin->setUniform("phase", 0u);
+		programBin->dispatchCompute(atomGroups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	scan(m_tileStarts.get(), valueCount);
+
+	// The entry buffer has to hold all entries before they are scattered, so their number is waited for
+	m_tileStarts->copySubData(m_entryCountReadback.get(), tileCount * sizeof(uint), 0, sizeof(uint));
+	auto fence = Sync::fence(GL_SYNC_GPU_COMMANDS_COMPLETE);
+	fence->clientWait(GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+	m_entryCount = *m_entryCountData;
+
+	// a quarter of headroom avoids growing again on every small change of the view
+	if (m_entriesCapacity < std::max(m_entryCount, 1u) * sizeof(uint))
+		reserve(m_entries, m_entriesCapacity, (std::max(m_entryCount, 1u) + m_entryCount / 4) * sizeof(uint));
+
+	m_tileStarts->copySubData(m_tileCursors.get(), 0, 0, valueCount * sizeof(uint));
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// the prefix sum uses the bindings of the indices and elements
+	elements->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+	m_entries->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+
+	if (atomGroups > 0 && m_entryCount > 0)
+	{
+		if (indices)
+			indices->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+
+		m_tileCursors->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+		programBin->setUniform("phase", 1u);
+		programBin->dispatchCompute(atomGroups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	// Every pixel is written, including those not covered by any sphere, so the textures need not be cleared
+	atoms->bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+	intersections->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+	m_tileStarts->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+
+	offsets->bindImageTexture(0, 0, false, 0, GL_WRITE_ONLY, GL_R32UI);
+	positions->bindImageTexture(1, 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	normals->bindImageTexture(2, 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+	programRaster->setUniform("inverseModelViewProjectionMatrix", inverse(projection * modelView));
+	programRaster->setUniform("radiusScale", radiusScale);
+	programRaster->setUniform("intersectionCapacity", intersectionCapacity);
+	programRaster->setUniform("viewportSize", size);
+	programRaster->setUniform("tileCounts", tileCounts);
+	programRaster->dispatchCompute(uint(tileCounts.x), uint(tileCounts.y), 1);
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	normals->unbindImageTexture(2);
+	positions->unbindImageTexture(1);
+	offsets->unbindImageTexture(0);
+
+	// the element buffer stays bound to binding 3 for the sphere shaders
+	for (uint binding : { 0u, 1u, 2u, 4u, 5u })
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+}
+
+uint SphereRasterizer::entryCount() const
+{
+	return m_entryCount;
+}
+
+void SphereRasterizer::reserve(std::unique_ptr<Buffer>& buffer, std::size_t& capacity, std::size_t size)
+{
+	// buffers only grow, so changing views and atom counts do not reallocate every frame
+	if (capacity < size)
+	{
+		buffer->setData(size, nullptr, GL_DYNAMIC_COPY);
+		capacity = size;
+	}
+}
+
+void SphereRasterizer::scan(Buffer* values, uint valueCount)
+{
+	auto programScan = m_renderer->shaderProgram("rasterizerscan");
+	auto programAdd = m_renderer->shaderProgram("rasterizeradd");
+
+	// The tile counts are turned into starts by a prefix sum over blocks, whose sums are scanned in turn until a single block remains
+	std::vector<Buffer*> levels = { values };
+	std::vector<uint> levelSizes = { valueCount };
+
+	while (true)
+	{
+		const std::size_t level = levels.size() - 1;
+		const uint blockCount = (levelSizes.back() + scanBlockSize - 1) / scanBlockSize;
+
+		if (m_blockSums.size() <= level)
+		{
+			m_blockSums.push_back(std::make_unique<Buffer>());
+			m_blockSumsCapacities.push_back(0);
+		}
+
+		reserve(m_blockSums[level], m_blockSumsCapacities[level], blockCount * sizeof(uint));
+
+		levels.back()->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+		m_blockSums[level]->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+		programScan->setUniform("valueCount", levelSizes.back());
+		programScan->dispatchCompute(blockCount, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		if (blockCount == 1)
+			break;
+
+		levels.push_back(m_blockSums[level].get());
+		levelSizes.push_back(blockCount);
+	}
+
+	for (std::size_t level = levels.size() - 1; level > 0; level--)
+	{
+		levels[level - 1]->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+		levels[level]->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+		programAdd->setUniform("valueCount", levelSizes[level - 1]);
+		programAdd->dispatchCompute((levelSizes[level - 1] + workGroupSize - 1) / workGroupSize, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	for (uint binding : { 1u, 3u })
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+}
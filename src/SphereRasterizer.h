@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <memory>
+
+#include <glbinding/gl/gl.h>
+#include <globjects/Buffer.h>
+#include <globjects/Program.h>
+#include <globjects/Texture.h>
+#include <globjects/Sync.h>
+
+namespace dynamol
+{
+	class Renderer;
+
+	// Rasterizes the spheres in compute shaders instead of expanding them into quads in the geometry shader. The screen rectangles
+	// of the spheres are binned into tiles of 16 x 16 pixels with a counting sort, then one work group per tile intersects the view
+	// rays of its pixels with the spheres of the tile, which it loads into shared memory in batches. It writes the same closest
+	// sphere positions and normals as the sphere pass and the same intersection lists as the list generation pass, but every list
+	// is built by the single invocation owning its pixel, so neither depth testing nor image atomics are needed.
+	class SphereRasterizer
+	{
+	public:
+		static const glm::uint tileSize = 16;
+
+		SphereRasterizer(Renderer* renderer);
+
+		// Bins count atoms, read through the indices if given, or the atoms counted by the first command of the cluster culler if
+		// commands is given. The radii are taken from the element buffer, scaled by radiusScale for the lists, and spheres reaching
+		// the near plane are skipped like in the geometry shader. The offsets, positions and normals are written for the whole
+		// textures and the entries are appended to the intersection buffer, whose count has to be set before.
+		void rasterize(globjects::Buffer* atoms, globjects::Buffer* indices, glm::uint count, globjects::Buffer* commands, globjects::Buffer* elements,
+			float radiusScale, float nearPlaneZ, const glm::mat4& modelView, const glm::mat4& projection, const glm::ivec2& size,
+			globjects::Texture* offsets, globjects::Texture* positions, globjects::Texture* normals, globjects::Buffer* intersections, glm::uint intersectionCapacity);
+
+		// Number of sphere references in all tiles of the latest call
+		glm::uint entryCount() const;
+
+	private:
+		static const glm::uint scanBlockSize = 1024;
+		static const glm::uint workGroupSize = 256;
+
+		void reserve(std::unique_ptr<globjects::Buffer>& buffer, std::size_t& capacity, std::size_t size);
+		void scan(globjects::Buffer* values, glm::uint valueCount);
+
+		Renderer* m_renderer;
+
+		glm::uint m_entryCount = 0;
+
+		std::unique_ptr<globjects::Buffer> m_tileStarts = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_tileCursors = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_entries = std::make_unique<globjects::Buffer>();
+		std::size_t m_tileStartsCapacity = 0;
+		std::size_t m_tileCursorsCapacity = 0;
+		std::size_t m_entriesCapacity = 0;
+
+		// block sums of every level of the prefix sum, until a single block remains
+		std::vector< std::unique_ptr<globjects::Buffer> > m_blockSums;
+		std::vector<std::size_t> m_blockSumsCapacities;
+
+		// the total number of entries is needed to size the entry buffer before scattering
+		std::unique_ptr<globjects::Buffer> m_entryCountReadback = std::make_unique<globjects::Buffer>();
+		const glm::uint* m_entryCountData = nullptr;
+	};
+}
@@ -1,16 +1,25 @@
 #include "SphereRenderer.h"
 #include <globjects/base/File.h>
 #include <globjects/State.h>
+#include <globjects/globjects.h>
+#include <glbinding/gl/extension.h>
 #include <iostream>
 #include <filesystem>
 #include <imgui.h>
 #include "Viewer.h"
 #include "Scene.h"
 #include "Protein.h"
+#include "PdbParser.h"
 #include <sstream>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <cmath>
+#include <cstdlib>
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/string_cast.hpp>
@@ -76,17 +85,19 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 {
 	Shader::hintIncludeImplementation(Shader::IncludeImplementation::Fallback);
 
-	for (auto i : viewer->scene()->protein()->atoms())
-	{
-		m_vertices.push_back(Buffer::create());
-		m_vertices.back()->setStorage(i, gl::GL_NONE_BIT);
-	}
+	// the intersection buffer starts small and is limited by the largest shader storage block, at least 128 MB
+	GLint64 maximumBlockSize = 0;
+	glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maximumBlockSize);
+	maximumBlockSize = std::max(maximumBlockSize, GLint64(1) << 27);
+	m_maximumIntersectionCapacity = (std::min(std::size_t(maximumIntersectionBufferSize), std::size_t(maximumBlockSize)) - intersectionHeaderSize) / intersectionEntrySize;
+	resizeIntersectionBuffer(minimumIntersectionCapacity);
 
-	m_elementColorsRadii->setStorage(viewer->scene()->protein()->activeElementColorsRadiiPacked(), gl::GL_NONE_BIT);
-	m_residueColors->setStorage(viewer->scene()->protein()->activeResidueColorsPacked(), gl::GL_NONE_BIT);
-	m_chainColors->setStorage(viewer->scene()->protein()->activeChainColorsPacked(), gl::GL_NONE_BIT);
+	// lists can only be sorted while they are generated if fragments of the same pixel can be serialized
+	m_fragmentShaderInterlock = hasExtension(GLextension::GL_ARB_fragment_shader_interlock);
 
-	m_intersectionBuffer->setStorage(sizeof(vec3) * 1024 * 1024 * 128 + sizeof(uint), nullptr, gl::GL_NONE_BIT);
+	// the entry counts and the statistics of the surface pass are copied to a mapped buffer, which is read once a fence is signaled
+	m_statisticsBuffer->setStorage(std::array<uint, 2>({ 0, 0 }), gl::GL_NONE_BIT);
+	resizeIntersectionReadback(1);
 
 	m_verticesQuad->setStorage(std::array<vec3, 1>({ vec3(0.0f, 0.0f, 0.0f) }), gl::GL_NONE_BIT);
 	auto vertexBindingQuad = m_vaoQuad->binding(0);
@@ -95,9 +106,6 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 	m_vaoQuad->enable(0);
 	m_vaoQuad->unbind();
 
-	m_shaderSourceDefines = StaticStringSource::create("");
-	m_shaderDefines = NamedString::create("/defines.glsl", m_shaderSourceDefines.get());
-
 	createShaderProgram("sphere", {
 			{ GL_VERTEX_SHADER,"./res/sphere/sphere-vs.glsl" },
 			{ GL_GEOMETRY_SHADER,"./res/sphere/sphere-gs.glsl" },
@@ -117,7 +125,7 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 			{ GL_GEOMETRY_SHADER,"./res/sphere/image-gs.glsl" },
 			{ GL_FRAGMENT_SHADER,"./res/sphere/surface-fs.glsl" },
 		},
-		{ "./res/sphere/globals.glsl" });
+		{ "./res/sphere/globals.glsl", "./res/sphere/sort.glsl" });
 
 	createShaderProgram("aosample", {
 			{ GL_VERTEX_SHADER,"./res/sphere/image-vs.glsl" },
@@ -161,6 +169,12 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 		},
 		{ "./res/sphere/globals.glsl" });
 
+	createShaderProgram("depth", {
+			{ GL_VERTEX_SHADER,"./res/sphere/image-vs.glsl" },
+			{ GL_GEOMETRY_SHADER,"./res/sphere/image-gs.glsl" },
+			{ GL_FRAGMENT_SHADER,"./res/sphere/depth-fs.glsl" },
+		});
+
 	createShaderProgram("shadow", {
 			{ GL_VERTEX_SHADER,"./res/sphere/sphere-vs.glsl" },
 			{ GL_GEOMETRY_SHADER,"./res/sphere/sphere-gs.glsl" },
@@ -174,7 +188,9 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 	},
 		{ "./res/model/globals.glsl"});
 
-	shaderProgram("transformfeedback")->setUniform("minBounds", viewer->scene()->protein()->minimumBounds());
+	m_cellList = std::make_unique<GpuCellList>(this);
+	m_clusterCuller = std::make_unique<ClusterCuller>(this);
+	m_sphereRasterizer = std::make_unique<SphereRasterizer>(this);
 
 	m_framebufferSize = viewer->viewportSize();
 
@@ -357,57 +373,98 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 	m_transformFeedback.reset(new TransformFeedback());
 	m_transformFeedback->setVaryings(shaderProgram("transformfeedback"), {"gCoords"}, GL_INTERLEAVED_ATTRIBS);
 
-	m_transformedCoordinates = Buffer::create();
-	m_transformedCoordinates->setStorage(viewer->scene()->protein()->atoms()[0].size() * sizeof(glm::vec4), nullptr, GL_NONE_BIT);
+	loadProtein();
 }
 
-void SphereRenderer::display()
+void SphereRenderer::proteinChanged()
 {
-	if (viewer()->scene()->protein()->atoms().size() == 0)
-		return;
+	// the stream stops decoding the previous protein before the buffers are created for the new one
+	m_timestepStream.reset();
 
-	// SaveOpenGL state
-	auto currentState = State::currentState();
+	for (auto& fence : m_slotFences)
+		fence.reset();
+
+	m_currentSlot = 0;
+	m_bvhTimestep = std::numeric_limits<std::size_t>::max();
+
+	// a selection refers to the atoms of the protein it was compiled for
+	m_selection = Selection();
+	m_selectionChanged = true;
 
-	static float resolutionScale = 1.0f;
+	loadProtein();
+}
+
+void SphereRenderer::loadProtein()
+{
+	const Protein* protein = viewer()->scene()->protein();
+
+	// 8 instead of 16 bytes per atom and timestep are uploaded when the attributes do not have to be repeated
+	const auto format = protein->hasStaticAttributes() ? TimestepStream::Format::QuantizedPositions : TimestepStream::Format::Atoms;
 
-	const ivec2 viewportSize = ivec2(vec2(viewer()->viewportSize()) * resolutionScale);
+	m_staticAttributes.reset();
+	m_uniformTableAttributes.reset();
 
-	// Resize all FBOs if the viewport size has changed
-	if (viewportSize != m_framebufferSize)
+	if (protein->hasStaticAttributes())
 	{
-		m_framebufferSize = viewportSize;
-		m_offsetTexture->image2D(0, GL_R32UI, m_framebufferSize, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
-		m_depthTexture->image2D(0, GL_DEPTH_COMPONENT, m_framebufferSize, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, nullptr);
-		m_spherePositionTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-		m_sphereNormalTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-		m_surfacePositionTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-		m_surfaceNormalTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-		m_surfaceDiffuseTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-		m_sphereDiffuseTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-		m_ambientTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-		m_blurTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-		m_colorTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_staticAttributes = Buffer::create();
+		m_staticAttributes->setStorage(protein->staticAttributes(), GL_NONE_BIT);
+
+		// the original packing of element, residue and chain index into 8 bits each for the uniform block lookups
+		if (protein->activeElementIds().size() <= uniformElementCount && protein->activeResidueNames().size() <= uniformResidueCount && protein->activeChainNames().size() <= uniformChainCount)
+		{
+			std::vector<uint> attributes(protein->staticAttributes().size());
+
+			for (std::size_t i = 0; i < attributes.size(); i++)
+			{
+				const uint a = protein->staticAttributes()[i];
+				const uvec2 group = protein->activeGroups()[Protein::groupIndex(a)];
+				attributes[i] = Protein::elementIndex(a) | (group.x << 8) | (group.y << 16);
+			}
+
+			m_uniformTableAttributes = Buffer::create();
+			m_uniformTableAttributes->setStorage(attributes, GL_NONE_BIT);
+		}
 	}
 
-	// our shader programs
+	// buffers with immutable storage are replaced, the previous ones are deleted once the GPU no longer uses them
+	m_timestepSlotSize = std::max<std::size_t>(protein->maximumAtomCount(), 1);
+	m_timestepElementSize = TimestepStream::elementSize(format);
+	m_timestepBuffer = Buffer::create();
+	m_timestepBuffer->setStorage(timestepSlotCount * m_timestepSlotSize * m_timestepElementSize, nullptr, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	m_timestepBufferData = static_cast<char*>(m_timestepBuffer->mapRange(0, timestepSlotCount * m_timestepSlotSize * m_timestepElementSize, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+	m_slotTimesteps.fill(std::numeric_limits<std::size_t>::max());
+	m_timestepStream = std::make_unique<TimestepStream>(protein, format);
+
+	m_elementColorsRadii = Buffer::create();
+	m_elementColorsRadii->setStorage(protein->activeElementColorsRadiiPacked(), gl::GL_NONE_BIT);
+	m_residueColors = Buffer::create();
+	m_residueColors->setStorage(protein->activeResidueColorsPacked(), gl::GL_NONE_BIT);
+	m_chainColors = Buffer::create();
+	m_chainColors->setStorage(protein->activeChainColorsPacked(), gl::GL_NONE_BIT);
+	m_groups = Buffer::create();
+	m_groups->setStorage(protein->activeGroups(), gl::GL_NONE_BIT);
+
+	shaderProgram("transformfeedback")->setUniform("minBounds", protein->minimumBounds());
 
-	auto programSphere = shaderProgram("sphere");
-	auto programSpawn = shaderProgram("spawn");
-	auto programSurface = shaderProgram("surface");
-	auto programAOSample = shaderProgram("aosample");
-	auto programAOBlur = shaderProgram("aoblur");
-	auto programShade = shaderProgram("shade");
-	auto programDOFBlur = shaderProgram("dofblur");
-	auto programDOFBlend = shaderProgram("dofblend");
-	auto programDisplay = shaderProgram("display");
-	auto programShadow = shaderProgram("shadow");
-	auto programTransformFeedback = shaderProgram("transformfeedback");
+	m_transformedCoordinates = Buffer::create();
+	m_transformedCoordinates->setStorage(m_timestepSlotSize * sizeof(glm::vec4), nullptr, GL_NONE_BIT);
+}
+
+void SphereRenderer::display()
+{
+	if (viewer()->scene()->protein()->timestepCount() == 0)
+		return;
+
+	// SaveOpenGL state
+	auto currentState = State::currentState();
+	Profiler* profiler = viewer()->profiler();
+
+	const ivec2 viewportSize = ivec2(vec2(viewer()->viewportSize()) * m_resolutionScale);
 
 	// get cursor position for magic lens
 	double mouseX, mouseY;
 	glfwGetCursorPos(viewer()->window(), &mouseX, &mouseY);
-	const vec2 focusPosition = vec2(2.0f*float(mouseX) / float(viewportSize.x) - 1.0f, -2.0f*float(mouseY) / float(viewportSize.y) + 1.0f);
+	const vec2 focusPosition = vec2(2.0f*float(mouseX) / float(viewer()->viewportSize().x) - 1.0f, -2.0f*float(mouseY) / float(viewer()->viewportSize().y) + 1.0f);
 
 	// retrieve/compute all necessary matrices and related properties
 	const mat4 viewMatrix = viewer()->viewTransform();
@@ -417,7 +474,6 @@ void SphereRenderer::display()
 	const mat4 modelLightMatrix = viewer()->modelLightTransform();
 	const mat4 inverseModelLightMatrix = inverse(modelLightMatrix);
 	const mat4 modelViewProjectionMatrix = viewer()->modelViewProjectionTransform();
-	const mat4 inverseModelViewProjectionMatrix = inverse(modelViewProjectionMatrix);
 	const mat4 modelLightProjectionMatrix = viewer()->modelLightProjectionTransform();
 	const mat4 inverseModelLightProjectionMatrix = inverse(modelLightProjectionMatrix);
 	const mat4 projectionMatrix = viewer()->projectionTransform();
@@ -428,11 +484,6 @@ void SphereRenderer::display()
 	const vec3 objectCenter = 0.5f * (viewer()->scene()->protein()->maximumBounds() + viewer()->scene()->protein()->minimumBounds());
 	const float objectRadius = 0.5f * length(viewer()->scene()->protein()->maximumBounds() - viewer()->scene()->protein()->minimumBounds());
 
-	const vec4 projectionInfo(float(-2.0 / (viewportSize.x * projectionMatrix[0][0])),
-		float(-2.0 / (viewportSize.y * projectionMatrix[1][1])),
-		float((1.0 - (double)projectionMatrix[0][2]) / projectionMatrix[0][0]),
-		float((1.0 + (double)projectionMatrix[1][2]) / projectionMatrix[1][1]));
-
 	const float projectionScale = float(viewportSize.y) / fabs(2.0f / projectionMatrix[1][1]);
 	const float fieldOfView = 2.0f * atan(1.0f / projectionMatrix[1][1]);
 
@@ -452,14 +503,6 @@ void SphereRenderer::display()
 	static float distanceBlending = 0.0f;
 	static float distanceScale = 1.0;
 
-	static bool ambientOcclusion = false;
-	static bool environmentMapping = false;
-	static bool environmentLighting = false;
-	static bool normalMapping = false;
-	static bool materialMapping = false;
-	static bool depthOfField = false;
-
-	static int coloring = 0;
 	static bool animate = false;
 	static float animationAmplitude = 1.0f;
 	static float animationFrequency = 1.0f;
@@ -481,7 +524,15 @@ void SphereRenderer::display()
 	// user interface for manipulating rendering parameters
 	if (ImGui::BeginMenu("Renderer"))
 	{
-		ImGui::SliderFloat("Resolution Scale", &resolutionScale, 0.25f, 8.0f);
+		ImGui::SliderFloat("Resolution Scale", &m_resolutionScale, 0.25f, 8.0f);
+
+		if (ImGui::CollapsingHeader("Tiled Rendering"))
+		{
+			ImGui::Checkbox("Tiled Rendering Enabled", &m_tiledRendering);
+			ImGui::SliderInt("Memory Budget (MB)", &m_tiledMemoryBudget, 256, 8192);
+			ImGui::SliderInt("Guard Band (pixels)", &m_tileGuardBand, 0, 256);
+			ImGui::Text("%d x %d pixels in %d x %d tiles of %d x %d", viewportSize.x, viewportSize.y, m_tileCount.x, m_tileCount.y, m_framebufferSize.x, m_framebufferSize.y);
+		}
 
 		if (ImGui::CollapsingHeader("Lighting"))
 		{
@@ -489,11 +540,11 @@ void SphereRenderer::display()
 			ImGui::ColorEdit3("Diffuse", (float*)&diffuseMaterial);
 			ImGui::ColorEdit3("Specular", (float*)&specularMaterial);
 			ImGui::SliderFloat("Shininess", &shininess, 1.0f, 256.0f);
-			ImGui::Checkbox("Ambient Occlusion Enabled", &ambientOcclusion);
-			ImGui::Checkbox("Material Mapping Enabled", &materialMapping);
-			ImGui::Checkbox("Normal Mapping Enabled", &normalMapping);
-			ImGui::Checkbox("Environment Mapping Enabled", &environmentMapping);
-			ImGui::Checkbox("Depth of Field Enabled", &depthOfField);
+			ImGui::Checkbox("Ambient Occlusion Enabled", &m_ambientOcclusion);
+			ImGui::Checkbox("Material Mapping Enabled", &m_materialMapping);
+			ImGui::Checkbox("Normal Mapping Enabled", &m_normalMapping);
+			ImGui::Checkbox("Environment Mapping Enabled", &m_environmentMapping);
+			ImGui::Checkbox("Depth of Field Enabled", &m_depthOfField);
 		}
 
 		if (ImGui::CollapsingHeader("Surface"))
@@ -501,12 +552,33 @@ void SphereRenderer::display()
 			ImGui::SliderFloat("Sharpness", &sharpness, 0.5f, 16.0f);
 			ImGui::SliderFloat("Dist. Blending", &distanceBlending, 0.0f, 1.0f);
 			ImGui::SliderFloat("Dist. Scale", &distanceScale, 0.0f, 16.0f);
-			ImGui::Combo("Coloring", &coloring, "None\0Element\0Residue\0Chain\0");
+			ImGui::Combo("Coloring", &m_coloring, "None\0Element\0Residue\0Chain\0");
 			ImGui::Checkbox("Magic Lens", &lens);
+
+			if (m_fragmentShaderInterlock)
+				ImGui::Checkbox("Sort Lists During Generation", &m_sortedLists);
+
+			// procedural animation displaces the atoms in the vertex shader, so it always uses the geometry shader
+			ImGui::Checkbox("Compute Rasterization", &m_computeRasterization);
+
+			if (m_computeRasterization && !animate)
+				ImGui::Text("Tiles: %u sphere references", m_sphereRasterizer->entryCount());
+
+			ImGui::Text(m_tileCount == ivec2(1) ? "GPU Time: %.3f ms (spheres and surface)" : "GPU Time: %.3f ms (all tiles)", m_surfaceTime);
+			ImGui::Text("Intersections: %zu of %zu entries (%.0f MB)", m_intersectionCount, m_intersectionCapacity, double(m_intersectionCapacity * intersectionEntrySize) / double(1 << 20));
+
+			if (m_intersectionTiling)
+				ImGui::TextWrapped("The intersections do not fit into the largest buffer, the image is rendered in %d x %d tiles.", m_tileCount.x, m_tileCount.y);
+
+			if (m_intersectionOverflow)
+				ImGui::TextWrapped("The intersection buffer is at its maximum size, intersections are missing. Reduce the resolution scale.");
+
+			if (m_truncatedPixelCount > 0)
+				ImGui::TextWrapped("%u pixels with more than 128 intersections, up to %u", m_truncatedPixelCount, m_maximumListLength);
 		}
 
 
-		if (environmentMapping)
+		if (m_environmentMapping)
 		{
 			if (ImGui::CollapsingHeader("Environment Mapping"))
 			{
@@ -531,12 +603,12 @@ void SphereRenderer::display()
 					ImGui::ListBoxFooter();
 				}
 
-				ImGui::Checkbox("Use for Illumination", &environmentLighting);
+				ImGui::Checkbox("Use for Illumination", &m_environmentLighting);
 			}
 		}
 
 
-		if (materialMapping)
+		if (m_materialMapping)
 		{
 			if (ImGui::CollapsingHeader("Material Mapping"))
 			{
@@ -564,7 +636,7 @@ void SphereRenderer::display()
 		}
 
 
-		if (normalMapping)
+		if (m_normalMapping)
 		{
 			if (ImGui::CollapsingHeader("Normal Mapping"))
 			{
@@ -591,7 +663,7 @@ void SphereRenderer::display()
 			}
 		}
 
-		if (depthOfField)
+		if (m_depthOfField)
 		{
 			if (ImGui::CollapsingHeader("Depth of Field"))
 			{
@@ -608,6 +680,60 @@ void SphereRenderer::display()
 		focalLength = 1.0f / (tan(fieldOfView * 0.5f) * 2.0f);
 		aparture = focalLength / fStop;
 
+		if (ImGui::CollapsingHeader("Cell List"))
+		{
+			ImGui::Checkbox("Rebuild Every Frame", &m_rebuildCellList);
+			ImGui::SliderFloat("Cell Size", &m_cellListCellSize, 1.0f, 16.0f);
+			ImGui::Text("GPU Time: %.3f ms (%d x %d x %d cells)", m_cellListTime, m_cellList->cellCounts().x, m_cellList->cellCounts().y, m_cellList->cellCounts().z);
+		}
+
+		if (ImGui::CollapsingHeader("Culling"))
+		{
+			ImGui::Checkbox("Frustum Culling", &m_clusterCulling);
+			ImGui::Checkbox("Occlusion Culling", &m_occlusionCulling);
+
+			if (m_clusterCulling)
+				ImGui::Text("%u of %u clusters, %u atoms drawn", m_clusterCuller->visibleClusterCount(), m_clusterCuller->clusterCount(), m_clusterCuller->visibleAtomCount());
+		}
+
+		if (ImGui::CollapsingHeader("Selection"))
+		{
+			// an empty expression draws all atoms, an invalid one keeps the previous selection
+			if (ImGui::InputText("Expression", m_selectionExpression, sizeof(m_selectionExpression), ImGuiInputTextFlags_EnterReturnsTrue))
+			{
+				Selection selection;
+
+				if (std::string(m_selectionExpression).find_first_not_of(" \t") == std::string::npos || selection.compile(m_selectionExpression, *viewer()->scene()->protein()))
+				{
+					m_selection = std::move(selection);
+					m_selectionChanged = true;
+					m_selectionError.clear();
+				}
+				else
+				{
+					m_selectionError = selection.error();
+				}
+			}
+
+			if (!m_selectionError.empty())
+				ImGui::TextWrapped("%s", m_selectionError.c_str());
+			else if (m_selection.isValid())
+				ImGui::Text("%zu atoms selected", m_selectedIndices.size());
+		}
+
+		if (ImGui::CollapsingHeader("Picking"))
+		{
+			ImGui::Checkbox("Refit Every Timestep", &m_refitEveryTimestep);
+			ImGui::Text("Hierarchy: %zu nodes, last update %.3f ms, last pick %.1f us", m_bvh.nodeCount(), m_bvhTime, m_pickTime);
+
+			if (animate)
+				ImGui::Text("Picking is disabled during procedural animation");
+			else if (m_pickedAtom != Bvh::noHit)
+				ImGui::TextWrapped("%s", m_pickedAtomDescription.c_str());
+			else
+				ImGui::Text("Ctrl + left click to pick an atom");
+		}
+
 		if (ImGui::CollapsingHeader("Animation"))
 		{
 			ImGui::Checkbox("Prodecural Animation", &animate);
@@ -622,62 +748,189 @@ void SphereRenderer::display()
 	const float contributingAtoms = 32.0f;
 	const float radiusScale = sqrtf(log(contributingAtoms * exp(sharpness)) / sharpness);
 
+	// The compute rasterizer replaces the sphere and list generation passes. It produces all spheres at once, so the clusters
+	// are only culled against the view frustum, as occlusion culling needs the depth of the spheres of the previous frame first.
+	const bool rasterize = m_computeRasterization && !animate;
+
+	// the uniform blocks can only be indexed if the tables of the protein fit into them
+	const bool uniformTableLookups = m_uniformTables && m_uniformTableAttributes != nullptr;
+
 	// Properties for animation
-	const uint timestepCount = (uint)viewer()->scene()->protein()->atoms().size();
-	const float animationTime = animate ? float(glfwGetTime()) : -1.0f;
-	const float currentTime = glfwGetTime() * animationFrequency;
+	const uint timestepCount = (uint)viewer()->scene()->protein()->timestepCount();
+	const float animationTime = animate ? float(viewer()->time()) : -1.0f;
+	const float currentTime = viewer()->time() * animationFrequency;
 	const uint currentTimestep = uint(currentTime) % timestepCount;
 	const uint nextTimestep = (currentTimestep + 1) % timestepCount;
 	const float animationDelta = currentTime - floor(currentTime);
-	const int vertexCount = int(viewer()->scene()->protein()->atoms()[currentTimestep].size());
 
-	// Defines for enabling/disabling shader feature based on parameter setting
-	std::string defines = "";
+	// Copy the current timestep into the next slot of the ring buffer unless it is already resident. Until the stream
+	// has decoded it, the previously displayed timestep is kept, so playback never stalls on decoding.
+	std::size_t currentSlot = std::find(m_slotTimesteps.begin(), m_slotTimesteps.end(), currentTimestep) - m_slotTimesteps.begin();
 
-	if (animate)
-		defines += "#define ANIMATION\n";
+	if (currentSlot == timestepSlotCount)
+	{
+		const std::size_t nextSlot = (m_currentSlot + 1) % timestepSlotCount;
+		// a captured video shows every timestep it reaches, however long decoding takes
+		const bool wait = m_slotTimesteps[m_currentSlot] == std::numeric_limits<std::size_t>::max() || viewer()->isCapturing();
+
+		// The slot may only be overwritten once the GPU has finished reading it. The fence is only polled, a slot that is
+		// still in use keeps the previous timestep on screen for another frame unless the timestep has to be shown.
+		bool slotAvailable = true;
 
-	if (lens)
-		defines += "#define LENSING\n";
+		if (m_slotFences[nextSlot])
+		{
+			const GLenum result = m_slotFences[nextSlot]->clientWait(GL_SYNC_FLUSH_COMMANDS_BIT, wait ? std::numeric_limits<GLuint64>::max() : 0);
+			slotAvailable = result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
 
-	if (coloring > 0)
-		defines += "#define COLORING\n";
+			if (slotAvailable)
+				m_slotFences[nextSlot].reset();
+		}
 
-	if (ambientOcclusion)
-		defines += "#define AMBIENT\n";
+		if (slotAvailable && m_timestepStream->read(currentTimestep, m_timestepBufferData + nextSlot * m_timestepSlotSize * m_timestepElementSize, wait, &m_slotQuantizations[nextSlot]))
+		{
+			m_slotTimesteps[nextSlot] = currentTimestep;
+			currentSlot = nextSlot;
+		}
+		else
+		{
+			currentSlot = m_currentSlot;
+		}
+	}
+	else
+	{
+		m_timestepStream->seek(currentTimestep);
+	}
 
-	if (environmentMapping)
-		defines += "#define ENVIRONMENT\n";
+	m_currentSlot = currentSlot;
+	const int vertexCount = int(viewer()->scene()->protein()->atomCount(m_slotTimesteps[currentSlot]));
 
-	if (environmentMapping && environmentLighting)
-		defines += "#define ENVIRONMENTLIGHTING\n";
+	// Reevaluate the selection for the displayed timestep, all timesteps select the same atoms unless positions are involved
+	if (m_selection.isValid())
+	{
+		const Protein* protein = viewer()->scene()->protein();
+		const std::size_t selectionTimestep = m_slotTimesteps[currentSlot];
 
-	if (normalMapping)
-		defines += "#define NORMAL\n";
+		if (m_selectionChanged || (selectionTimestep != m_selectionTimestep && (m_selection.dependsOnPositions() || !protein->hasStaticAttributes())))
+		{
+			if (protein->hasStaticAttributes())
+			{
+				std::vector<vec3> positions;
+				protein->loadPositions(selectionTimestep, positions);
+				m_selection.evaluate(positions.data(), protein->staticAttributes().data(), positions.size(), m_selectedAtoms);
+			}
+			else
+			{
+				std::vector<vec4> atoms;
+				protein->loadTimestep(selectionTimestep, atoms);
+				m_selection.evaluate(atoms.data(), atoms.size(), m_selectedAtoms);
+			}
 
-	if (materialMapping)
-		defines += "#define MATERIAL\n";
+			m_selectedAtoms.indices(m_selectedIndices);
+			m_selectionIndices->setData(m_selectedIndices, GL_DYNAMIC_DRAW);
+			m_selectionTimestep = selectionTimestep;
+			m_selectionChanged = false;
+		}
+	}
+	else if (m_selectionChanged)
+	{
+		m_selectedIndices.clear();
+		m_selectionTimestep = std::numeric_limits<std::size_t>::max();
+		m_selectionChanged = false;
+	}
 
-	if (depthOfField)
-		defines += "#define DEPTHOFFIELD\n";
+	// Defines for enabling/disabling shader feature based on parameter setting
+	struct Option
+	{
+		const char* name;
+		bool enabled;
+		bool selectable;
+	};
+
+	const Option options[] = {
+		{ "ANIMATION", animate, true },
+		{ "LENSING", lens, true },
+		{ "COLORING", m_coloring > 0, true },
+		{ "SORTEDLISTS", m_sortedLists && m_fragmentShaderInterlock, m_fragmentShaderInterlock },
+		{ "AMBIENT", m_ambientOcclusion, true },
+		{ "ENVIRONMENT", m_environmentMapping, true },
+		{ "ENVIRONMENTLIGHTING", m_environmentMapping && m_environmentLighting, m_environmentMapping },
+		{ "NORMAL", m_normalMapping, true },
+		{ "MATERIAL", m_materialMapping, true },
+		{ "DEPTHOFFIELD", m_depthOfField, true },
+		{ "UNIFORMTABLES", uniformTableLookups, false }
+	};
+
+	// The permutations differing in a single option are the ones the next click in the interface selects
+	std::string defines = "";
+	std::vector<std::string> alternatives;
 
-	// Reload shaders if settings have changed
-	if (defines != m_shaderSourceDefines->string())
+	for (const Option& option : options)
 	{
-		m_shaderSourceDefines->setString(defines);
-		reloadShaders();
+		if (option.enabled)
+			defines += std::string("#define ") + option.name + "\n";
+
+		if (!option.selectable)
+			continue;
+
+		std::string alternative = "";
+
+		for (const Option& o : options)
+		{
+			if (o.enabled != (&o == &option))
+				alternative += std::string("#define ") + o.name + "\n";
+		}
+
+		alternatives.push_back(alternative);
 	}
 
+	// Programs are switched to the permutation for the defines, which is linked on first use unless it is cached
+	setShaderDefines(defines, alternatives);
+
+	// our shader programs
+	auto programSphere = shaderProgram("sphere");
+	auto programSpawn = shaderProgram("spawn");
+	auto programDepth = shaderProgram("depth");
+	auto programSurface = shaderProgram("surface");
+	auto programAOSample = shaderProgram("aosample");
+	auto programAOBlur = shaderProgram("aoblur");
+	auto programShade = shaderProgram("shade");
+	auto programDOFBlur = shaderProgram("dofblur");
+	auto programDOFBlend = shaderProgram("dofblend");
+	auto programDisplay = shaderProgram("display");
+	auto programShadow = shaderProgram("shadow");
+	auto programTransformFeedback = shaderProgram("transformfeedback");
+
 	// Read buffer from fluidsim
 	// Vertex binding setup
-	const globjects::Buffer *const buffer{m_vertices[currentTimestep].get()};
 	auto vertexBinding = m_vao->binding(0);
 	vertexBinding->setAttribute(0);
-	vertexBinding->setBuffer(buffer, 0, sizeof(vec4));
-	vertexBinding->setFormat(4, GL_FLOAT);
+	vertexBinding->setBuffer(m_timestepBuffer.get(), currentSlot * m_timestepSlotSize * m_timestepElementSize, GLsizei(m_timestepElementSize));
+
+	if (m_timestepStream->format() == TimestepStream::Format::QuantizedPositions)
+		vertexBinding->setFormat(4, GL_UNSIGNED_SHORT, GL_TRUE);
+	else if (m_timestepStream->format() == TimestepStream::Format::Positions)
+		vertexBinding->setFormat(3, GL_FLOAT);
+	else
+		vertexBinding->setFormat(4, GL_FLOAT);
+
 	m_vao->enable(0);
 
+	// the transform feedback pass decodes the positions and packs the static attributes back into w for the later passes
+	if (m_staticAttributes)
+	{
+		auto attributeBinding = m_vao->binding(1);
+		attributeBinding->setAttribute(1);
+		attributeBinding->setBuffer(uniformTableLookups ? m_uniformTableAttributes.get() : m_staticAttributes.get(), 0, sizeof(uint));
+		attributeBinding->setIFormat(1, GL_UNSIGNED_INT);
+		m_vao->enable(1);
+	}
+
+	programTransformFeedback->setUniform("positionOrigin", m_slotQuantizations[currentSlot].origin);
+	programTransformFeedback->setUniform("positionExtent", m_slotQuantizations[currentSlot].extent);
+	programTransformFeedback->setUniform("staticAttributes", m_staticAttributes != nullptr);
+
 
+	profiler->begin("transform feedback");
 	glEnable(GL_RASTERIZER_DISCARD);
 
 	m_transformedCoordinates->bindBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
@@ -692,16 +945,64 @@ void SphereRenderer::display()
 	m_transformFeedback->end();
 	m_transformFeedback->unbind();
 
+	m_slotFences[currentSlot] = Sync::fence(GL_SYNC_GPU_COMMANDS_COMPLETE);
+
 	glDisable(GL_RASTERIZER_DISCARD);
+	profiler->end();
+
+	// Pick the atom under the cursor when the left mouse button is pressed while holding Ctrl, from the transformed coordinates of this frame
+	const bool pickButtonPressed = glfwGetMouseButton(viewer()->window(), GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS &&
+		(glfwGetKey(viewer()->window(), GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS || glfwGetKey(viewer()->window(), GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS);
+
+	if (!animate)
+	{
+		if (pickButtonPressed && !m_pickButtonPressed && !ImGui::GetIO().WantCaptureMouse)
+			pickAtom(focusPosition, modelViewMatrix, projectionMatrix, m_slotTimesteps[currentSlot], std::size_t(vertexCount));
+		else if (m_refitEveryTimestep && m_bvhTimestep != std::numeric_limits<std::size_t>::max() && m_bvhTimestep != m_slotTimesteps[currentSlot])
+			updateBvh(m_slotTimesteps[currentSlot], std::size_t(vertexCount));
+	}
+	else
+	{
+		m_pickedAtom = Bvh::noHit;
+	}
+
+	m_pickButtonPressed = pickButtonPressed;
+
+	// The cell list is rebuilt from the transformed atoms, so it follows playback and animation
+	if (m_rebuildCellList)
+	{
+		if (!m_cellListTimerPending)
+			m_cellListTimer->begin(GL_TIME_ELAPSED);
+
+		const Profiler::Scope scope(profiler, "cell list");
+		const Protein* protein = viewer()->scene()->protein();
+		m_cellList->build(m_transformedCoordinates.get(), uint(vertexCount), protein->minimumBounds(), protein->maximumBounds(), m_cellListCellSize);
+
+		if (!m_cellListTimerPending)
+		{
+			m_cellListTimer->end(GL_TIME_ELAPSED);
+			m_cellListTimerPending = true;
+		}
+	}
+
+	if (m_cellListTimerPending && m_cellListTimer->resultAvailable())
+	{
+		m_cellListTime = double(m_cellListTimer->get64(GL_QUERY_RESULT)) / 1000000.0;
+		m_cellListTimerPending = false;
+	}
 
 	vertexBinding->setBuffer(m_transformedCoordinates.get(), 0, sizeof(glm::vec4));
+	vertexBinding->setFormat(4, GL_FLOAT);
+
+	if (m_staticAttributes)
+		m_vao->disable(1);
 
 	/* Used for interploation, which is not active
 	if (timestepCount > 0)
 	{
 		auto nextVertexBinding = m_vao->binding(1);
 		nextVertexBinding->setAttribute(1);
-		nextVertexBinding->setBuffer(m_vertices[nextTimestep].get(), 0, sizeof(vec4));
+		nextVertexBinding->setBuffer(m_timestepBuffer.get(), nextSlot * m_timestepSlotSize * sizeof(vec4), sizeof(vec4));
 		nextVertexBinding->setFormat(4, GL_FLOAT);
 		m_vao->enable(1);
 	}*/
@@ -752,395 +1053,735 @@ void SphereRenderer::display()
 	glViewport(0, 0, viewportSize.x, viewportSize.y);
 	*/
 	//////////////////////////////////////////////////////////////////////////
-	// Sphere rendering pass
+	// Tile layout
 	//////////////////////////////////////////////////////////////////////////
-	m_sphereFramebuffer->bind();
-	glClearDepth(1.0f);
-	glClearColor(0.0, 0.0, 0.0, 65535.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// In tiled mode, the image is rendered in tiles that share one set of textures and one intersection buffer, whose size is
+	// chosen to fit into the memory budget. Each tile is extended by a guard band, so that ambient occlusion and depth of field
+	// can sample beyond its border, and only its interior is copied into the image. Otherwise the whole image is a single tile,
+	// unless its entries do not fit into the largest intersection buffer.
+	readIntersectionCounts();
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
-
-	programSphere->setUniform("modelViewMatrix", modelViewMatrix);
-	programSphere->setUniform("projectionMatrix", projectionMatrix);
-	programSphere->setUniform("modelViewProjectionMatrix", modelViewProjectionMatrix);
-	programSphere->setUniform("inverseModelViewProjectionMatrix", inverseModelViewProjectionMatrix);
-	programSphere->setUniform("radiusScale", 1.0f);
-	programSphere->setUniform("clipRadiusScale", radiusScale);
-	programSphere->setUniform("nearPlaneZ", nearPlane.z);
-	programSphere->setUniform("animationDelta", animationDelta);
-	programSphere->setUniform("animationTime", animationTime);
-	programSphere->setUniform("animationAmplitude", animationAmplitude);
-	programSphere->setUniform("animationFrequency", animationFrequency);
+	ivec2 tileCount = ivec2(1);
+	ivec2 tileSize = viewportSize;
+	int guardBand = 0;
 
-	m_vao->bind();
-	programSphere->use();
-	m_vao->drawArrays(GL_POINTS, 0, vertexCount);
-	programSphere->release();
-	m_vao->unbind();
+	m_intersectionTiling = !m_tiledRendering && m_intersectionDensity * double(viewportSize.x) * double(viewportSize.y) > double(m_maximumIntersectionCapacity);
 
-	//////////////////////////////////////////////////////////////////////////
-	// List generation pass
-	//////////////////////////////////////////////////////////////////////////
-	const uint intersectionClearValue = 1;
-	m_intersectionBuffer->clearSubData(GL_R32UI, 0, sizeof(uint), GL_RED_INTEGER, GL_UNSIGNED_INT, &intersectionClearValue);
+	if (m_tiledRendering || m_intersectionTiling)
+	{
+		// the entries per pixel of the previous frame are rounded up to a power of two, so the tiles do not follow every small change
+		const double intersectionDensity = std::exp2(std::ceil(std::log2(std::max(m_intersectionDensity, 1.0))));
+		const double pixelSize = double(tilePixelSize) + intersectionDensity * double(intersectionEntrySize) * 1.25;
 
-	const uint offsetClearValue = 0;
-	m_offsetTexture->clearImage(0, GL_RED_INTEGER, GL_UNSIGNED_INT, &offsetClearValue);
+		// the entries of a tile also have to fit into the largest intersection buffer
+		const double pixelCount = std::min(double(m_tiledMemoryBudget) * double(1 << 20) / pixelSize, double(m_maximumIntersectionCapacity) / (intersectionDensity * 1.25));
+		const int extent = int(std::sqrt(pixelCount));
+		const int interior = std::max(extent - 2 * m_tileGuardBand, int(minimumTileSize));
 
-	glMemoryBarrier(GL_ALL_BARRIER_BITS);
+		tileCount = (viewportSize + interior - 1) / interior;
 
-	glDepthFunc(GL_ALWAYS);
-	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-	glDepthMask(GL_FALSE);
-
-	m_spherePositionTexture->bindActive(0);
-	m_offsetTexture->bindImageTexture(0, 0, false, 0, GL_READ_WRITE, GL_R32UI);
-	m_elementColorsRadii->bindBase(GL_UNIFORM_BUFFER, 0);
-	m_residueColors->bindBase(GL_UNIFORM_BUFFER, 1);
-	m_chainColors->bindBase(GL_UNIFORM_BUFFER, 2);
-
-	programSpawn->setUniform("modelViewMatrix", modelViewMatrix);
-	programSpawn->setUniform("projectionMatrix", projectionMatrix);
-	programSpawn->setUniform("modelViewProjectionMatrix", modelViewProjectionMatrix);
-	programSpawn->setUniform("inverseModelViewProjectionMatrix", inverseModelViewProjectionMatrix);
-	programSpawn->setUniform("radiusScale", radiusScale);
-	programSpawn->setUniform("clipRadiusScale", radiusScale);
-	programSpawn->setUniform("nearPlaneZ", nearPlane.z);
-	programSpawn->setUniform("animationDelta", animationDelta);
-	programSpawn->setUniform("animationTime", animationTime);
-	programSpawn->setUniform("animationAmplitude", animationAmplitude);
-	programSpawn->setUniform("animationFrequency", animationFrequency);
+		if (tileCount != ivec2(1))
+		{
+			tileSize = (viewportSize + tileCount - 1) / tileCount;
+			guardBand = m_tileGuardBand;
+		}
+	}
 
-	m_vao->bind();
-	programSpawn->use();
-	m_vao->drawArrays(GL_POINTS, 0, vertexCount);
-	programSpawn->release();
-	m_vao->unbind();
+	const ivec2 framebufferSize = tileSize + 2 * guardBand;
+
+	// Resize all FBOs if the tile size has changed
+	if (framebufferSize != m_framebufferSize)
+	{
+		m_framebufferSize = framebufferSize;
+		m_offsetTexture->image2D(0, GL_R32UI, m_framebufferSize, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+		m_depthTexture->image2D(0, GL_DEPTH_COMPONENT, m_framebufferSize, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, nullptr);
+		m_spherePositionTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_sphereNormalTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_surfacePositionTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_surfaceNormalTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_surfaceDiffuseTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_sphereDiffuseTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_ambientTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_blurTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_colorTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	}
 
+	// the tiles are copied into an image of the full size, which is only kept while rendering more than one tile
+	if (tileCount != ivec2(1))
+	{
+		if (!m_tiledFramebuffer || m_tiledImageSize != viewportSize)
+		{
+			m_tiledImageSize = viewportSize;
+
+			m_tiledColorTexture = Texture::create(GL_TEXTURE_2D);
+			m_tiledColorTexture->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			m_tiledColorTexture->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			m_tiledColorTexture->setParameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			m_tiledColorTexture->setParameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			m_tiledColorTexture->image2D(0, GL_RGBA8, m_tiledImageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+			m_tiledFramebuffer = Framebuffer::create();
+			m_tiledFramebuffer->attachTexture(GL_COLOR_ATTACHMENT0, m_tiledColorTexture.get());
+			m_tiledFramebuffer->setDrawBuffers({ GL_COLOR_ATTACHMENT0 });
+		}
+	}
+	else if (m_tiledFramebuffer)
+	{
+		m_tiledFramebuffer.reset();
+		m_tiledColorTexture.reset();
+		m_tiledImageSize = ivec2(0);
+	}
 
-	m_spherePositionTexture->unbindActive(0);
-	m_intersectionBuffer->unbind(GL_SHADER_STORAGE_BUFFER);
-	m_offsetTexture->unbindImageTexture(0);
+	m_tileCount = tileCount;
 
-	m_sphereFramebuffer->unbind();
-	glMemoryBarrier(GL_ALL_BARRIER_BITS);
+	// the entry counts of all tiles are read in a later frame, unless the GPU has not yet finished with any of the slots
+	if (std::size_t(tileCount.x * tileCount.y) + 2 > m_intersectionReadbackSlotSize)
+		resizeIntersectionReadback(tileCount.x * tileCount.y);
 
-	//////////////////////////////////////////////////////////////////////////
-	// Surface intersection pass
-	//////////////////////////////////////////////////////////////////////////
-	m_surfaceFramebuffer->bind();
-	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-	glDepthMask(GL_TRUE);
+	const bool intersectionReadback = !m_readbackFences[m_currentReadbackSlot];
+	const std::size_t intersectionReadbackOffset = (1 + m_currentReadbackSlot * m_intersectionReadbackSlotSize) * sizeof(uint);
 
-	glClearDepth(1.0f);
-	glClearColor(0.0f, 0.0f, 0.0f, 65535.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// the timer covers all tiles, it is only started if the result of the previous one has been read
+	const bool surfaceTimer = !m_surfaceTimerPending;
 
-	m_spherePositionTexture->bindActive(0);
-	m_sphereNormalTexture->bindActive(1);
-	m_offsetTexture->bindActive(3);
-	m_environmentTextures[environmentTextureIndex]->bindActive(4);
-	m_bumpTextures[bumpTextureIndex]->bindActive(5);
-	m_materialTextures[materialTextureIndex]->bindActive(6);
-	m_intersectionBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
-	m_statisticsBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
-
-	programSurface->setUniform("modelViewMatrix", modelViewMatrix);
-	programSurface->setUniform("projectionMatrix", projectionMatrix);
-	programSurface->setUniform("modelViewProjectionMatrix", modelViewProjectionMatrix);
-	programSurface->setUniform("inverseModelViewProjectionMatrix", inverseModelViewProjectionMatrix);
-	programSurface->setUniform("normalMatrix", normalMatrix);
-	programSurface->setUniform("lightPosition", vec3(worldLightPosition));
-	programSurface->setUniform("ambientMaterial", ambientMaterial);
-	programSurface->setUniform("diffuseMaterial", diffuseMaterial);
-	programSurface->setUniform("specularMaterial", specularMaterial);
-	programSurface->setUniform("shininess", shininess);
-	programSurface->setUniform("focusPosition", focusPosition);
-	programSurface->setUniform("positionTexture", 0);
-	programSurface->setUniform("normalTexture", 1);
-	programSurface->setUniform("offsetTexture", 3);
-	programSurface->setUniform("environmentTexture", 4);
-	programSurface->setUniform("bumpTexture", 5);
-	programSurface->setUniform("materialTexture", 6);
-	programSurface->setUniform("sharpness", sharpness);
-	programSurface->setUniform("coloring", uint(coloring));
-	programSurface->setUniform("environment", environmentMapping);
-	programSurface->setUniform("lens", lens);
-
-	m_vaoQuad->bind();
-	programSurface->use();
-	m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
-	programSurface->release();
-	m_vaoQuad->unbind();
+	for (int tile = 0; tile < tileCount.x * tileCount.y; tile++)
+	{
+		const ivec2 tileOrigin = ivec2(tile % tileCount.x, tile / tileCount.x) * tileSize;
+		const ivec2 framebufferOrigin = tileOrigin - guardBand;
 
-	m_intersectionBuffer->unbind(GL_SHADER_STORAGE_BUFFER);
+		// The projection is narrowed to the part of the image covered by the framebuffer, which leaves the depth unchanged
+		const vec2 tileScale = vec2(viewportSize) / vec2(m_framebufferSize);
+		const vec2 tileOffset = (vec2(viewportSize) - 2.0f * vec2(framebufferOrigin)) / vec2(m_framebufferSize) - 1.0f;
 
-	m_materialTextures[materialTextureIndex]->unbindActive(6);
-	m_bumpTextures[bumpTextureIndex]->unbindActive(5);
-	m_environmentTextures[environmentTextureIndex]->unbindActive(4);
-	m_offsetTexture->unbindActive(3);
-	m_sphereNormalTexture->unbindActive(1);
-	m_spherePositionTexture->unbindActive(0);
+		mat4 tileMatrix = mat4(1.0f);
+		tileMatrix[0][0] = tileScale.x;
+		tileMatrix[1][1] = tileScale.y;
+		tileMatrix[3] = vec4(tileOffset, 0.0f, 1.0f);
 
-	m_chainColors->unbind(GL_UNIFORM_BUFFER);
-	m_residueColors->unbind(GL_UNIFORM_BUFFER);
-	m_elementColorsRadii->unbind(GL_UNIFORM_BUFFER);
+		const mat4 tileProjectionMatrix = tileMatrix * projectionMatrix;
+		const mat4 tileModelViewProjectionMatrix = tileMatrix * modelViewProjectionMatrix;
+		const mat4 tileInverseModelViewProjectionMatrix = inverse(tileModelViewProjectionMatrix);
 
-	m_surfaceFramebuffer->unbind();
+		// maps normalized device coordinates of the tile to those of the image, for the magic lens around the cursor
+		const vec4 tileTransform(1.0f / tileScale, -tileOffset / tileScale);
 
+		const vec4 projectionInfo(float(-2.0 / (m_framebufferSize.x * tileProjectionMatrix[0][0])),
+			float(-2.0 / (m_framebufferSize.y * tileProjectionMatrix[1][1])),
+			float((1.0 - (double)tileProjectionMatrix[2][0]) / tileProjectionMatrix[0][0]),
+			float((1.0 - (double)tileProjectionMatrix[2][1]) / tileProjectionMatrix[1][1]));
+
+		glViewport(0, 0, m_framebufferSize.x, m_framebufferSize.y);
 
-	//////////////////////////////////////////////////////////////////////////
-	// Ambient occlusion (optional)
-	//////////////////////////////////////////////////////////////////////////
-	if (ambientOcclusion)
-	{
 		//////////////////////////////////////////////////////////////////////////
-		// Ambient occlusion sampling
+		// Sphere rendering pass
 		//////////////////////////////////////////////////////////////////////////
-		m_aoFramebuffer->bind();
+		if (tile == 0 && surfaceTimer)
+			m_surfaceTimer->begin(GL_TIME_ELAPSED);
 
-		programAOSample->setUniform("projectionInfo", projectionInfo);
-		programAOSample->setUniform("projectionScale", projectionScale);
-		programAOSample->setUniform("viewLightPosition", viewLightPosition);
-		programAOSample->setUniform("surfaceNormalTexture", 0);
+		profiler->begin("sphere");
+		m_elementColorsRadii->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
 
-		m_surfaceNormalTexture->bindActive(0);
+		// the culling and rasterization compute shaders always read the elements from the storage buffer
+		if (uniformTableLookups)
+		{
+			m_elementColorsRadii->bindBase(GL_UNIFORM_BUFFER, 0);
+			m_residueColors->bindBase(GL_UNIFORM_BUFFER, 1);
+			m_chainColors->bindBase(GL_UNIFORM_BUFFER, 2);
+		}
 
-		m_vaoQuad->bind();
-		programAOSample->use();
-		m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
-		programAOSample->release();
-		m_vaoQuad->unbind();
+		// Clusters of atoms outside of the view or hidden behind the spheres are skipped, the others are gathered for indirect draws
+		if (m_clusterCulling)
+		{
+			const bool selection = m_selection.isValid();
+			const uint atomCount = selection ? uint(m_selectedIndices.size()) : uint(vertexCount);
+			const float margin = animate ? animationAmplitude : 0.0f;
+
+			m_clusterCuller->cullPreviouslyVisible(m_transformedCoordinates.get(), selection ? m_selectionIndices.get() : nullptr, atomCount, m_elementColorsRadii.get(),
+				std::max(radiusScale, 1.0f), margin, tileModelViewProjectionMatrix, m_occlusionCulling && !rasterize);
 
-		m_aoFramebuffer->unbind();
+			vertexBinding->setBuffer(m_clusterCuller->visibleAtoms(), 0, sizeof(glm::vec4));
+		}
 
+		m_sphereFramebuffer->bind();
+		glClearDepth(1.0f);
+		glClearColor(0.0, 0.0, 0.0, 65535.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		//////////////////////////////////////////////////////////////////////////
-		// Ambient occlusion blurring -- horizontal
-		//////////////////////////////////////////////////////////////////////////
-		m_aoBlurFramebuffer->bind();
-		programAOBlur->setUniform("normalTexture", 0);
-		programAOBlur->setUniform("ambientTexture", 1);
-		programAOBlur->setUniform("offset", vec2(1.0f / float(viewportSize.x), 0.0f));
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LESS);
+
+		programSphere->setUniform("modelViewMatrix", modelViewMatrix);
+		programSphere->setUniform("projectionMatrix", tileProjectionMatrix);
+		programSphere->setUniform("modelViewProjectionMatrix", tileModelViewProjectionMatrix);
+		programSphere->setUniform("inverseModelViewProjectionMatrix", tileInverseModelViewProjectionMatrix);
+		programSphere->setUniform("radiusScale", 1.0f);
+		programSphere->setUniform("clipRadiusScale", radiusScale);
+		programSphere->setUniform("nearPlaneZ", nearPlane.z);
+		programSphere->setUniform("animationDelta", animationDelta);
+		programSphere->setUniform("animationTime", animationTime);
+		programSphere->setUniform("animationAmplitude", animationAmplitude);
+		programSphere->setUniform("animationFrequency", animationFrequency);
+
+		// the spheres of the compute rasterizer are produced together with the lists below
+		if (!rasterize)
+		{
+			m_vao->bind();
+			programSphere->use();
 
-		m_ambientTexture->bindActive(1);
+			if (m_clusterCulling)
+			{
+				m_clusterCuller->commands()->bind(GL_DRAW_INDIRECT_BUFFER);
+				m_vao->drawArraysIndirect(GL_POINTS, ClusterCuller::previouslyVisibleCommand());
 
-		m_vaoQuad->bind();
-		programAOBlur->use();
-		m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
-		programAOBlur->release();
-		m_vaoQuad->unbind();
+				// the clusters that were hidden in the previous frame are tested against the depth of those drawn so far
+				if (m_occlusionCulling)
+				{
+					programSphere->release();
+					m_vao->unbind();
+					m_sphereFramebuffer->unbind();
 
-		m_ambientTexture->unbindActive(1);
-		m_aoBlurFramebuffer->unbind();
+					m_clusterCuller->cullNewlyVisible(m_depthTexture.get(), m_framebufferSize, tileModelViewProjectionMatrix);
 
+					m_sphereFramebuffer->bind();
+					m_vao->bind();
+					programSphere->use();
 
-		//////////////////////////////////////////////////////////////////////////
-		// Ambient occlusion blurring -- vertical
-		//////////////////////////////////////////////////////////////////////////
-		m_aoFramebuffer->bind();
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		programAOBlur->setUniform("offset", vec2(0.0f, 1.0f / float(viewportSize.y)));
+					m_clusterCuller->commands()->bind(GL_DRAW_INDIRECT_BUFFER);
+					m_vao->drawArraysIndirect(GL_POINTS, ClusterCuller::newlyVisibleCommand());
+				}
 
-		m_blurTexture->bindActive(1);
+				m_clusterCuller->commands()->unbind(GL_DRAW_INDIRECT_BUFFER);
+			}
+			else if (m_selection.isValid())
+			{
+				m_vao->bindElementBuffer(m_selectionIndices.get());
+				m_vao->drawElements(GL_POINTS, GLsizei(m_selectedIndices.size()), GL_UNSIGNED_INT, nullptr);
+			}
+			else
+			{
+				m_vao->drawArrays(GL_POINTS, 0, vertexCount);
+			}
 
-		m_vaoQuad->bind();
-		programAOBlur->use();
-		m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
-		programAOBlur->release();
-		m_vaoQuad->unbind();
+			programSphere->release();
+			m_vao->unbind();
+		}
 
-		m_blurTexture->unbindActive(1);
-		m_surfaceNormalTexture->unbindActive(0);
+		profiler->end();
 
-		m_aoFramebuffer->unbind();
-	}
+		m_residueColors->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+		m_chainColors->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+		m_groups->bindBase(GL_SHADER_STORAGE_BUFFER, 6);
 
-	//////////////////////////////////////////////////////////////////////////
-	// Shading
-	//////////////////////////////////////////////////////////////////////////
-	m_shadeFramebuffer->bind();
-	glDepthMask(GL_FALSE);
-
-	m_spherePositionTexture->bindActive(0);
-	m_sphereNormalTexture->bindActive(1);
-	m_sphereDiffuseTexture->bindActive(2);
-	m_surfacePositionTexture->bindActive(3);
-	m_surfaceNormalTexture->bindActive(4);
-	m_surfaceDiffuseTexture->bindActive(5);
-	m_depthTexture->bindActive(6);
-	m_ambientTexture->bindActive(7);
-	m_materialTextures[materialTextureIndex]->bindActive(8);
-	m_environmentTextures[environmentTextureIndex]->bindActive(9);
-	m_shadowColorTexture->bindActive(10);
-	m_shadowDepthTexture->bindActive(11);
-
-	programShade->setUniform("modelViewMatrix", modelViewMatrix);
-	programShade->setUniform("projectionMatrix", projectionMatrix);
-	programShade->setUniform("modelViewProjection", modelViewProjectionMatrix);
-	programShade->setUniform("inverseModelViewProjectionMatrix", inverseModelViewProjectionMatrix);
-	programShade->setUniform("normalMatrix", normalMatrix);
-	programShade->setUniform("inverseNormalMatrix", inverseNormalMatrix);
-	programShade->setUniform("modelLightMatrix", modelLightMatrix);
-	programShade->setUniform("modelLightProjectionMatrix", modelLightProjectionMatrix);
-	programShade->setUniform("lightPosition", vec3(worldLightPosition));
-	programShade->setUniform("ambientMaterial", ambientMaterial);
-	programShade->setUniform("diffuseMaterial", diffuseMaterial);
-	programShade->setUniform("specularMaterial", specularMaterial);
-	programShade->setUniform("distanceBlending", distanceBlending);
-	programShade->setUniform("distanceScale", distanceScale);
-	programShade->setUniform("shininess", shininess);
-	programShade->setUniform("focusPosition", focusPosition);
-	programShade->setUniform("objectCenter", objectCenter);
-	programShade->setUniform("objectRadius", objectRadius);
-
-	programShade->setUniform("spherePositionTexture", 0);
-	programShade->setUniform("sphereNormalTexture", 1);
-	programShade->setUniform("sphereDiffuseTexture", 2);
-
-	programShade->setUniform("surfacePositionTexture", 3);
-	programShade->setUniform("surfaceNormalTexture", 4);
-	programShade->setUniform("surfaceDiffuseTexture", 5);
-
-	programShade->setUniform("depthTexture", 6);
-	programShade->setUniform("ambientTexture", 7);
-	programShade->setUniform("materialTexture", 8);
-	programShade->setUniform("environmentTexture", 9);
-	programShade->setUniform("shadowColorTexture", 10);
-	programShade->setUniform("shadowDepthTexture", 11);
-
-	programShade->setUniform("environment", environmentMapping);
-	programShade->setUniform("maximumCoCRadius", maximumCoCRadius);
-	programShade->setUniform("aparture", aparture);
-	programShade->setUniform("focalDistance", focalDistance);
-	programShade->setUniform("focalLength", focalLength);
-	programShade->setUniform("backgroundColor", viewer()->backgroundColor());
-
-
-	m_vaoQuad->bind();
-	programShade->use();
-	m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
-	programShade->release();
-	m_vaoQuad->unbind();
+		// The list generation and surface passes are repeated with a larger intersection buffer if the lists did not fit
+		bool intersectionRetry = false;
+
+		do
+		{
+			//////////////////////////////////////////////////////////////////////////
+			// List generation pass
+			//////////////////////////////////////////////////////////////////////////
+			profiler->begin("spawn");
+			m_sphereFramebuffer->bind();
 
-	m_shadowDepthTexture->unbindActive(11);
-	m_shadowColorTexture->unbindActive(10);
-	m_environmentTextures[environmentTextureIndex]->unbindActive(9);
-	m_materialTextures[materialTextureIndex]->unbindActive(8);
-	m_ambientTexture->unbindActive(7);
-	m_depthTexture->unbindActive(6);
-	m_surfaceDiffuseTexture->unbindActive(5);
-	m_surfaceNormalTexture->unbindActive(4);
-	m_surfacePositionTexture->unbindActive(3);
-	m_sphereDiffuseTexture->unbindActive(2);
-	m_sphereNormalTexture->unbindActive(1);
-	m_spherePositionTexture->unbindActive(0);
+			// the statistics of the previous surface pass are copied before they are reset, so they are complete when read
+			if (intersectionReadback && !intersectionRetry)
+				m_statisticsBuffer->copySubData(m_intersectionReadback.get(), 0, intersectionReadbackOffset, 2 * sizeof(uint));
 
-	m_shadeFramebuffer->unbind();
+			const uint statisticsClearValue = 0;
+			m_statisticsBuffer->clearSubData(GL_R32UI, 0, 2 * sizeof(uint), GL_RED_INTEGER, GL_UNSIGNED_INT, &statisticsClearValue);
 
+			// the first entry is not used, as an offset of zero ends a list
+			const uint intersectionClearValue = 1;
+			m_intersectionBuffer->clearSubData(GL_R32UI, 0, sizeof(uint), GL_RED_INTEGER, GL_UNSIGNED_INT, &intersectionClearValue);
 
-	//////////////////////////////////////////////////////////////////////////
-	// Depth of field (optional)
-	//////////////////////////////////////////////////////////////////////////
-	if (depthOfField)
-	{
-		//////////////////////////////////////////////////////////////////////////
-		// Depth of field blurring -- horizontal
-		//////////////////////////////////////////////////////////////////////////
-		m_dofBlurFramebuffer->bind();
+			const uint offsetClearValue = 0;
+			m_offsetTexture->clearImage(0, GL_RED_INTEGER, GL_UNSIGNED_INT, &offsetClearValue);
 
-		m_colorTexture->bindActive(0);
-		m_colorTexture->bindActive(1);
+			glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
-		programDOFBlur->setUniform("maximumCoCRadius", maximumCoCRadius);
-		programDOFBlur->setUniform("aparture", aparture);
-		programDOFBlur->setUniform("focalDistance", focalDistance);
-		programDOFBlur->setUniform("focalLength", focalLength);
+			if (rasterize)
+			{
+				// with culling, the count only bounds the visible atoms, whose number the rasterizer reads from the commands
+				const bool selection = m_selection.isValid();
+				const uint atomCount = selection ? uint(m_selectedIndices.size()) : uint(vertexCount);
+				Buffer* atoms = m_clusterCulling ? m_clusterCuller->visibleAtoms() : m_transformedCoordinates.get();
+				Buffer* indices = (selection && !m_clusterCulling) ? m_selectionIndices.get() : nullptr;
+				Buffer* commands = m_clusterCulling ? m_clusterCuller->commands() : nullptr;
 
-		programDOFBlur->setUniform("uMaxCoCRadiusPixels", (int)round(maximumCoCRadius));
-		programDOFBlur->setUniform("uNearBlurRadiusPixels", (int)round(maximumCoCRadius));
-		programDOFBlur->setUniform("uInvNearBlurRadiusPixels", 1.0f / maximumCoCRadius);
-		programDOFBlur->setUniform("horizontal", true);
-		programDOFBlur->setUniform("nearTexture", 0);
-		programDOFBlur->setUniform("blurTexture", 1);
+				m_sphereFramebuffer->unbind();
 
-		m_vaoQuad->bind();
-		programDOFBlur->use();
-		m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
-		programDOFBlur->release();
-		m_vaoQuad->unbind();
+				m_sphereRasterizer->rasterize(atoms, indices, atomCount, commands, m_elementColorsRadii.get(), radiusScale, nearPlane.z, modelViewMatrix, tileProjectionMatrix, m_framebufferSize,
+					m_offsetTexture.get(), m_spherePositionTexture.get(), m_sphereNormalTexture.get(), m_intersectionBuffer.get(), uint(m_intersectionCapacity));
 
-		m_colorTexture->unbindActive(1);
-		m_colorTexture->unbindActive(0);
-		m_dofBlurFramebuffer->unbind();
+				// the depth of the closest spheres is needed by the later passes like after the sphere pass
+				m_sphereFramebuffer->bind();
+				glDepthFunc(GL_ALWAYS);
+				glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				glDepthMask(GL_TRUE);
 
+				m_spherePositionTexture->bindActive(0);
 
-		//////////////////////////////////////////////////////////////////////////
-		// Depth of field blurring -- vertical
-		//////////////////////////////////////////////////////////////////////////
-		m_dofFramebuffer->bind();
+				programDepth->setUniform("modelViewProjectionMatrix", tileModelViewProjectionMatrix);
+				programDepth->setUniform("positionTexture", 0);
 
-		m_sphereNormalTexture->bindActive(0);
-		m_surfaceNormalTexture->bindActive(1);
-		programDOFBlur->setUniform("horizontal", false);
-		programDOFBlur->setUniform("nearTexture", 0);
-		programDOFBlur->setUniform("blurTexture", 1);
+				m_vaoQuad->bind();
+				programDepth->use();
+				m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
+				programDepth->release();
+				m_vaoQuad->unbind();
 
-		m_vaoQuad->bind();
-		programDOFBlur->use();
-		m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
-		programDOFBlur->release();
-		m_vaoQuad->unbind();
+				m_spherePositionTexture->unbindActive(0);
+			}
+			else
+			{
+				glDepthFunc(GL_ALWAYS);
+				glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				glDepthMask(GL_FALSE);
+
+				m_spherePositionTexture->bindActive(0);
+				m_offsetTexture->bindImageTexture(0, 0, false, 0, GL_READ_WRITE, GL_R32UI);
+				m_intersectionBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+
+				programSpawn->setUniform("modelViewMatrix", modelViewMatrix);
+				programSpawn->setUniform("projectionMatrix", tileProjectionMatrix);
+				programSpawn->setUniform("modelViewProjectionMatrix", tileModelViewProjectionMatrix);
+				programSpawn->setUniform("inverseModelViewProjectionMatrix", tileInverseModelViewProjectionMatrix);
+				programSpawn->setUniform("radiusScale", radiusScale);
+				programSpawn->setUniform("clipRadiusScale", radiusScale);
+				programSpawn->setUniform("nearPlaneZ", nearPlane.z);
+				programSpawn->setUniform("animationDelta", animationDelta);
+				programSpawn->setUniform("animationTime", animationTime);
+				programSpawn->setUniform("animationAmplitude", animationAmplitude);
+				programSpawn->setUniform("animationFrequency", animationFrequency);
+				programSpawn->setUniform("intersectionCapacity", uint(m_intersectionCapacity));
+
+				m_vao->bind();
+				programSpawn->use();
+
+				// the list generation pass draws the atoms of both phases, which are consecutive in the buffer of visible atoms
+				if (m_clusterCulling)
+				{
+					m_clusterCuller->commands()->bind(GL_DRAW_INDIRECT_BUFFER);
+					m_vao->multiDrawArraysIndirect(GL_POINTS, ClusterCuller::previouslyVisibleCommand(), 2);
+					m_clusterCuller->commands()->unbind(GL_DRAW_INDIRECT_BUFFER);
+				}
+				else if (m_selection.isValid())
+				{
+					m_vao->bindElementBuffer(m_selectionIndices.get());
+					m_vao->drawElements(GL_POINTS, GLsizei(m_selectedIndices.size()), GL_UNSIGNED_INT, nullptr);
+				}
+				else
+				{
+					m_vao->drawArrays(GL_POINTS, 0, vertexCount);
+				}
+
+				programSpawn->release();
+				m_vao->unbind();
+
+				m_spherePositionTexture->unbindActive(0);
+				m_intersectionBuffer->unbind(GL_SHADER_STORAGE_BUFFER);
+				m_offsetTexture->unbindImageTexture(0);
+			}
+
+			m_sphereFramebuffer->unbind();
+			glMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+			if (intersectionReadback)
+				m_intersectionBuffer->copySubData(m_intersectionReadback.get(), 0, intersectionReadbackOffset + (2 + tile) * sizeof(uint), sizeof(uint));
 
-		m_surfaceNormalTexture->unbindActive(1);
-		m_sphereNormalTexture->unbindActive(0);
+			// after the lists of a frame did not fit, the count is also copied to the first element to be checked right away
+			std::unique_ptr<Sync> intersectionFence;
 
-		m_dofFramebuffer->unbind();
+			if (m_intersectionVerify)
+			{
+				m_intersectionBuffer->copySubData(m_intersectionReadback.get(), 0, 0, sizeof(uint));
+				intersectionFence = Sync::fence(GL_SYNC_GPU_COMMANDS_COMPLETE);
+			}
+
+			profiler->end();
+
+			//////////////////////////////////////////////////////////////////////////
+			// Surface intersection pass
+			//////////////////////////////////////////////////////////////////////////
+			profiler->begin("surface");
+			m_surfaceFramebuffer->bind();
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthMask(GL_TRUE);
+
+			glClearDepth(1.0f);
+			glClearColor(0.0f, 0.0f, 0.0f, 65535.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			m_spherePositionTexture->bindActive(0);
+			m_sphereNormalTexture->bindActive(1);
+			m_offsetTexture->bindActive(3);
+			m_environmentTextures[environmentTextureIndex]->bindActive(4);
+			m_bumpTextures[bumpTextureIndex]->bindActive(5);
+			m_materialTextures[materialTextureIndex]->bindActive(6);
+			m_intersectionBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+			m_statisticsBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+
+			programSurface->setUniform("modelViewMatrix", modelViewMatrix);
+			programSurface->setUniform("projectionMatrix", tileProjectionMatrix);
+			programSurface->setUniform("modelViewProjectionMatrix", tileModelViewProjectionMatrix);
+			programSurface->setUniform("inverseModelViewProjectionMatrix", tileInverseModelViewProjectionMatrix);
+			programSurface->setUniform("normalMatrix", normalMatrix);
+			programSurface->setUniform("lightPosition", vec3(worldLightPosition));
+			programSurface->setUniform("ambientMaterial", ambientMaterial);
+			programSurface->setUniform("diffuseMaterial", diffuseMaterial);
+			programSurface->setUniform("specularMaterial", specularMaterial);
+			programSurface->setUniform("shininess", shininess);
+			programSurface->setUniform("focusPosition", focusPosition);
+			programSurface->setUniform("tileTransform", tileTransform);
+			programSurface->setUniform("positionTexture", 0);
+			programSurface->setUniform("normalTexture", 1);
+			programSurface->setUniform("offsetTexture", 3);
+			programSurface->setUniform("environmentTexture", 4);
+			programSurface->setUniform("bumpTexture", 5);
+			programSurface->setUniform("materialTexture", 6);
+			programSurface->setUniform("sharpness", sharpness);
+			programSurface->setUniform("coloring", uint(m_coloring));
+			programSurface->setUniform("environment", m_environmentMapping);
+			programSurface->setUniform("lens", lens);
+
+			m_vaoQuad->bind();
+			programSurface->use();
+			m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
+			programSurface->release();
+			m_vaoQuad->unbind();
+
+			m_intersectionBuffer->unbind(GL_SHADER_STORAGE_BUFFER);
+
+			m_materialTextures[materialTextureIndex]->unbindActive(6);
+			m_bumpTextures[bumpTextureIndex]->unbindActive(5);
+			m_environmentTextures[environmentTextureIndex]->unbindActive(4);
+			m_offsetTexture->unbindActive(3);
+			m_sphereNormalTexture->unbindActive(1);
+			m_spherePositionTexture->unbindActive(0);
+
+			m_groups->unbind(GL_SHADER_STORAGE_BUFFER);
+			m_chainColors->unbind(GL_SHADER_STORAGE_BUFFER);
+			m_residueColors->unbind(GL_SHADER_STORAGE_BUFFER);
+			m_elementColorsRadii->unbind(GL_SHADER_STORAGE_BUFFER);
+
+			if (uniformTableLookups)
+			{
+				m_chainColors->unbind(GL_UNIFORM_BUFFER);
+				m_residueColors->unbind(GL_UNIFORM_BUFFER);
+				m_elementColorsRadii->unbind(GL_UNIFORM_BUFFER);
+			}
+
+			m_surfaceFramebuffer->unbind();
+			profiler->end();
+
+			// The surface pass is issued before waiting for the entry count, so the GPU keeps working in the meantime
+			if (intersectionFence)
+			{
+				intersectionFence->clientWait(GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+				intersectionRetry = updateIntersectionCapacity(m_intersectionReadbackData[0]);
+			}
+		}
+		while (intersectionRetry);
+
+		// the result is read in a later frame to avoid stalling the pipeline
+		if (tile == tileCount.x * tileCount.y - 1 && surfaceTimer)
+		{
+			m_surfaceTimer->end(GL_TIME_ELAPSED);
+			m_surfaceTimerPending = true;
+		}
+
+		if (m_surfaceTimerPending && m_surfaceTimer->resultAvailable())
+		{
+			m_surfaceTime = double(m_surfaceTimer->get64(GL_QUERY_RESULT)) / 1000000.0;
+			m_surfaceTimerPending = false;
+		}
 
 
 		//////////////////////////////////////////////////////////////////////////
-		// Depth of field blending
+		// Ambient occlusion (optional)
 		//////////////////////////////////////////////////////////////////////////
-		m_shadeFramebuffer->bind();
-
-		m_colorTexture->bindActive(0);
-		m_sphereDiffuseTexture->bindActive(1);
-		m_surfaceDiffuseTexture->bindActive(2);
+		if (m_ambientOcclusion)
+		{
+			//////////////////////////////////////////////////////////////////////////
+			// Ambient occlusion sampling
+			//////////////////////////////////////////////////////////////////////////
+			profiler->begin("ao sample");
+			m_aoFramebuffer->bind();
+
+			programAOSample->setUniform("projectionInfo", projectionInfo);
+			programAOSample->setUniform("projectionScale", projectionScale);
+			programAOSample->setUniform("viewLightPosition", viewLightPosition);
+			programAOSample->setUniform("surfaceNormalTexture", 0);
+
+			m_surfaceNormalTexture->bindActive(0);
+
+			m_vaoQuad->bind();
+			programAOSample->use();
+			m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
+			programAOSample->release();
+			m_vaoQuad->unbind();
+
+			m_aoFramebuffer->unbind();
+			profiler->end();
+
+
+			//////////////////////////////////////////////////////////////////////////
+			// Ambient occlusion blurring -- horizontal
+			//////////////////////////////////////////////////////////////////////////
+			profiler->begin("ao blur");
+			m_aoBlurFramebuffer->bind();
+			programAOBlur->setUniform("normalTexture", 0);
+			programAOBlur->setUniform("ambientTexture", 1);
+			programAOBlur->setUniform("offset", vec2(1.0f / float(m_framebufferSize.x), 0.0f));
+
+			m_ambientTexture->bindActive(1);
+
+			m_vaoQuad->bind();
+			programAOBlur->use();
+			m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
+			programAOBlur->release();
+			m_vaoQuad->unbind();
+
+			m_ambientTexture->unbindActive(1);
+			m_aoBlurFramebuffer->unbind();
+
+
+			//////////////////////////////////////////////////////////////////////////
+			// Ambient occlusion blurring -- vertical
+			//////////////////////////////////////////////////////////////////////////
+			m_aoFramebuffer->bind();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			programAOBlur->setUniform("offset", vec2(0.0f, 1.0f / float(m_framebufferSize.y)));
+
+			m_blurTexture->bindActive(1);
+
+			m_vaoQuad->bind();
+			programAOBlur->use();
+			m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
+			programAOBlur->release();
+			m_vaoQuad->unbind();
+
+			m_blurTexture->unbindActive(1);
+			m_surfaceNormalTexture->unbindActive(0);
+
+			m_aoFramebuffer->unbind();
+			profiler->end();
+		}
 
-		programDOFBlend->setUniform("maximumCoCRadius", maximumCoCRadius);
-		programDOFBlend->setUniform("aparture", aparture);
-		programDOFBlend->setUniform("focalDistance", focalDistance);
-		programDOFBlend->setUniform("focalLength", focalLength);
+		//////////////////////////////////////////////////////////////////////////
+		// Shading
+		//////////////////////////////////////////////////////////////////////////
+		profiler->begin("shade");
+		m_shadeFramebuffer->bind();
+		glDepthMask(GL_FALSE);
+
+		m_spherePositionTexture->bindActive(0);
+		m_sphereNormalTexture->bindActive(1);
+		m_sphereDiffuseTexture->bindActive(2);
+		m_surfacePositionTexture->bindActive(3);
+		m_surfaceNormalTexture->bindActive(4);
+		m_surfaceDiffuseTexture->bindActive(5);
+		m_depthTexture->bindActive(6);
+		m_ambientTexture->bindActive(7);
+		m_materialTextures[materialTextureIndex]->bindActive(8);
+		m_environmentTextures[environmentTextureIndex]->bindActive(9);
+		m_shadowColorTexture->bindActive(10);
+		m_shadowDepthTexture->bindActive(11);
+
+		programShade->setUniform("modelViewMatrix", modelViewMatrix);
+		programShade->setUniform("projectionMatrix", tileProjectionMatrix);
+		programShade->setUniform("modelViewProjection", tileModelViewProjectionMatrix);
+		programShade->setUniform("inverseModelViewProjectionMatrix", tileInverseModelViewProjectionMatrix);
+		programShade->setUniform("normalMatrix", normalMatrix);
+		programShade->setUniform("inverseNormalMatrix", inverseNormalMatrix);
+		programShade->setUniform("modelLightMatrix", modelLightMatrix);
+		programShade->setUniform("modelLightProjectionMatrix", modelLightProjectionMatrix);
+		programShade->setUniform("lightPosition", vec3(worldLightPosition));
+		programShade->setUniform("ambientMaterial", ambientMaterial);
+		programShade->setUniform("diffuseMaterial", diffuseMaterial);
+		programShade->setUniform("specularMaterial", specularMaterial);
+		programShade->setUniform("distanceBlending", distanceBlending);
+		programShade->setUniform("distanceScale", distanceScale);
+		programShade->setUniform("shininess", shininess);
+		programShade->setUniform("focusPosition", focusPosition);
+		programShade->setUniform("objectCenter", objectCenter);
+		programShade->setUniform("objectRadius", objectRadius);
+
+		programShade->setUniform("spherePositionTexture", 0);
+		programShade->setUniform("sphereNormalTexture", 1);
+		programShade->setUniform("sphereDiffuseTexture", 2);
+
+		programShade->setUniform("surfacePositionTexture", 3);
+		programShade->setUniform("surfaceNormalTexture", 4);
+		programShade->setUniform("surfaceDiffuseTexture", 5);
+
+		programShade->setUniform("depthTexture", 6);
+		programShade->setUniform("ambientTexture", 7);
+		programShade->setUniform("materialTexture", 8);
+		programShade->setUniform("environmentTexture", 9);
+		programShade->setUniform("shadowColorTexture", 10);
+		programShade->setUniform("shadowDepthTexture", 11);
+
+		programShade->setUniform("environment", m_environmentMapping);
+		programShade->setUniform("maximumCoCRadius", maximumCoCRadius);
+		programShade->setUniform("aparture", aparture);
+		programShade->setUniform("focalDistance", focalDistance);
+		programShade->setUniform("focalLength", focalLength);
+		programShade->setUniform("backgroundColor", viewer()->backgroundColor());
 
-		programDOFBlend->setUniform("colorTexture", 0);
-		programDOFBlend->setUniform("nearTexture", 1);
-		programDOFBlend->setUniform("blurTexture", 2);
 
 		m_vaoQuad->bind();
-		programDOFBlend->use();
+		programShade->use();
 		m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
-		programDOFBlend->release();
+		programShade->release();
 		m_vaoQuad->unbind();
 
-		m_surfaceDiffuseTexture->unbindActive(1);
-		m_sphereDiffuseTexture->unbindActive(0);
+		m_shadowDepthTexture->unbindActive(11);
+		m_shadowColorTexture->unbindActive(10);
+		m_environmentTextures[environmentTextureIndex]->unbindActive(9);
+		m_materialTextures[materialTextureIndex]->unbindActive(8);
+		m_ambientTexture->unbindActive(7);
+		m_depthTexture->unbindActive(6);
+		m_surfaceDiffuseTexture->unbindActive(5);
+		m_surfaceNormalTexture->unbindActive(4);
+		m_surfacePositionTexture->unbindActive(3);
+		m_sphereDiffuseTexture->unbindActive(2);
+		m_sphereNormalTexture->unbindActive(1);
+		m_spherePositionTexture->unbindActive(0);
+
 		m_shadeFramebuffer->unbind();
+		profiler->end();
+
+
+		//////////////////////////////////////////////////////////////////////////
+		// Depth of field (optional)
+		//////////////////////////////////////////////////////////////////////////
+		if (m_depthOfField)
+		{
+			profiler->begin("dof");
+
+			//////////////////////////////////////////////////////////////////////////
+			// Depth of field blurring -- horizontal
+			//////////////////////////////////////////////////////////////////////////
+			m_dofBlurFramebuffer->bind();
+
+			m_colorTexture->bindActive(0);
+			m_colorTexture->bindActive(1);
+
+			programDOFBlur->setUniform("maximumCoCRadius", maximumCoCRadius);
+			programDOFBlur->setUniform("aparture", aparture);
+			programDOFBlur->setUniform("focalDistance", focalDistance);
+			programDOFBlur->setUniform("focalLength", focalLength);
+
+			programDOFBlur->setUniform("uMaxCoCRadiusPixels", (int)round(maximumCoCRadius));
+			programDOFBlur->setUniform("uNearBlurRadiusPixels", (int)round(maximumCoCRadius));
+			programDOFBlur->setUniform("uInvNearBlurRadiusPixels", 1.0f / maximumCoCRadius);
+			programDOFBlur->setUniform("horizontal", true);
+			programDOFBlur->setUniform("nearTexture", 0);
+			programDOFBlur->setUniform("blurTexture", 1);
+
+			m_vaoQuad->bind();
+			programDOFBlur->use();
+			m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
+			programDOFBlur->release();
+			m_vaoQuad->unbind();
+
+			m_colorTexture->unbindActive(1);
+			m_colorTexture->unbindActive(0);
+			m_dofBlurFramebuffer->unbind();
+
+
+			//////////////////////////////////////////////////////////////////////////
+			// Depth of field blurring -- vertical
+			//////////////////////////////////////////////////////////////////////////
+			m_dofFramebuffer->bind();
+
+			m_sphereNormalTexture->bindActive(0);
+			m_surfaceNormalTexture->bindActive(1);
+			programDOFBlur->setUniform("horizontal", false);
+			programDOFBlur->setUniform("nearTexture", 0);
+			programDOFBlur->setUniform("blurTexture", 1);
+
+			m_vaoQuad->bind();
+			programDOFBlur->use();
+			m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
+			programDOFBlur->release();
+			m_vaoQuad->unbind();
+
+			m_surfaceNormalTexture->unbindActive(1);
+			m_sphereNormalTexture->unbindActive(0);
+
+			m_dofFramebuffer->unbind();
+
+
+			//////////////////////////////////////////////////////////////////////////
+			// Depth of field blending
+			//////////////////////////////////////////////////////////////////////////
+			m_shadeFramebuffer->bind();
+
+			m_colorTexture->bindActive(0);
+			m_sphereDiffuseTexture->bindActive(1);
+			m_surfaceDiffuseTexture->bindActive(2);
+
+			programDOFBlend->setUniform("maximumCoCRadius", maximumCoCRadius);
+			programDOFBlend->setUniform("aparture", aparture);
+			programDOFBlend->setUniform("focalDistance", focalDistance);
+			programDOFBlend->setUniform("focalLength", focalLength);
+
+			programDOFBlend->setUniform("colorTexture", 0);
+			programDOFBlend->setUniform("nearTexture", 1);
+			programDOFBlend->setUniform("blurTexture", 2);
+
+			m_vaoQuad->bind();
+			programDOFBlend->use();
+			m_vaoQuad->drawArrays(GL_POINTS, 0, 1);
+			programDOFBlend->release();
+			m_vaoQuad->unbind();
+
+			m_surfaceDiffuseTexture->unbindActive(1);
+			m_sphereDiffuseTexture->unbindActive(0);
+			m_shadeFramebuffer->unbind();
+			profiler->end();
+		}
+
+		// only the interior of a tile is copied into the image, its guard band is covered by the neighboring tiles
+		if (m_tiledFramebuffer)
+		{
+			const ivec2 extent = min(tileSize, viewportSize - tileOrigin);
+			m_shadeFramebuffer->blit(GL_COLOR_ATTACHMENT0, { guardBand, guardBand, guardBand + extent.x, guardBand + extent.y }, m_tiledFramebuffer.get(), GL_COLOR_ATTACHMENT0, { tileOrigin.x, tileOrigin.y, tileOrigin.x + extent.x, tileOrigin.y + extent.y }, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}
+	}
+
+	if (intersectionReadback)
+	{
+		m_readbackTileCounts[m_currentReadbackSlot] = tileCount.x * tileCount.y;
+		m_readbackCapacities[m_currentReadbackSlot] = m_intersectionCapacity;
+		m_readbackPixelCounts[m_currentReadbackSlot] = double(m_framebufferSize.x) * double(m_framebufferSize.y);
+		m_readbackFences[m_currentReadbackSlot] = Sync::fence(GL_SYNC_GPU_COMMANDS_COMPLETE);
+		m_currentReadbackSlot = (m_currentReadbackSlot + 1) % intersectionReadbackSlotCount;
 	}
 
+	m_intersectionVerify = false;
+
+	glViewport(0, 0, viewer()->viewportSize().x, viewer()->viewportSize().y);
+	profiler->begin("display");
+
 	if (viewportSize == viewer()->viewportSize())
 	{
-		// Blit final image into visible framebuffer
-		m_shadeFramebuffer->blit(GL_COLOR_ATTACHMENT0, { 0,0,viewer()->viewportSize().x, viewer()->viewportSize().y }, Framebuffer::defaultFBO().get(), GL_BACK, { 0,0,viewer()->viewportSize().x, viewer()->viewportSize().y }, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		// Blit final image into visible framebuffer, an image composed of tiles has no depth
+		if (m_tiledFramebuffer)
+			m_tiledFramebuffer->blit(GL_COLOR_ATTACHMENT0, { 0,0,viewer()->viewportSize().x, viewer()->viewportSize().y }, viewer()->framebuffer(), viewer()->framebufferBuffer(), { 0,0,viewer()->viewportSize().x, viewer()->viewportSize().y }, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		else
+			m_shadeFramebuffer->blit(GL_COLOR_ATTACHMENT0, { 0,0,viewer()->viewportSize().x, viewer()->viewportSize().y }, viewer()->framebuffer(), viewer()->framebufferBuffer(), { 0,0,viewer()->viewportSize().x, viewer()->viewportSize().y }, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
 	}
 	else
 	{
-		m_colorTexture->bindActive(0);
+		Texture* colorTexture = m_tiledFramebuffer ? m_tiledColorTexture.get() : m_colorTexture.get();
+		viewer()->framebuffer()->bind();
+		colorTexture->bindActive(0);
 		m_depthTexture->bindActive(1);
 
-		glViewport(0, 0, viewer()->viewportSize().x, viewer()->viewportSize().y);
-		glDepthMask(GL_TRUE);
+		glDepthMask(m_tiledFramebuffer ? GL_FALSE : GL_TRUE);
 
 		programDisplay->setUniform("colorTexture", 0);
 		programDisplay->setUniform("depthTexture", 1);
@@ -1152,10 +1793,331 @@ void SphereRenderer::display()
 		m_vaoQuad->unbind();
 
 		m_depthTexture->unbindActive(1);
-		m_colorTexture->unbindActive(0);
+		colorTexture->unbindActive(0);
 
 	}
 
+	profiler->end();
+
 	// Restore OpenGL state
 	currentState->apply();
-}
\ No newline at end of file
+}
+
+bool SphereRenderer::setOption(const std::string& name, const std::string& value)
+{
+	const std::unordered_map<std::string, bool*> switches = {
+		{ "ambient-occlusion", &m_ambientOcclusion },
+		{ "environment-mapping", &m_environmentMapping },
+		{ "environment-lighting", &m_environmentLighting },
+		{ "normal-mapping", &m_normalMapping },
+		{ "material-mapping", &m_materialMapping },
+		{ "depth-of-field", &m_depthOfField },
+		{ "cluster-culling", &m_clusterCulling },
+		{ "occlusion-culling", &m_occlusionCulling },
+		{ "sorted-lists", &m_sortedLists },
+		{ "tiled-rendering", &m_tiledRendering },
+		{ "compute-rasterization", &m_computeRasterization }
+	};
+
+	auto s = switches.find(name);
+
+	if (s != switches.end())
+	{
+		if (value == "on" || value == "true" || value == "1")
+			*s->second = true;
+		else if (value == "off" || value == "false" || value == "0")
+			*s->second = false;
+		else
+			return false;
+
+		return true;
+	}
+
+	// the coloring modes are numbered like in the user interface
+	if (name == "coloring" && value.size() == 1 && value[0] >= '0' && value[0] <= '3')
+	{
+		m_coloring = value[0] - '0';
+		return true;
+	}
+
+	// the same range as the slider of the user interface
+	if (name == "resolution-scale")
+	{
+		char* end = nullptr;
+		const float scale = std::strtof(value.c_str(), &end);
+
+		if (end == value.c_str() || *end != '\0' || scale < 0.25f || scale > 8.0f)
+			return false;
+
+		m_resolutionScale = scale;
+		return true;
+	}
+
+	return false;
+}
+
+void SphereRenderer::setComputeRasterization(bool enabled)
+{
+	m_computeRasterization = enabled;
+}
+
+void SphereRenderer::setUniformTables(bool enabled)
+{
+	m_uniformTables = enabled;
+}
+
+void SphereRenderer::resizeIntersectionBuffer(std::size_t capacity)
+{
+	m_intersectionCapacity = std::min(capacity, m_maximumIntersectionCapacity);
+	m_intersectionBuffer->setData(intersectionHeaderSize + m_intersectionCapacity * intersectionEntrySize, nullptr, GL_DYNAMIC_COPY);
+}
+
+void SphereRenderer::resizeIntersectionReadback(int tileCount)
+{
+	// Counts in flight are dropped, the storage of the mapped buffer cannot change and it stays alive until the GPU is done
+	for (auto& fence : m_readbackFences)
+		fence.reset();
+
+	// the first element holds the count of the tile being checked, each slot the statistics and the counts of all tiles
+	m_intersectionReadbackSlotSize = 2 + std::size_t(tileCount);
+	const std::size_t size = (1 + intersectionReadbackSlotCount * m_intersectionReadbackSlotSize) * sizeof(uint);
+
+	m_intersectionReadback = std::make_unique<Buffer>();
+	m_intersectionReadback->setStorage(size, nullptr, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_CLIENT_STORAGE_BIT);
+	m_intersectionReadbackData = static_cast<const uint*>(m_intersectionReadback->mapRange(0, size, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+}
+
+void SphereRenderer::readIntersectionCounts()
+{
+	// The slots are read in the order they were written, up to the first one that the GPU has not finished yet
+	for (std::size_t i = 0; i < intersectionReadbackSlotCount; i++)
+	{
+		const std::size_t slot = (m_currentReadbackSlot + i) % intersectionReadbackSlotCount;
+
+		if (!m_readbackFences[slot])
+			continue;
+
+		const GLenum result = m_readbackFences[slot]->clientWait(GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			return;
+
+		m_readbackFences[slot].reset();
+
+		const uint* data = m_intersectionReadbackData + 1 + slot * m_intersectionReadbackSlotSize;
+		std::size_t count = 0;
+
+		for (int tile = 0; tile < m_readbackTileCounts[slot]; tile++)
+			count = std::max(count, std::size_t(data[2 + tile]));
+
+		m_truncatedPixelCount = data[0];
+		m_maximumListLength = data[1];
+		m_intersectionDensity = double(count) / m_readbackPixelCounts[slot];
+
+		// entries of that frame were dropped, so the next one checks each tile and generates its lists again if they do not fit
+		if (count > m_readbackCapacities[slot] && m_readbackCapacities[slot] < m_maximumIntersectionCapacity)
+			m_intersectionVerify = true;
+
+		updateIntersectionCapacity(count);
+	}
+}
+
+bool SphereRenderer::updateIntersectionCapacity(std::size_t count)
+{
+	// the count includes the unused first entry and all entries that were dropped
+	m_intersectionCount = count;
+
+	// A quarter of headroom avoids growing again on every small change of the view
+	const std::size_t capacity = std::max(std::size_t(minimumIntersectionCapacity), m_intersectionCount + m_intersectionCount / 4);
+
+	if (m_intersectionCount > m_intersectionCapacity)
+	{
+		m_intersectionIdleFrames = 0;
+		m_intersectionOverflow = m_intersectionCapacity == m_maximumIntersectionCapacity;
+
+		if (m_intersectionOverflow)
+			return false;
+
+		resizeIntersectionBuffer(capacity);
+		return true;
+	}
+
+	m_intersectionOverflow = false;
+
+	if (m_intersectionCount < m_intersectionCapacity / 4 && capacity < m_intersectionCapacity)
+	{
+		if (++m_intersectionIdleFrames >= intersectionShrinkFrames)
+		{
+			resizeIntersectionBuffer(capacity);
+			m_intersectionIdleFrames = 0;
+		}
+	}
+	else
+	{
+		m_intersectionIdleFrames = 0;
+	}
+
+	return false;
+}
+
+void SphereRenderer::updateBvh(std::size_t timestep, std::size_t atomCount)
+{
+	const Protein* protein = viewer()->scene()->protein();
+	const double startTime = glfwGetTime();
+
+	// the transformed coordinates include the displacement by the fluid simulation, reading them waits for the transform feedback pass
+	std::vector<vec4> coordinates(atomCount);
+	m_transformedCoordinates->getSubData(0, GLsizeiptr(atomCount * sizeof(vec4)), coordinates.data());
+	m_bvhPositions.resize(atomCount);
+
+	for (std::size_t i = 0; i < atomCount; i++)
+		m_bvhPositions[i] = vec3(coordinates[i]);
+
+	// the same atoms only need the bounds to follow their positions, which holds for all timesteps if they share their attributes
+	if (m_bvhTimestep != std::numeric_limits<std::size_t>::max() && m_bvh.size() == atomCount && (protein->hasStaticAttributes() || timestep == m_bvhTimestep))
+	{
+		m_bvh.refit(m_bvhPositions.data());
+	}
+	else
+	{
+		// the w components of the transformed coordinates may be packed for the uniform blocks, so the radii are looked up from the protein
+		std::vector<float> radii(atomCount);
+
+		if (protein->hasStaticAttributes())
+		{
+			for (std::size_t i = 0; i < atomCount; i++)
+				radii[i] = protein->activeElementRadii()[Protein::elementIndex(protein->staticAttributes()[i])];
+		}
+		else
+		{
+			std::vector<vec4> atoms;
+			protein->loadTimestep(timestep, atoms);
+
+			for (std::size_t i = 0; i < atomCount; i++)
+				radii[i] = protein->activeElementRadii()[Protein::elementIndex(floatBitsToUint(atoms[i].w))];
+		}
+
+		m_bvh.build(m_bvhPositions.data(), radii.data(), atomCount);
+	}
+
+	m_bvhTimestep = timestep;
+	m_bvhTime = (glfwGetTime() - startTime) * 1000.0;
+}
+
+// Whether a point on the screen, given by the tangents of its view angles, lies within the screen radius of a sphere in view space.
+// Off the view axis, the silhouette reaches furthest from the projected center on the side away from the screen center, by the
+// difference of the tangents of the angles to the far edge of the sphere and to its center.
+static bool withinScreenRadius(const vec2& point, const vec3& center, float radius, float tolerance)
+{
+	const float distance = length(center);
+
+	// the sphere contains the camera or reaches behind it
+	if (distance <= radius || center.z >= 0.0f)
+		return true;
+
+	const float centerAngle = std::acos(std::min(-center.z / distance, 1.0f));
+	const float edgeAngle = centerAngle + std::asin(radius / distance);
+
+	if (edgeAngle >= half_pi<float>())
+		return true;
+
+	const vec2 projectedCenter = vec2(center) / -center.z;
+	return length(point - projectedCenter) <= std::tan(edgeAngle) - std::tan(centerAngle) + tolerance;
+}
+
+void SphereRenderer::pickAtom(const vec2& position, const mat4& modelViewMatrix, const mat4& projectionMatrix, std::size_t timestep, std::size_t atomCount)
+{
+	updateBvh(timestep, atomCount);
+
+	// the ray runs from the near to the far plane in model coordinates, in which the spheres are drawn with their element radius
+	const mat4 inverseModelViewProjection = inverse(projectionMatrix * modelViewMatrix);
+	vec4 nearPoint = inverseModelViewProjection * vec4(position, -1.0f, 1.0f);
+	vec4 farPoint = inverseModelViewProjection * vec4(position, 1.0f, 1.0f);
+	nearPoint /= nearPoint.w;
+	farPoint /= farPoint.w;
+
+	Bvh::Ray ray;
+	ray.origin = vec3(nearPoint);
+	ray.direction = vec3(farPoint) - vec3(nearPoint);
+	ray.maximumDistance = 1.0f;
+
+	const double startTime = glfwGetTime();
+	Bvh::Hit hit;
+
+	// only atoms that are drawn can be picked
+	if (m_selection.isValid())
+	{
+		std::vector<Bvh::Hit> hits;
+		m_bvh.intersectAll(ray, hits);
+
+		for (const auto& h : hits)
+		{
+			if (h.index < m_selectedAtoms.size() && m_selectedAtoms.test(h.index))
+			{
+				hit = h;
+				break;
+			}
+		}
+	}
+	else
+	{
+		hit = m_bvh.intersect(ray);
+	}
+
+	m_pickTime = (glfwGetTime() - startTime) * 1000000.0;
+
+	const Protein* protein = viewer()->scene()->protein();
+	std::vector<vec4> atoms;
+
+	// the picked sphere has to be drawn under the cursor, which fails if the hierarchy does not match the displayed positions
+	if (hit.index != Bvh::noHit)
+	{
+		protein->loadTimestep(timestep, atoms);
+
+		vec4 cursor = inverse(projectionMatrix) * vec4(position, -1.0f, 1.0f);
+		cursor /= cursor.w;
+
+		const vec3 center = vec3(modelViewMatrix * vec4(m_bvhPositions[hit.index], 1.0f));
+		const float scale = length(vec3(modelViewMatrix[0]));
+		const float radius = protein->activeElementRadii()[Protein::elementIndex(floatBitsToUint(atoms[hit.index].w))];
+		const float pixel = 2.0f / (std::abs(projectionMatrix[1][1]) * float(viewer()->viewportSize().y));
+
+		if (!withinScreenRadius(vec2(cursor) / -cursor.z, center, radius * scale, pixel))
+		{
+			globjects::debug() << "Picked atom " << hit.index << " is not drawn under the cursor, the pick is discarded.";
+			hit = Bvh::Hit();
+		}
+	}
+
+	m_pickedAtom = hit.index;
+
+	if (hit.index == Bvh::noHit)
+		return;
+
+	const vec4 atom = atoms[hit.index];
+	const uint attributes = floatBitsToUint(atom.w);
+	const uint elementId = protein->activeElementIds()[Protein::elementIndex(attributes)];
+	const uint groupIndex = Protein::groupIndex(attributes);
+	const uvec2 group = protein->activeGroups()[groupIndex];
+
+	std::string element = "?";
+
+	for (const auto& e : Protein::elementIds())
+	{
+		if (e.second == elementId)
+		{
+			element = e.first;
+			break;
+		}
+	}
+
+	// atoms sorted along a space-filling curve are reported by their index in the file
+	const uint fileIndex = protein->atomOrder().empty() ? hit.index : protein->atomOrder()[hit.index];
+
+	std::stringstream description;
+	description << "Atom " << fileIndex + 1 << ": " << element << " of " << PdbParser::name(protein->activeResidueNames()[group.x]) << " "
+		<< protein->activeResidueNumbers()[groupIndex] << " in chain " << PdbParser::name(protein->activeChainNames()[group.y])
+		<< " at (" << atom.x << ", " << atom.y << ", " << atom.z << ")";
+
+	m_pickedAtomDescription = description.str();
+}
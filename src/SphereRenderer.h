@@ -1,6 +1,14 @@
 #pragma once
 #include "Renderer.h"
+#include "TimestepStream.h"
+#include "Selection.h"
+#include "GpuCellList.h"
+#include "ClusterCuller.h"
+#include "SphereRasterizer.h"
+#include "Bvh.h"
 #include <memory>
+#include <array>
+#include <limits>
 
 #include <glm/glm.hpp>
 #include <glbinding/gl/gl.h>
@@ -18,6 +26,8 @@
 #include <globjects/base/File.h>
 #include <globjects/TextureHandle.h>
 #include <globjects/TransformFeedback.h>
+#include <globjects/Sync.h>
+#include <globjects/Query.h>
 #include <globjects/NamedString.h>
 #include <globjects/base/StaticStringSource.h>
 
@@ -30,23 +40,73 @@ namespace dynamol
 	public:
 		SphereRenderer(Viewer *viewer);
 		virtual void display();
+		virtual void proteinChanged();
+
+		// Selects the compute shader rasterizer instead of the geometry shader path, like the option in the user interface
+		void setComputeRasterization(bool enabled);
+
+		// Selects the original indexing of the element, residue and chain tables through uniform blocks of fixed size instead of
+		// storage buffers, for comparing both in the table indexing benchmark. The atoms are drawn with the original packing of
+		// their attributes, which holds 8-bit residue and chain indices, so the tables of the protein have to fit into the blocks.
+		static const std::size_t uniformElementCount = 32;
+		static const std::size_t uniformResidueCount = 32;
+		static const std::size_t uniformChainCount = 64;
+		void setUniformTables(bool enabled);
+
+		// Sets an option of the user interface by name, such as ambient-occlusion=on or coloring=2, for this renderer.
+		// Returns false if the option or the value is unknown.
+		bool setOption(const std::string& name, const std::string& value);
 
 	private:
+		void loadProtein();
+		void resizeIntersectionBuffer(std::size_t capacity);
+		void resizeIntersectionReadback(int tileCount);
+		void readIntersectionCounts();
+		bool updateIntersectionCapacity(std::size_t count);
+		void updateBvh(std::size_t timestep, std::size_t atomCount);
+		void pickAtom(const glm::vec2& position, const glm::mat4& modelViewMatrix, const glm::mat4& projectionMatrix, std::size_t timestep, std::size_t atomCount);
 		
-		std::vector< std::unique_ptr<globjects::Buffer> > m_vertices;
 		std::unique_ptr<globjects::VertexArray> m_vao = std::make_unique<globjects::VertexArray>();
 		std::unique_ptr<globjects::Buffer> m_elementColorsRadii = std::make_unique<globjects::Buffer>();
 		std::unique_ptr<globjects::Buffer> m_residueColors = std::make_unique<globjects::Buffer>();
 		std::unique_ptr<globjects::Buffer> m_chainColors = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_groups = std::make_unique<globjects::Buffer>();
 		
 		std::unique_ptr<globjects::VertexArray> m_vaoQuad = std::make_unique<globjects::VertexArray>();
 		std::unique_ptr<globjects::Buffer> m_verticesQuad = std::make_unique<globjects::Buffer>();
-		
-		std::unique_ptr<globjects::StaticStringSource> m_shaderSourceDefines = nullptr;
-		std::unique_ptr<globjects::NamedString> m_shaderDefines = nullptr;
 
+		// The per-pixel lists of sphere intersections share one buffer, which is sized from the number of entries of the previous
+		// frames. The counts of all tiles of a frame are copied to one of several mapped slots, which is read without waiting once
+		// its fence is signaled. If the lists of a frame did not fit, the buffer grows and the next frame waits for the count of
+		// each tile to generate its lists again until they fit. If the largest buffer cannot hold the entries of the whole image,
+		// it is rendered in tiles. The buffer shrinks again once most of it has remained unused for a while. Lists longer than
+		// the surface pass considers are counted in the statistics.
+		static const std::size_t intersectionHeaderSize = 16;
+		static const std::size_t intersectionEntrySize = 48;
+		static const std::size_t minimumIntersectionCapacity = 1 << 20;
+		static const std::size_t maximumIntersectionBufferSize = std::size_t(1536) << 20;
+		static const unsigned int intersectionShrinkFrames = 120;
+		static const std::size_t intersectionReadbackSlotCount = 3;
 		std::unique_ptr<globjects::Buffer> m_intersectionBuffer = std::make_unique<globjects::Buffer>();
 		std::unique_ptr<globjects::Buffer> m_statisticsBuffer = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_intersectionReadback = std::make_unique<globjects::Buffer>();
+		const glm::uint* m_intersectionReadbackData = nullptr;
+		std::size_t m_intersectionReadbackSlotSize = 0;
+		std::array<int, intersectionReadbackSlotCount> m_readbackTileCounts;
+		std::array<std::size_t, intersectionReadbackSlotCount> m_readbackCapacities;
+		std::array<double, intersectionReadbackSlotCount> m_readbackPixelCounts;
+		std::array<std::unique_ptr<globjects::Sync>, intersectionReadbackSlotCount> m_readbackFences;
+		std::size_t m_currentReadbackSlot = 0;
+		bool m_intersectionVerify = false;
+		bool m_intersectionTiling = false;
+		std::size_t m_intersectionCapacity = 0;
+		std::size_t m_maximumIntersectionCapacity = 0;
+		std::size_t m_intersectionCount = 0;
+		unsigned int m_intersectionIdleFrames = 0;
+		bool m_intersectionOverflow = false;
+		glm::uint m_truncatedPixelCount = 0;
+		glm::uint m_maximumListLength = 0;
+		bool m_fragmentShaderInterlock = false;
 		std::unique_ptr<globjects::Texture> m_offsetTexture = nullptr;
 		std::unique_ptr<globjects::Texture> m_depthTexture = nullptr;
 		std::unique_ptr<globjects::Texture> m_spherePositionTexture = nullptr;
@@ -78,6 +138,95 @@ namespace dynamol
 		std::unique_ptr<globjects::TransformFeedback> m_transformFeedback = nullptr;
 		std::unique_ptr<globjects::Buffer> m_transformedCoordinates = nullptr;
 
+		// Timesteps are streamed through a persistently mapped ring buffer with one slot per timestep in flight.
+		// If all timesteps share their attributes, these are uploaded once and only quantized positions are streamed.
+		static const std::size_t timestepSlotCount = 3;
+		std::unique_ptr<TimestepStream> m_timestepStream;
+		std::unique_ptr<globjects::Buffer> m_timestepBuffer = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_staticAttributes = nullptr;
+		std::unique_ptr<globjects::Buffer> m_uniformTableAttributes = nullptr;
+		char* m_timestepBufferData = nullptr;
+		std::size_t m_timestepSlotSize = 0;
+		std::size_t m_timestepElementSize = 0;
+		std::array<std::size_t, timestepSlotCount> m_slotTimesteps;
+		std::array<TimestepStream::Quantization, timestepSlotCount> m_slotQuantizations;
+		std::array<std::unique_ptr<globjects::Sync>, timestepSlotCount> m_slotFences;
+		std::size_t m_currentSlot = 0;
+
+		// Only the atoms of a valid selection are drawn by the sphere and list generation passes, through a list of their indices.
+		// The selection is reevaluated if the displayed timestep changes and either its positions or its attributes are relevant.
+		Selection m_selection;
+		AtomBitset m_selectedAtoms;
+		std::vector<glm::uint> m_selectedIndices;
+		std::unique_ptr<globjects::Buffer> m_selectionIndices = std::make_unique<globjects::Buffer>();
+		std::size_t m_selectionTimestep = std::numeric_limits<std::size_t>::max();
+		bool m_selectionChanged = false;
+		std::string m_selectionError;
+
+		// Duration of the sphere, list generation and surface passes, which look up the element, residue and chain tables
+		std::unique_ptr<globjects::Query> m_surfaceTimer = std::make_unique<globjects::Query>();
+		bool m_surfaceTimerPending = false;
+		double m_surfaceTime = 0.0;
+
+		// Spatial index over the transformed atoms of the displayed timestep, which later passes can query
+		std::unique_ptr<GpuCellList> m_cellList;
+		std::unique_ptr<globjects::Query> m_cellListTimer = std::make_unique<globjects::Query>();
+		bool m_cellListTimerPending = false;
+		double m_cellListTime = 0.0;
+
+		// Frustum and occlusion culling of clusters of atoms before the sphere and list generation passes
+		std::unique_ptr<ClusterCuller> m_clusterCuller;
+
+		// Alternative to the sphere and list generation passes that bins the spheres into screen tiles in compute shaders
+		std::unique_ptr<SphereRasterizer> m_sphereRasterizer;
+
+		// Options of the user interface, the first ones can also be set by name through setOption
+		bool m_ambientOcclusion = false;
+		bool m_environmentMapping = false;
+		bool m_environmentLighting = false;
+		bool m_normalMapping = false;
+		bool m_materialMapping = false;
+		bool m_depthOfField = false;
+		int m_coloring = 0;
+		bool m_clusterCulling = true;
+		bool m_occlusionCulling = true;
+		bool m_sortedLists = false;
+		bool m_tiledRendering = false;
+		bool m_computeRasterization = false;
+		float m_resolutionScale = 1.0f;
+		int m_tiledMemoryBudget = 1024;
+		int m_tileGuardBand = 64;
+		bool m_rebuildCellList = false;
+		float m_cellListCellSize = 4.0f;
+		bool m_refitEveryTimestep = false;
+		char m_selectionExpression[256] = "";
+
+		// the former indexing of the tables through uniform blocks, only chosen by the table indexing benchmark
+		bool m_uniformTables = false;
+
+		// Hierarchy over the atom spheres for picking with Ctrl + left click, built from the transformed coordinates of the frame, so
+		// that it includes the displacement by the fluid simulation. It is refit when picking or, optionally, whenever the displayed
+		// timestep changes. Procedural animation displaces the atoms in the shaders only, so picking is disabled while it is active.
+		Bvh m_bvh;
+		std::vector<glm::vec3> m_bvhPositions;
+		std::size_t m_bvhTimestep = std::numeric_limits<std::size_t>::max();
+		double m_bvhTime = 0.0;
+		double m_pickTime = 0.0;
+		bool m_pickButtonPressed = false;
+		glm::uint m_pickedAtom = Bvh::noHit;
+		std::string m_pickedAtomDescription;
+
+		// In tiled mode the textures above hold one tile and its guard band, and each tile is copied into the full image after shading.
+		// Per pixel, the tiles take nine RGBA32F textures, the depth and offset textures and the depth pyramid of the culling, in
+		// addition to the intersection entries, whose number per pixel is measured over the tiles of the previous frame.
+		static const std::size_t tilePixelSize = 9 * 16 + 4 + 4 + 6;
+		static const int minimumTileSize = 256;
+		std::unique_ptr<globjects::Texture> m_tiledColorTexture = nullptr;
+		std::unique_ptr<globjects::Framebuffer> m_tiledFramebuffer = nullptr;
+		glm::ivec2 m_tiledImageSize = glm::ivec2(0);
+		glm::ivec2 m_tileCount = glm::ivec2(1);
+		double m_intersectionDensity = 4.0;
+
 		glm::ivec2 m_shadowMapSize = glm::ivec2(512, 512);
 		glm::ivec2 m_framebufferSize;
 	};
@@ -0,0 +1,139 @@
+#include "TableBenchmark.h"
+#include "SphereRenderer.h"
+#include "Viewer.h"
+#include "Scene.h"
+#include "Protein.h"
+#include "Profiler.h"
+
+#include <glbinding/gl/gl.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+
+namespace
+{
+	// the passes that look up the tables
+	const char* const tablePasses[] = { "sphere", "spawn", "surface" };
+
+	// Renders frames with the current options and returns the average frame time and the median GPU time of the passes that
+	// look up the tables, both in milliseconds
+	void measure(GLFWwindow* window, Viewer* viewer, unsigned int frameCount, double& frameTime, double& passTime)
+	{
+		// the first frames link the permutation of the shaders and size the buffers
+		for (unsigned int i = 0; i < 20; i++)
+		{
+			glfwPollEvents();
+			viewer->display();
+			glfwSwapBuffers(window);
+		}
+
+		glFinish();
+
+		Profiler* profiler = viewer->profiler();
+		profiler->startRecording();
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		for (unsigned int i = 0; i < frameCount; i++)
+		{
+			glfwPollEvents();
+			viewer->display();
+			glfwSwapBuffers(window);
+		}
+
+		glFinish();
+		const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - startTime;
+		frameTime = duration.count() * 1000.0 / double(std::max(frameCount, 1u));
+
+		const std::vector<Profiler::FrameTimes> frames = profiler->stopRecording();
+		std::vector<double> passTimes;
+
+		for (const auto& f : frames)
+		{
+			double time = 0.0;
+
+			for (std::size_t p = 0; p < profiler->passCount() && p < f.gpuTimes.size(); p++)
+			{
+				if (std::find(std::begin(tablePasses), std::end(tablePasses), profiler->passName(p)) != std::end(tablePasses))
+					time += f.gpuTimes[p];
+			}
+
+			passTimes.push_back(time);
+		}
+
+		passTime = 0.0;
+
+		if (!passTimes.empty())
+		{
+			std::nth_element(passTimes.begin(), passTimes.begin() + passTimes.size() / 2, passTimes.end());
+			passTime = passTimes[passTimes.size() / 2];
+		}
+	}
+}
+
+bool TableBenchmark::run(GLFWwindow* window, const std::string& filename, unsigned int frameCount)
+{
+	Scene scene;
+	Protein* protein = scene.protein();
+	protein->load(filename, false);
+
+	if (protein->timestepCount() == 0 || protein->atomCount(0) == 0)
+	{
+		std::cout << "Could not load atoms from " << filename << "." << std::endl;
+		return false;
+	}
+
+	const std::size_t elementCount = protein->activeElementColorsRadiiPacked().size();
+	const std::size_t residueCount = protein->activeResidueColorsPacked().size();
+	const std::size_t chainCount = protein->activeChainColorsPacked().size();
+
+	if (!protein->hasStaticAttributes() || elementCount > SphereRenderer::uniformElementCount || residueCount > SphereRenderer::uniformResidueCount || chainCount > SphereRenderer::uniformChainCount)
+	{
+		std::cout << filename << " has " << elementCount << " elements, " << residueCount << " residues and " << chainCount << " chains, more than the uniform blocks hold ("
+			<< SphereRenderer::uniformElementCount << ", " << SphereRenderer::uniformResidueCount << " and " << SphereRenderer::uniformChainCount << "), or its timesteps have different attributes." << std::endl;
+		return false;
+	}
+
+	// both paths render the same view of the same scene, the uniform blocks only exist for the geometry shader path
+	auto viewer = std::make_unique<Viewer>(window, &scene);
+	SphereRenderer* sphereRenderer = viewer->sphereRenderer();
+	sphereRenderer->setComputeRasterization(false);
+
+	const vec3 boundingBoxSize = protein->maximumBounds() - protein->minimumBounds();
+	const float maximumSize = std::max(boundingBoxSize.x, std::max(boundingBoxSize.y, boundingBoxSize.z));
+	mat4 modelTransform = scale(vec3(2.0f) / vec3(maximumSize));
+	modelTransform = modelTransform * translate(-0.5f * (protein->minimumBounds() + protein->maximumBounds()));
+	viewer->setModelTransform(modelTransform);
+
+	std::cout << "Benchmarking table lookups on " << filename << " (" << frameCount << " frames, " << elementCount << " elements, " << residueCount << " residues, "
+		<< chainCount << " chains)" << std::endl;
+
+	const char* colorings[] = { "element", "residue", "chain" };
+
+	for (int coloring = 1; coloring <= 3; coloring++)
+	{
+		sphereRenderer->setOption("coloring", std::to_string(coloring));
+		std::cout << "  Coloring by " << colorings[coloring - 1] << std::endl;
+
+		double frameTimes[2] = { 0.0, 0.0 };
+		double passTimes[2] = { 0.0, 0.0 };
+
+		for (int uniform = 0; uniform < 2; uniform++)
+		{
+			sphereRenderer->setUniformTables(uniform == 1);
+			measure(window, viewer.get(), frameCount, frameTimes[uniform], passTimes[uniform]);
+
+			std::cout << "    " << (uniform ? "Uniform blocks:  " : "Storage buffers: ") << frameTimes[uniform] << " ms per frame, " << passTimes[uniform] << " ms in the sphere, list generation and surface passes" << std::endl;
+		}
+
+		std::cout << "    Storage buffers relative to uniform blocks: " << passTimes[0] / std::max(passTimes[1], 1e-9) << "x pass time" << std::endl;
+	}
+
+	return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+struct GLFWwindow;
+
+namespace dynamol
+{
+	// Compares looking up the element, residue and chain tables from shader storage buffers with the original indexing through
+	// uniform blocks of 32 elements, 32 residues and 64 chains with 8-bit indices, rendering the same view of the file with both
+	// for each coloring. Reports the frame time and the median GPU time of the sphere, list generation and surface passes, which
+	// read the tables. The tables of the file have to fit into the uniform blocks. Requires a window with a current OpenGL context.
+	class TableBenchmark
+	{
+	public:
+		static bool run(GLFWwindow* window, const std::string& filename, unsigned int frameCount = 200);
+	};
+}
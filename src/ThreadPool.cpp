@@ -0,0 +1,143 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+using namespace dynamol;
+
+namespace
+{
+	thread_local bool insideParallelFor = false;
+}
+
+ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool threadPool;
+	return threadPool;
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	start(threadCount);
+}
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+}
+
+unsigned int ThreadPool::threadCount() const
+{
+	return static_cast<unsigned int>(m_threads.size()) + 1;
+}
+
+void ThreadPool::setThreadCount(unsigned int threadCount)
+{
+	std::lock_guard<std::mutex> callLock(m_callMutex);
+
+	stop();
+	start(threadCount);
+}
+
+void ThreadPool::start(unsigned int threadCount)
+{
+	threadCount = std::max(threadCount, 1u);
+
+	// threads started after earlier loops only wait for the following ones
+	unsigned long long generation;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = false;
+		generation = m_generation;
+	}
+
+	for (unsigned int i = 1; i < threadCount; i++)
+		m_threads.emplace_back(&ThreadPool::work, this, generation);
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_wakeCondition.notify_all();
+
+	for (auto& t : m_threads)
+		t.join();
+
+	m_threads.clear();
+}
+
+void ThreadPool::parallelFor(std::size_t count, const std::function<void(std::size_t)>& function)
+{
+	if (count == 0)
+		return;
+
+	if (count == 1 || m_threads.empty() || insideParallelFor || !m_callMutex.try_lock())
+	{
+		for (std::size_t i = 0; i < count; i++)
+			function(i);
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_function = &function;
+		m_count = count;
+		m_next = 0;
+		m_activeThreads = static_cast<unsigned int>(m_threads.size());
+		m_generation++;
+	}
+
+	m_wakeCondition.notify_all();
+
+	run();
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_doneCondition.wait(lock, [this] { return m_activeThreads == 0; });
+		m_function = nullptr;
+	}
+
+	m_callMutex.unlock();
+}
+
+void ThreadPool::work(unsigned long long generation)
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeCondition.wait(lock, [this, generation] { return m_stop || m_generation != generation; });
+
+			if (m_stop)
+				return;
+
+			generation = m_generation;
+		}
+
+		run();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (--m_activeThreads == 0)
+				m_doneCondition.notify_all();
+		}
+	}
+}
+
+void ThreadPool::run()
+{
+	insideParallelFor = true;
+
+	std::size_t i;
+
+	while ((i = m_next.fetch_add(1)) < m_count)
+		(*m_function)(i);
+
+	insideParallelFor = false;
+}
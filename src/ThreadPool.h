@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+
+namespace dynamol
+{
+	// Persistent worker threads for data-parallel loops
+	class ThreadPool
+	{
+	public:
+		static ThreadPool& instance();
+
+		ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency());
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Number of threads participating in a parallel loop, including the calling thread
+		unsigned int threadCount() const;
+
+		// Replaces the worker threads, waits for a running parallel loop to finish first
+		void setThreadCount(unsigned int threadCount);
+
+		// Invokes function(i) for every i in [0, count) and blocks until all invocations have finished.
+		// Nested or concurrent calls are executed serially on the calling thread.
+		void parallelFor(std::size_t count, const std::function<void(std::size_t)>& function);
+
+	private:
+		void start(unsigned int threadCount);
+		void stop();
+		void work(unsigned long long generation);
+		void run();
+
+		std::vector<std::thread> m_threads;
+		std::mutex m_mutex;
+		std::mutex m_callMutex;
+		std::condition_variable m_wakeCondition;
+		std::condition_variable m_doneCondition;
+
+		const std::function<void(std::size_t)>* m_function = nullptr;
+		std::size_t m_count = 0;
+		std::atomic<std::size_t> m_next = 0;
+		unsigned int m_activeThreads = 0;
+		unsigned long long m_generation = 0;
+		bool m_stop = false;
+	};
+}
@@ -0,0 +1,194 @@
+#include "TimestepStream.h"
+#include "Protein.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace dynamol;
+using namespace glm;
+
+vec3 TimestepStream::Quantization::decode(const u16vec4& position) const
+{
+	return origin + extent * (vec3(float(position.x), float(position.y), float(position.z)) / 65535.0f);
+}
+
+vec3 TimestepStream::Quantization::maximumError() const
+{
+	return extent / (2.0f * 65535.0f);
+}
+
+TimestepStream::TimestepStream(const Protein* protein, Format format, std::size_t windowSize) : m_protein(protein), m_format(format), m_timestepCount(protein->timestepCount())
+{
+	// timestep t is always decoded into frame t % windowSize, so a window never contains the same frame twice
+	m_frames.resize(std::max<std::size_t>(std::min(windowSize, m_timestepCount), 1));
+
+	if (m_timestepCount > 0)
+		m_thread = std::thread(&TimestepStream::work, this);
+}
+
+TimestepStream::~TimestepStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_workCondition.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+TimestepStream::Format TimestepStream::format() const
+{
+	return m_format;
+}
+
+std::size_t TimestepStream::elementSize(Format format)
+{
+	switch (format)
+	{
+	case Format::Positions:
+		return sizeof(vec3);
+	case Format::QuantizedPositions:
+		return sizeof(u16vec4);
+	default:
+		return sizeof(vec4);
+	}
+}
+
+void TimestepStream::seek(std::size_t timestep)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_playhead == timestep)
+			return;
+
+		m_playhead = timestep;
+	}
+
+	m_workCondition.notify_all();
+}
+
+bool TimestepStream::read(std::size_t timestep, void* destination, bool wait, Quantization* quantization)
+{
+	if (timestep >= m_timestepCount)
+		return false;
+
+	seek(timestep);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	const Frame& frame = m_frames[timestep % m_frames.size()];
+
+	const auto available = [&frame, timestep] { return frame.ready && frame.timestep == timestep; };
+
+	if (wait)
+		m_readyCondition.wait(lock, available);
+	else if (!available())
+		return false;
+
+	if (m_format == Format::Atoms)
+		std::memcpy(destination, frame.atoms.data(), frame.atoms.size() * sizeof(vec4));
+	else if (m_format == Format::Positions)
+		std::memcpy(destination, frame.positions.data(), frame.positions.size() * sizeof(vec3));
+	else
+		std::memcpy(destination, frame.quantizedPositions.data(), frame.quantizedPositions.size() * sizeof(u16vec4));
+
+	if (quantization)
+		*quantization = frame.quantization;
+
+	return true;
+}
+
+void TimestepStream::work()
+{
+	Frame decoded;
+	std::vector<vec3> positions;
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (!m_stop)
+	{
+		// find the first timestep in the window after the playhead that has not been decoded yet
+		std::size_t timestep = m_timestepCount;
+
+		for (std::size_t i = 0; i < m_frames.size(); i++)
+		{
+			const std::size_t t = (m_playhead + i) % m_timestepCount;
+			const Frame& frame = m_frames[t % m_frames.size()];
+
+			if (!frame.ready || frame.timestep != t)
+			{
+				timestep = t;
+				break;
+			}
+		}
+
+		if (timestep == m_timestepCount)
+		{
+			m_workCondition.wait(lock);
+			continue;
+		}
+
+		lock.unlock();
+		decode(timestep, decoded, positions);
+		lock.lock();
+
+		// the buffers of the replaced frame are reused for the next one
+		Frame& frame = m_frames[timestep % m_frames.size()];
+		frame.atoms.swap(decoded.atoms);
+		frame.positions.swap(decoded.positions);
+		frame.quantizedPositions.swap(decoded.quantizedPositions);
+		frame.quantization = decoded.quantization;
+		frame.timestep = timestep;
+		frame.ready = true;
+
+		m_readyCondition.notify_all();
+	}
+}
+
+void TimestepStream::decode(std::size_t timestep, Frame& frame, std::vector<vec3>& positions) const
+{
+	if (m_format == Format::Atoms)
+	{
+		m_protein->loadTimestep(timestep, frame.atoms);
+		return;
+	}
+
+	if (m_format == Format::Positions)
+	{
+		m_protein->loadPositions(timestep, frame.positions);
+		return;
+	}
+
+	m_protein->loadPositions(timestep, positions);
+
+	// Frames of trajectories may leave the bounds of the protein, which are then only extended for this timestep
+	vec3 lower = m_protein->minimumBounds();
+	vec3 upper = m_protein->maximumBounds();
+
+	for (const auto& p : positions)
+	{
+		lower = min(lower, p);
+		upper = max(upper, p);
+	}
+
+	frame.quantization.origin = lower;
+	frame.quantization.extent = max(upper - lower, vec3(0.0f));
+
+	vec3 scale = vec3(0.0f);
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (frame.quantization.extent[i] > 0.0f)
+			scale[i] = 65535.0f / frame.quantization.extent[i];
+	}
+
+	frame.quantizedPositions.resize(positions.size());
+
+	for (std::size_t i = 0; i < positions.size(); i++)
+	{
+		const vec3 q = clamp(round((positions[i] - lower) * scale), 0.0f, 65535.0f);
+		frame.quantizedPositions[i] = u16vec4(std::uint16_t(q.x), std::uint16_t(q.y), std::uint16_t(q.z), 0);
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+namespace dynamol
+{
+	class Protein;
+
+	// Decodes a bounded window of timesteps following the playhead on a background thread,
+	// so that only a constant number of timesteps is held in memory during playback
+	class TimestepStream
+	{
+	public:
+		enum class Format
+		{
+			// vec4 per atom with the attributes packed into w, as returned by Protein::loadTimestep
+			Atoms,
+			// vec3 per atom, the attributes are taken from Protein::staticAttributes
+			Positions,
+			// u16vec4 per atom in fixed point relative to the bounds of the timestep, w is unused
+			QuantizedPositions
+		};
+
+		// Maps quantized positions back to model space, position = origin + extent * quantized / 65535
+		struct Quantization
+		{
+			glm::vec3 origin = glm::vec3(0.0f);
+			glm::vec3 extent = glm::vec3(1.0f);
+
+			glm::vec3 decode(const glm::u16vec4& position) const;
+
+			// largest per-axis distance between a position and its decoded quantization, not counting float rounding
+			glm::vec3 maximumError() const;
+		};
+
+		// Positions and QuantizedPositions require Protein::hasStaticAttributes
+		TimestepStream(const Protein* protein, Format format = Format::Atoms, std::size_t windowSize = 8);
+		~TimestepStream();
+
+		TimestepStream(const TimestepStream&) = delete;
+		TimestepStream& operator=(const TimestepStream&) = delete;
+
+		Format format() const;
+
+		// Size of a single atom in the destination of read
+		static std::size_t elementSize(Format format);
+
+		// Moves the playhead, the following timesteps are decoded ahead of time
+		void seek(std::size_t timestep);
+
+		// Copies a decoded timestep to the destination, which must hold at least atomCount(timestep) elements of the stream's format.
+		// Moves the playhead and returns false if the timestep is not available yet and wait is false.
+		// The quantization of the timestep is returned for QuantizedPositions, the identity otherwise.
+		bool read(std::size_t timestep, void* destination, bool wait, Quantization* quantization = nullptr);
+
+	private:
+		struct Frame
+		{
+			std::size_t timestep = 0;
+			bool ready = false;
+			std::vector<glm::vec4> atoms;
+			std::vector<glm::vec3> positions;
+			std::vector<glm::u16vec4> quantizedPositions;
+			Quantization quantization;
+		};
+
+		void work();
+		void decode(std::size_t timestep, Frame& frame, std::vector<glm::vec3>& positions) const;
+
+		const Protein* m_protein = nullptr;
+		Format m_format = Format::Atoms;
+		std::size_t m_timestepCount = 0;
+		std::vector<Frame> m_frames;
+
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_workCondition;
+		std::condition_variable m_readyCondition;
+		std::size_t m_playhead = 0;
+		bool m_stop = false;
+	};
+}
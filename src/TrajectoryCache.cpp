@@ -0,0 +1,453 @@
+#include "TrajectoryCache.h"
+#include "Protein.h"
+#include "ThreadPool.h"
+
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <globjects/globjects.h>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	const char magic[8] = { 'D', 'Y', 'N', 'A', 'M', 'O', 'L', 'C' };
+	const std::uint64_t pageSize = 4096;
+
+	// all timesteps share the attributes of the first one, caches written before this flag existed are treated as varying
+	const std::uint32_t staticAttributesFlag = 1;
+
+	struct Header
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t timestepCount;
+		std::uint64_t sourceSize;
+		std::int64_t sourceModificationTime;
+		std::uint64_t sourceHash;
+		std::uint32_t elementIdCount;
+		std::uint32_t residueNameCount;
+		std::uint32_t chainNameCount;
+		std::uint32_t flags;
+		float minimumBounds[3];
+		float maximumBounds[3];
+		std::uint32_t groupCount;
+		std::uint32_t reserved;
+		std::uint64_t timestepTableOffset;
+		std::uint64_t dataOffset;
+	};
+
+	struct SourceKey
+	{
+		std::uint64_t size = 0;
+		std::int64_t modificationTime = 0;
+		std::uint64_t hash = 0;
+	};
+
+	std::uint64_t align(std::uint64_t offset, std::uint64_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// the id tables follow the header, the element ids are followed by the 64-bit residue and chain names, the groups and their residue numbers
+	struct TableOffsets
+	{
+		std::uint64_t elementIds = 0;
+		std::uint64_t residueNames = 0;
+		std::uint64_t chainNames = 0;
+		std::uint64_t groups = 0;
+		std::uint64_t residueNumbers = 0;
+		std::uint64_t end = 0;
+	};
+
+	TableOffsets tableOffsets(const Header& header)
+	{
+		TableOffsets offsets;
+		offsets.elementIds = sizeof(Header);
+		offsets.residueNames = align(offsets.elementIds + std::uint64_t(header.elementIdCount) * sizeof(std::uint32_t), sizeof(std::uint64_t));
+		offsets.chainNames = offsets.residueNames + std::uint64_t(header.residueNameCount) * sizeof(std::uint64_t);
+		offsets.groups = offsets.chainNames + std::uint64_t(header.chainNameCount) * sizeof(std::uint64_t);
+		offsets.residueNumbers = offsets.groups + std::uint64_t(header.groupCount) * sizeof(uvec2);
+		offsets.end = offsets.residueNumbers + std::uint64_t(header.groupCount) * sizeof(std::int32_t);
+
+		return offsets;
+	}
+
+	template <typename T>
+	void writeTable(std::ofstream& file, const std::vector<T>& table)
+	{
+		file.write(reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(T)));
+	}
+
+	template <typename T>
+	void readTable(const char* data, std::uint64_t offset, std::size_t count, std::vector<T>& table)
+	{
+		table.resize(count);
+
+		if (count > 0)
+			std::memcpy(table.data(), data + offset, count * sizeof(T));
+	}
+
+	// 64-bit FNV-1a
+	std::uint64_t hash(const char* data, std::size_t size, std::uint64_t value = 14695981039346656037ull)
+	{
+		for (std::size_t i = 0; i < size; i++)
+		{
+			value ^= std::uint64_t(static_cast<unsigned char>(data[i]));
+			value *= 1099511628211ull;
+		}
+
+		return value;
+	}
+
+	// Hashing gigabytes of text on every start would defeat the purpose of the cache, so only the head, the tail
+	// and evenly spaced blocks of larger files are hashed. Together with size and modification time, this reliably
+	// detects regenerated or edited files.
+	std::uint64_t sampledHash(const char* data, std::size_t size)
+	{
+		const std::size_t edgeSize = 64 * 1024;
+		const std::size_t blockSize = 4096;
+		const std::size_t blockCount = 64;
+
+		std::uint64_t value = hash(reinterpret_cast<const char*>(&size), sizeof(size));
+
+		if (size <= 2 * edgeSize + blockCount * blockSize)
+			return hash(data, size, value);
+
+		value = hash(data, edgeSize, value);
+		value = hash(data + size - edgeSize, edgeSize, value);
+
+		const std::size_t stride = (size - 2 * edgeSize - blockSize) / blockCount;
+
+		for (std::size_t i = 0; i < blockCount; i++)
+			value = hash(data + edgeSize + i * stride, blockSize, value);
+
+		return value;
+	}
+
+	bool sourceKey(const std::string& filename, SourceKey& key)
+	{
+		std::error_code error;
+		const auto modificationTime = std::filesystem::last_write_time(filename, error);
+
+		if (error)
+			return false;
+
+		MappedFile file(filename);
+
+		if (!file.isOpen())
+			return false;
+
+		key.size = file.size();
+		key.modificationTime = std::int64_t(modificationTime.time_since_epoch().count());
+		key.hash = sampledHash(file.data(), file.size());
+
+		return true;
+	}
+
+	void pad(std::ofstream& file, std::uint64_t offset)
+	{
+		static const char zeros[pageSize] = {};
+		const std::uint64_t position = std::uint64_t(file.tellp());
+
+		if (offset > position)
+			file.write(zeros, std::streamsize(offset - position));
+	}
+}
+
+std::string TrajectoryCache::filename(const std::string& sourceFilename)
+{
+	// files of the same name in different directories are told apart by a hash of their absolute path
+	std::error_code error;
+	const std::filesystem::path source(sourceFilename);
+	const std::filesystem::path absolute = std::filesystem::absolute(source, error);
+	const std::string path = error ? sourceFilename : absolute.lexically_normal().string();
+
+	std::uint64_t hash = 14695981039346656037ull;
+
+	for (char c : path)
+		hash = (hash ^ std::uint64_t(static_cast<unsigned char>(c))) * 1099511628211ull;
+
+	char suffix[18];
+	std::snprintf(suffix, sizeof(suffix), "-%016llx", static_cast<unsigned long long>(hash));
+
+	return (std::filesystem::path(directory) / (source.filename().string() + suffix + ".dynamolcache")).string();
+}
+
+bool TrajectoryCache::write(const std::string& sourceFilename, const Protein& protein)
+{
+	SourceKey key;
+
+	if (!sourceKey(sourceFilename, key))
+		return false;
+
+	const std::string cacheFilename = filename(sourceFilename);
+	const std::string temporaryFilename = cacheFilename + ".tmp";
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	std::ofstream file(temporaryFilename, std::ios::binary | std::ios::trunc);
+
+	if (!file)
+	{
+		globjects::debug() << "Could not write trajectory cache " << cacheFilename << ".";
+		return false;
+	}
+
+	Header header = {};
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = Version;
+	header.timestepCount = std::uint32_t(protein.timestepCount());
+	header.sourceSize = key.size;
+	header.sourceModificationTime = key.modificationTime;
+	header.sourceHash = key.hash;
+	header.elementIdCount = std::uint32_t(protein.activeElementIds().size());
+	header.residueNameCount = std::uint32_t(protein.activeResidueNames().size());
+	header.chainNameCount = std::uint32_t(protein.activeChainNames().size());
+	header.groupCount = std::uint32_t(protein.activeGroups().size());
+	header.flags = protein.hasStaticAttributes() ? staticAttributesFlag : 0;
+
+	for (int i = 0; i < 3; i++)
+	{
+		header.minimumBounds[i] = protein.minimumBounds()[i];
+		header.maximumBounds[i] = protein.maximumBounds()[i];
+	}
+
+	const TableOffsets offsets = tableOffsets(header);
+	header.timestepTableOffset = align(offsets.end, sizeof(std::uint64_t));
+	header.dataOffset = align(header.timestepTableOffset + std::uint64_t(header.timestepCount) * sizeof(Timestep), pageSize);
+
+	std::vector<Timestep> timesteps(protein.timestepCount());
+	std::uint64_t offset = header.dataOffset;
+
+	for (std::size_t i = 0; i < timesteps.size(); i++)
+	{
+		timesteps[i].offset = offset;
+		timesteps[i].atomCount = protein.atomCount(i);
+		offset += timesteps[i].atomCount * sizeof(vec4);
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	writeTable(file, protein.activeElementIds());
+	pad(file, offsets.residueNames);
+	writeTable(file, protein.activeResidueNames());
+	writeTable(file, protein.activeChainNames());
+	writeTable(file, protein.activeGroups());
+	writeTable(file, protein.activeResidueNumbers());
+
+	pad(file, header.timestepTableOffset);
+	file.write(reinterpret_cast<const char*>(timesteps.data()), std::streamsize(timesteps.size() * sizeof(Timestep)));
+	pad(file, header.dataOffset);
+
+	// timesteps are decoded in parallel batches and written in order
+	ThreadPool& threadPool = ThreadPool::instance();
+	std::vector< std::vector<vec4> > batch(threadPool.threadCount());
+
+	for (std::size_t first = 0; first < timesteps.size(); first += batch.size())
+	{
+		const std::size_t count = std::min(batch.size(), timesteps.size() - first);
+
+		threadPool.parallelFor(count, [&](std::size_t i)
+		{
+			protein.loadTimestep(first + i, batch[i]);
+		});
+
+		for (std::size_t i = 0; i < count; i++)
+			file.write(reinterpret_cast<const char*>(batch[i].data()), std::streamsize(batch[i].size() * sizeof(vec4)));
+	}
+
+	file.close();
+
+	if (!file)
+	{
+		globjects::debug() << "Could not write trajectory cache " << cacheFilename << ".";
+		std::filesystem::remove(temporaryFilename, error);
+		return false;
+	}
+
+	// the cache only becomes visible once it is complete
+	std::filesystem::rename(temporaryFilename, cacheFilename, error);
+
+	if (error)
+	{
+		globjects::debug() << "Could not write trajectory cache " << cacheFilename << ".";
+		std::filesystem::remove(temporaryFilename, error);
+		return false;
+	}
+
+	globjects::debug() << "Trajectory cache written to " << cacheFilename << ".";
+	return true;
+}
+
+TrajectoryCache::TrajectoryCache()
+{
+
+}
+
+TrajectoryCache::~TrajectoryCache()
+{
+	close();
+}
+
+bool TrajectoryCache::open(const std::string& sourceFilename)
+{
+	close();
+
+	SourceKey key;
+
+	if (!sourceKey(sourceFilename, key))
+		return false;
+
+	if (!m_file.open(filename(sourceFilename)))
+		return false;
+
+	const char* data = m_file.data();
+	const std::uint64_t size = m_file.size();
+
+	Header header;
+
+	if (size < sizeof(Header))
+	{
+		close();
+		return false;
+	}
+
+	std::memcpy(&header, data, sizeof(Header));
+
+	const TableOffsets offsets = tableOffsets(header);
+
+	const bool valid = std::memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+		header.version == Version &&
+		header.sourceSize == key.size &&
+		header.sourceModificationTime == key.modificationTime &&
+		header.sourceHash == key.hash &&
+		header.groupCount <= Protein::maximumGroupCount &&
+		header.timestepTableOffset >= offsets.end &&
+		header.dataOffset >= header.timestepTableOffset + std::uint64_t(header.timestepCount) * sizeof(Timestep) &&
+		header.dataOffset % pageSize == 0 &&
+		header.dataOffset <= size;
+
+	if (!valid)
+	{
+		close();
+		return false;
+	}
+
+	readTable(data, offsets.elementIds, header.elementIdCount, m_elementIds);
+	readTable(data, offsets.residueNames, header.residueNameCount, m_residueNames);
+	readTable(data, offsets.chainNames, header.chainNameCount, m_chainNames);
+	readTable(data, offsets.groups, header.groupCount, m_groups);
+	readTable(data, offsets.residueNumbers, header.groupCount, m_residueNumbers);
+
+	const bool elementsValid = !m_elementIds.empty() && m_elementIds.size() <= 256 &&
+		std::all_of(m_elementIds.begin(), m_elementIds.end(), [](uint id) { return id < Protein::elementRadii().size(); });
+
+	const bool groupsValid = !m_residueNames.empty() && !m_chainNames.empty() && !m_groups.empty() &&
+		std::all_of(m_groups.begin(), m_groups.end(), [this](const uvec2& g) { return g.x < m_residueNames.size() && g.y < m_chainNames.size(); });
+
+	if (!elementsValid || !groupsValid)
+	{
+		close();
+		return false;
+	}
+
+	m_timesteps.resize(header.timestepCount);
+
+	if (!m_timesteps.empty())
+		std::memcpy(m_timesteps.data(), data + header.timestepTableOffset, m_timesteps.size() * sizeof(Timestep));
+
+	for (const auto& t : m_timesteps)
+	{
+		if (t.offset < header.dataOffset || t.offset % sizeof(vec4) != 0 || t.atomCount > (size - std::min(size, t.offset)) / sizeof(vec4))
+		{
+			close();
+			return false;
+		}
+	}
+
+	m_staticAttributes = (header.flags & staticAttributesFlag) != 0 && !m_timesteps.empty() &&
+		std::all_of(m_timesteps.begin(), m_timesteps.end(), [this](const Timestep& t) { return t.atomCount == m_timesteps.front().atomCount; });
+
+	m_minimumBounds = vec3(header.minimumBounds[0], header.minimumBounds[1], header.minimumBounds[2]);
+	m_maximumBounds = vec3(header.maximumBounds[0], header.maximumBounds[1], header.maximumBounds[2]);
+
+	return true;
+}
+
+void TrajectoryCache::close()
+{
+	m_file.close();
+	m_timesteps.clear();
+	m_staticAttributes = false;
+	m_elementIds.clear();
+	m_residueNames.clear();
+	m_chainNames.clear();
+	m_groups.clear();
+	m_residueNumbers.clear();
+}
+
+bool TrajectoryCache::isOpen() const
+{
+	return m_file.isOpen();
+}
+
+bool TrajectoryCache::hasStaticAttributes() const
+{
+	return m_staticAttributes;
+}
+
+std::size_t TrajectoryCache::timestepCount() const
+{
+	return m_timesteps.size();
+}
+
+std::size_t TrajectoryCache::atomCount(std::size_t timestep) const
+{
+	return std::size_t(m_timesteps[timestep].atomCount);
+}
+
+const vec4* TrajectoryCache::atomData(std::size_t timestep) const
+{
+	return reinterpret_cast<const vec4*>(m_file.data() + m_timesteps[timestep].offset);
+}
+
+const std::vector<uint>& TrajectoryCache::elementIds() const
+{
+	return m_elementIds;
+}
+
+const std::vector<std::uint64_t>& TrajectoryCache::residueNames() const
+{
+	return m_residueNames;
+}
+
+const std::vector<std::uint64_t>& TrajectoryCache::chainNames() const
+{
+	return m_chainNames;
+}
+
+const std::vector<uvec2>& TrajectoryCache::groups() const
+{
+	return m_groups;
+}
+
+const std::vector<std::int32_t>& TrajectoryCache::residueNumbers() const
+{
+	return m_residueNumbers;
+}
+
+vec3 TrajectoryCache::minimumBounds() const
+{
+	return m_minimumBounds;
+}
+
+vec3 TrajectoryCache::maximumBounds() const
+{
+	return m_maximumBounds;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+	class Protein;
+
+	// Binary file in the cache directory holding the decoded timesteps, id tables and bounds of a source file.
+	// The cache is keyed by size, modification time and a sampled content hash of the source file
+	// and is memory-mapped when opened, so timesteps can be uploaded without intermediate copies.
+	class TrajectoryCache
+	{
+	public:
+		static const std::uint32_t Version = 4;
+		static constexpr const char* directory = "./cache/trajectories";
+
+		static std::string filename(const std::string& sourceFilename);
+		static bool write(const std::string& sourceFilename, const Protein& protein);
+
+		TrajectoryCache();
+		~TrajectoryCache();
+
+		// Maps the cache belonging to the given source file, fails if it is missing, outdated or corrupt
+		bool open(const std::string& sourceFilename);
+		void close();
+		bool isOpen() const;
+
+		// Returns whether the cached protein stored its attributes only once, see Protein::hasStaticAttributes
+		bool hasStaticAttributes() const;
+
+		std::size_t timestepCount() const;
+		std::size_t atomCount(std::size_t timestep) const;
+		const glm::vec4* atomData(std::size_t timestep) const;
+
+		const std::vector<glm::uint>& elementIds() const;
+		const std::vector<std::uint64_t>& residueNames() const;
+		const std::vector<std::uint64_t>& chainNames() const;
+		const std::vector<glm::uvec2>& groups() const;
+		const std::vector<std::int32_t>& residueNumbers() const;
+
+		glm::vec3 minimumBounds() const;
+		glm::vec3 maximumBounds() const;
+
+	private:
+		struct Timestep
+		{
+			std::uint64_t offset = 0;
+			std::uint64_t atomCount = 0;
+		};
+
+		MappedFile m_file;
+		std::vector<Timestep> m_timesteps;
+		bool m_staticAttributes = false;
+
+		std::vector<glm::uint> m_elementIds;
+		std::vector<std::uint64_t> m_residueNames;
+		std::vector<std::uint64_t> m_chainNames;
+		std::vector<glm::uvec2> m_groups;
+		std::vector<std::int32_t> m_residueNumbers;
+
+		glm::vec3 m_minimumBounds = glm::vec3(0.0);
+		glm::vec3 m_maximumBounds = glm::vec3(0.0);
+	};
+}
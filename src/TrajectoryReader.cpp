@@ -0,0 +1,23 @@
+#include "TrajectoryReader.h"
+#include "DcdReader.h"
+#include "XtcReader.h"
+
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+
+using namespace dynamol;
+
+std::unique_ptr<TrajectoryReader> TrajectoryReader::create(const std::string& filename)
+{
+	std::string extension = std::filesystem::path(filename).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+
+	if (extension == ".dcd")
+		return std::make_unique<DcdReader>();
+
+	if (extension == ".xtc")
+		return std::make_unique<XtcReader>();
+
+	return nullptr;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+	// Random access to the atom positions of a binary molecular dynamics trajectory
+	class TrajectoryReader
+	{
+	public:
+		// Creates a reader based on the file extension (.dcd or .xtc), returns nullptr for unknown formats
+		static std::unique_ptr<TrajectoryReader> create(const std::string& filename);
+
+		virtual ~TrajectoryReader() = default;
+
+		virtual bool open(const std::string& filename) = 0;
+		virtual std::size_t frameCount() const = 0;
+		virtual std::size_t atomCount() const = 0;
+
+		// Reads the atom positions of a frame in Angstrom, safe to call from multiple threads
+		virtual bool readFrame(std::size_t frame, std::vector<glm::vec3>& positions) const = 0;
+	};
+}
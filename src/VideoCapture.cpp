@@ -0,0 +1,273 @@
+#include "VideoCapture.h"
+
+#include <globjects/globjects.h>
+
+#include <algorithm>
+#include <csignal>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+using namespace globjects;
+
+namespace
+{
+	bool endsWith(const std::string& text, const std::string& suffix)
+	{
+		return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+}
+
+VideoCapture::VideoCapture(FrameReadback* readback, const std::string& destination, const ivec2& size, int frameRate) : m_readback(readback), m_destination(destination), m_size(size), m_frameRate(std::max(frameRate, 1))
+{
+	m_format = (endsWith(destination, ".rgb") || endsWith(destination, ".raw")) ? Format::RGB : Format::Y4M;
+	m_pipe = !destination.empty() && destination[0] == '|';
+
+	if (m_pipe)
+	{
+#ifdef _WIN32
+		m_file = popen(destination.substr(1).c_str(), "wb");
+#else
+		// an encoder that exits early would otherwise terminate the viewer on the next write
+		std::signal(SIGPIPE, SIG_IGN);
+		m_file = popen(destination.substr(1).c_str(), "w");
+#endif
+	}
+	else
+	{
+		m_file = std::fopen(destination.c_str(), "wb");
+	}
+
+	if (!m_file)
+	{
+		globjects::critical() << "Could not open " << destination << " for video capture.";
+		return;
+	}
+
+	// Every Y4M frame starts with its own header line, the planes follow without padding
+	if (m_format == Format::Y4M)
+	{
+		const std::string header = "YUV4MPEG2 W" + std::to_string(m_size.x) + " H" + std::to_string(m_size.y) + " F" + std::to_string(m_frameRate) + ":1 Ip A1:1 C444\n";
+		std::fwrite(header.data(), 1, header.size(), m_file);
+		m_frameSize = 6 + std::size_t(m_size.x) * std::size_t(m_size.y) * 3;
+	}
+	else
+	{
+		m_frameSize = std::size_t(m_size.x) * std::size_t(m_size.y) * 3;
+	}
+
+	m_thread = std::thread(&VideoCapture::run, this);
+}
+
+VideoCapture::~VideoCapture()
+{
+	if (!m_file)
+		return;
+
+	// the callbacks of frames still being read refer to this capture
+	m_readback->finish();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+
+	m_queued.notify_all();
+	m_thread.join();
+
+	if (m_pipe)
+		pclose(m_file);
+	else
+		std::fclose(m_file);
+}
+
+bool VideoCapture::isOpen() const
+{
+	return m_file != nullptr;
+}
+
+const std::string& VideoCapture::destination() const
+{
+	return m_destination;
+}
+
+const ivec2& VideoCapture::size() const
+{
+	return m_size;
+}
+
+int VideoCapture::frameRate() const
+{
+	return m_frameRate;
+}
+
+VideoCapture::Format VideoCapture::format() const
+{
+	return m_format;
+}
+
+bool VideoCapture::capture(Framebuffer* framebuffer, GLenum buffer, const ivec2& size)
+{
+	if (!m_file || size != m_size)
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_statistics.failed)
+			return false;
+	}
+
+	// The readback only blocks once all of its buffers wait for a full queue
+	const auto startTime = std::chrono::steady_clock::now();
+	m_readback->read(framebuffer, buffer, size, [this](const FrameReadback::Image& image) { convert(image); }, true);
+	const double waitTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_statistics.capturedFrames++;
+	m_statistics.waitTime += waitTime;
+	m_statistics.maximumWaitTime = std::max(m_statistics.maximumWaitTime, waitTime);
+
+	return true;
+}
+
+VideoCapture::Statistics VideoCapture::statistics() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Statistics statistics = m_statistics;
+	statistics.queueDepth = m_queue.size();
+	statistics.elapsedTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+
+	return statistics;
+}
+
+void VideoCapture::convert(const FrameReadback::Image& image)
+{
+	std::vector<unsigned char> frame;
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (m_queue.size() >= maximumQueueDepth)
+		{
+			m_statistics.fullQueueFrames++;
+			m_written.wait(lock, [this] { return m_queue.size() < maximumQueueDepth; });
+		}
+
+		// frames are recycled, so the queue allocates at most maximumQueueDepth of them
+		if (!m_freeFrames.empty())
+		{
+			frame = std::move(m_freeFrames.back());
+			m_freeFrames.pop_back();
+		}
+	}
+
+	frame.resize(m_frameSize);
+
+	const std::size_t width = std::size_t(m_size.x);
+	const std::size_t height = std::size_t(m_size.y);
+	const std::size_t pixelCount = width * height;
+
+	// The rows of the readback start at the bottom, videos start at the top
+	if (m_format == Format::Y4M)
+	{
+		std::copy_n("FRAME\n", 6, frame.begin());
+		unsigned char* yPlane = frame.data() + 6;
+		unsigned char* uPlane = yPlane + pixelCount;
+		unsigned char* vPlane = uPlane + pixelCount;
+
+		for (std::size_t y = 0; y < height; y++)
+		{
+			const unsigned char* source = image.data + (height - 1 - y) * width * 4;
+			const std::size_t row = y * width;
+
+			// BT.601 with limited range in fixed point, which is what decoders assume for streams without color tags
+			for (std::size_t x = 0; x < width; x++)
+			{
+				const int r = source[4 * x];
+				const int g = source[4 * x + 1];
+				const int b = source[4 * x + 2];
+
+				yPlane[row + x] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+				uPlane[row + x] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				vPlane[row + x] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+			}
+		}
+	}
+	else
+	{
+		for (std::size_t y = 0; y < height; y++)
+		{
+			const unsigned char* source = image.data + (height - 1 - y) * width * 4;
+			unsigned char* target = frame.data() + y * width * 3;
+
+			for (std::size_t x = 0; x < width; x++)
+			{
+				target[3 * x] = source[4 * x];
+				target[3 * x + 1] = source[4 * x + 1];
+				target[3 * x + 2] = source[4 * x + 2];
+			}
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(std::move(frame));
+		m_statistics.peakQueueDepth = std::max(m_statistics.peakQueueDepth, m_queue.size());
+	}
+
+	m_queued.notify_one();
+}
+
+void VideoCapture::run()
+{
+	while (true)
+	{
+		std::vector<unsigned char> frame;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queued.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+
+			if (m_queue.empty())
+				break;
+
+			frame = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+
+		// after a failed write, the remaining frames are discarded so that the readback never waits for the writer
+		bool failed = false;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			failed = m_statistics.failed;
+		}
+
+		const bool written = !failed && std::fwrite(frame.data(), 1, frame.size(), m_file) == frame.size();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (written)
+			{
+				m_statistics.writtenFrames++;
+				m_statistics.writtenBytes += frame.size();
+			}
+			else
+			{
+				m_statistics.failed = true;
+			}
+
+			m_freeFrames.push_back(std::move(frame));
+		}
+
+		m_written.notify_all();
+	}
+}
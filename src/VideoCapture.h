@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glbinding/gl/gl.h>
+#include <globjects/Framebuffer.h>
+#include <glm/glm.hpp>
+
+#include "FrameReadback.h"
+
+namespace dynamol
+{
+	// Streams every frame of the viewer into a file, or into the standard input of an encoder when the destination starts with a
+	// pipe, e.g. "|ffmpeg -i - -c:v libx264 -crf 18 movie.mp4". Destinations ending in .rgb or .raw receive raw RGB frames with 8
+	// bits per channel, all others a YUV4MPEG2 stream with full chroma resolution, which encoders read without further options.
+	//
+	// The frames are read through the asynchronous readback of the viewer and converted on its worker thread, and a writer thread
+	// writes them out. At most maximumQueueDepth frames wait for the writer; once the queue is full, the readback and eventually
+	// the render loop wait for it instead of dropping frames, as the viewer advances its time by a fixed step for every captured
+	// frame. The statistics show how often and how long this happened.
+	class VideoCapture
+	{
+	public:
+		enum class Format { Y4M, RGB };
+
+		struct Statistics
+		{
+			std::size_t capturedFrames = 0;
+			std::size_t writtenFrames = 0;
+			std::size_t queueDepth = 0;
+			std::size_t peakQueueDepth = 0;
+
+			// frames that found the queue full and waited for the writer
+			std::size_t fullQueueFrames = 0;
+
+			// time in milliseconds that the render loop spent waiting for a readback buffer
+			double waitTime = 0.0;
+			double maximumWaitTime = 0.0;
+
+			std::size_t writtenBytes = 0;
+			double elapsedTime = 0.0;
+			bool failed = false;
+		};
+
+		static const std::size_t maximumQueueDepth = 8;
+
+		VideoCapture(FrameReadback* readback, const std::string& destination, const glm::ivec2& size, int frameRate);
+
+		// Waits for the frames still in flight to be written and closes the destination
+		~VideoCapture();
+
+		bool isOpen() const;
+		const std::string& destination() const;
+		const glm::ivec2& size() const;
+		int frameRate() const;
+		Format format() const;
+
+		// Queues the framebuffer as the next frame, returns false if its size differs from that of the video or writing failed
+		bool capture(globjects::Framebuffer* framebuffer, gl::GLenum buffer, const glm::ivec2& size);
+
+		Statistics statistics() const;
+
+	private:
+		void convert(const FrameReadback::Image& image);
+		void run();
+
+		FrameReadback* m_readback;
+		std::string m_destination;
+		glm::ivec2 m_size;
+		int m_frameRate;
+		Format m_format;
+		std::size_t m_frameSize = 0;
+
+		std::FILE* m_file = nullptr;
+		bool m_pipe = false;
+
+		std::thread m_thread;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_queued;
+		std::condition_variable m_written;
+		std::deque< std::vector<unsigned char> > m_queue;
+		std::vector< std::vector<unsigned char> > m_freeFrames;
+		bool m_stopping = false;
+
+		Statistics m_statistics;
+		std::chrono::steady_clock::time_point m_startTime = std::chrono::steady_clock::now();
+	};
+}
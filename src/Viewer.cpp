@@ -21,6 +21,7 @@
 #include <fstream>
 #include <sstream>
 #include <list>
+#include <algorithm>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
@@ -34,9 +35,22 @@ using namespace globjects;
 #include <backends/imgui_impl_opengl3.cpp>
 #include <backends/imgui_impl_glfw.cpp>
 
+namespace
+{
+	// the simulation grid has one cell per unit of the bounds of the protein
+	std::array<std::int32_t, 3> fluidCubeSize(const Protein* protein)
+	{
+		const glm::vec3 &minBounds{protein->minimumBounds()};
+		const glm::vec3 &maxBounds{protein->maximumBounds()};
+		return { std::int32_t(maxBounds.x + 1 - minBounds.x), std::int32_t(maxBounds.y + 1 - minBounds.y), std::int32_t(maxBounds.z + 1 - minBounds.z) };
+	}
+}
 
-Viewer::Viewer(GLFWwindow *window, Scene *scene) : m_window(window), m_scene(scene)
+Viewer::Viewer(GLFWwindow *window, Scene *scene, std::shared_ptr<ShaderCache> shaderCache) : m_window(window), m_scene(scene), m_shaderCache(shaderCache), m_defaultFramebuffer(Framebuffer::defaultFBO())
 {
+	if (!m_shaderCache)
+		m_shaderCache = std::make_shared<ShaderCache>(window, "./cache/shaders");
+
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO();
 
@@ -53,14 +67,13 @@ Viewer::Viewer(GLFWwindow *window, Scene *scene) : m_window(window), m_scene(sce
 
 	m_interactors.emplace_back(std::make_unique<CameraInteractor>(this));
 	m_renderers.emplace_back(std::make_unique<SphereRenderer>(this));
+	m_sphereRenderer = static_cast<SphereRenderer*>(m_renderers.back().get());
 
 	static constexpr auto CubeSize = 128;
 	std::int32_t width;
 	std::int32_t height;
 	glfwGetWindowSize(window, &width, &height);
-	const glm::vec3 &minBounds{scene->protein()->minimumBounds()};
-	const glm::vec3 &maxBounds{scene->protein()->maximumBounds()};
-	const std::array<std::int32_t, 3> cubeSize{maxBounds.x + 1 - minBounds.x, maxBounds.y + 1 - minBounds.y, maxBounds.z + 1 - minBounds.z};
+	const std::array<std::int32_t, 3> cubeSize{fluidCubeSize(scene->protein())};
 	//const std::array<std::int32_t, 3> cubeSize{256, 256, 256};
 	
 	m_interactors.emplace_back(std::make_unique<FluidSim>(m_renderers.back().get(), std::array{width, height}, cubeSize));
@@ -79,25 +92,57 @@ Viewer::Viewer(GLFWwindow *window, Scene *scene) : m_window(window), m_scene(sce
 	}
 }
 
+Viewer::~Viewer()
+{
+	// allows another viewer to be created for the same window afterwards
+	ImGui_ImplOpenGL3_Shutdown();
+	ImGui_ImplGlfw_Shutdown();
+	ImGui::DestroyContext();
+}
+
 void Viewer::display()
 {
+	m_profiler->beginFrame();
+	m_frameReadback->update();
+
+	// While capturing, every frame advances the time by the same step, however long it takes to render
+	const double timestep = m_videoCapture ? 1.0 / double(m_videoCapture->frameRate()) : m_timestep;
+
+	if (timestep > 0.0)
+		m_time += timestep;
+	else
+		m_time = glfwGetTime() - m_timeOffset;
+
 	beginFrame();
 	mainMenu();
 
+	framebuffer()->bind();
 	glClearColor(m_backgroundColor.r, m_backgroundColor.g, m_backgroundColor.b, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glViewport(0, 0, viewportSize().x, viewportSize().y);
 
-	m_fluidSim->Execute();
+	{
+		Profiler::Scope scope(m_profiler.get(), "fluid simulation");
+		m_fluidSim->Execute();
+	}
 
 	for (auto& r : m_renderers)
 	{
 		if (r->isEnabled())
 		{
+			framebuffer()->bind();
 			r->display();
 		}
 	}
 
+	// binaries are retrieved once the programs have been used, so they include everything set up after creating them
+	for (auto& r : m_renderers)
+	{
+		r->storeShaderBinaries();
+	}
+
+	framebuffer()->bind();
+
 	for (auto& i : m_interactors)
 	{
 		i->display();
@@ -121,13 +166,71 @@ FluidSim* Viewer::fluidSim()
 	return m_fluidSim;
 }
 
+SphereRenderer* Viewer::sphereRenderer()
+{
+	return m_sphereRenderer;
+}
+
+void Viewer::setProtein(std::unique_ptr<Protein> protein)
+{
+	// the previous protein is kept until the renderers have stopped reading from it
+	std::unique_ptr<Protein> previousProtein = m_scene->setProtein(std::move(protein));
+
+	for (auto& r : m_renderers)
+		r->proteinChanged();
+
+	m_fluidSim->Resize(fluidCubeSize(m_scene->protein()));
+}
+
+ShaderCache* Viewer::shaderCache()
+{
+	return m_shaderCache.get();
+}
+
+Profiler* Viewer::profiler()
+{
+	return m_profiler.get();
+}
+
 ivec2 Viewer::viewportSize() const
 {
+	if (m_framebuffer)
+		return m_framebufferSize;
+
 	int width, height;
 	glfwGetFramebufferSize(m_window, &width, &height);
 	return ivec2(width,height);
 }
 
+void Viewer::setFramebuffer(globjects::Framebuffer* framebuffer, const glm::ivec2& size)
+{
+	m_framebuffer = framebuffer;
+	m_framebufferSize = size;
+
+	// the interactors adapt to the new size like to a resized window
+	const ivec2 newSize = viewportSize();
+
+	for (auto& i : m_interactors)
+	{
+		i->framebufferSizeEvent(newSize.x, newSize.y);
+	}
+}
+
+void Viewer::setUiVisible(bool visible)
+{
+	m_showUi = visible;
+}
+
+globjects::Framebuffer* Viewer::framebuffer() const
+{
+	return m_framebuffer ? m_framebuffer : m_defaultFramebuffer.get();
+}
+
+GLenum Viewer::framebufferBuffer() const
+{
+	return m_framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK;
+}
+
 glm::vec3 Viewer::backgroundColor() const
 {
 	return m_backgroundColor;
@@ -213,15 +316,68 @@ void Viewer::setCameraPosition(const glm::vec3 &cameraPosition)
 	m_cameraPosition = cameraPosition;
 }
 
-void Viewer::saveImage(const std::string & filename)
+bool Viewer::saveImage(const std::string & filename, bool wait)
 {
-	uvec2 size = viewportSize();
-	std::vector<unsigned char> image(size.x*size.y * 4);
+	// the image is encoded on the worker thread of the readback, the flip only applies to stb_image_write
+	return m_frameReadback->read(framebuffer(), framebufferBuffer(), viewportSize(), [filename](const FrameReadback::Image& image)
+	{
+		stbi_flip_vertically_on_write(true);
+		stbi_write_png(filename.c_str(), image.size.x, image.size.y, 4, image.data, image.size.x * 4);
+	}, wait);
+}
+
+FrameReadback* Viewer::frameReadback()
+{
+	return m_frameReadback.get();
+}
+
+bool Viewer::startCapture(const std::string& destination, int frameRate)
+{
+	stopCapture();
+
+	auto capture = std::make_unique<VideoCapture>(m_frameReadback.get(), destination, viewportSize(), frameRate);
+
+	if (!capture->isOpen())
+		return false;
+
+	std::cout << "Capturing video to " << destination << " at " << capture->frameRate() << " frames/second ..." << std::endl;
+
+	m_captureFrameRate = capture->frameRate();
+	m_videoCapture = std::move(capture);
+
+	return true;
+}
+
+void Viewer::stopCapture()
+{
+	if (!m_videoCapture)
+		return;
+
+	// the time continues from the last captured frame
+	m_timeOffset = glfwGetTime() - m_time;
 
-	glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, (void*)&image.front());
+	const std::string destination = m_videoCapture->destination();
+	m_videoCapture.reset();
 
-	stbi_flip_vertically_on_write(true);
-	stbi_write_png(filename.c_str(), size.x, size.y, 4, &image.front(), size.x * 4);
+	std::cout << "Finished capturing video to " << destination << std::endl;
+}
+
+bool Viewer::isCapturing() const
+{
+	return m_videoCapture != nullptr;
+}
+
+double Viewer::time() const
+{
+	return m_time;
+}
+
+void Viewer::setTimestep(double timestep)
+{
+	m_timestep = std::max(timestep, 0.0);
+
+	// the time continues from the current frame when following the clock again
+	m_timeOffset = glfwGetTime() - m_time;
 }
 
 void Viewer::framebufferSizeCallback(GLFWwindow* window, int width, int height)
@@ -268,6 +424,18 @@ void Viewer::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 		{
 			viewer->m_saveScreenshot = true;
 		}
+		else if (key == GLFW_KEY_F3 && action == GLFW_RELEASE)
+		{
+			viewer->m_showProfiler = !viewer->m_showProfiler;
+		}
+		else if (key == GLFW_KEY_F4 && action == GLFW_RELEASE)
+		{
+			viewer->m_toggleTrace = true;
+		}
+		else if (key == GLFW_KEY_F6 && action == GLFW_RELEASE)
+		{
+			viewer->m_toggleCapture = true;
+		}
 		else if (key >= GLFW_KEY_1 && key <= GLFW_KEY_9 && action == GLFW_RELEASE)
 		{
 			int index = key - GLFW_KEY_1;
@@ -392,34 +560,49 @@ void Viewer::endFrame()
 
 	if (m_saveScreenshot)
 	{
-		std::string basename = scene()->protein()->filename();
-		size_t pos = basename.rfind('.', basename.length());
-
-		if (pos != std::string::npos)
-			basename = basename.substr(0,pos);
+		std::string filename = availableFilename("", ".png");
 
-		uint i = 0;
-		std::string filename;
-
-		for (uint i = 0; i <= 9999; i++)
+		// if every readback buffer is still in use, the screenshot is taken in one of the next frames
+		if (saveImage(filename))
 		{
-			std::stringstream ss;
-			ss << basename << "-";
-			ss << std::setw(4) << std::setfill('0') << i;
-			ss << ".png";
+			// reserves the name, so screenshots taken before the image is written get the next one
+			std::ofstream file(filename);
+			std::cout << "Saving screenshot to " << filename << " ..." << std::endl;
+			m_saveScreenshot = false;
+		}
+	}
 
-			filename = ss.str();
+	if (m_toggleTrace)
+	{
+		toggleTrace();
+		m_toggleTrace = false;
+	}
 
-			std::ifstream f(filename.c_str());
+	if (m_toggleCapture)
+	{
+		toggleCapture();
+		m_toggleCapture = false;
+	}
 
-			if (!f.good())
-				break;
+	// like screenshots, the frames of a video do not show the user interface
+	if (m_videoCapture)
+	{
+		if (!m_videoCapture->capture(framebuffer(), framebufferBuffer(), viewportSize()))
+		{
+			globjects::critical() << "Video capture stopped, the viewport was resized or the frames could not be written.";
+			stopCapture();
 		}
+		else
+		{
+			displayCaptureStatistics();
+		}
+	}
 
-		std::cout << "Saving screenshot to " << filename << " ..." << std::endl;
-
-		saveImage(filename);
-		m_saveScreenshot = false;
+	if (m_showProfiler)
+	{
+		ImGui::Begin("Profiler", &m_showProfiler);
+		m_profiler->displayOverlay();
+		ImGui::End();
 	}
 
 	ImGui::Begin("Debug Framebuffer");
@@ -428,7 +611,16 @@ void Viewer::endFrame()
 	ImGui::End();
 
 	if (m_showUi)
+	{
+		Profiler::Scope scope(m_profiler.get(), "ui");
+		framebuffer()->bind();
 		renderUi();
+	}
+	else
+	{
+		// the next frame can only be started once this one has ended
+		ImGui::EndFrame();
+	}
 }
 
 void Viewer::renderUi()
@@ -447,6 +639,12 @@ void Viewer::mainMenu()
 		if (ImGui::MenuItem("Screenshot", "F2"))
 			m_saveScreenshot = true;
 
+		if (ImGui::MenuItem(m_profiler->isTracing() ? "Stop Trace" : "Start Trace", "F4"))
+			m_toggleTrace = true;
+
+		if (ImGui::MenuItem(m_videoCapture ? "Stop Video Capture" : "Start Video Capture", "F6"))
+			m_toggleCapture = true;
+
 		if (ImGui::MenuItem("Exit", "Alt+F4"))
 			glfwSetWindowShouldClose(m_window, GLFW_TRUE);
 
@@ -456,6 +654,7 @@ void Viewer::mainMenu()
 	if (ImGui::BeginMenu("Settings"))
 	{
 		ImGui::ColorEdit3("Background", (float*)&m_backgroundColor);
+		ImGui::MenuItem("Profiler", "F3", &m_showProfiler);
 
 		if (ImGui::BeginMenu("Viewport"))
 		{
@@ -483,3 +682,74 @@ void Viewer::mainMenu()
 		ImGui::EndMenu();
 	}
 }
+
+void Viewer::toggleTrace()
+{
+	if (!m_profiler->isTracing())
+	{
+		std::cout << "Recording trace ..." << std::endl;
+		m_profiler->startTrace();
+		return;
+	}
+
+	std::string filename = availableFilename("-trace", ".json");
+	std::cout << "Saving trace to " << filename << " ..." << std::endl;
+
+	if (!m_profiler->stopTrace(filename))
+		globjects::critical() << "Could not write trace to " << filename << "!";
+}
+
+void Viewer::toggleCapture()
+{
+	if (m_videoCapture)
+		stopCapture();
+	else
+		startCapture(availableFilename("-video", ".y4m"), m_captureFrameRate);
+}
+
+void Viewer::displayCaptureStatistics()
+{
+	const VideoCapture::Statistics statistics = m_videoCapture->statistics();
+	const double elapsedTime = std::max(statistics.elapsedTime, 1e-9);
+
+	ImGui::Begin("Video Capture");
+	ImGui::Text("%s", m_videoCapture->destination().c_str());
+	ImGui::Text("%d x %d at %d frames/second", m_videoCapture->size().x, m_videoCapture->size().y, m_videoCapture->frameRate());
+	ImGui::Text("Frames: %zu captured, %zu written, %.1f frames/second", statistics.capturedFrames, statistics.writtenFrames, double(statistics.writtenFrames) / elapsedTime);
+	ImGui::Text("Queue: %zu of %zu, peak %zu, full for %zu frames", statistics.queueDepth, VideoCapture::maximumQueueDepth, statistics.peakQueueDepth, statistics.fullQueueFrames);
+	ImGui::Text("Render loop waited %.1f ms in total, at most %.2f ms", statistics.waitTime, statistics.maximumWaitTime);
+	ImGui::Text("Written %.1f MB/s", double(statistics.writtenBytes) / (1024.0 * 1024.0) / elapsedTime);
+
+	if (ImGui::Button("Stop"))
+		m_toggleCapture = true;
+
+	ImGui::End();
+}
+
+std::string Viewer::availableFilename(const std::string& suffix, const std::string& extension) const
+{
+	std::string basename = m_scene->protein()->filename();
+	size_t pos = basename.rfind('.', basename.length());
+
+	if (pos != std::string::npos)
+		basename = basename.substr(0,pos);
+
+	std::string filename;
+
+	for (uint i = 0; i <= 9999; i++)
+	{
+		std::stringstream ss;
+		ss << basename << suffix << "-";
+		ss << std::setw(4) << std::setfill('0') << i;
+		ss << extension;
+
+		filename = ss.str();
+
+		std::ifstream f(filename.c_str());
+
+		if (!f.good())
+			break;
+	}
+
+	return filename;
+}
@@ -13,22 +13,43 @@
 #include "Interactor.h"
 #include "Renderer.h"
 #include "FluidSim.h"
+#include "ShaderCache.h"
+#include "Profiler.h"
+#include "FrameReadback.h"
+#include "VideoCapture.h"
 
 namespace dynamol
 {
+	class SphereRenderer;
 
 	class Viewer
 	{
 	public:
-		Viewer(GLFWwindow* window, Scene* scene);
+		// Programs are linked through the given shader cache, which can be shared by several viewers, or through one of its own
+		Viewer(GLFWwindow* window, Scene* scene, std::shared_ptr<ShaderCache> shaderCache = nullptr);
+		~Viewer();
 		void display();
 
 		GLFWwindow * window();
 		Scene* scene();
 		FluidSim *fluidSim();
+		SphereRenderer* sphereRenderer();
+
+		// Replaces the protein of the scene and rebuilds everything derived from it, while programs and textures are kept
+		void setProtein(std::unique_ptr<Protein> protein);
+		ShaderCache* shaderCache();
+		Profiler* profiler();
 
 		glm::ivec2 viewportSize() const;
 
+		// Renders into the given framebuffer of the given size instead of the window, which then does not need to be visible
+		void setFramebuffer(globjects::Framebuffer* framebuffer, const glm::ivec2& size);
+		void setUiVisible(bool visible);
+
+		// the framebuffer the final image is drawn into and its color buffer
+		globjects::Framebuffer* framebuffer() const;
+		gl::GLenum framebufferBuffer() const;
+
 		glm::vec3 backgroundColor() const;
 		glm::mat4 modelTransform() const;
 		glm::mat4 viewTransform() const;
@@ -52,7 +73,22 @@ namespace dynamol
 		glm::vec3 cameraPosition() const;
 		void setCameraPosition(const glm::vec3 &cameraPosition);
 
-		void saveImage(const std::string & filename);
+		// Saves the framebuffer as a PNG image, which is read and encoded in the background. Returns false if all readback buffers
+		// are in use, unless it is asked to wait for one.
+		bool saveImage(const std::string & filename, bool wait = false);
+		FrameReadback* frameReadback();
+
+		// Streams every frame into the destination as described for VideoCapture, while the time of the viewer advances by a
+		// fixed step of one frame
+		bool startCapture(const std::string& destination, int frameRate = 60);
+		void stopCapture();
+		bool isCapturing() const;
+
+		// the time in seconds that animations and simulations use for the current frame
+		double time() const;
+
+		// Advances the time by a fixed step per frame instead of following the clock, unless the step is zero
+		void setTimestep(double timestep);
 
 	private:
 
@@ -60,6 +96,10 @@ namespace dynamol
 		void endFrame();
 		void renderUi();
 		void mainMenu();
+		void toggleTrace();
+		void toggleCapture();
+		void displayCaptureStatistics();
+		std::string availableFilename(const std::string& suffix, const std::string& extension) const;
 
 		static void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 		static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -70,9 +110,23 @@ namespace dynamol
 		GLFWwindow* m_window;
 		Scene *m_scene;
 
+		// declared before the renderers, which link their programs through it
+		std::shared_ptr<ShaderCache> m_shaderCache;
+		std::unique_ptr<Profiler> m_profiler = std::make_unique<Profiler>();
+		std::unique_ptr<FrameReadback> m_frameReadback = std::make_unique<FrameReadback>();
+		std::unique_ptr<VideoCapture> m_videoCapture;
+		int m_captureFrameRate = 60;
+		double m_time = 0.0;
+		double m_timeOffset = 0.0;
+		double m_timestep = 0.0;
 		std::vector<std::unique_ptr<Interactor>> m_interactors;
 		std::vector<std::unique_ptr<Renderer>> m_renderers;
 		FluidSim *m_fluidSim;
+		SphereRenderer* m_sphereRenderer = nullptr;
+
+		std::unique_ptr<globjects::Framebuffer> m_defaultFramebuffer;
+		globjects::Framebuffer* m_framebuffer = nullptr;
+		glm::ivec2 m_framebufferSize = glm::ivec2(0);
 
 		glm::vec3 m_backgroundColor = glm::vec3(0.2f, 0.2f, 0.2f);
 		glm::mat4 m_modelTransform = glm::mat4(1.0f);
@@ -83,6 +137,9 @@ namespace dynamol
 
 		bool m_showUi = true;
 		bool m_saveScreenshot = false;
+		bool m_showProfiler = false;
+		bool m_toggleTrace = false;
+		bool m_toggleCapture = false;
 	};
 
 
@@ -0,0 +1,467 @@
+#include "XtcReader.h"
+
+#include <cstring>
+#include <algorithm>
+#include <globjects/globjects.h>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	const std::int32_t magicNumber = 1995;
+
+	// magic, atom count, step, time, box, atom count
+	const std::size_t headerSize = 4 * 4 + 9 * 4 + 4;
+
+	// precision, minimum, maximum, small index and byte count of compressed frames
+	const std::size_t compressionHeaderSize = 4 + 3 * 4 + 3 * 4 + 4 + 4;
+
+	// the "magic integers" of the xdr3dfcoord compression, approximately 2^(i/3)
+	const int magicInts[] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 0,
+		8, 10, 12, 16, 20, 25, 32, 40, 50, 64,
+		80, 101, 128, 161, 203, 256, 322, 406, 512, 645,
+		812, 1024, 1290, 1625, 2048, 2580, 3250, 4096, 5060, 6501,
+		8192, 10321, 13003, 16384, 20642, 26007, 32768, 41285, 52015, 65536,
+		82570, 104031, 131072, 165140, 208063, 262144, 330280, 416127, 524287, 660561,
+		832255, 1048576, 1321122, 1664510, 2097152, 2642245, 3329021, 4194304, 5284491, 6658042,
+		8388607, 10568983, 13316085, 16777216
+	};
+
+	const int firstIndex = 9;
+	const int lastIndex = int(sizeof(magicInts) / sizeof(magicInts[0]));
+
+	// all XTC data is big-endian
+	inline std::int32_t readInt(const char* data)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+		return std::int32_t((std::uint32_t(bytes[0]) << 24) | (std::uint32_t(bytes[1]) << 16) | (std::uint32_t(bytes[2]) << 8) | std::uint32_t(bytes[3]));
+	}
+
+	inline float readFloat(const char* data)
+	{
+		const std::int32_t bits = readInt(data);
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// number of bits needed to store values in [0, size]
+	int bitCount(unsigned int size)
+	{
+		unsigned int number = 1;
+		int count = 0;
+
+		while (size >= number && count < 32)
+		{
+			count++;
+			number <<= 1;
+		}
+
+		return count;
+	}
+
+	// number of bits needed to store three values in mixed radix with the given sizes
+	int bitCount(const unsigned int sizes[3])
+	{
+		unsigned int bytes[32];
+		unsigned int byteCount = 1;
+		bytes[0] = 1;
+
+		for (int i = 0; i < 3; i++)
+		{
+			unsigned int carry = 0;
+			unsigned int b;
+
+			for (b = 0; b < byteCount; b++)
+			{
+				carry = bytes[b] * sizes[i] + carry;
+				bytes[b] = carry & 0xFF;
+				carry >>= 8;
+			}
+
+			while (carry != 0 && b < 32)
+			{
+				bytes[b++] = carry & 0xFF;
+				carry >>= 8;
+			}
+
+			byteCount = b;
+		}
+
+		int count = 0;
+		unsigned int number = 1;
+		byteCount--;
+
+		while (bytes[byteCount] >= number)
+		{
+			count++;
+			number *= 2;
+		}
+
+		return count + int(byteCount) * 8;
+	}
+
+	// reads the big-endian bit stream of a compressed frame
+	class BitReader
+	{
+	public:
+		BitReader(const unsigned char* data, std::size_t size) : m_data(data), m_size(size)
+		{
+		}
+
+		bool overflow() const
+		{
+			return m_overflow;
+		}
+
+		int bits(int count)
+		{
+			const unsigned int mask = (count >= 32) ? 0xFFFFFFFFu : ((1u << count) - 1);
+			unsigned int number = 0;
+
+			while (count >= 8)
+			{
+				m_lastByte = (m_lastByte << 8) | nextByte();
+				number |= (m_lastByte >> m_lastBits) << (count - 8);
+				count -= 8;
+			}
+
+			if (count > 0)
+			{
+				if (int(m_lastBits) < count)
+				{
+					m_lastBits += 8;
+					m_lastByte = (m_lastByte << 8) | nextByte();
+				}
+
+				m_lastBits -= count;
+				number |= (m_lastByte >> m_lastBits) & ((1u << count) - 1);
+			}
+
+			return int(number & mask);
+		}
+
+		// decodes three integers stored as a single mixed-radix number of the given bit count
+		void ints(int count, const unsigned int sizes[3], int numbers[3])
+		{
+			int bytes[32] = {};
+			int byteCount = 0;
+
+			while (count > 8 && byteCount < 32)
+			{
+				bytes[byteCount++] = bits(8);
+				count -= 8;
+			}
+
+			if (count > 0 && byteCount < 32)
+				bytes[byteCount++] = bits(count);
+
+			// numbers of up to 64 bits, which covers practically all frames, are decoded with native division
+			if (byteCount <= 8)
+			{
+				std::uint64_t number = 0;
+
+				for (int j = byteCount - 1; j >= 0; j--)
+					number = (number << 8) | std::uint64_t(bytes[j]);
+
+				numbers[2] = int(number % sizes[2]);
+				number /= sizes[2];
+				numbers[1] = int(number % sizes[1]);
+				numbers[0] = int(std::uint32_t(number / sizes[1]));
+				return;
+			}
+
+			for (int i = 2; i > 0; i--)
+			{
+				unsigned int number = 0;
+
+				for (int j = byteCount - 1; j >= 0; j--)
+				{
+					number = (number << 8) | static_cast<unsigned int>(bytes[j]);
+					const unsigned int quotient = number / sizes[i];
+					bytes[j] = int(quotient);
+					number = number - quotient * sizes[i];
+				}
+
+				numbers[i] = int(number);
+			}
+
+			numbers[0] = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
+		}
+
+	private:
+		unsigned int nextByte()
+		{
+			if (m_position < m_size)
+				return m_data[m_position++];
+
+			m_overflow = true;
+			return 0;
+		}
+
+		const unsigned char* m_data = nullptr;
+		std::size_t m_size = 0;
+		std::size_t m_position = 0;
+		unsigned int m_lastBits = 0;
+		unsigned int m_lastByte = 0;
+		bool m_overflow = false;
+	};
+
+	// Decompression of xdr3dfcoord data: coordinates are quantized with the given precision, the first atom of each
+	// group is stored relative to the minimum and subsequent ones as small differences with an adaptive bit size
+	bool decompress(const char* header, const unsigned char* data, std::size_t byteCount, std::size_t atomCount, std::vector<vec3>& positions)
+	{
+		const float precision = readFloat(header);
+
+		int minimum[3];
+		int maximum[3];
+		unsigned int sizes[3];
+
+		for (int i = 0; i < 3; i++)
+		{
+			minimum[i] = readInt(header + 4 + i * 4);
+			maximum[i] = readInt(header + 16 + i * 4);
+			sizes[i] = static_cast<unsigned int>(maximum[i] - minimum[i] + 1);
+		}
+
+		int bitSizes[3] = { 0, 0, 0 };
+		int bitSize = 0;
+
+		// very large ranges cannot be combined into a single number
+		if ((sizes[0] | sizes[1] | sizes[2]) > 0xFFFFFF)
+		{
+			for (int i = 0; i < 3; i++)
+				bitSizes[i] = bitCount(sizes[i]);
+		}
+		else
+		{
+			bitSize = bitCount(sizes);
+		}
+
+		int smallIndex = readInt(header + 28);
+
+		if (smallIndex < firstIndex || smallIndex >= lastIndex || precision <= 0.0f)
+			return false;
+
+		int smaller = magicInts[std::max(firstIndex, smallIndex - 1)] / 2;
+		int smallNumber = magicInts[smallIndex] / 2;
+		unsigned int smallSizes[3] = { static_cast<unsigned int>(magicInts[smallIndex]), static_cast<unsigned int>(magicInts[smallIndex]), static_cast<unsigned int>(magicInts[smallIndex]) };
+
+		// positions are stored in nanometers
+		const float scale = 10.0f / precision;
+
+		BitReader reader(data, byteCount);
+		positions.resize(atomCount);
+
+		std::size_t positionCount = 0;
+		std::size_t i = 0;
+		int run = 0;
+
+		const auto append = [&](const int coordinates[3])
+		{
+			if (positionCount < atomCount)
+				positions[positionCount++] = vec3(float(coordinates[0]), float(coordinates[1]), float(coordinates[2])) * scale;
+		};
+
+		while (i < atomCount)
+		{
+			int coordinates[3];
+
+			if (bitSize == 0)
+			{
+				for (int k = 0; k < 3; k++)
+					coordinates[k] = reader.bits(bitSizes[k]);
+			}
+			else
+			{
+				reader.ints(bitSize, sizes, coordinates);
+			}
+
+			i++;
+
+			int previous[3];
+
+			for (int k = 0; k < 3; k++)
+			{
+				coordinates[k] += minimum[k];
+				previous[k] = coordinates[k];
+			}
+
+			int isSmaller = 0;
+
+			// the run length is only updated when flagged and applies to all following atoms otherwise
+			if (reader.bits(1) == 1)
+			{
+				run = reader.bits(5);
+				isSmaller = run % 3;
+				run -= isSmaller;
+				isSmaller--;
+			}
+
+			if (run > 0)
+			{
+				for (int k = 0; k < run; k += 3)
+				{
+					int small[3];
+					reader.ints(smallIndex, smallSizes, small);
+					i++;
+
+					for (int c = 0; c < 3; c++)
+						small[c] += previous[c] - smallNumber;
+
+					if (k == 0)
+					{
+						// the first two atoms of a run are swapped for better compression of water molecules
+						std::swap(small[0], previous[0]);
+						std::swap(small[1], previous[1]);
+						std::swap(small[2], previous[2]);
+						append(previous);
+					}
+					else
+					{
+						std::copy(small, small + 3, previous);
+					}
+
+					append(small);
+				}
+			}
+			else
+			{
+				append(coordinates);
+			}
+
+			smallIndex += isSmaller;
+
+			if (smallIndex < firstIndex || smallIndex >= lastIndex || reader.overflow())
+				return false;
+
+			if (isSmaller < 0)
+			{
+				smallNumber = smaller;
+				smaller = (smallIndex > firstIndex) ? magicInts[smallIndex - 1] / 2 : 0;
+			}
+			else if (isSmaller > 0)
+			{
+				smaller = smallNumber;
+				smallNumber = magicInts[smallIndex] / 2;
+			}
+
+			smallSizes[0] = smallSizes[1] = smallSizes[2] = static_cast<unsigned int>(magicInts[smallIndex]);
+		}
+
+		return positionCount == atomCount && i == atomCount;
+	}
+}
+
+bool XtcReader::open(const std::string& filename)
+{
+	m_frameOffsets.clear();
+	m_atomCount = 0;
+
+	if (!m_file.open(filename))
+	{
+		globjects::critical() << "Could not open XTC file " << filename << "!";
+		return false;
+	}
+
+	// Frames have a variable size, but each header contains the size of its compressed data, so the index
+	// is built by hopping from header to header without touching the coordinates themselves
+	std::size_t offset = 0;
+
+	while (offset + headerSize <= m_file.size())
+	{
+		const char* header = m_file.data() + offset;
+
+		if (readInt(header) != magicNumber)
+			break;
+
+		const std::int32_t atomCount = readInt(header + 4);
+
+		if (atomCount <= 0 || (m_frameOffsets.size() > 0 && std::size_t(atomCount) != m_atomCount))
+			break;
+
+		const std::size_t size = frameSize(offset);
+
+		// an incomplete last frame is ignored
+		if (size == 0 || offset + size > m_file.size())
+			break;
+
+		m_atomCount = std::size_t(atomCount);
+		m_frameOffsets.push_back(offset);
+		offset += size;
+	}
+
+	if (m_frameOffsets.empty())
+	{
+		globjects::critical() << filename << " is not a valid XTC file!";
+		return false;
+	}
+
+	globjects::debug() << "XTC file " << filename << ": " << uint(m_frameOffsets.size()) << " frames, " << uint(m_atomCount) << " atoms.";
+
+	return true;
+}
+
+std::size_t XtcReader::frameCount() const
+{
+	return m_frameOffsets.size();
+}
+
+std::size_t XtcReader::atomCount() const
+{
+	return m_atomCount;
+}
+
+bool XtcReader::readFrame(std::size_t frame, std::vector<vec3>& positions) const
+{
+	if (frame >= m_frameOffsets.size())
+		return false;
+
+	const char* header = m_file.data() + m_frameOffsets[frame];
+
+	// tiny systems are stored uncompressed
+	if (m_atomCount <= 9)
+	{
+		positions.resize(m_atomCount);
+
+		for (std::size_t i = 0; i < m_atomCount; i++)
+		{
+			for (int k = 0; k < 3; k++)
+				positions[i][k] = readFloat(header + headerSize + (i * 3 + k) * 4) * 10.0f;
+		}
+
+		return true;
+	}
+
+	const char* compressionHeader = header + headerSize;
+	const std::size_t byteCount = std::size_t(readInt(compressionHeader + compressionHeaderSize - 4));
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(compressionHeader + compressionHeaderSize);
+
+	return decompress(compressionHeader, data, byteCount, m_atomCount, positions);
+}
+
+std::size_t XtcReader::frameSize(std::size_t offset) const
+{
+	const char* header = m_file.data() + offset;
+	const std::size_t atomCount = std::size_t(readInt(header + 4));
+
+	if (std::size_t(readInt(header + headerSize - 4)) != atomCount)
+		return 0;
+
+	if (atomCount <= 9)
+		return headerSize + atomCount * 3 * 4;
+
+	if (offset + headerSize + compressionHeaderSize > m_file.size())
+		return 0;
+
+	const std::int32_t byteCount = readInt(header + headerSize + compressionHeaderSize - 4);
+
+	if (byteCount < 0)
+		return 0;
+
+	// opaque XDR data is padded to a multiple of four bytes
+	return headerSize + compressionHeaderSize + (std::size_t(byteCount) + 3) / 4 * 4;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "TrajectoryReader.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+
+namespace dynamol
+{
+	// GROMACS XTC trajectories with compressed coordinates, frames are located through an offset index built when opening
+	class XtcReader : public TrajectoryReader
+	{
+	public:
+		bool open(const std::string& filename) override;
+		std::size_t frameCount() const override;
+		std::size_t atomCount() const override;
+		bool readFrame(std::size_t frame, std::vector<glm::vec3>& positions) const override;
+
+	private:
+		std::size_t frameSize(std::size_t offset) const;
+
+		MappedFile m_file;
+		std::size_t m_atomCount = 0;
+		std::vector<std::size_t> m_frameOffsets;
+	};
+}
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <vector>
+#include <cstdlib>
 
 #include <glbinding/Version.h>
 #include <glbinding/Binding.h>
@@ -26,6 +28,17 @@
 #include "Viewer.h"
 #include "Interactor.h"
 #include "Renderer.h"
+#include "LoadingBenchmark.h"
+#include "SelectionBenchmark.h"
+#include "CellListBenchmark.h"
+#include "BvhBenchmark.h"
+#include "MortonOrderBenchmark.h"
+#include "SortBenchmark.h"
+#include "RasterizerBenchmark.h"
+#include "BatchRenderer.h"
+#include "CameraPathBenchmark.h"
+#include "FluidBenchmark.h"
+#include "TableBenchmark.h"
 
 using namespace gl;
 using namespace glm;
@@ -39,6 +52,62 @@ void error_callback(int errnum, const char * errmsg)
 
 int main(int argc, char *argv[])
 {
+	// Loading benchmark, does not require an OpenGL context
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-loading")
+	{
+		std::string fileName = (argc > 2) ? std::string(argv[2]) : "./dat/6b0x.pdb";
+		unsigned int threadCount = (argc > 3) ? unsigned(std::stoul(argv[3])) : std::thread::hardware_concurrency();
+		return LoadingBenchmark::run(fileName, threadCount) ? 0 : 1;
+	}
+
+	// Selection benchmark, replicates the first timestep to the given number of atoms
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-selection")
+	{
+		std::string fileName = (argc > 2) ? std::string(argv[2]) : "./dat/6b0x.pdb";
+		std::size_t atomCount = (argc > 3) ? std::size_t(std::stoull(argv[3])) : 5000000;
+		return SelectionBenchmark::run(fileName, atomCount) ? 0 : 1;
+	}
+
+	// Cell list benchmark, replicates the first timestep to the given number of atoms
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-celllist")
+	{
+		std::string fileName = (argc > 2) ? std::string(argv[2]) : "./dat/6b0x.pdb";
+		std::size_t atomCount = (argc > 3) ? std::size_t(std::stoull(argv[3])) : 1000000;
+		return CellListBenchmark::run(fileName, atomCount) ? 0 : 1;
+	}
+
+	// Bounding volume hierarchy benchmark, replicates the first timestep to the given number of atoms
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-bvh")
+	{
+		std::string fileName = (argc > 2) ? std::string(argv[2]) : "./dat/6b0x.pdb";
+		std::size_t atomCount = (argc > 3) ? std::size_t(std::stoull(argv[3])) : 1000000;
+		return BvhBenchmark::run(fileName, atomCount) ? 0 : 1;
+	}
+
+	// Fluid solver benchmark on the CPU only, for a grid of the given size along each axis
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-fluid-cpu")
+	{
+		std::int32_t size = (argc > 2) ? std::int32_t(std::stoi(argv[2])) : 128;
+		return FluidBenchmark::run(size, false) ? 0 : 1;
+	}
+
+	// Batch rendering only draws offscreen, optionally without a display on the null platform of GLFW
+	const bool batch = argc > 1 && std::string(argv[1]) == "--batch";
+	bool headless = false;
+
+	for (int i = 2; batch && i < argc; i++)
+		headless = headless || std::string(argv[i]) == "--headless";
+
+	if (headless)
+	{
+#ifdef GLFW_PLATFORM_NULL
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+		globjects::critical() << "Headless rendering requires GLFW 3.4 or later.";
+		return 1;
+#endif
+	}
+
 	// Initialize GLFW
 	if (!glfwInit())
 		return 1;
@@ -53,9 +122,22 @@ int main(int argc, char *argv[])
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
 	glfwWindowHint(GLFW_SAMPLES, 8);
 
+	if (batch)
+		glfwWindowHint(GLFW_VISIBLE, false);
+
+	// Without a display, the context is surfaceless and created by EGL, e.g. with Mesa's llvmpipe, or by OSMesa
+	if (headless)
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+
 	// Create a context and, if valid, make it current
 	GLFWwindow * window = glfwCreateWindow(1280, 720, "dynamol", NULL, NULL);
 
+	if (window == nullptr && headless)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		window = glfwCreateWindow(1280, 720, "dynamol", NULL, NULL);
+	}
+
 	if (window == nullptr)
 	{
 		globjects::critical() << "Context creation failed - terminating execution.";
@@ -80,21 +162,145 @@ int main(int argc, char *argv[])
 		<< "OpenGL Vendor:   " << glbinding::aux::ContextInfo::vendor() << std::endl
 		<< "OpenGL Renderer: " << glbinding::aux::ContextInfo::renderer() << std::endl;
 
+	// Atom order benchmark, renders in file and in Morton order
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-order")
+	{
+		std::string fileName = (argc > 2) ? std::string(argv[2]) : "./dat/6b0x.pdb";
+		std::size_t atomCount = (argc > 3) ? std::size_t(std::stoull(argv[3])) : 2000000;
+
+		glfwSwapInterval(0);
+		const bool success = MortonOrderBenchmark::run(window, fileName, atomCount);
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+
+		return success ? 0 : 1;
+	}
+
+	// Sphere rasterization benchmark, renders with the geometry shader and with the compute shaders
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-raster")
+	{
+		std::string fileName = (argc > 2) ? std::string(argv[2]) : "./dat/6b0x.pdb";
+		std::size_t atomCount = (argc > 3) ? std::size_t(std::stoull(argv[3])) : 2000000;
+
+		glfwSwapInterval(0);
+		const bool success = RasterizerBenchmark::run(window, fileName, atomCount);
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+
+		return success ? 0 : 1;
+	}
+
+	// Table indexing benchmark, renders with the tables in storage buffers and in uniform blocks
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-tables")
+	{
+		std::string fileName = (argc > 2) ? std::string(argv[2]) : "./dat/6b0x.pdb";
+
+		glfwSwapInterval(0);
+		const bool success = TableBenchmark::run(window, fileName);
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+
+		return success ? 0 : 1;
+	}
+
+	// Camera path benchmark, renders the scenario of the given JSON file and writes the times of every frame and pass
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-path")
+	{
+		std::string scenarioName = (argc > 2) ? std::string(argv[2]) : "./dat/benchmarks/spin.json";
+		std::string outputName = (argc > 3) ? std::string(argv[3]) : "";
+
+		glfwSwapInterval(0);
+		const bool success = CameraPathBenchmark::run(window, scenarioName, outputName);
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+
+		return success ? 0 : 1;
+	}
+
+	// Intersection list sorting benchmark, sorts the given number of synthetic lists per distribution of their lengths
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-sort")
+	{
+		std::size_t listCount = (argc > 2) ? std::size_t(std::stoull(argv[2])) : 262144;
+		const bool success = SortBenchmark::run(listCount);
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+
+		return success ? 0 : 1;
+	}
+
+	// Fluid solver benchmark, compares the CPU kernels with the compute shaders for a grid of the given size along each axis
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-fluid")
+	{
+		std::int32_t size = (argc > 2) ? std::int32_t(std::stoi(argv[2])) : 128;
+		const bool success = FluidBenchmark::run(size, true);
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+
+		return success ? 0 : 1;
+	}
+
+	// Batch rendering, renders the given files from the given camera presets into images
+	if (batch)
+	{
+		const bool success = BatchRenderer::run(window, std::vector<std::string>(argv + 2, argv + argc));
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+
+		return success ? 0 : 1;
+	}
+
+	// the remaining arguments are the file and an optional trajectory
+	std::vector<std::string> arguments;
+	bool mortonOrder = false;
+	bool trajectoryCache = false;
+	std::string captureDestination;
+	int captureFrameRate = 60;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--morton-order")
+			mortonOrder = true;
+		else if (std::string(argv[i]) == "--trajectory-cache")
+			trajectoryCache = true;
+		else if (std::string(argv[i]) == "--capture" && i + 1 < argc)
+			captureDestination = argv[++i];
+		else if (std::string(argv[i]) == "--capture-rate" && i + 1 < argc)
+			captureFrameRate = std::max(std::atoi(argv[++i]), 1);
+		else
+			arguments.push_back(argv[i]);
+	}
+
 	std::string fileName = "./dat/6b0x.pdb";
 
-	if (argc > 1)
-		fileName = std::string(argv[1]);
+	if (arguments.size() > 0)
+		fileName = arguments[0];
 	else
 	{
-		const char *filterExtensions[] = { "*.pdb" };
-		const char *openfileName = tinyfd_openFileDialog("Open File", "./", 1, filterExtensions, "Protein Data Bank Files (*.pdb)", 0);
+		const char *filterExtensions[] = { "*.pdb", "*.cif", "*.mmcif", "*.bcif", "*.gz" };
+		const char *openfileName = tinyfd_openFileDialog("Open File", "./", 5, filterExtensions, "Protein Data Bank Files (*.pdb, *.cif, *.mmcif, *.bcif, *.gz)", 0);
 
 		if (openfileName)
 			fileName = std::string(openfileName);
 	}
 	
 	auto scene = std::make_unique<Scene>();
-	scene->protein()->load(fileName);
+	scene->protein()->load(fileName, trajectoryCache);
+
+	// an optional DCD or XTC trajectory provides the coordinates for the atoms of the PDB file
+	if (arguments.size() > 1)
+		scene->protein()->loadTrajectory(arguments[1]);
+
+	// sorting the atoms spatially improves the locality of the rendering passes
+	if (mortonOrder)
+		scene->protein()->sortAtomsSpatially();
+
 	auto viewer = std::make_unique<Viewer>(window, scene.get());
 
 	// Scaling the model's bounding box to the canonical view volume
@@ -104,6 +310,9 @@ int main(int argc, char *argv[])
 	modelTransform = modelTransform * translate(-0.5f*(scene->protein()->minimumBounds() + scene->protein()->maximumBounds()));
 	viewer->setModelTransform(modelTransform);
 
+	// the video starts with the first frame, F6 stops it
+	if (!captureDestination.empty())
+		viewer->startCapture(captureDestination, captureFrameRate);
 
 	glfwSwapInterval(0);
 
@@ -0,0 +1,190 @@
+#include "Test.h"
+#include "Bvh.h"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// tests the ray against every sphere in the same way as the hierarchy, sorted by distance and index
+	std::vector<Bvh::Hit> bruteForceHits(const std::vector<vec3>& positions, const std::vector<float>& radii, const Bvh::Ray& ray)
+	{
+		std::vector<Bvh::Hit> hits;
+		const float squaredLength = dot(ray.direction, ray.direction);
+
+		for (std::size_t i = 0; i < positions.size(); i++)
+		{
+			const vec3 offset = ray.origin - positions[i];
+			const float b = dot(offset, ray.direction);
+			const float c = dot(offset, offset) - radii[i] * radii[i];
+			const float discriminant = b * b - squaredLength * c;
+
+			if (discriminant < 0.0f)
+				continue;
+
+			const float root = std::sqrt(discriminant);
+			float distance = (-b - root) / squaredLength;
+
+			if (distance < 0.0f)
+				distance = (-b + root) / squaredLength;
+
+			if (distance >= 0.0f && distance <= ray.maximumDistance)
+				hits.push_back({ uint(i), distance });
+		}
+
+		std::sort(hits.begin(), hits.end(), [](const Bvh::Hit& a, const Bvh::Hit& b)
+		{
+			return a.distance < b.distance || (a.distance == b.distance && a.index < b.index);
+		});
+
+		return hits;
+	}
+
+	bool equal(const Bvh::Hit& a, const Bvh::Hit& b)
+	{
+		return a.index == b.index && (a.index == Bvh::noHit || a.distance == b.distance);
+	}
+
+	bool equal(const std::vector<Bvh::Hit>& a, const std::vector<Bvh::Hit>& b)
+	{
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const Bvh::Hit& x, const Bvh::Hit& y) { return equal(x, y); });
+	}
+
+	Bvh::Ray ray(const vec3& origin, const vec3& direction, float maximumDistance = std::numeric_limits<float>::max())
+	{
+		Bvh::Ray r;
+		r.origin = origin;
+		r.direction = direction;
+		r.maximumDistance = maximumDistance;
+
+		return r;
+	}
+
+	// checks every kind of query of the hierarchy against testing every sphere
+	void checkQueries(const Bvh& bvh, const std::vector<vec3>& positions, const std::vector<float>& radii, const std::vector<Bvh::Ray>& rays)
+	{
+		std::vector<Bvh::Hit> packetHits(rays.size());
+		bvh.intersect(rays.data(), rays.size(), packetHits.data());
+
+		std::vector<Bvh::Hit> hits;
+
+		for (std::size_t i = 0; i < rays.size(); i++)
+		{
+			const std::vector<Bvh::Hit> reference = bruteForceHits(positions, radii, rays[i]);
+			const Bvh::Hit first = reference.empty() ? Bvh::Hit() : reference.front();
+
+			DYNAMOL_CHECK(equal(bvh.intersect(rays[i]), first));
+			DYNAMOL_CHECK(equal(packetHits[i], first));
+
+			bvh.intersectAll(rays[i], hits);
+			DYNAMOL_CHECK(equal(hits, reference));
+		}
+	}
+}
+
+DYNAMOL_TEST(bvh, singleSphere)
+{
+	const vec3 position = vec3(0.0f);
+	const float radius = 1.0f;
+	Bvh bvh;
+	bvh.build(&position, &radius, 1);
+
+	DYNAMOL_CHECK(bvh.size() == 1);
+	DYNAMOL_CHECK(bvh.minimumBounds() == vec3(-1.0f) && bvh.maximumBounds() == vec3(1.0f));
+
+	Bvh::Hit hit = bvh.intersect(ray(vec3(0.0f, 0.0f, 10.0f), vec3(0.0f, 0.0f, -1.0f)));
+	DYNAMOL_CHECK(hit.index == 0 && hit.distance == 9.0f);
+
+	// distances are given in multiples of the length of the direction
+	hit = bvh.intersect(ray(vec3(0.0f, 0.0f, 10.0f), vec3(0.0f, 0.0f, -2.0f)));
+	DYNAMOL_CHECK(hit.index == 0 && hit.distance == 4.5f);
+
+	// a ray starting inside hits where it leaves the sphere
+	hit = bvh.intersect(ray(vec3(0.0f), vec3(1.0f, 0.0f, 0.0f)));
+	DYNAMOL_CHECK(hit.index == 0 && hit.distance == 1.0f);
+
+	// passing the sphere or pointing away from it is not a hit
+	DYNAMOL_CHECK(bvh.intersect(ray(vec3(1.001f, 0.0f, 10.0f), vec3(0.0f, 0.0f, -1.0f))).index == Bvh::noHit);
+	DYNAMOL_CHECK(bvh.intersect(ray(vec3(0.0f, 0.0f, 10.0f), vec3(0.0f, 0.0f, 1.0f))).index == Bvh::noHit);
+
+	// the maximum distance is inclusive
+	DYNAMOL_CHECK(bvh.intersect(ray(vec3(0.0f, 0.0f, 10.0f), vec3(0.0f, 0.0f, -1.0f), 9.0f)).index == 0);
+	DYNAMOL_CHECK(bvh.intersect(ray(vec3(0.0f, 0.0f, 10.0f), vec3(0.0f, 0.0f, -1.0f), 8.999f)).index == Bvh::noHit);
+}
+
+DYNAMOL_TEST(bvh, order)
+{
+	// spheres along the x axis, with a duplicate of sphere 3 at index 1
+	const std::vector<vec3> positions = { vec3(8.0f, 0.0f, 0.0f), vec3(4.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, 0.0f), vec3(4.0f, 0.0f, 0.0f), vec3(12.0f, 0.0f, 0.0f) };
+	const std::vector<float> radii = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+	Bvh bvh;
+	bvh.build(positions.data(), radii.data(), positions.size());
+
+	const Bvh::Ray r = ray(vec3(-10.0f, 0.0f, 0.0f), vec3(1.0f, 0.0f, 0.0f));
+	const Bvh::Hit hit = bvh.intersect(r);
+	DYNAMOL_CHECK(hit.index == 2 && hit.distance == 9.0f);
+
+	// ties are resolved by the lower index
+	std::vector<Bvh::Hit> hits;
+	bvh.intersectAll(r, hits);
+	DYNAMOL_CHECK(hits.size() == 5);
+	DYNAMOL_CHECK(hits.size() == 5 && hits[0].index == 2 && hits[1].index == 1 && hits[2].index == 3 && hits[3].index == 0 && hits[4].index == 4);
+	DYNAMOL_CHECK(bvh.intersect(ray(vec3(4.0f, 0.0f, 10.0f), vec3(0.0f, 0.0f, -1.0f))).index == 1);
+
+	bvh.intersectAll(ray(vec3(-10.0f, 0.0f, 0.0f), vec3(1.0f, 0.0f, 0.0f), 13.0f), hits);
+	DYNAMOL_CHECK(hits.size() == 3);
+}
+
+DYNAMOL_TEST(bvh, randomSpheres)
+{
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> positionDistribution(-30.0f, 30.0f);
+	std::uniform_real_distribution<float> radiusDistribution(0.5f, 2.0f);
+	std::uniform_real_distribution<float> motionDistribution(-0.5f, 0.5f);
+	std::normal_distribution<float> directionDistribution;
+
+	std::vector<vec3> positions(3000);
+	std::vector<float> radii(positions.size());
+
+	for (std::size_t i = 0; i < positions.size(); i++)
+	{
+		positions[i] = vec3(positionDistribution(random), positionDistribution(random), positionDistribution(random));
+		radii[i] = radiusDistribution(random);
+	}
+
+	Bvh bvh;
+	bvh.build(positions.data(), radii.data(), positions.size());
+	DYNAMOL_CHECK(bvh.size() == positions.size());
+
+	// rays from outside aimed at random spheres, from inside in random directions, and a block of coherent view rays
+	std::vector<Bvh::Ray> rays;
+	std::uniform_int_distribution<std::size_t> sphereDistribution(0, positions.size() - 1);
+
+	for (int i = 0; i < 100; i++)
+	{
+		const vec3 origin = 80.0f * normalize(vec3(directionDistribution(random), directionDistribution(random), directionDistribution(random)));
+		rays.push_back(ray(origin, positions[sphereDistribution(random)] - origin));
+		rays.push_back(ray(positions[sphereDistribution(random)], vec3(directionDistribution(random), directionDistribution(random), directionDistribution(random)), 10.0f));
+	}
+
+	for (int y = 0; y < 16; y++)
+	{
+		for (int x = 0; x < 16; x++)
+			rays.push_back(ray(vec3(0.0f, 0.0f, 60.0f), vec3(0.05f * float(x - 8), 0.05f * float(y - 8), -1.0f)));
+	}
+
+	checkQueries(bvh, positions, radii, rays);
+
+	// refitting to moved positions keeps every query exact
+	for (auto& p : positions)
+		p += vec3(motionDistribution(random), motionDistribution(random), motionDistribution(random));
+
+	bvh.refit(positions.data());
+	checkQueries(bvh, positions, radii, rays);
+}
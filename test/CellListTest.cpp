@@ -0,0 +1,166 @@
+#include "Test.h"
+#include "CellList.h"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <utility>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	std::vector<uint> bruteForceRange(const std::vector<vec3>& positions, const vec3& q, float radius)
+	{
+		std::vector<uint> indices;
+
+		for (std::size_t i = 0; i < positions.size(); i++)
+		{
+			if (dot(positions[i] - q, positions[i] - q) <= radius * radius)
+				indices.push_back(uint(i));
+		}
+
+		return indices;
+	}
+
+	std::vector<uint> bruteForceNearest(const std::vector<vec3>& positions, const vec3& q, std::size_t k)
+	{
+		std::vector< std::pair<float, uint> > distances;
+
+		for (std::size_t i = 0; i < positions.size(); i++)
+			distances.push_back({ dot(positions[i] - q, positions[i] - q), uint(i) });
+
+		std::sort(distances.begin(), distances.end());
+		std::vector<uint> indices;
+
+		for (std::size_t i = 0; i < std::min(k, distances.size()); i++)
+			indices.push_back(distances[i].second);
+
+		return indices;
+	}
+
+	std::vector<uint> range(const CellList& cellList, const vec3& q, float radius)
+	{
+		std::vector<uint> indices;
+		cellList.range(q, radius, indices);
+		std::sort(indices.begin(), indices.end());
+
+		return indices;
+	}
+
+	std::vector<uint> nearest(const CellList& cellList, const vec3& q, std::size_t k)
+	{
+		std::vector<uint> indices;
+		cellList.nearest(q, k, indices);
+
+		return indices;
+	}
+
+	// points on a grid with a spacing of one, whose distances are exact
+	std::vector<vec3> grid(int size)
+	{
+		std::vector<vec3> positions;
+
+		for (int z = 0; z < size; z++)
+		{
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+					positions.push_back(vec3(float(x), float(y), float(z)));
+			}
+		}
+
+		return positions;
+	}
+}
+
+DYNAMOL_TEST(celllist, rangeBoundary)
+{
+	const std::vector<vec3> positions = grid(8);
+
+	for (float cellSize : { 0.5f, 1.0f, 2.0f, 3.0f })
+	{
+		CellList cellList;
+		cellList.build(positions.data(), positions.size(), vec3(0.0f), vec3(7.0f), cellSize);
+		DYNAMOL_CHECK(cellList.size() == positions.size());
+
+		// points at exactly the radius are included, so the ranges hold 7, 33 and 123 points
+		DYNAMOL_CHECK(range(cellList, vec3(3.0f), 1.0f).size() == 7);
+		DYNAMOL_CHECK(range(cellList, vec3(3.0f), 2.0f).size() == 33);
+		DYNAMOL_CHECK(range(cellList, vec3(3.0f), 3.0f).size() == 123);
+
+		for (float radius : { 0.0f, 1.0f, 2.0f, 3.0f, 5.0f })
+		{
+			for (const vec3& q : { vec3(0.0f), vec3(3.0f), vec3(7.0f, 0.0f, 3.0f), vec3(3.5f, 3.5f, 3.5f) })
+			{
+				DYNAMOL_CHECK(range(cellList, q, radius) == bruteForceRange(positions, q, radius));
+				DYNAMOL_CHECK(cellList.contains(q, radius) == !bruteForceRange(positions, q, radius).empty());
+			}
+		}
+	}
+}
+
+DYNAMOL_TEST(celllist, randomQueries)
+{
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> distribution(-20.0f, 20.0f);
+	std::vector<vec3> positions(2000);
+
+	for (auto& p : positions)
+		p = vec3(distribution(random), distribution(random), distribution(random));
+
+	// the bounds cover only part of the positions, the others are stored in the border cells
+	CellList cellList;
+	cellList.build(positions.data(), positions.size(), vec3(-10.0f), vec3(10.0f), 3.0f);
+
+	for (int i = 0; i < 100; i++)
+	{
+		const vec3 q = 1.5f * vec3(distribution(random), distribution(random), distribution(random));
+
+		for (float radius : { 0.5f, 4.0f, 12.0f })
+			DYNAMOL_CHECK(range(cellList, q, radius) == bruteForceRange(positions, q, radius));
+
+		for (std::size_t k : { 1, 16, 100 })
+			DYNAMOL_CHECK(nearest(cellList, q, k) == bruteForceNearest(positions, q, k));
+	}
+}
+
+DYNAMOL_TEST(celllist, nearestTies)
+{
+	const std::vector<vec3> positions = grid(5);
+	CellList cellList;
+	cellList.build(positions.data(), positions.size(), vec3(0.0f), vec3(4.0f), 1.0f);
+
+	// the six neighbors of the center are at the same distance and ordered by index
+	const std::vector<uint> indices = nearest(cellList, vec3(2.0f), 7);
+	DYNAMOL_CHECK(indices == std::vector<uint>({ 62, 37, 57, 61, 63, 67, 87 }));
+	DYNAMOL_CHECK(indices == bruteForceNearest(positions, vec3(2.0f), 7));
+
+	// more neighbors than atoms returns all of them
+	DYNAMOL_CHECK(nearest(cellList, vec3(100.0f), 1000).size() == positions.size());
+	DYNAMOL_CHECK(nearest(cellList, vec3(100.0f), 1000) == bruteForceNearest(positions, vec3(100.0f), 1000));
+	DYNAMOL_CHECK(nearest(cellList, vec3(2.0f), 0).empty());
+}
+
+DYNAMOL_TEST(celllist, rebuild)
+{
+	// rebuilding with fewer atoms and other bounds does not keep any of the previous ones
+	std::vector<vec3> positions = grid(6);
+	CellList cellList;
+	cellList.build(positions.data(), positions.size(), vec3(0.0f), vec3(5.0f), 1.0f);
+
+	positions = { vec3(10.0f), vec3(11.0f, 10.0f, 10.0f), vec3(20.0f) };
+	cellList.build(positions.data(), positions.size(), vec3(10.0f), vec3(20.0f), 2.0f);
+
+	DYNAMOL_CHECK(cellList.size() == 3);
+	DYNAMOL_CHECK(range(cellList, vec3(10.0f), 1.0f) == std::vector<uint>({ 0, 1 }));
+	DYNAMOL_CHECK(range(cellList, vec3(0.0f), 5.0f).empty());
+	DYNAMOL_CHECK(nearest(cellList, vec3(19.0f), 1) == std::vector<uint>({ 2 }));
+
+	// atoms with their attributes in w are indexed by their positions
+	std::vector<vec4> atoms = { vec4(1.0f, 2.0f, 3.0f, uintBitsToFloat(7u)), vec4(4.0f, 2.0f, 3.0f, uintBitsToFloat(9u)) };
+	cellList.build(atoms.data(), atoms.size(), vec3(0.0f), vec3(5.0f), 1.0f);
+	DYNAMOL_CHECK(range(cellList, vec3(1.0f, 2.0f, 3.0f), 3.0f) == std::vector<uint>({ 0, 1 }));
+	DYNAMOL_CHECK(range(cellList, vec3(1.0f, 2.0f, 3.0f), 2.999f) == std::vector<uint>({ 0 }));
+}
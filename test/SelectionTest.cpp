@@ -0,0 +1,151 @@
+#include "Test.h"
+#include "Selection.h"
+#include "Protein.h"
+
+#include <vector>
+#include <string>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// Atom 0 is the target of the distance tests, atoms 2, 3 and 6 are exactly 5 Angstrom away from it and atom 5 slightly further
+	const std::vector<TestAtom> atoms = {
+		{ "ALA", 'A', 1, 0.0f, 0.0f, 0.0f, "C" },
+		{ "ALA", 'A', 1, 1.5f, 0.0f, 0.0f, "N" },
+		{ "GLY", 'A', 2, 5.0f, 0.0f, 0.0f, "C" },
+		{ "GLY", 'B', 3, 3.0f, 4.0f, 0.0f, "O" },
+		{ "HEM", 'B', 10, 5.5f, 0.0f, 0.0f, "O" },
+		{ "HEM", 'B', 20, 0.0f, 0.0f, 5.001f, "N" },
+		{ "SER", 'C', 15, 0.0f, -5.0f, 0.0f, "C" }
+	};
+
+	const Protein& protein()
+	{
+		static Protein protein;
+
+		if (protein.timestepCount() == 0)
+			protein.load(writeTestFile("selection", atoms));
+
+		return protein;
+	}
+
+	// Returns the indices of the selected atoms, or a single noHit index if the expression does not compile
+	std::vector<uint> select(const std::string& expression)
+	{
+		Selection selection;
+
+		if (!selection.compile(expression, protein()))
+			return { ~0u };
+
+		std::vector<vec4> timestep;
+		protein().loadTimestep(0, timestep);
+
+		AtomBitset result;
+		selection.evaluate(timestep.data(), timestep.size(), result);
+
+		std::vector<uint> indices;
+		result.indices(indices);
+
+		return indices;
+	}
+
+	bool fails(const std::string& expression)
+	{
+		Selection selection;
+		return !selection.compile(expression, protein()) && !selection.error().empty() && !selection.isValid();
+	}
+}
+
+DYNAMOL_TEST(selection, load)
+{
+	DYNAMOL_CHECK(protein().timestepCount() == 1);
+	DYNAMOL_CHECK(protein().atomCount(0) == atoms.size());
+}
+
+DYNAMOL_TEST(selection, terms)
+{
+	DYNAMOL_CHECK(select("all") == std::vector<uint>({ 0, 1, 2, 3, 4, 5, 6 }));
+	DYNAMOL_CHECK(select("none").empty());
+	DYNAMOL_CHECK(select("chain B") == std::vector<uint>({ 3, 4, 5 }));
+	DYNAMOL_CHECK(select("chain A C") == std::vector<uint>({ 0, 1, 2, 6 }));
+	DYNAMOL_CHECK(select("resname HEM GLY") == std::vector<uint>({ 2, 3, 4, 5 }));
+	DYNAMOL_CHECK(select("element O") == std::vector<uint>({ 3, 4 }));
+	DYNAMOL_CHECK(select("resid 2-10") == std::vector<uint>({ 2, 3, 4 }));
+	DYNAMOL_CHECK(select("resid 2 to 3 20") == std::vector<uint>({ 2, 3, 5 }));
+	DYNAMOL_CHECK(select("chain D").empty());
+}
+
+DYNAMOL_TEST(selection, precedence)
+{
+	// not binds tighter than and, which binds tighter than or
+	DYNAMOL_CHECK(select("not chain A and element C") == std::vector<uint>({ 6 }));
+	DYNAMOL_CHECK(select("not (chain A and element C)") == std::vector<uint>({ 1, 3, 4, 5, 6 }));
+	DYNAMOL_CHECK(select("chain A or chain B and element O") == std::vector<uint>({ 0, 1, 2, 3, 4 }));
+	DYNAMOL_CHECK(select("(chain A or chain B) and element O") == std::vector<uint>({ 3, 4 }));
+	DYNAMOL_CHECK(select("element O and chain B or chain C") == std::vector<uint>({ 3, 4, 6 }));
+	DYNAMOL_CHECK(select("not not chain C") == std::vector<uint>({ 6 }));
+
+	// within applies to the following term only
+	DYNAMOL_CHECK(select("within 5 of resid 1 and chain B") == std::vector<uint>({ 3, 4 }));
+	DYNAMOL_CHECK(select("within 5 of (resid 1 and chain B)").empty());
+}
+
+DYNAMOL_TEST(selection, withinBoundary)
+{
+	// atoms at exactly the distance are included, the target atoms themselves as well
+	DYNAMOL_CHECK(select("within 5 of (resid 1 and element C)") == std::vector<uint>({ 0, 1, 2, 3, 6 }));
+	DYNAMOL_CHECK(select("within 4.999 of (resid 1 and element C)") == std::vector<uint>({ 0, 1 }));
+	DYNAMOL_CHECK(select("within 5 of resid 1") == std::vector<uint>({ 0, 1, 2, 3, 4, 6 }));
+	DYNAMOL_CHECK(select("within 5.001 of (resid 1 and element C)") == std::vector<uint>({ 0, 1, 2, 3, 5, 6 }));
+	DYNAMOL_CHECK(select("within 0 of chain C") == std::vector<uint>({ 6 }));
+	DYNAMOL_CHECK(select("within 5 of none").empty());
+}
+
+DYNAMOL_TEST(selection, evaluationPaths)
+{
+	for (const char* expression : { "chain A or element O", "within 5 of chain C", "not resid 1-3 and within 2 of element N" })
+	{
+		Selection selection;
+		DYNAMOL_CHECK(selection.compile(expression, protein()));
+
+		std::vector<vec4> timestep;
+		protein().loadTimestep(0, timestep);
+
+		std::vector<vec3> positions;
+		std::vector<uint> attributes;
+
+		for (const auto& a : timestep)
+		{
+			positions.push_back(vec3(a));
+			attributes.push_back(floatBitsToUint(a.w));
+		}
+
+		AtomBitset packed;
+		AtomBitset separate;
+		selection.evaluate(timestep.data(), timestep.size(), packed);
+		selection.evaluate(positions.data(), attributes.data(), positions.size(), separate);
+
+		DYNAMOL_CHECK(packed.size() == timestep.size());
+		DYNAMOL_CHECK(packed.words() == separate.words());
+	}
+
+	Selection selection;
+	DYNAMOL_CHECK(selection.compile("chain A and resname ALA", protein()) && !selection.dependsOnPositions());
+	DYNAMOL_CHECK(selection.compile("chain A and within 3 of element O", protein()) && selection.dependsOnPositions());
+}
+
+DYNAMOL_TEST(selection, errors)
+{
+	DYNAMOL_CHECK(fails(""));
+	DYNAMOL_CHECK(fails("chain"));
+	DYNAMOL_CHECK(fails("(chain A"));
+	DYNAMOL_CHECK(fails("chain A)"));
+	DYNAMOL_CHECK(fails("chain A and"));
+	DYNAMOL_CHECK(fails("resid 5 to"));
+	DYNAMOL_CHECK(fails("resid A"));
+	DYNAMOL_CHECK(fails("within of chain A"));
+	DYNAMOL_CHECK(fails("within 5 chain A"));
+	DYNAMOL_CHECK(fails("element Xx"));
+}
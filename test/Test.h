@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace dynamol
+{
+	// Registry of the test cases, which are defined with DYNAMOL_TEST and report failed conditions with DYNAMOL_CHECK
+	class Test
+	{
+	public:
+		Test(const char* suite, const char* name, void (*function)());
+
+		// Runs all test cases of the suite, or of all suites if it is empty, and returns the number of failed checks
+		static std::size_t run(const std::string& suite);
+		static void fail(const char* file, int line, const char* condition);
+
+	private:
+		struct Case
+		{
+			const char* suite;
+			const char* name;
+			void (*function)();
+		};
+
+		static std::vector<Case>& cases();
+		static std::size_t s_failures;
+	};
+
+	// Atom of a synthetic input file
+	struct TestAtom
+	{
+		const char* residueName;
+		char chain;
+		int residueNumber;
+		float x, y, z;
+		const char* element;
+	};
+
+	// Writes the atoms as a PDB file into the temporary directory and returns its name
+	std::string writeTestFile(const std::string& name, const std::vector<TestAtom>& atoms);
+}
+
+#define DYNAMOL_CHECK(condition) ((condition) ? void(0) : dynamol::Test::fail(__FILE__, __LINE__, #condition))
+
+#define DYNAMOL_TEST(suite, name) \
+	static void suite##_##name(); \
+	static const dynamol::Test suite##_##name##_test(#suite, #name, &suite##_##name); \
+	static void suite##_##name()
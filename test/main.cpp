@@ -0,0 +1,74 @@
+#include "Test.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+
+using namespace dynamol;
+
+std::size_t Test::s_failures = 0;
+
+Test::Test(const char* suite, const char* name, void (*function)())
+{
+	cases().push_back({ suite, name, function });
+}
+
+std::size_t Test::run(const std::string& suite)
+{
+	s_failures = 0;
+	std::size_t caseCount = 0;
+
+	for (const auto& c : cases())
+	{
+		if (!suite.empty() && suite != c.suite)
+			continue;
+
+		const std::size_t failures = s_failures;
+		c.function();
+		caseCount++;
+
+		std::cout << (s_failures == failures ? "passed " : "FAILED ") << c.suite << "." << c.name << std::endl;
+	}
+
+	std::cout << caseCount << " test cases, " << s_failures << " failed checks" << std::endl;
+
+	return caseCount == 0 ? 1 : s_failures;
+}
+
+void Test::fail(const char* file, int line, const char* condition)
+{
+	std::cout << file << "(" << line << "): check failed: " << condition << std::endl;
+	s_failures++;
+}
+
+std::vector<Test::Case>& Test::cases()
+{
+	static std::vector<Case> cases;
+	return cases;
+}
+
+std::string dynamol::writeTestFile(const std::string& name, const std::vector<TestAtom>& atoms)
+{
+	const std::string filename = (std::filesystem::temp_directory_path() / ("dynamol-test-" + name + ".pdb")).string();
+	std::ofstream file(filename, std::ios::binary);
+	char line[128];
+
+	for (const auto& a : atoms)
+	{
+		std::snprintf(line, sizeof(line), "ATOM      1  X   %-3.3s %c%4d    %8.3f%8.3f%8.3f  1.00  0.00          %2.2s\n",
+			a.residueName, a.chain, a.residueNumber, a.x, a.y, a.z, a.element);
+
+		file << line;
+	}
+
+	file << "END\n";
+
+	return filename;
+}
+
+// Runs the suite given as the first argument, or all suites without arguments
+int main(int argc, char* argv[])
+{
+	return Test::run(argc > 1 ? argv[1] : "") == 0 ? 0 : 1;
+}